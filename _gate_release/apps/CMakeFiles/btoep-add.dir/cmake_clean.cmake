@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-add.dir/btoep-add.c.o"
+  "CMakeFiles/btoep-add.dir/btoep-add.c.o.d"
+  "CMakeFiles/btoep-add.dir/util/opt.c.o"
+  "CMakeFiles/btoep-add.dir/util/opt.c.o.d"
+  "btoep-add"
+  "btoep-add.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-add.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
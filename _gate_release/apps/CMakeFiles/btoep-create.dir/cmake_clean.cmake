@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-create.dir/btoep-create.c.o"
+  "CMakeFiles/btoep-create.dir/btoep-create.c.o.d"
+  "CMakeFiles/btoep-create.dir/util/opt.c.o"
+  "CMakeFiles/btoep-create.dir/util/opt.c.o.d"
+  "btoep-create"
+  "btoep-create.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-create.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
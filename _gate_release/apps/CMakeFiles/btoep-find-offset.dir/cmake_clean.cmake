@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-find-offset.dir/btoep-find-offset.c.o"
+  "CMakeFiles/btoep-find-offset.dir/btoep-find-offset.c.o.d"
+  "CMakeFiles/btoep-find-offset.dir/util/opt.c.o"
+  "CMakeFiles/btoep-find-offset.dir/util/opt.c.o.d"
+  "btoep-find-offset"
+  "btoep-find-offset.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-find-offset.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
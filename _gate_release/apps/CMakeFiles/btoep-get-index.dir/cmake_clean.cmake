@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-get-index.dir/btoep-get-index.c.o"
+  "CMakeFiles/btoep-get-index.dir/btoep-get-index.c.o.d"
+  "CMakeFiles/btoep-get-index.dir/util/opt.c.o"
+  "CMakeFiles/btoep-get-index.dir/util/opt.c.o.d"
+  "btoep-get-index"
+  "btoep-get-index.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-get-index.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
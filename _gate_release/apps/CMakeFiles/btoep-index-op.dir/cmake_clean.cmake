@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-index-op.dir/btoep-index-op.c.o"
+  "CMakeFiles/btoep-index-op.dir/btoep-index-op.c.o.d"
+  "CMakeFiles/btoep-index-op.dir/util/opt.c.o"
+  "CMakeFiles/btoep-index-op.dir/util/opt.c.o.d"
+  "btoep-index-op"
+  "btoep-index-op.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-index-op.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
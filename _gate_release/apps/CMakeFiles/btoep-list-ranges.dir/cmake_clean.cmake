@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-list-ranges.dir/btoep-list-ranges.c.o"
+  "CMakeFiles/btoep-list-ranges.dir/btoep-list-ranges.c.o.d"
+  "CMakeFiles/btoep-list-ranges.dir/util/opt.c.o"
+  "CMakeFiles/btoep-list-ranges.dir/util/opt.c.o.d"
+  "btoep-list-ranges"
+  "btoep-list-ranges.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-list-ranges.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
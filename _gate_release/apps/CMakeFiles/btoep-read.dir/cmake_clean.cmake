@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-read.dir/btoep-read.c.o"
+  "CMakeFiles/btoep-read.dir/btoep-read.c.o.d"
+  "CMakeFiles/btoep-read.dir/util/opt.c.o"
+  "CMakeFiles/btoep-read.dir/util/opt.c.o.d"
+  "btoep-read"
+  "btoep-read.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-read.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-set-index.dir/btoep-set-index.c.o"
+  "CMakeFiles/btoep-set-index.dir/btoep-set-index.c.o.d"
+  "CMakeFiles/btoep-set-index.dir/util/opt.c.o"
+  "CMakeFiles/btoep-set-index.dir/util/opt.c.o.d"
+  "btoep-set-index"
+  "btoep-set-index.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-set-index.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-set-size.dir/btoep-set-size.c.o"
+  "CMakeFiles/btoep-set-size.dir/btoep-set-size.c.o.d"
+  "CMakeFiles/btoep-set-size.dir/util/opt.c.o"
+  "CMakeFiles/btoep-set-size.dir/util/opt.c.o.d"
+  "btoep-set-size"
+  "btoep-set-size.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-set-size.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
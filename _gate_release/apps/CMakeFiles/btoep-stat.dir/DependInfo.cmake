@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/apps/btoep-stat.c" "apps/CMakeFiles/btoep-stat.dir/btoep-stat.c.o" "gcc" "apps/CMakeFiles/btoep-stat.dir/btoep-stat.c.o.d"
+  "/root/repo/apps/util/opt.c" "apps/CMakeFiles/btoep-stat.dir/util/opt.c.o" "gcc" "apps/CMakeFiles/btoep-stat.dir/util/opt.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_gate_release/lib/CMakeFiles/btoep.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep-stat.dir/btoep-stat.c.o"
+  "CMakeFiles/btoep-stat.dir/btoep-stat.c.o.d"
+  "CMakeFiles/btoep-stat.dir/util/opt.c.o"
+  "CMakeFiles/btoep-stat.dir/util/opt.c.o.d"
+  "btoep-stat"
+  "btoep-stat.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep-stat.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,25 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/lib/src/bitmap.c" "lib/CMakeFiles/btoep.dir/src/bitmap.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/bitmap.c.o.d"
+  "/root/repo/lib/src/dataset.c" "lib/CMakeFiles/btoep.dir/src/dataset.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/dataset.c.o.d"
+  "/root/repo/lib/src/eliasfano.c" "lib/CMakeFiles/btoep.dir/src/eliasfano.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/eliasfano.c.o.d"
+  "/root/repo/lib/src/range.c" "lib/CMakeFiles/btoep.dir/src/range.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/range.c.o.d"
+  "/root/repo/lib/src/shm.c" "lib/CMakeFiles/btoep.dir/src/shm.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/shm.c.o.d"
+  "/root/repo/lib/src/stream.c" "lib/CMakeFiles/btoep.dir/src/stream.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/stream.c.o.d"
+  "/root/repo/lib/src/uleb128.c" "lib/CMakeFiles/btoep.dir/src/uleb128.c.o" "gcc" "lib/CMakeFiles/btoep.dir/src/uleb128.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,23 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/btoep.dir/src/bitmap.c.o"
+  "CMakeFiles/btoep.dir/src/bitmap.c.o.d"
+  "CMakeFiles/btoep.dir/src/dataset.c.o"
+  "CMakeFiles/btoep.dir/src/dataset.c.o.d"
+  "CMakeFiles/btoep.dir/src/eliasfano.c.o"
+  "CMakeFiles/btoep.dir/src/eliasfano.c.o.d"
+  "CMakeFiles/btoep.dir/src/range.c.o"
+  "CMakeFiles/btoep.dir/src/range.c.o.d"
+  "CMakeFiles/btoep.dir/src/shm.c.o"
+  "CMakeFiles/btoep.dir/src/shm.c.o.d"
+  "CMakeFiles/btoep.dir/src/stream.c.o"
+  "CMakeFiles/btoep.dir/src/stream.c.o.d"
+  "CMakeFiles/btoep.dir/src/uleb128.c.o"
+  "CMakeFiles/btoep.dir/src/uleb128.c.o.d"
+  "libbtoep.a"
+  "libbtoep.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/btoep.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
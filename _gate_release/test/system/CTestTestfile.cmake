@@ -0,0 +1,26 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/test/system
+# Build directory: /root/repo/_gate_release/test/system
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(system:test-add "/usr/bin/python3" "/root/repo/test/system/test-add.py")
+set_tests_properties(system:test-add PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-create "/usr/bin/python3" "/root/repo/test/system/test-create.py")
+set_tests_properties(system:test-create PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-find-offset "/usr/bin/python3" "/root/repo/test/system/test-find-offset.py")
+set_tests_properties(system:test-find-offset PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-get-index "/usr/bin/python3" "/root/repo/test/system/test-get-index.py")
+set_tests_properties(system:test-get-index PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-index-op "/usr/bin/python3" "/root/repo/test/system/test-index-op.py")
+set_tests_properties(system:test-index-op PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-list-ranges "/usr/bin/python3" "/root/repo/test/system/test-list-ranges.py")
+set_tests_properties(system:test-list-ranges PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-read "/usr/bin/python3" "/root/repo/test/system/test-read.py")
+set_tests_properties(system:test-read PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-set-index "/usr/bin/python3" "/root/repo/test/system/test-set-index.py")
+set_tests_properties(system:test-set-index PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-set-size "/usr/bin/python3" "/root/repo/test/system/test-set-size.py")
+set_tests_properties(system:test-set-size PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
+add_test(system:test-stat "/usr/bin/python3" "/root/repo/test/system/test-stat.py")
+set_tests_properties(system:test-stat PROPERTIES  ENVIRONMENT "PATH=/root/repo/_gate_release/apps" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/test/system/CMakeLists.txt;7;add_test;/root/repo/test/system/CMakeLists.txt;0;")
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-bitmap.dir/test-bitmap.c.o"
+  "CMakeFiles/test-bitmap.dir/test-bitmap.c.o.d"
+  "test-bitmap"
+  "test-bitmap.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-bitmap.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
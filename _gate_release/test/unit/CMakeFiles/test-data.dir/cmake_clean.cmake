@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-data.dir/test-data.c.o"
+  "CMakeFiles/test-data.dir/test-data.c.o.d"
+  "test-data"
+  "test-data.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-data.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-eliasfano.dir/test-eliasfano.c.o"
+  "CMakeFiles/test-eliasfano.dir/test-eliasfano.c.o.d"
+  "test-eliasfano"
+  "test-eliasfano.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-eliasfano.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-index.dir/test-index.c.o"
+  "CMakeFiles/test-index.dir/test-index.c.o.d"
+  "test-index"
+  "test-index.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-index.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
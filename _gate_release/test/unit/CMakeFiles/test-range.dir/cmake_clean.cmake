@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-range.dir/test-range.c.o"
+  "CMakeFiles/test-range.dir/test-range.c.o.d"
+  "test-range"
+  "test-range.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-range.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-shm.dir/test-shm.c.o"
+  "CMakeFiles/test-shm.dir/test-shm.c.o.d"
+  "test-shm"
+  "test-shm.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-shm.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
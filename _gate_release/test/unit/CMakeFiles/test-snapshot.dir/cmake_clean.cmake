@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-snapshot.dir/test-snapshot.c.o"
+  "CMakeFiles/test-snapshot.dir/test-snapshot.c.o.d"
+  "test-snapshot"
+  "test-snapshot.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-snapshot.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
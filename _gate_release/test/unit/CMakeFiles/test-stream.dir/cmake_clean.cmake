@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-stream.dir/test-stream.c.o"
+  "CMakeFiles/test-stream.dir/test-stream.c.o.d"
+  "test-stream"
+  "test-stream.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-stream.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test-uleb128.dir/test-uleb128.c.o"
+  "CMakeFiles/test-uleb128.dir/test-uleb128.c.o.d"
+  "test-uleb128"
+  "test-uleb128.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-uleb128.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
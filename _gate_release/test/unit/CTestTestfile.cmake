@@ -0,0 +1,28 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/test/unit
+# Build directory: /root/repo/_gate_release/test/unit
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(UnitTestSetup "mkdir" "/root/repo/_gate_release/test/unit/tmp")
+set_tests_properties(UnitTestSetup PROPERTIES  FIXTURES_SETUP "UnitTest" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;7;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(UnitTestCleanup "rm" "-rf" "/root/repo/_gate_release/test/unit/tmp")
+set_tests_properties(UnitTestCleanup PROPERTIES  FIXTURES_CLEANUP "UnitTest" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;8;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-bitmap "/root/repo/_gate_release/test/unit/test-bitmap")
+set_tests_properties(unit:test-bitmap PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-data "/root/repo/_gate_release/test/unit/test-data")
+set_tests_properties(unit:test-data PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-eliasfano "/root/repo/_gate_release/test/unit/test-eliasfano")
+set_tests_properties(unit:test-eliasfano PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-index "/root/repo/_gate_release/test/unit/test-index")
+set_tests_properties(unit:test-index PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-range "/root/repo/_gate_release/test/unit/test-range")
+set_tests_properties(unit:test-range PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-shm "/root/repo/_gate_release/test/unit/test-shm")
+set_tests_properties(unit:test-shm PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-snapshot "/root/repo/_gate_release/test/unit/test-snapshot")
+set_tests_properties(unit:test-snapshot PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-stream "/root/repo/_gate_release/test/unit/test-stream")
+set_tests_properties(unit:test-stream PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
+add_test(unit:test-uleb128 "/root/repo/_gate_release/test/unit/test-uleb128")
+set_tests_properties(unit:test-uleb128 PROPERTIES  FIXTURES_REQUIRED "UnitTest" TIMEOUT "20" WORKING_DIRECTORY "/root/repo/_gate_release/test/unit/tmp" _BACKTRACE_TRIPLES "/root/repo/test/unit/CMakeLists.txt;30;add_test;/root/repo/test/unit/CMakeLists.txt;0;")
@@ -3,6 +3,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef _MSC_VER
+# include <io.h>
+#endif
+
 #include "util/common.h"
 
 typedef struct {
@@ -68,32 +72,23 @@ int main(int argc, char** argv) {
   if (opts.enforce_length.exists)
     max_length = opts.enforce_length.value;*/
 
-  bool btoep_ok = true, source_ok = true;
+  // The library reads the source file directly, bypassing stdio.
+#ifdef _MSC_VER
+  btoep_fd source_fd = (HANDLE) _get_osfhandle(_fileno(source));
+#else
+  btoep_fd source_fd = fileno(source);
+#endif
 
-  char buffer[64 * 1024];
+  // We intentionally do not modify the index until all data has been written
+  // successfully.
   btoep_range added_range = btoep_mkrange(opts.offset.value, 0);
-  while (!feof(source)) {
-    size_t n_read = fread(buffer, 1, sizeof(buffer), source);
-    if (n_read < sizeof(buffer) && ferror(source)) {
-      print_stdlib_error(errno, "fread");
-      source_ok = false;
-      break;
-    }
-
-    // We intentionally do not use btoep_data_add_range here to avoid modifying
-    // the index until all data has been written successfully.
-    btoep_range new_range = btoep_mkrange(added_range.offset + added_range.length, n_read);
-    if (!btoep_data_write(&dataset, new_range, buffer, n_read, opts.on_conflict.value)) {
-      btoep_ok = false;
-      break;
-    }
-
-    added_range.length += n_read;
-  }
+  bool btoep_ok = btoep_data_write_from_fd(&dataset, added_range.offset,
+                                           source_fd, opts.on_conflict.value,
+                                           &added_range.length);
 
   fclose(source); // TODO: Check the return value
 
-  if (added_range.length != 0 && btoep_ok && source_ok) {
+  if (added_range.length != 0 && btoep_ok) {
     if (!btoep_index_add(&dataset, added_range))
       btoep_ok = false;
   }
@@ -102,5 +97,5 @@ int main(int argc, char** argv) {
   if (!btoep_ok)
     print_lib_error(&dataset);
 
-  return (btoep_ok && source_ok) ? B_EXIT_CODE_SUCCESS : B_EXIT_CODE_APP_ERROR;
+  return btoep_ok ? B_EXIT_CODE_SUCCESS : B_EXIT_CODE_APP_ERROR;
 }
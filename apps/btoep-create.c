@@ -8,18 +8,28 @@
 typedef struct {
   dataset_path_opts paths;
   optional_uint64 size;
+  optional_int index_format;
+  bool preallocate;
 } cmd_opts;
 
+#define INDEX_FORMAT_ENUM(CASE)                                                \
+  CASE("compact", 0)                                                           \
+  CASE("paged",   B_CREATE_PAGED_INDEX)                                        \
+
+static bool OPT_ACCEPT_ENUM_ONCE(index_format, optional_int, INDEX_FORMAT_ENUM)
+
 int main(int argc, char** argv) {
-  opt_def options[4] = {
-    UINT64_OPTION("--size", size)
+  opt_def options[6] = {
+    UINT64_OPTION("--size", size),
+    CUSTOM_OPTION("--index-format", opt_accept_index_format),
+    BOOL_FLAG("--preallocate", preallocate)
   };
 
-  opt_add_nested(options + 1, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
+  opt_add_nested(options + 3, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
 
   cmd_opts opts;
   memset(&opts, 0, sizeof(opts));
-  parse_cmd_opts(options, 4, &opts, (size_t) argc - 1, argv + 1,
+  parse_cmd_opts(options, 6, &opts, (size_t) argc - 1, argv + 1,
                  create_usage_string, "btoep-create");
 
   if (!opts.paths.data_path) {
@@ -27,14 +37,21 @@ int main(int argc, char** argv) {
     return offer_more_info("btoep-create");
   }
 
+  if (opts.preallocate && !opts.size.set_by_user) {
+    fprintf(stderr, "Error: The --preallocate option requires --size.\n");
+    return offer_more_info("btoep-create");
+  }
+
   btoep_dataset dataset;
   bool success = btoep_open(&dataset, opts.paths.data_path,
                             opts.paths.index_path, opts.paths.lock_path,
-                            B_CREATE_NEW_READ_WRITE);
+                            B_CREATE_NEW_READ_WRITE | opts.index_format.value);
 
   if (success) {
-    if (opts.size.set_by_user)
-      success = btoep_data_set_size(&dataset, opts.size.value, false);
+    if (opts.size.set_by_user) {
+      int flags = opts.preallocate ? BTOEP_SIZE_PREALLOCATE : 0;
+      success = btoep_data_set_size(&dataset, opts.size.value, flags);
+    }
 
     // The order is important here. Even if the previous call failed, the dataset
     // should still be closed.
@@ -1,5 +1,6 @@
 #include <assert.h>
-#include <btoep/dataset.h>
+#include <btoep/eliasfano.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
 
@@ -27,42 +28,189 @@ static uint64_t write_range(btoep_range range, uint64_t prev_end) {
   return range.offset + range.length;
 }
 
-static bool print_index(btoep_dataset* dataset, uint64_t min_length) {
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
+#define RANGES_PER_CALL 256
+
+typedef bool (*range_fn)(void* arg, btoep_range range);
+
+static bool for_each_range(btoep_dataset* dataset, btoep_range window,
+                           int mode, uint64_t min_length,
+                           range_fn fn, void* arg) {
+  btoep_index_cursor cursor;
+  if (!btoep_index_cursor_start(dataset, &cursor))
     return false;
 
+  btoep_range ranges[RANGES_PER_CALL];
+  size_t n_ranges;
+  do {
+    if (!btoep_index_get_ranges(dataset, window, mode, ranges, RANGES_PER_CALL,
+                                &n_ranges, &cursor))
+      return false;
+    for (size_t i = 0; i < n_ranges; i++) {
+      if (ranges[i].length >= min_length && !fn(arg, ranges[i]))
+        return false;
+    }
+  } while (n_ranges == RANGES_PER_CALL);
+
+  return true;
+}
+
+static bool print_compact_range(void* arg, btoep_range range) {
+  uint64_t* prev_end = arg;
+  *prev_end = write_range(range, *prev_end);
+  return true;
+}
+
+static bool print_index(btoep_dataset* dataset, uint64_t min_length) {
   uint64_t prev_end = 0;
+  return for_each_range(dataset, btoep_max_range_from(0), BTOEP_FIND_DATA,
+                        min_length, print_compact_range, &prev_end);
+}
+
+static bool count_range(void* arg, btoep_range range) {
+  (void) range;
+  uint64_t* n_ranges = arg;
+  (*n_ranges)++;
+  return true;
+}
 
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    btoep_range range;
-    if (!btoep_index_iterator_next(&iterator, &range))
+static bool for_each_changed_range(btoep_dataset* dataset,
+                                   const btoep_range* changes, size_t n_changes,
+                                   int mode, range_fn fn, void* arg) {
+  for (size_t i = 0; i < n_changes; i++) {
+    if (!for_each_range(dataset, changes[i], mode, 0, fn, arg))
       return false;
-    if (range.length >= min_length)
-      prev_end = write_range(range, prev_end);
+  }
+  return true;
+}
+
+/*
+ * Prints the current revision, followed by the number of removed ranges, the
+ * removed ranges, and the added ranges, both in the compact format. Each range
+ * that may have changed since the given revision is split into parts that do
+ * and do not contain data. If the change log does not go back far enough, the
+ * entire address space is assumed to have changed.
+ */
+static bool print_changes(btoep_dataset* dataset, uint64_t since) {
+  static btoep_range changes[BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH];
+  uint64_t revision;
+  size_t n_changes;
+  bool is_complete;
+  if (!btoep_index_get_revision(dataset, &revision) ||
+      !btoep_index_get_changes(dataset, since, changes, &n_changes, &is_complete))
+    return false;
+
+  if (!is_complete) {
+    changes[0] = btoep_max_range_from(0);
+    n_changes = 1;
   }
 
+  uint64_t n_removed = 0;
+  if (!for_each_changed_range(dataset, changes, n_changes, BTOEP_FIND_NO_DATA,
+                              count_range, &n_removed))
+    return false;
+
+  write_uleb128(revision);
+  write_uleb128(n_removed);
+  uint64_t prev_end = 0;
+  if (!for_each_changed_range(dataset, changes, n_changes, BTOEP_FIND_NO_DATA,
+                              print_compact_range, &prev_end))
+    return false;
+  prev_end = 0;
+  return for_each_changed_range(dataset, changes, n_changes, BTOEP_FIND_DATA,
+                                print_compact_range, &prev_end);
+}
+
+typedef struct {
+  uint64_t n_ranges;
+  uint64_t end;
+} index_summary;
+
+static bool summarize_range(void* arg, btoep_range range) {
+  index_summary* summary = arg;
+  summary->n_ranges++;
+  summary->end = range.offset + range.length;
+  return true;
+}
+
+static bool encode_range(void* arg, btoep_range range) {
+  btoep_ef_encoder* encoder = arg;
+  if (!btoep_ef_encoder_add(encoder, range)) {
+    print_lib_error_info(&encoder->last_error);
+    return false;
+  }
   return true;
 }
 
+/*
+ * The encoded size depends on the number of ranges and on the end of the last
+ * range, so this requires two passes over the index. Errors are reported here,
+ * since not all of them are stored in the dataset.
+ */
+static bool print_elias_fano_index(btoep_dataset* dataset, uint64_t min_length) {
+  index_summary summary = { 0, 0 };
+  if (!for_each_range(dataset, btoep_max_range_from(0), BTOEP_FIND_DATA,
+                      min_length, summarize_range, &summary)) {
+    print_lib_error(dataset);
+    return false;
+  }
+
+  btoep_ef_encoder encoder;
+  if (!btoep_ef_encoder_init(&encoder, summary.n_ranges, summary.end)) {
+    print_lib_error_info(&encoder.last_error);
+    return false;
+  }
+
+  bool success = true;
+  encoder.last_error.code = 0;
+  if (!for_each_range(dataset, btoep_max_range_from(0), BTOEP_FIND_DATA,
+                      min_length, encode_range, &encoder)) {
+    if (encoder.last_error.code == 0)
+      print_lib_error(dataset);
+    success = false;
+  } else if (fwrite(encoder.data, 1, encoder.size, stdout) != encoder.size ||
+             fflush(stdout) != 0) {
+    print_stdlib_error(errno, "fwrite");
+    success = false;
+  }
+
+  btoep_ef_encoder_free(&encoder);
+  return success;
+}
+
+#define OUTPUT_FORMAT_COMPACT    1
+#define OUTPUT_FORMAT_ELIAS_FANO 2
+
 typedef struct {
   dataset_path_opts paths;
   optional_uint64 min_range_length;
+  optional_int format;
+  optional_uint64 since;
 } cmd_opts;
 
+#define OUTPUT_FORMAT_ENUM(CASE)                                               \
+  CASE("compact",    OUTPUT_FORMAT_COMPACT)                                    \
+  CASE("elias-fano", OUTPUT_FORMAT_ELIAS_FANO)                                 \
+
+static bool OPT_ACCEPT_ENUM_ONCE(format, optional_int, OUTPUT_FORMAT_ENUM)
+
 int main(int argc, char** argv) {
-  opt_def options[4] = {
-    UINT64_OPTION("--min-range-length", min_range_length)
+  opt_def options[6] = {
+    UINT64_OPTION("--min-range-length", min_range_length),
+    CUSTOM_OPTION("--format", opt_accept_format),
+    UINT64_OPTION("--since", since)
   };
 
-  opt_add_nested(options + 1, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
+  opt_add_nested(options + 3, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
 
   cmd_opts opts = {
     .min_range_length = {
       .value = 0
+    },
+    .format = {
+      .value = OUTPUT_FORMAT_COMPACT
     }
   };
-  parse_cmd_opts(options, 4, &opts, (size_t) argc - 1, argv + 1,
+  parse_cmd_opts(options, 6, &opts, (size_t) argc - 1, argv + 1,
                  get_index_usage_string, "btoep-get-index");
 
   if (!opts.paths.data_path) {
@@ -70,6 +218,13 @@ int main(int argc, char** argv) {
     return offer_more_info("btoep-get-index");
   }
 
+  if (opts.since.set_by_user &&
+      (opts.format.set_by_user || opts.min_range_length.set_by_user)) {
+    fprintf(stderr, "Error: The --since option cannot be combined with the "
+                    "--format and --min-range-length options.\n");
+    return offer_more_info("btoep-get-index");
+  }
+
   btoep_dataset dataset;
   if (!btoep_open(&dataset, opts.paths.data_path, opts.paths.index_path,
                   opts.paths.lock_path, B_OPEN_EXISTING_READ_ONLY)) {
@@ -78,11 +233,22 @@ int main(int argc, char** argv) {
   }
 
 #ifdef _MSC_VER
-  // Prevent Windows from replacing '\n' with '\r\n' when calling fputc.
+  // Prevent Windows from replacing '\n' with '\r\n' when writing.
   _setmode(fileno(stdout), _O_BINARY);
 #endif
 
-  bool success = print_index(&dataset, opts.min_range_length.value);
+  bool success;
+  if (opts.format.value == OUTPUT_FORMAT_ELIAS_FANO) {
+    if (!print_elias_fano_index(&dataset, opts.min_range_length.value)) {
+      btoep_close(&dataset);
+      return B_EXIT_CODE_APP_ERROR;
+    }
+    success = true;
+  } else if (opts.since.set_by_user) {
+    success = print_changes(&dataset, opts.since.value);
+  } else {
+    success = print_index(&dataset, opts.min_range_length.value);
+  }
 
   success = btoep_close(&dataset) && success;
 
@@ -0,0 +1,119 @@
+#include <btoep/stream.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+# include <io.h>
+# include <fcntl.h>
+#endif
+
+#include "util/common.h"
+
+typedef struct {
+  optional_int op;
+  const char** inputs;
+  size_t n_inputs;
+} cmd_opts;
+
+#define OP_ENUM(CASE)                                                          \
+  CASE("union",        BTOEP_INDEX_UNION)                                      \
+  CASE("intersection", BTOEP_INDEX_INTERSECTION)                               \
+  CASE("difference",   BTOEP_INDEX_DIFFERENCE)                                 \
+
+static bool OPT_ACCEPT_ENUM_ONCE(op, optional_int, OP_ENUM)
+
+static bool opt_accept_input(void* out, const char* value) {
+  cmd_opts* opts = out;
+  opts->inputs[opts->n_inputs++] = value;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  opt_def options[2] = {
+    CUSTOM_OPTION("--op", opt_accept_op),
+    CUSTOM_OPTION("--input", opt_accept_input)
+  };
+
+  // There cannot be more inputs than arguments.
+  cmd_opts opts = {
+    .inputs = malloc(argc * sizeof(const char*)),
+    .n_inputs = 0
+  };
+  if (opts.inputs == NULL) {
+    print_stdlib_error(ENOMEM, "malloc");
+    return B_EXIT_CODE_APP_ERROR;
+  }
+
+  parse_cmd_opts(options, 2, &opts, (size_t) argc - 1, argv + 1,
+                 index_op_usage_string, "btoep-index-op");
+
+  if (!opts.op.set_by_user) {
+    fprintf(stderr, "Error: The --op option is required.\n");
+    return offer_more_info("btoep-index-op");
+  }
+
+  if (opts.n_inputs == 0) {
+    fprintf(stderr, "Error: The --input option is required.\n");
+    return offer_more_info("btoep-index-op");
+  }
+
+  btoep_index_source* sources = malloc(opts.n_inputs * sizeof(btoep_index_source));
+  btoep_index_source** source_ptrs = malloc(opts.n_inputs * sizeof(btoep_index_source*));
+  FILE** files = calloc(opts.n_inputs, sizeof(FILE*));
+  if (sources == NULL || source_ptrs == NULL || files == NULL) {
+    print_stdlib_error(ENOMEM, "malloc");
+    return B_EXIT_CODE_APP_ERROR;
+  }
+
+#ifdef _MSC_VER
+  // Prevent Windows from replacing '\n' with '\r\n' and vice versa.
+  _setmode(fileno(stdin), _O_BINARY);
+  _setmode(fileno(stdout), _O_BINARY);
+#endif
+
+  bool success = true, used_stdin = false;
+  for (size_t i = 0; i < opts.n_inputs && success; i++) {
+    if (strcmp(opts.inputs[i], "-") == 0) {
+      if (used_stdin) {
+        fprintf(stderr, "Error: The standard input stream can only be used "
+                        "once.\n");
+        return offer_more_info("btoep-index-op");
+      }
+      used_stdin = true;
+      files[i] = stdin;
+    } else if ((files[i] = fopen(opts.inputs[i], "rb")) == NULL) {
+      print_stdlib_error(errno, "fopen");
+      success = false;
+      break;
+    }
+    btoep_index_source_init_file(&sources[i], files[i]);
+    source_ptrs[i] = &sources[i];
+  }
+
+  if (success) {
+    btoep_index_writer writer;
+    btoep_last_error_info error;
+    btoep_index_writer_init(&writer, stdout);
+    success = btoep_index_combine(source_ptrs, opts.n_inputs, opts.op.value,
+                                  &writer, &error);
+    if (!success) {
+      print_lib_error_info(&error);
+    } else if (fflush(stdout) != 0) {
+      print_stdlib_error(errno, "fflush");
+      success = false;
+    }
+  }
+
+  for (size_t i = 0; i < opts.n_inputs; i++) {
+    if (files[i] != NULL && files[i] != stdin)
+      fclose(files[i]);
+  }
+  free(files);
+  free(source_ptrs);
+  free(sources);
+  free(opts.inputs);
+
+  return success ? B_EXIT_CODE_SUCCESS : B_EXIT_CODE_APP_ERROR;
+}
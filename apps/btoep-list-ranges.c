@@ -1,4 +1,3 @@
-#include <assert.h>
 #include <btoep/dataset.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -6,7 +5,8 @@
 #include "util/common.h"
 
 typedef void (*print_range_fn)(btoep_range range);
-typedef bool (*list_fn)(btoep_index_iterator* iterator, print_range_fn print_range);
+
+#define RANGES_PER_CALL 256
 
 static void print_range_excl(btoep_range range) {
   printf("%" PRIu64 "...%" PRIu64 "\n",
@@ -18,45 +18,27 @@ static void print_range_incl(btoep_range range) {
          range.offset, range.offset + range.length - 1);
 }
 
-static bool list_data_ranges(btoep_index_iterator* iterator, print_range_fn print_range) {
-  uint64_t total_size;
-  if (!btoep_data_get_size(iterator->dataset, &total_size))
+static bool list_ranges(btoep_dataset* dataset, bool missing,
+                        print_range_fn print_range) {
+  // Missing ranges are only relevant up to the size of the dataset.
+  btoep_range window = btoep_max_range_from(0);
+  if (missing && !btoep_data_get_size(dataset, &window.length))
     return false;
 
-  while (!btoep_index_iterator_is_eof(iterator)) {
-    btoep_range range;
-    if (!btoep_index_iterator_next(iterator, &range))
-      return false;
-    print_range(range);
-  }
-
-  return true;
-}
-
-static bool list_missing_ranges(btoep_index_iterator* iterator, print_range_fn print_range) {
-  uint64_t total_size;
-  if (!btoep_data_get_size(iterator->dataset, &total_size))
+  btoep_index_cursor cursor;
+  if (!btoep_index_cursor_start(dataset, &cursor))
     return false;
 
-  uint64_t prev_end_offset = 0;
-
-  while (!btoep_index_iterator_is_eof(iterator)) {
-    btoep_range range;
-    if (!btoep_index_iterator_next(iterator, &range))
+  int mode = missing ? BTOEP_FIND_NO_DATA : BTOEP_FIND_DATA;
+  btoep_range ranges[RANGES_PER_CALL];
+  size_t n_ranges;
+  do {
+    if (!btoep_index_get_ranges(dataset, window, mode, ranges, RANGES_PER_CALL,
+                                &n_ranges, &cursor))
       return false;
-
-    if (range.offset != 0) {
-      assert(range.offset > prev_end_offset);
-      print_range(btoep_mkrange(prev_end_offset, range.offset - prev_end_offset));
-    }
-
-    prev_end_offset = range.offset + range.length;
-  }
-
-  // TODO: What if prev_end_offset > total_size ? Fail ?
-  if (prev_end_offset != total_size) {
-    print_range(btoep_mkrange(prev_end_offset, total_size - prev_end_offset));
-  }
+    for (size_t i = 0; i < n_ranges; i++)
+      print_range(ranges[i]);
+  } while (n_ranges == RANGES_PER_CALL);
 
   return true;
 }
@@ -105,11 +87,7 @@ int main(int argc, char** argv) {
     return B_EXIT_CODE_APP_ERROR;
   }
 
-  list_fn list_ranges = opts.missing ? list_missing_ranges : list_data_ranges;
-
-  btoep_index_iterator iterator;
-  bool success = btoep_index_iterator_start(&dataset, &iterator) &&
-                 list_ranges(&iterator, opts.range_format.value);
+  bool success = list_ranges(&dataset, opts.missing, opts.range_format.value);
 
   success = btoep_close(&dataset) && success;
 
@@ -2,9 +2,8 @@
 #include <btoep/dataset.h>
 #include <stdio.h>
 
-#ifdef _MSC_VER
-# include <io.h>
-# include <fcntl.h>
+#ifndef _MSC_VER
+# include <unistd.h>
 #endif
 
 #include "util/common.h"
@@ -62,26 +61,15 @@ int main(int argc, char** argv) {
   if (opts.limit.set_by_user && range.length > opts.limit.value)
     range.length = opts.limit.value;
 
+  if (success && range.length != 0) {
+    // This bypasses stdio, which also means that Windows does not replace '\n'
+    // with '\r\n'.
 #ifdef _MSC_VER
-  // Prevent Windows from replacing '\n' with '\r\n' when calling fwrite.
-  _setmode(fileno(stdout), _O_BINARY);
+    btoep_fd out = GetStdHandle(STD_OUTPUT_HANDLE);
+#else
+    btoep_fd out = STDOUT_FILENO;
 #endif
-
-  if (success) {
-    char buffer[64 * 1024];
-    while (range.length > 0) {
-      size_t size = sizeof(buffer);
-      if (!btoep_data_read_range(&dataset, range, buffer, &size)) {
-        success = false;
-        break;
-      }
-      range = btoep_range_remove_left(range, size);
-      size_t written = fwrite(buffer, 1, size, stdout);
-      if (written != size) {
-        print_stdlib_error(errno, "fwrite");
-        break;
-      }
-    }
+    success = btoep_data_read_to_fd(&dataset, range, out);
   }
 
   // The order is important here. Even if the previous call failed, the dataset
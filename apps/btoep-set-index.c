@@ -0,0 +1,151 @@
+#include <btoep/stream.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+# include <io.h>
+# include <fcntl.h>
+#endif
+
+#include "util/common.h"
+
+#define SOURCE_FORMAT_COMPACT 1
+#define SOURCE_FORMAT_BINARY  2
+
+typedef struct {
+  dataset_path_opts paths;
+  const char* source_path;
+  optional_int source_format;
+} cmd_opts;
+
+#define SOURCE_FORMAT_ENUM(CASE)                                               \
+  CASE("compact", SOURCE_FORMAT_COMPACT)                                       \
+  CASE("binary",  SOURCE_FORMAT_BINARY)                                        \
+
+static bool OPT_ACCEPT_ENUM_ONCE(source_format, optional_int, SOURCE_FORMAT_ENUM)
+
+static inline uint64_t read_le64(const uint8_t* in) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--)
+    value = (value << 8) | in[i];
+  return value;
+}
+
+/*
+ * Reads ranges that consist of a little-endian 64-bit offset and a
+ * little-endian 64-bit length each.
+ */
+static bool read_binary_ranges(FILE* source, btoep_range** out, size_t* n_out) {
+  btoep_range* ranges = NULL;
+  size_t n_ranges = 0, capacity = 0;
+  uint8_t record[16];
+  size_t n_read;
+  while ((n_read = fread(record, 1, sizeof(record), source)) == sizeof(record)) {
+    if (n_ranges == capacity) {
+      capacity = (capacity == 0) ? 1024 : 2 * capacity;
+      btoep_range* new_ranges = realloc(ranges, capacity * sizeof(btoep_range));
+      if (new_ranges == NULL) {
+        free(ranges);
+        print_stdlib_error(ENOMEM, "realloc");
+        return false;
+      }
+      ranges = new_ranges;
+    }
+    ranges[n_ranges++] = btoep_mkrange(read_le64(record), read_le64(record + 8));
+  }
+
+  if (ferror(source)) {
+    free(ranges);
+    print_stdlib_error(errno, "fread");
+    return false;
+  }
+
+  if (n_read != 0) {
+    free(ranges);
+    fprintf(stderr, "Error: The input ends with an incomplete range.\n");
+    return false;
+  }
+
+  *out = ranges;
+  *n_out = n_ranges;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  opt_def options[5] = {
+    STRING_OPTION("--source", source_path),
+    CUSTOM_OPTION("--source-format", opt_accept_source_format)
+  };
+
+  opt_add_nested(options + 2, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
+
+  cmd_opts opts = {
+    .source_format = {
+      .value = SOURCE_FORMAT_COMPACT
+    }
+  };
+  parse_cmd_opts(options, 5, &opts, (size_t) argc - 1, argv + 1,
+                 set_index_usage_string, "btoep-set-index");
+
+  if (!opts.paths.data_path) {
+    fprintf(stderr, "Error: The --dataset option is required.\n");
+    return offer_more_info("btoep-set-index");
+  }
+
+  FILE* source = stdin;
+  if (opts.source_path != NULL && strcmp(opts.source_path, "-") != 0) {
+    source = fopen(opts.source_path, "rb");
+    if (source == NULL) {
+      print_stdlib_error(errno, "fopen");
+      return B_EXIT_CODE_APP_ERROR;
+    }
+  }
+
+#ifdef _MSC_VER
+  // Prevent Windows from replacing '\r\n' with '\n'.
+  if (source == stdin)
+    _setmode(fileno(stdin), _O_BINARY);
+#endif
+
+  // The entire input is read before the dataset is modified.
+  btoep_index_source index_source;
+  btoep_range* ranges = NULL;
+  if (opts.source_format.value == SOURCE_FORMAT_BINARY) {
+    size_t n_ranges;
+    bool ok = read_binary_ranges(source, &ranges, &n_ranges);
+    if (source != stdin)
+      fclose(source);
+    source = NULL;
+    if (!ok)
+      return B_EXIT_CODE_APP_ERROR;
+    btoep_index_source_init_array(&index_source, ranges, n_ranges);
+  } else {
+    btoep_index_source_init_file(&index_source, source);
+  }
+
+  btoep_dataset dataset;
+  bool success = btoep_open(&dataset, opts.paths.data_path,
+                            opts.paths.index_path, opts.paths.lock_path,
+                            B_OPEN_EXISTING_READ_WRITE);
+
+  if (success) {
+    success = btoep_index_replace(&dataset, &index_source);
+
+    // The order is important here. Even if the previous call failed, the dataset
+    // should still be closed.
+    success = btoep_close(&dataset) && success;
+  }
+
+  if (source != NULL && source != stdin)
+    fclose(source);
+  free(ranges);
+
+  if (!success) {
+    print_lib_error(&dataset);
+    return B_EXIT_CODE_APP_ERROR;
+  }
+
+  return B_EXIT_CODE_SUCCESS;
+}
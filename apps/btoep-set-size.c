@@ -6,21 +6,24 @@
 typedef struct {
   dataset_path_opts paths;
   bool force;
+  bool preallocate;
   optional_uint64 size;
 } cmd_opts;
 
 int main(int argc, char** argv) {
-  opt_def options[5] = {
+  opt_def options[6] = {
     BOOL_FLAG("--force", force),
+    BOOL_FLAG("--preallocate", preallocate),
     UINT64_OPTION("--size", size)
   };
 
-  opt_add_nested(options + 2, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
+  opt_add_nested(options + 3, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
 
   cmd_opts opts = {
-    .force = false
+    .force = false,
+    .preallocate = false
   };
-  parse_cmd_opts(options, 5, &opts, (size_t) argc - 1, argv + 1,
+  parse_cmd_opts(options, 6, &opts, (size_t) argc - 1, argv + 1,
                  set_size_usage_string, "btoep-set-size");
 
   if (!opts.paths.data_path) {
@@ -40,7 +43,9 @@ int main(int argc, char** argv) {
     return B_EXIT_CODE_APP_ERROR;
   }
 
-  bool success = btoep_data_set_size(&dataset, opts.size.value, opts.force);
+  int flags = (opts.force ? BTOEP_SIZE_ALLOW_DESTRUCTIVE : 0) |
+              (opts.preallocate ? BTOEP_SIZE_PREALLOCATE : 0);
+  bool success = btoep_data_set_size(&dataset, opts.size.value, flags);
 
   // The order is important here. Even if the previous call failed, the dataset
   // should still be closed.
@@ -0,0 +1,65 @@
+#include <btoep/dataset.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/common.h"
+
+static bool print_stats(btoep_dataset* dataset) {
+  btoep_index_stats stats;
+  uint64_t size, revision;
+  if (!btoep_index_get_stats(dataset, &stats) ||
+      !btoep_data_get_size(dataset, &size) ||
+      !btoep_index_get_revision(dataset, &revision))
+    return false;
+
+  if (stats.format_version == 0)
+    printf("format: compact\n");
+  else
+    printf("format: paged (version %u)\n", stats.format_version);
+  printf("ranges: %" PRIu64 "\n", stats.n_entries);
+  printf("bytes: %" PRIu64 "\n", stats.n_bytes);
+  printf("end: %" PRIu64 "\n", stats.end);
+  printf("size: %" PRIu64 "\n", size);
+  printf("fingerprint: %016" PRIx64 "\n", stats.fingerprint);
+  printf("revision: %" PRIu64 "\n", revision);
+  return true;
+}
+
+typedef struct {
+  dataset_path_opts paths;
+} cmd_opts;
+
+int main(int argc, char** argv) {
+  opt_def options[3];
+
+  opt_add_nested(options, dataset_path_opt_defs, 3, offsetof(cmd_opts, paths));
+
+  cmd_opts opts;
+  memset(&opts, 0, sizeof(opts));
+  parse_cmd_opts(options, 3, &opts, (size_t) argc - 1, argv + 1,
+                 stat_usage_string, "btoep-stat");
+
+  if (!opts.paths.data_path) {
+    fprintf(stderr, "Error: The --dataset option is required.\n");
+    return offer_more_info("btoep-stat");
+  }
+
+  btoep_dataset dataset;
+  if (!btoep_open(&dataset, opts.paths.data_path, opts.paths.index_path,
+                  opts.paths.lock_path, B_OPEN_EXISTING_READ_ONLY)) {
+    print_lib_error(&dataset);
+    return B_EXIT_CODE_APP_ERROR;
+  }
+
+  bool success = print_stats(&dataset);
+
+  success = btoep_close(&dataset) && success;
+
+  if (!success) {
+    print_lib_error(&dataset);
+    return B_EXIT_CODE_APP_ERROR;
+  }
+
+  return B_EXIT_CODE_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include <btoep/dataset.h>
 #include <btoep/version.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,28 +58,34 @@ static inline void print_stdlib_error(int error_code, const char* func) {
   print_errno_details(error_code, func);
 }
 
-static inline void print_lib_error(btoep_dataset* dataset) {
-  btoep_last_error_info info;
-  btoep_last_error(dataset, &info);
-
-  const char* msg = btoep_strerror(info.code);
-  const char* ext_msg = system_strerror(info.system_error_code);
+static inline void print_lib_error_info(const btoep_last_error_info* info) {
+  const char* msg = btoep_strerror(info->code);
+  const char* ext_msg = system_strerror(info->system_error_code);
   print_error_message_line(msg, ext_msg);
 
-  fprintf(stderr, "Library error name: %s\n", btoep_strerror_name(info.code));
-  fprintf(stderr, "Library error code: %d\n", info.code);
+  fprintf(stderr, "Library error name: %s\n", btoep_strerror_name(info->code));
+  fprintf(stderr, "Library error code: %d\n", info->code);
+
+  if (info->code == B_ERR_DATA_CONFLICT)
+    fprintf(stderr, "Conflict offset: %" PRIu64 "\n", info->conflict_offset);
 
-  if (info.system_error_code != 0) {
+  if (info->system_error_code != 0) {
     const char* name;
 #ifdef _MSC_VER
-    name = get_windows_error_name(info.system_error_code);
+    name = get_windows_error_name(info->system_error_code);
 #else
-    name = get_errno_error_name(info.system_error_code);
+    name = get_errno_error_name(info->system_error_code);
 #endif
-    print_system_error_details(name, info.system_error_code, info.system_func);
+    print_system_error_details(name, info->system_error_code, info->system_func);
   }
 }
 
+static inline void print_lib_error(btoep_dataset* dataset) {
+  btoep_last_error_info info;
+  btoep_last_error(dataset, &info);
+  print_lib_error_info(&info);
+}
+
 static inline int offer_more_info(const char* name) {
   fprintf(stderr, "Use '%s --help' for more information.\n", name);
   return B_EXIT_CODE_USAGE_ERROR;
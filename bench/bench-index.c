@@ -0,0 +1,158 @@
+#include <assert.h>
+#include <btoep/dataset.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../lib/src/uleb128.h"
+
+/*
+ * Measures how quickly index entries can be decoded, both by the bare ULEB128
+ * decoders and through index iterators. Each measurement is repeated until it
+ * has taken at least MIN_DURATION seconds.
+ */
+
+#define N_ENTRIES    (1024 * 1024)
+#define MIN_DURATION 0.5
+
+#define N_BATCH_RANGES (64 * 1024)
+
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t encode(uint8_t* out, uint64_t value) {
+  size_t length = 0;
+  do {
+    out[length++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+  } while (value > 0);
+  return length;
+}
+
+// Most ranges and gaps are small, but some are much larger.
+static uint64_t random_value(void) {
+  switch (rand() % 8) {
+  case 0:  return rand() % (1 << 28);
+  case 1:
+  case 2:  return rand() % (1 << 14);
+  default: return rand() % (1 << 7);
+  }
+}
+
+static void report(const char* name, uint64_t n_entries, double duration) {
+  printf("%-24s %8.2f million entries per second\n", name,
+         n_entries / duration / 1e6);
+}
+
+static void bench_decoders(const uint8_t* index, size_t index_size) {
+  static btoep_uleb128_pair pairs[BTOEP_INDEX_BATCH_SIZE];
+
+  for (size_t d = 0; d < btoep_uleb128_n_decoders; d++) {
+    const btoep_uleb128_decoder* decoder = &btoep_uleb128_decoders[d];
+    if (!decoder->is_supported())
+      continue;
+
+    // Decode in batches, like the library does.
+    uint64_t n_entries = 0;
+    double start = now(), duration;
+    do {
+      size_t pos = 0;
+      while (pos != index_size) {
+        size_t n = decoder->decode_pairs(index + pos, index_size - pos, pairs,
+                                         BTOEP_INDEX_BATCH_SIZE);
+        assert(n != 0);
+        pos += pairs[n - 1].end;
+        n_entries += n;
+      }
+    } while ((duration = now() - start) < MIN_DURATION);
+
+    report(decoder->name, n_entries, duration);
+  }
+}
+
+static void bench_iterator(const uint8_t* index, size_t index_size) {
+  btoep_dataset dataset;
+  btoep_index_iterator iterator;
+  btoep_range range;
+
+  assert(btoep_open(&dataset, "bench_index", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  assert(btoep_close(&dataset));
+  FILE* file = fopen("bench_index.idx", "wb");
+  assert(file != NULL);
+  assert(fwrite(index, 1, index_size, file) == index_size);
+  fclose(file);
+
+  assert(btoep_open(&dataset, "bench_index", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  uint64_t n_entries = 0;
+  double start = now(), duration;
+  do {
+    assert(btoep_index_iterator_start(&dataset, &iterator));
+    while (!btoep_index_iterator_is_eof(&iterator)) {
+      assert(btoep_index_iterator_next(&iterator, &range));
+      n_entries++;
+    }
+  } while ((duration = now() - start) < MIN_DURATION);
+  assert(btoep_close(&dataset));
+
+  report("index iterator", n_entries, duration);
+
+  remove("bench_index.idx");
+  remove("bench_index");
+}
+
+/*
+ * Adds ranges from front to back, either one at a time or in batches, to an
+ * index that already contains many entries.
+ */
+static void bench_add(size_t batch_size) {
+  static btoep_range ranges[N_BATCH_RANGES];
+  btoep_dataset dataset;
+
+  assert(btoep_open(&dataset, "bench_add", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  for (size_t i = 0; i < N_BATCH_RANGES; i++)
+    ranges[i] = btoep_mkrange(64 * i + 8, 8);
+  assert(btoep_index_add_many(&dataset, ranges, N_BATCH_RANGES));
+  for (size_t i = 0; i < N_BATCH_RANGES; i++)
+    ranges[i] = btoep_mkrange(64 * i + 32, 8);
+
+  double start = now();
+  for (size_t i = 0; i < N_BATCH_RANGES; i += batch_size) {
+    if (batch_size == 1)
+      assert(btoep_index_add(&dataset, ranges[i]));
+    else
+      assert(btoep_index_add_many(&dataset, ranges + i, batch_size));
+  }
+  double duration = now() - start;
+  assert(btoep_close(&dataset));
+
+  char name[32];
+  snprintf(name, sizeof(name), "add, batches of %zu", batch_size);
+  report(name, N_BATCH_RANGES, duration);
+
+  remove("bench_add.idx");
+  remove("bench_add");
+}
+
+int main(void) {
+  static uint8_t index[N_ENTRIES * 2 * BTOEP_ULEB128_MAX_LENGTH];
+  size_t index_size = 0;
+  for (size_t i = 0; i < N_ENTRIES; i++) {
+    index_size += encode(index + index_size, random_value());
+    index_size += encode(index + index_size, random_value());
+  }
+
+  printf("Decoding %d entries (%zu bytes)\n", N_ENTRIES, index_size);
+  bench_decoders(index, index_size);
+  bench_iterator(index, index_size);
+
+  printf("Adding %d ranges\n", N_BATCH_RANGES);
+  bench_add(1);
+  bench_add(256);
+  return 0;
+}
@@ -13,11 +13,15 @@
 # else
 #  include <limits.h>
 # endif
+# include <pthread.h>
 #endif
 
 #include "range.h"
 
-#define BTOEP_INDEX_CACHE_SIZE 65536 // 64 KiB
+#define BTOEP_INDEX_PAGE_SIZE   4096 // 4 KiB
+#define BTOEP_INDEX_CACHE_PAGES 16
+#define BTOEP_INDEX_CACHE_SIZE  (BTOEP_INDEX_CACHE_PAGES * BTOEP_INDEX_PAGE_SIZE)
+#define BTOEP_INDEX_BATCH_SIZE  64
 
 #define B_ERR_INPUT_OUTPUT         1
 #define B_ERR_DATASET_LOCKED       2
@@ -28,24 +32,46 @@
 #define B_ERR_INVALID_ARGUMENT     7
 #define B_ERR_DEAD_INDEX_ITERATOR  8
 #define B_ERR_DATASET_READ_ONLY    9
+#define B_ERR_OUT_OF_MEMORY       10
+#define B_ERR_SNAPSHOTS_IN_USE    11
+#define B_ERR_NOT_PUBLISHED       12
+#define B_ERR_DATA_VIEWS_IN_USE   13
+#define B_ERR_CANNOT_PREALLOCATE  14
 
 #define B_OPEN_EXISTING_READ_ONLY   0
 #define B_OPEN_EXISTING_READ_WRITE  1
 #define B_CREATE_NEW_READ_WRITE     2
 #define B_OPEN_OR_CREATE_READ_WRITE 3
 
+/*
+ * This flag can be combined with any of the above modes. If the index file is
+ * empty, e.g., because it was just created, the index will use the paged
+ * format. Otherwise, the existing format is retained.
+ */
+#define B_CREATE_PAGED_INDEX 16
+
+/*
+ * This flag can be combined with any of the above modes. Changes to the index
+ * are appended to a journal file instead of modifying the index file, and are
+ * only folded into the index file once the journal becomes too long, or when
+ * the dataset is closed. See btoep_index_flush.
+ */
+#define B_INDEX_JOURNAL 32
+
 #ifdef _MSC_VER
 # define OS_MAX_PATH MAX_PATH
 typedef LPCTSTR btoep_path;
 typedef TCHAR btoep_path_buffer[MAX_PATH];
 typedef HANDLE btoep_fd;
 typedef DWORD btoep_syserrno;
+typedef SRWLOCK btoep_mutex;
 #else
 # define OS_MAX_PATH PATH_MAX
 typedef const char* btoep_path;
 typedef char btoep_path_buffer[PATH_MAX];
 typedef int btoep_fd;
 typedef int btoep_syserrno;
+typedef pthread_mutex_t btoep_mutex;
 #endif
 
 typedef struct {
@@ -53,19 +79,155 @@ typedef struct {
   const char* func;
   btoep_syserrno system_error_code;
   const char* system_func;
+  // For B_ERR_DATA_CONFLICT, the offset of the first byte that differs from
+  // the existing data.
+  uint64_t conflict_offset;
 } btoep_last_error_info;
 
+/*
+ * The state of an index iterator at the beginning of an entry. See
+ * btoep_index_iterator_seek.
+ */
+typedef struct {
+  uint64_t index_offset;
+  uint64_t data_offset;
+  // Number of entries between this checkpoint and the next one.
+  uint64_t n_entries;
+} btoep_index_checkpoint;
+
+/*
+ * A page of the index cache, which holds BTOEP_INDEX_PAGE_SIZE bytes of the
+ * index, starting at an offset that is a multiple of the page size.
+ */
+typedef struct {
+  uint64_t offset;
+  // Value of the cache clock when the page was last used, or zero if the page
+  // is not in use.
+  uint64_t last_used;
+  bool is_valid;
+  bool is_dirty;
+  btoep_range dirty_range;
+  uint8_t data[BTOEP_INDEX_PAGE_SIZE];
+} btoep_index_cache_page;
+
+/*
+ * A leaf page of an index that uses the paged format. Each leaf contains a part
+ * of the (logical) index, starting at the given offset within the index.
+ */
+typedef struct {
+  uint64_t index_offset;
+  uint32_t page;
+  uint32_t used;
+} btoep_index_leaf;
+
+/* A compressed bitmap of index blocks, see lib/src/bitmap.h. */
+struct btoep_bitmap;
+
+/* A change to the index that has been recorded in the index journal. */
+typedef struct {
+  btoep_range range;
+  bool is_removal;
+} btoep_index_journal_record;
+
+/*
+ * A part of the data that was affected by a change to the index, and the index
+ * revision that the change produced.
+ */
+typedef struct {
+  uint64_t revision;
+  btoep_range range;
+} btoep_index_change;
+
+/*
+ * Maximum number of ranges in the change log. Older changes are discarded.
+ */
+#define BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH 4096
+
+/*
+ * Aggregate statistics of an index, see btoep_index_get_stats.
+ */
+typedef struct {
+  // Zero for the compact format, otherwise the version of the paged format.
+  unsigned format_version;
+  // Number of entries, i.e., of non-adjacent ranges.
+  uint64_t n_entries;
+  // Total length of all entries.
+  uint64_t n_bytes;
+  // End of the last entry, or zero if the index is empty.
+  uint64_t end;
+  // Hash of all entries, which is equal for equal indexes.
+  uint64_t fingerprint;
+} btoep_index_stats;
+
+/*
+ * An immutable copy of the index, see btoep_index_snapshot_acquire.
+ */
+typedef struct {
+  // Index revision (see btoep_index_get_revision) and size of the dataset at
+  // the time the snapshot was published.
+  uint64_t revision;
+  uint64_t data_size;
+  // All index entries in ascending order.
+  const btoep_range* ranges;
+  size_t n_ranges;
+} btoep_index_snapshot;
+
+/*
+ * A published snapshot and the number of readers that are currently using it.
+ * The snapshot must be the first member.
+ */
+typedef struct {
+  btoep_index_snapshot snapshot;
+  btoep_range* ranges;
+  size_t capacity;
+  volatile long n_readers;
+} btoep_index_snapshot_slot;
+
+/*
+ * Maximum number of snapshots that can be in use at the same time, including
+ * the most recently published one.
+ */
+#define BTOEP_INDEX_SNAPSHOT_SLOTS 8
+
+/*
+ * A mapping of the data file and the number of data views that point into it.
+ * When the data file grows, the current mapping is replaced by a larger one,
+ * but the previous mapping remains until all views into it have been released.
+ */
+typedef struct {
+  const uint8_t* address;
+  uint64_t size;
+  size_t n_views;
+#ifdef _MSC_VER
+  HANDLE handle;
+#endif
+} btoep_data_map;
+
+/*
+ * Maximum number of mappings of the data file, including the current one. Each
+ * mapping that is not current remains until all views into it are released.
+ */
+#define BTOEP_DATA_MAP_SLOTS 4
+
 typedef struct {
   // Configurable paths.
   btoep_path_buffer data_path;
   btoep_path_buffer index_path;
   btoep_path_buffer lock_path;
+  btoep_path_buffer checkpoint_path;
+  btoep_path_buffer journal_path;
+  btoep_path_buffer changes_path;
 
-  // File descriptors.
+  // File descriptors. The data file is only accessed at explicit offsets, so
+  // its file position is meaningless.
   btoep_fd data_fd;
   btoep_fd index_fd;
   bool read_only;
 
+  // Serializes index queries of concurrent btoep_data_read_range calls on
+  // read-only datasets.
+  btoep_mutex index_lock;
+
   // Error information.
   btoep_last_error_info last_error;
 
@@ -78,16 +240,121 @@ typedef struct {
   // changed.
   uint64_t index_rev;
 
-  // Index cache.
-  uint8_t index_cache[BTOEP_INDEX_CACHE_SIZE];
-  btoep_range index_cache_range;
-  bool index_cache_is_dirty;
-  btoep_range index_cache_dirty_range;
+  // The most recent change to the index, which replaced the area between
+  // last_edit_start and last_edit_end within an index of last_edit_old_size
+  // bytes. This allows cursors to follow the change without searching.
+  uint64_t last_edit_rev;
+  uint64_t last_edit_start;
+  uint64_t last_edit_end;
+  uint64_t last_edit_old_size;
+
+  // Mapping of the index file, which is only used for read-only datasets. While
+  // the index file is mapped, the index cache is not used.
+  const uint8_t* index_map;
+  uint64_t index_map_size;
+#ifdef _MSC_VER
+  HANDLE index_map_handle;
+#endif
+
+  // Mappings of the data file, see btoep_data_view_acquire. current_data_map
+  // is NULL until the first view is acquired.
+  btoep_data_map data_maps[BTOEP_DATA_MAP_SLOTS];
+  btoep_data_map* current_data_map;
+
+  // Index cache. Pages are evicted in least recently used order, and modified
+  // pages are written to the index file when they are evicted or flushed.
+  btoep_index_cache_page index_cache[BTOEP_INDEX_CACHE_PAGES];
+  uint64_t index_cache_clock;
+  size_t index_cache_mru;
+
+  // Recently decoded index entries and the index offsets after each of them.
+  // This is only valid if the index has not changed since.
+  btoep_range index_batch[BTOEP_INDEX_BATCH_SIZE];
+  uint64_t index_batch_ends[BTOEP_INDEX_BATCH_SIZE];
+  uint64_t index_batch_offset;
+  uint64_t index_batch_rev;
+  size_t index_batch_length;
+  size_t index_batch_pos;
+
+  // Paged index format. The leaves form a linked list within the index file,
+  // and a copy of that list is loaded into memory on first use.
+  bool index_is_paged;
+  bool index_header_is_dirty;
+  unsigned index_paged_version;
+  uint64_t index_n_pages;
+  uint64_t index_free_page;
+  uint64_t index_first_leaf;
+  btoep_index_leaf* index_leaves;
+  size_t n_index_leaves;
+  size_t index_leaves_capacity;
+  size_t index_leaf_mru;
+  bool index_leaves_are_loaded;
+
+  // Statistics of the index file, not including the journal. They are stored
+  // in the header of paged indexes and are updated along with the index, but
+  // compact indexes have no header, so their statistics require a single scan
+  // of the index.
+  btoep_index_stats index_stats;
+  bool index_stats_are_known;
+
+  // Decoded copy of the index. This is loaded when the index is first queried
+  // and allows binary searches instead of scanning the index. It is merely a
+  // cache: if it cannot be allocated, queries fall back to scanning the index.
+  btoep_range* index_table;
+  size_t index_table_length;
+  size_t index_table_capacity;
+  bool index_table_is_loaded;
+
+  // Alternative to the decoded index for fragmented indexes. If all entries
+  // begin and end at multiples of a common block size (except for the end of
+  // the last entry), a bitmap of blocks that contain data is often much smaller
+  // than the decoded index. At most one of the two is loaded at a time.
+  struct btoep_bitmap* index_bitmap;
+  unsigned index_bitmap_shift;
+  uint64_t index_bitmap_end;
+
+  // Index checkpoints. These are stored in a separate file and allow iterators
+  // to skip most of the index. Like the decoded index, they are only a cache.
+  btoep_index_checkpoint* checkpoints;
+  size_t n_checkpoints;
+  size_t checkpoints_capacity;
+  bool checkpoints_are_loaded;
+  bool checkpoints_are_dirty;
+  bool checkpoint_file_was_read;
+  bool checkpoints_were_scanned;
+
+  // Index journal. While the journal contains records, the decoded index table
+  // reflects both the index and the journal, and iterators use the table. The
+  // first journal_n_written records have been written to the journal file.
+  bool index_uses_journal;
+  btoep_index_journal_record* journal;
+  size_t journal_length;
+  size_t journal_capacity;
+  size_t journal_n_written;
+
+  // Persistent index revision and change log. Changes with revisions after
+  // changes_first_revision are all recorded in the log. Both are stored in a
+  // separate file and are loaded before the index is first modified.
+  uint64_t revision;
+  uint64_t changes_first_revision;
+  btoep_index_change* changes;
+  size_t n_changes;
+  size_t changes_capacity;
+  bool changes_are_loaded;
+  bool changes_are_dirty;
+
+  // Published index snapshots. Readers pin the slot of the current snapshot
+  // while they are using it, and new snapshots are only ever built in slots
+  // that are neither current nor pinned. current_snapshot is -1 until the
+  // first snapshot has been published.
+  btoep_index_snapshot_slot snapshot_slots[BTOEP_INDEX_SNAPSHOT_SLOTS];
+  volatile long current_snapshot;
 } btoep_dataset;
 
 /* Used to iterate over the index of a dataset. */
 typedef struct {
-  // Position of the iterator.
+  // Position of the iterator. While the index journal contains records, the
+  // index offset is a position within the decoded index table instead.
   uint64_t index_offset;
   uint64_t data_offset;
 
@@ -96,6 +363,15 @@ typedef struct {
   uint64_t index_rev;
 } btoep_index_iterator;
 
+/*
+ * Unlike an iterator, a cursor remains usable when the index changes. It keeps
+ * track of a data offset, and only ever returns data after that offset.
+ */
+typedef struct {
+  btoep_index_iterator iterator;
+  uint64_t data_offset;
+} btoep_index_cursor;
+
 /*
  * State management
  */
@@ -123,11 +399,43 @@ bool btoep_data_add_range(btoep_dataset* dataset, btoep_range range, const void*
 
 bool btoep_data_write(btoep_dataset* dataset, btoep_range range, const void* data, size_t data_size, int conflict_mode);
 
+/*
+ * Writes multiple ranges, which is equivalent to calling btoep_data_write for
+ * each range, where data[i] contains ranges[i].length bytes. The ranges must be
+ * sorted and must not overlap. Data that ends up in adjacent parts of the data
+ * file is written with as few system calls as possible.
+ *
+ * Like btoep_data_write, this does not add the ranges to the index, see
+ * btoep_index_add_many.
+ */
+bool btoep_data_writev(btoep_dataset* dataset, const btoep_range* ranges,
+                       const void* const* data, size_t n_ranges,
+                       int conflict_mode);
+
+/*
+ * Writes the contents of the given file, starting at its current position, to
+ * the dataset, starting at the given offset. This is equivalent to reading the
+ * file until its end and passing the data to btoep_data_write, and thus does
+ * not modify the index either. Afterwards, length is the number of bytes that
+ * have been processed, even if this function fails.
+ *
+ * On Linux, data from regular files and pipes is moved within the kernel, if
+ * possible, and file systems may even share the underlying storage.
+ */
+bool btoep_data_write_from_fd(btoep_dataset* dataset, uint64_t offset,
+                              btoep_fd fd, int conflict_mode,
+                              uint64_t* length);
+
 /*
  * Reads a range of data. The given range must be a subset of an existing range.
  * In other words, this function does not permit reading outside of existing
  * ranges.
  *
+ * If the dataset was opened with B_OPEN_EXISTING_READ_ONLY, multiple threads
+ * may call this function at the same time, as long as no other functions are
+ * called concurrently. If concurrent calls fail, the last error information
+ * may belong to any of them.
+ *
  * data_size may be NULL, in which case range->length is used. If it is not
  * NULL, this function only reads up to data_size bytes of the given range,
  * and then sets data_size to the number of bytes read.
@@ -137,6 +445,29 @@ bool btoep_data_write(btoep_dataset* dataset, btoep_range range, const void* dat
  */
 bool btoep_data_read_range(btoep_dataset* dataset, btoep_range range, void* data, size_t* data_size);
 
+/*
+ * Reads multiple ranges, each of which must be a subset of an existing range,
+ * into the respective buffers. The ranges must be sorted by their offsets,
+ * which allows checking all of them in a single pass over the index. Adjacent
+ * ranges are read with as few system calls as possible.
+ *
+ * The same guarantees regarding concurrent calls apply as for
+ * btoep_data_read_range.
+ */
+bool btoep_data_readv(btoep_dataset* dataset, const btoep_range* ranges,
+                      void* const* data, size_t n_ranges);
+
+/*
+ * Writes a range of data, which must be a subset of an existing range, to the
+ * given file, e.g., to standard output. On Linux, the data is moved within the
+ * kernel without copying it into a buffer, if the file type permits it.
+ *
+ * The same guarantees regarding concurrent calls apply as for
+ * btoep_data_read_range.
+ */
+bool btoep_data_read_to_fd(btoep_dataset* dataset, btoep_range range,
+                           btoep_fd fd);
+
 /*
  * This function is similar to the read() function. It attempts to read up to
  * length bytes starting at the given offset, but may return fewer bytes.
@@ -147,6 +478,9 @@ bool btoep_data_read_range(btoep_dataset* dataset, btoep_range range, void* data
  * data than length. However, it is guaranteed to return more than zero bytes,
  * unless either length is zero, or the offset is at the end of the file.
  *
+ * This does not use the index, so the same guarantees regarding concurrent
+ * calls apply as for btoep_data_read_range.
+ *
  * Unlike btoep_data_read_range, this function allows reading outside of
  * existing data ranges.
  */
@@ -154,7 +488,43 @@ bool btoep_data_read(btoep_dataset* dataset, uint64_t offset, void* data, size_t
 
 bool btoep_data_get_size(btoep_dataset* dataset, uint64_t* size);
 
-bool btoep_data_set_size(btoep_dataset* dataset, uint64_t size, bool allow_destructive);
+#define BTOEP_SIZE_ALLOW_DESTRUCTIVE 1
+#define BTOEP_SIZE_PREALLOCATE       2
+
+/*
+ * Changes the size of the data file. Unless flags include
+ * BTOEP_SIZE_ALLOW_DESTRUCTIVE, this fails with B_ERR_SIZE_TOO_SMALL if any
+ * existing data would be removed.
+ *
+ * With BTOEP_SIZE_PREALLOCATE, storage for the entire data file is allocated
+ * in advance when it grows, which prevents fragmentation when data is added out
+ * of order. If the file system does not support that, this fails with
+ * B_ERR_CANNOT_PREALLOCATE, and neither the data file nor the index changes.
+ *
+ * Shrinking the data file fails with B_ERR_DATA_VIEWS_IN_USE while any data
+ * views point into a mapping that extends beyond the new size.
+ */
+bool btoep_data_set_size(btoep_dataset* dataset, uint64_t size, int flags);
+
+/*
+ * Provides direct access to a range of data through a memory mapping of the
+ * data file, which avoids copying the data. Like btoep_data_read_range, this
+ * fails with B_ERR_READ_OUT_OF_BOUNDS unless the range is a subset of an
+ * existing range.
+ *
+ * The view remains valid until it is released, even if the data file grows in
+ * the meantime. However, views reflect later modifications of the data, e.g.,
+ * through BTOEP_CONFLICT_OVERWRITE. At most BTOEP_DATA_MAP_SLOTS mappings can
+ * exist at the same time, so acquiring a view after the data file has grown
+ * may fail with B_ERR_DATA_VIEWS_IN_USE until older views are released.
+ *
+ * All views must be released before the dataset is closed. The same guarantees
+ * regarding concurrent calls apply as for btoep_data_read_range.
+ */
+bool btoep_data_view_acquire(btoep_dataset* dataset, btoep_range range,
+                             const void** ptr);
+
+void btoep_data_view_release(btoep_dataset* dataset, const void* ptr);
 
 /*
  * Index API
@@ -170,12 +540,71 @@ bool btoep_index_iterator_skip(btoep_index_iterator* iter);
 
 bool btoep_index_iterator_is_eof(btoep_index_iterator* iter);
 
+/*
+ * Moves the iterator to the first entry that ends after the given data offset,
+ * that is, to the entry that contains the offset, or to the next entry if no
+ * entry contains it. If there is no such entry, the iterator reaches the end of
+ * the index.
+ *
+ * This uses checkpoints to avoid decoding most of the index, and can also be
+ * used to revive an iterator that is too old.
+ */
+bool btoep_index_iterator_seek(btoep_index_iterator* iter, uint64_t data_offset);
+
+/*
+ * Creates a cursor at the beginning of the index.
+ */
+bool btoep_index_cursor_start(btoep_dataset* dataset, btoep_index_cursor* cursor);
+
+/*
+ * Moves the cursor to the given data offset, which may be before or after its
+ * current position.
+ */
+bool btoep_index_cursor_seek(btoep_index_cursor* cursor, uint64_t data_offset);
+
+/*
+ * Finds the first data after the data offset of the cursor, that is, the part
+ * of the first index entry that ends after the offset. If there is such data,
+ * exists is set to true, and the cursor moves to the end of the returned range.
+ *
+ * If the index has changed, the cursor is repositioned based on its data
+ * offset. This is cheap if the change did not affect entries close to the
+ * cursor. Entries that the cursor has already passed, even if they have been
+ * changed, are never returned again.
+ */
+bool btoep_index_cursor_next(btoep_index_cursor* cursor, bool* exists,
+                             btoep_range* range);
+
+/*
+ * Like btoep_index_cursor_next, but does not move the cursor.
+ */
+bool btoep_index_cursor_peek(btoep_index_cursor* cursor, bool* exists,
+                             btoep_range* range);
+
 /* This invalidates all existing iterators. */
 bool btoep_index_add(btoep_dataset* dataset, btoep_range range);
 
 /* This invalidates all existing iterators. */
 bool btoep_index_remove(btoep_dataset* dataset, btoep_range range);
 
+/*
+ * Adds all given ranges to the index. The ranges may be in any order and may
+ * overlap. This is equivalent to adding each range individually, but only
+ * requires a single pass over the affected part of the index.
+ *
+ * This invalidates all existing iterators.
+ */
+bool btoep_index_add_many(btoep_dataset* dataset, const btoep_range* ranges,
+                          size_t n_ranges);
+
+/*
+ * Removes all given ranges from the index, like btoep_index_add_many.
+ *
+ * This invalidates all existing iterators.
+ */
+bool btoep_index_remove_many(btoep_dataset* dataset, const btoep_range* ranges,
+                             size_t n_ranges);
+
 #define BTOEP_FIND_DATA    1
 #define BTOEP_FIND_NO_DATA 2
 
@@ -186,6 +615,91 @@ bool btoep_index_contains(btoep_dataset* dataset, btoep_range relevant_range, bo
 
 bool btoep_index_contains_any(btoep_dataset* dataset, btoep_range relevant_range, bool* contains_any);
 
+/*
+ * Retrieves up to capacity ranges within the given window at once, which is
+ * much cheaper than iterating over individual entries. Depending on the mode,
+ * which is either BTOEP_FIND_DATA or BTOEP_FIND_NO_DATA, these are the parts of
+ * the window that do or do not contain data, in ascending order.
+ *
+ * If cursor is NULL, ranges are retrieved from the beginning of the window.
+ * Otherwise, retrieval starts at the data offset of the cursor (or at the
+ * beginning of the window, if that is later), and the cursor moves past the
+ * returned ranges. Repeated calls thus page through the window, and the cursor
+ * remains usable even if the index changes between calls. Once fewer than
+ * capacity ranges are returned, the end of the window has been reached.
+ */
+bool btoep_index_get_ranges(btoep_dataset* dataset, btoep_range window,
+                            int mode, btoep_range* ranges, size_t capacity,
+                            size_t* n_ranges, btoep_index_cursor* cursor);
+
+/*
+ * Retrieves aggregate statistics of the index. For paged indexes, this does not
+ * require decoding the index. The fingerprint does not depend on the order in
+ * which ranges were added or removed, nor on the format of the index.
+ */
+bool btoep_index_get_stats(btoep_dataset* dataset, btoep_index_stats* stats);
+
+/*
+ * Retrieves the revision of the index. Unlike the revision that iterators use,
+ * it is stored on disk, and it increases with every change to the index, even
+ * across processes. Equal revisions of the same dataset refer to equal indexes.
+ */
+bool btoep_index_get_revision(btoep_dataset* dataset, uint64_t* revision);
+
+/*
+ * Retrieves the parts of the data that may have been added to or removed from
+ * the index since the given revision, in ascending order. The ranges array must
+ * have room for BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH ranges.
+ *
+ * The change log only covers recent changes. If it does not go back as far as
+ * the given revision, or if the revision is unknown, is_complete is set to
+ * false and no ranges are returned; the entire index must be assumed to have
+ * changed in that case.
+ */
+bool btoep_index_get_changes(btoep_dataset* dataset, uint64_t since,
+                             btoep_range* ranges, size_t* n_ranges,
+                             bool* is_complete);
+
+/*
+ * Index snapshots allow other threads to query the index while the dataset is
+ * being modified. Apart from the functions below, a dataset must only ever be
+ * used by a single thread at a time, which is referred to as the writer.
+ *
+ * The writer publishes a copy of the current index, which replaces the
+ * previously published snapshot. This fails with B_ERR_SNAPSHOTS_IN_USE if all
+ * other snapshot slots are still in use by readers.
+ */
+bool btoep_index_snapshot_publish(btoep_dataset* dataset);
+
+/*
+ * Any thread can acquire the most recently published snapshot without locking,
+ * and the snapshot remains valid and unchanged until it is released, no matter
+ * how the index is modified in the meantime. Returns NULL if no snapshot has
+ * been published yet. All snapshots must be released before the dataset is
+ * closed.
+ */
+const btoep_index_snapshot* btoep_index_snapshot_acquire(btoep_dataset* dataset);
+
+void btoep_index_snapshot_release(const btoep_index_snapshot* snapshot);
+
+/*
+ * Like btoep_index_find_offset, but this cannot fail. The return value
+ * indicates whether an offset was found.
+ */
+bool btoep_index_snapshot_find_offset(const btoep_index_snapshot* snapshot,
+                                      uint64_t start, int mode,
+                                      uint64_t* offset);
+
+bool btoep_index_snapshot_contains(const btoep_index_snapshot* snapshot,
+                                   btoep_range range);
+
+bool btoep_index_snapshot_contains_any(const btoep_index_snapshot* snapshot,
+                                       btoep_range range);
+
+/*
+ * Writes all changes to the index to disk. If the dataset was opened with
+ * B_INDEX_JOURNAL, this only appends new journal records to the journal file.
+ */
 bool btoep_index_flush(btoep_dataset* dataset);
 
 #endif  // __BTOEP__DATASET_H__
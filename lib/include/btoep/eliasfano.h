@@ -0,0 +1,120 @@
+#ifndef __BTOEP__ELIASFANO_H__
+#define __BTOEP__ELIASFANO_H__
+
+#include "dataset.h"
+
+/*
+ * A quasi-succinct encoding of an index, which is usually much smaller than the
+ * compact format, and which can be queried without decoding it first.
+ *
+ * The boundaries of all n entries, that is, the offset and the end of each
+ * entry, form a strictly increasing sequence of 2n values x_0 < ... < x_max.
+ * The Elias-Fano encoding stores the lowest l bits of each value as they are,
+ * where l = floor(log2(x_max / 2n)), or zero if x_max < 2n. The remaining high
+ * bits are stored in a bit vector, in which the j-th value sets the bit at
+ * (x_j >> l) + j. This takes less than l + 3 bits per boundary, no matter how
+ * the entries are distributed.
+ *
+ * An encoded index consists of
+ *
+ *  - the magic value BTOEP_EF_MAGIC (8 bytes, including the format version),
+ *  - the number of entries n as a ULEB128 value,
+ *  - unless n is zero, the end of the last entry x_max as a ULEB128 value,
+ *  - the low bits of all values, 2n * l bits, and
+ *  - the high bit vector, 2n + (x_max >> l) bits.
+ *
+ * Bits are in little-endian order, and both bit arrays are padded with zero
+ * bits to full bytes.
+ */
+
+#define BTOEP_EF_MAGIC      "\xc2\xd4\xcf\xc5\xd0\xc5\xc6\x01"
+#define BTOEP_EF_MAGIC_SIZE 8
+
+typedef struct {
+  btoep_last_error_info last_error;
+  uint8_t* data;
+  size_t size;
+
+  uint64_t n_values;
+  uint64_t n_added;
+  uint64_t end;
+  uint64_t prev_end;
+  unsigned low_bits;
+  uint8_t* low;
+  uint8_t* high;
+} btoep_ef_encoder;
+
+/*
+ * Prepares encoding n_ranges entries, the last of which must end at the given
+ * offset. This allocates the entire encoded index, which is complete once all
+ * entries have been added, and is then stored in data and size.
+ */
+bool btoep_ef_encoder_init(btoep_ef_encoder* encoder, uint64_t n_ranges,
+                           uint64_t end);
+
+/*
+ * Adds the next entry. Entries must be added in ascending order, and must be
+ * neither empty, adjacent, nor overlapping, otherwise this fails with
+ * B_ERR_INVALID_ARGUMENT.
+ */
+bool btoep_ef_encoder_add(btoep_ef_encoder* encoder, btoep_range range);
+
+void btoep_ef_encoder_free(btoep_ef_encoder* encoder);
+
+/*
+ * An encoded index. Opening it validates the encoding and samples the positions
+ * of every BTOEP_EF_SAMPLE_RATE-th one and zero within the high bit vector,
+ * which only takes a small fraction of the size of the encoded index itself.
+ * Afterwards, each query only needs to look at a few bytes.
+ */
+typedef struct {
+  btoep_last_error_info last_error;
+  uint64_t n_ranges;
+
+  const uint8_t* low;
+  const uint8_t* high;
+  size_t low_size;
+  size_t high_size;
+  uint64_t n_values;
+  uint64_t n_zeros;
+  unsigned low_bits;
+  uint64_t* one_samples;
+  uint64_t* zero_samples;
+} btoep_ef_index;
+
+#define BTOEP_EF_SAMPLE_RATE 256
+
+/*
+ * Opens the encoded index, which must remain valid while the index is in use.
+ * If the data is not a valid encoded index, this fails with
+ * B_ERR_INVALID_INDEX_FORMAT.
+ */
+bool btoep_ef_index_open(btoep_ef_index* index, const void* data, size_t size);
+
+void btoep_ef_index_close(btoep_ef_index* index);
+
+/*
+ * Retrieves the i-th entry, where i must be less than n_ranges.
+ */
+btoep_range btoep_ef_index_get(const btoep_ef_index* index, uint64_t i);
+
+/*
+ * Like btoep_index_find_offset, but this cannot fail. The return value
+ * indicates whether an offset was found.
+ */
+bool btoep_ef_index_find_offset(const btoep_ef_index* index, uint64_t start,
+                                int mode, uint64_t* offset);
+
+/*
+ * Checks whether a single entry contains the entire range. Since the encoded
+ * index does not know the size of the dataset, empty ranges are always
+ * contained.
+ */
+bool btoep_ef_index_contains(const btoep_ef_index* index, btoep_range range);
+
+/*
+ * Checks whether any entry intersects with the range.
+ */
+bool btoep_ef_index_contains_any(const btoep_ef_index* index, btoep_range range);
+
+#endif  // __BTOEP__ELIASFANO_H__
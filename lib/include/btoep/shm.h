@@ -0,0 +1,111 @@
+#ifndef __BTOEP__SHM_H__
+#define __BTOEP__SHM_H__
+
+#include "dataset.h"
+
+/*
+ * Publishes the index of a dataset in shared memory, so that other processes
+ * on the same host can check which data is present without opening the dataset,
+ * without acquiring its lock, and without any system calls.
+ *
+ * The shared memory consists of a small control segment, whose name is derived
+ * from the absolute path of the index file, and a table of all index entries.
+ * The table is guarded by a sequence counter, which is odd while the table is
+ * being updated. Readers retry until they observe the same even value before
+ * and after a query. When the table needs to grow, the publisher creates a new
+ * table with the next generation number, stores that number in the control
+ * segment, and marks the previous table as replaced.
+ */
+
+#ifdef _MSC_VER
+# define BTOEP_SHM_NAME_PREFIX "Local\\btoep-"
+#else
+# define BTOEP_SHM_NAME_PREFIX "/btoep-"
+#endif
+
+// The prefix, 16 hexadecimal digits of the path hash, a hyphen, and up to 20
+// decimal digits of the table generation, including the terminating null.
+#define BTOEP_SHM_NAME_SIZE (sizeof(BTOEP_SHM_NAME_PREFIX) + 16 + 1 + 20)
+
+typedef struct {
+  void* address;
+  size_t size;
+#ifdef _MSC_VER
+  HANDLE handle;
+#endif
+} btoep_shm_mapping;
+
+typedef struct {
+  btoep_last_error_info last_error;
+  btoep_dataset* dataset;
+  char name[BTOEP_SHM_NAME_SIZE];
+  uint64_t generation;
+  uint64_t capacity;
+  btoep_shm_mapping control;
+  btoep_shm_mapping table;
+
+  // Entries are retrieved before the table is locked.
+  btoep_range* buffer;
+  size_t buffer_capacity;
+} btoep_shm_publisher;
+
+/*
+ * Creates the shared memory for the given dataset and publishes its index.
+ * Only one process may publish a dataset at a time, so the dataset must have
+ * been opened for writing. Otherwise, this fails with B_ERR_DATASET_READ_ONLY.
+ */
+bool btoep_shm_publisher_open(btoep_shm_publisher* publisher,
+                              btoep_dataset* dataset);
+
+/*
+ * Updates the published index. Readers never observe a partially updated
+ * index, but they do not observe changes until they are published either.
+ */
+bool btoep_shm_publish(btoep_shm_publisher* publisher);
+
+/*
+ * Marks the index as no longer published and removes the shared memory.
+ */
+void btoep_shm_publisher_close(btoep_shm_publisher* publisher);
+
+typedef struct {
+  btoep_last_error_info last_error;
+  char name[BTOEP_SHM_NAME_SIZE];
+  uint64_t generation;
+  uint64_t capacity;
+  btoep_shm_mapping control;
+  btoep_shm_mapping table;
+} btoep_shm_reader;
+
+/*
+ * Opens the published index of a dataset. The index path defaults to the data
+ * path with the extension ".idx", as in btoep_open. If no process publishes
+ * the index, this fails with B_ERR_NOT_PUBLISHED, and the caller should fall
+ * back to opening the dataset.
+ *
+ * Queries also fail with B_ERR_NOT_PUBLISHED once the publisher has closed the
+ * published index, in which case the reader should be closed.
+ */
+bool btoep_shm_reader_open(btoep_shm_reader* reader, btoep_path data_path,
+                           btoep_path index_path);
+
+void btoep_shm_reader_close(btoep_shm_reader* reader);
+
+/*
+ * Like the respective dataset functions, but these only use the published
+ * index, and thus do not reflect changes that have not been published yet.
+ */
+
+bool btoep_shm_reader_get_revision(btoep_shm_reader* reader,
+                                   uint64_t* revision);
+
+bool btoep_shm_reader_find_offset(btoep_shm_reader* reader, uint64_t start,
+                                  int mode, bool* exists, uint64_t* offset);
+
+bool btoep_shm_reader_contains(btoep_shm_reader* reader, btoep_range range,
+                               bool* result);
+
+bool btoep_shm_reader_contains_any(btoep_shm_reader* reader, btoep_range range,
+                                   bool* result);
+
+#endif  // __BTOEP__SHM_H__
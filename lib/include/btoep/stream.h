@@ -0,0 +1,126 @@
+#ifndef __BTOEP__STREAM_H__
+#define __BTOEP__STREAM_H__
+
+#include <stdio.h>
+
+#include "dataset.h"
+
+/*
+ * Streaming operations on indexes. Entries are decoded, combined, and encoded
+ * one at a time, so memory usage does not depend on the size of the indexes.
+ *
+ * Encoded indexes use the compact format, which is what btoep-get-index
+ * produces and what index files that do not use the paged format contain.
+ */
+
+#define BTOEP_INDEX_STREAM_BUFFER_SIZE 4096
+
+/*
+ * A source of index entries in ascending order, either an encoded index that is
+ * read from a file, an array of ranges, or the index of a dataset.
+ */
+typedef struct {
+  btoep_last_error_info last_error;
+
+  // Encoded indexes.
+  FILE* file;
+  uint8_t buffer[BTOEP_INDEX_STREAM_BUFFER_SIZE];
+  size_t buffer_pos;
+  size_t buffer_length;
+  bool is_eof;
+  btoep_range batch[BTOEP_INDEX_BATCH_SIZE];
+  size_t batch_pos;
+  size_t batch_length;
+  uint64_t prev_end;
+  bool has_prev;
+
+  // Arrays of ranges.
+  bool is_array;
+  const btoep_range* ranges;
+  size_t n_ranges;
+  size_t ranges_pos;
+
+  // Dataset indexes.
+  btoep_dataset* dataset;
+  btoep_index_iterator iterator;
+} btoep_index_source;
+
+/*
+ * Decodes the index that is read from the given file, which must have been
+ * opened in binary mode.
+ */
+void btoep_index_source_init_file(btoep_index_source* source, FILE* file);
+
+/*
+ * Iterates over the given ranges, which must remain valid while the source is
+ * in use. The ranges must be in ascending order, and must be neither empty,
+ * adjacent, nor overlapping, otherwise retrieving the first offending range
+ * fails with B_ERR_INVALID_ARGUMENT.
+ */
+void btoep_index_source_init_array(btoep_index_source* source,
+                                   const btoep_range* ranges, size_t n_ranges);
+
+/*
+ * Iterates over the index of the given dataset. The index must not be modified
+ * while the source is in use.
+ */
+bool btoep_index_source_init_dataset(btoep_index_source* source,
+                                     btoep_dataset* dataset);
+
+/*
+ * Retrieves the next entry. At the end of the index, exists is set to false.
+ */
+bool btoep_index_source_next(btoep_index_source* source, bool* exists,
+                             btoep_range* range);
+
+/*
+ * Encodes index entries and writes them to a file. Entries must be written in
+ * ascending order, and must be neither empty, adjacent, nor overlapping.
+ */
+typedef struct {
+  btoep_last_error_info last_error;
+  FILE* file;
+  uint64_t prev_end;
+  bool has_prev;
+} btoep_index_writer;
+
+void btoep_index_writer_init(btoep_index_writer* writer, FILE* file);
+
+bool btoep_index_writer_write(btoep_index_writer* writer, btoep_range range);
+
+#define BTOEP_INDEX_UNION        1
+#define BTOEP_INDEX_INTERSECTION 2
+#define BTOEP_INDEX_DIFFERENCE   3
+
+/*
+ * Combines the entries of all sources and writes the result to the writer:
+ *
+ *  - BTOEP_INDEX_UNION: data that is in any source,
+ *  - BTOEP_INDEX_INTERSECTION: data that is in all sources,
+ *  - BTOEP_INDEX_DIFFERENCE: data that is in the first source, but not in any
+ *    other source.
+ *
+ * The sources are merged using a heap, so this takes O(n log k) time for n
+ * entries in k sources, and memory proportional to k. If an error occurs,
+ * information about it is stored in error, regardless of whether a source or
+ * the writer failed.
+ */
+bool btoep_index_combine(btoep_index_source* const* sources, size_t n_sources,
+                         int op, btoep_index_writer* writer,
+                         btoep_last_error_info* error);
+
+/*
+ * Replaces the entire index of the dataset with the entries of the source. The
+ * new index is encoded in memory first, so if the source fails, e.g., because
+ * it contains invalid data, the index is not modified. Otherwise, journal
+ * records are folded into the previous index, and the new index is written to
+ * a temporary file in a single pass, which then replaces the index file. If any
+ * of this fails or is interrupted, the previous index remains intact. This is
+ * much faster than adding each entry individually.
+ *
+ * The source must not be the index of the same dataset. This invalidates all
+ * existing iterators.
+ */
+bool btoep_index_replace(btoep_dataset* dataset, btoep_index_source* source);
+
+#endif  // __BTOEP__STREAM_H__
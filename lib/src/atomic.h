@@ -0,0 +1,85 @@
+#ifndef __BTOEP__ATOMIC_H__
+#define __BTOEP__ATOMIC_H__
+
+#include <stdint.h>
+
+#ifdef _MSC_VER
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+#endif
+
+/*
+ * Sequentially consistent operations on shared counters. These operate on
+ * plain volatile longs, which can be part of public structures, instead of on
+ * C11 atomic types, which MSVC does not fully support.
+ */
+
+static inline long atomic_load_long(volatile long* value) {
+#ifdef _MSC_VER
+  return InterlockedCompareExchange(value, 0, 0);
+#else
+  return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_store_long(volatile long* value, long new_value) {
+#ifdef _MSC_VER
+  InterlockedExchange(value, new_value);
+#else
+  __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_increment_long(volatile long* value) {
+#ifdef _MSC_VER
+  InterlockedIncrement(value);
+#else
+  __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_decrement_long(volatile long* value) {
+#ifdef _MSC_VER
+  InterlockedDecrement(value);
+#else
+  __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*
+ * Operations on 64-bit values, which may be part of read-only shared memory.
+ * On Windows, aligned 64-bit loads and stores are atomic, but require explicit
+ * barriers.
+ */
+
+static inline uint64_t atomic_load_u64(const volatile uint64_t* value) {
+#ifdef _MSC_VER
+  uint64_t result = *value;
+  MemoryBarrier();
+  return result;
+#else
+  return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_store_u64(volatile uint64_t* value, uint64_t new_value) {
+#ifdef _MSC_VER
+  MemoryBarrier();
+  *value = new_value;
+  MemoryBarrier();
+#else
+  __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_fence(void) {
+#ifdef _MSC_VER
+  MemoryBarrier();
+#else
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+#endif  // __BTOEP__ATOMIC_H__
@@ -0,0 +1,488 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "bits.h"
+
+#define CONTAINER_ARRAY  1
+#define CONTAINER_BITMAP 2
+#define CONTAINER_RUN    3
+
+#define CHUNK_MASK  (BTOEP_BITMAP_CHUNK_SIZE - 1)
+#define CHUNK_WORDS (BTOEP_BITMAP_CHUNK_SIZE / 64)
+
+// Arrays contain 16-bit values, runs are pairs of a 16-bit start and a 16-bit
+// length minus one, and bitmaps have one bit per block.
+#define ARRAY_VALUE_SIZE 2
+#define RUN_SIZE         4
+#define BITMAP_SIZE      (CHUNK_WORDS * sizeof(uint64_t))
+
+/*
+ * Operations on plain bitmaps of CHUNK_WORDS words.
+ */
+
+static bool words_next(const uint64_t* words, uint32_t pos, bool value,
+                       uint32_t* result) {
+  for (uint32_t i = pos / 64; i < CHUNK_WORDS; i++) {
+    uint64_t word = value ? words[i] : ~words[i];
+    if (i == pos / 64)
+      word &= ~UINT64_C(0) << (pos % 64);
+    if (word != 0) {
+      *result = 64 * i + lowest_bit(word);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool words_prev(const uint64_t* words, uint32_t pos, bool value,
+                       uint32_t* result) {
+  for (uint32_t i = pos / 64 + 1; i-- > 0;) {
+    uint64_t word = value ? words[i] : ~words[i];
+    if (i == pos / 64)
+      word &= ~UINT64_C(0) >> (63 - pos % 64);
+    if (word != 0) {
+      *result = 64 * i + highest_bit(word);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void words_set(uint64_t* words, uint32_t first, uint32_t n, bool value) {
+  uint32_t last = first + n - 1;
+  for (uint32_t i = first / 64; i <= last / 64; i++) {
+    uint64_t mask = ~UINT64_C(0);
+    if (i == first / 64)
+      mask &= ~UINT64_C(0) << (first % 64);
+    if (i == last / 64)
+      mask &= ~UINT64_C(0) >> (63 - last % 64);
+    if (value)
+      words[i] |= mask;
+    else
+      words[i] &= ~mask;
+  }
+}
+
+/*
+ * Operations on containers. Positions within a container are the lowest
+ * BTOEP_BITMAP_CHUNK_BITS bits of block numbers.
+ */
+
+// Returns the number of values in the array that are less than pos.
+static uint32_t array_lower_bound(const uint16_t* values, uint32_t n,
+                                  uint32_t pos) {
+  uint32_t low = 0, high = n;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (values[mid] < pos)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// Returns the number of runs that start before or at pos.
+static uint32_t runs_upper_bound(const uint16_t* runs, uint32_t n,
+                                 uint32_t pos) {
+  uint32_t low = 0, high = n;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (runs[2 * mid] <= pos)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static size_t container_data_size(const btoep_bitmap_container* container) {
+  switch (container->type) {
+  case CONTAINER_ARRAY: return (size_t) container->n * ARRAY_VALUE_SIZE;
+  case CONTAINER_RUN:   return (size_t) container->n * RUN_SIZE;
+  default:              return BITMAP_SIZE;
+  }
+}
+
+static bool container_contains(const btoep_bitmap_container* container,
+                               uint32_t pos) {
+  const uint16_t* values = container->data;
+  uint32_t i;
+  switch (container->type) {
+  case CONTAINER_ARRAY:
+    i = array_lower_bound(values, container->n, pos);
+    return i < container->n && values[i] == pos;
+  case CONTAINER_RUN:
+    i = runs_upper_bound(values, container->n, pos);
+    return i > 0 && (uint32_t) values[2 * i - 2] + values[2 * i - 1] >= pos;
+  default:
+    return (((const uint64_t*) container->data)[pos / 64] >> (pos % 64)) & 1;
+  }
+}
+
+static bool container_next(const btoep_bitmap_container* container,
+                           uint32_t pos, bool value, uint32_t* result) {
+  const uint16_t* values = container->data;
+  uint32_t n = container->n, i;
+
+  if (container->type == CONTAINER_ARRAY) {
+    i = array_lower_bound(values, n, pos);
+    if (value) {
+      if (i == n)
+        return false;
+      *result = values[i];
+      return true;
+    }
+    for (; i < n && values[i] == pos; i++)
+      pos++;
+    *result = pos;
+    return pos <= CHUNK_MASK;
+  }
+
+  if (container->type == CONTAINER_RUN) {
+    i = runs_upper_bound(values, n, pos);
+    uint32_t run_end = (i == 0) ? 0 : (uint32_t) values[2 * i - 2] + values[2 * i - 1];
+    if (i != 0 && run_end >= pos) {
+      // Runs are never adjacent, so the first block after a run is missing.
+      *result = value ? pos : run_end + 1;
+      return value || run_end < CHUNK_MASK;
+    }
+    if (!value) {
+      *result = pos;
+      return true;
+    }
+    if (i == n)
+      return false;
+    *result = values[2 * i];
+    return true;
+  }
+
+  return words_next(container->data, pos, value, result);
+}
+
+static bool container_prev(const btoep_bitmap_container* container,
+                           uint32_t pos, bool value, uint32_t* result) {
+  const uint16_t* values = container->data;
+  uint32_t n = container->n, i;
+
+  if (container->type == CONTAINER_ARRAY) {
+    i = array_lower_bound(values, n, pos + 1);
+    if (value) {
+      if (i == 0)
+        return false;
+      *result = values[i - 1];
+      return true;
+    }
+    for (; i > 0 && values[i - 1] == pos; i--) {
+      if (pos == 0)
+        return false;
+      pos--;
+    }
+    *result = pos;
+    return true;
+  }
+
+  if (container->type == CONTAINER_RUN) {
+    i = runs_upper_bound(values, n, pos);
+    if (i == 0) {
+      *result = pos;
+      return !value;
+    }
+    uint32_t run_start = values[2 * i - 2];
+    uint32_t run_end = run_start + values[2 * i - 1];
+    if (run_end >= pos) {
+      *result = value ? pos : run_start - 1;
+      return value || run_start != 0;
+    }
+    *result = value ? run_end : pos;
+    return true;
+  }
+
+  return words_prev(container->data, pos, value, result);
+}
+
+static void container_to_words(const btoep_bitmap_container* container,
+                               uint64_t* words) {
+  const uint16_t* values = container->data;
+  if (container->type == CONTAINER_BITMAP) {
+    memcpy(words, container->data, BITMAP_SIZE);
+    return;
+  }
+
+  memset(words, 0, BITMAP_SIZE);
+  for (uint32_t i = 0; i < container->n; i++) {
+    if (container->type == CONTAINER_ARRAY)
+      words[values[i] / 64] |= UINT64_C(1) << (values[i] % 64);
+    else
+      words_set(words, values[2 * i], (uint32_t) values[2 * i + 1] + 1, true);
+  }
+}
+
+/*
+ * Replaces the contents of the container with the given blocks, which must not
+ * be empty, using whichever container type is smallest. The container is left
+ * unmodified if memory cannot be allocated.
+ */
+static bool container_from_words(btoep_bitmap_container* container,
+                                 const uint64_t* words) {
+  uint32_t n_blocks = 0, n_runs = 0;
+  uint64_t carry = 0;
+  for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+    n_blocks += count_bits(words[i]);
+    n_runs += count_bits(words[i] & ~((words[i] << 1) | carry));
+    carry = words[i] >> 63;
+  }
+
+  uint8_t type = CONTAINER_BITMAP;
+  size_t size = BITMAP_SIZE;
+  if ((size_t) n_runs * RUN_SIZE < size) {
+    type = CONTAINER_RUN;
+    size = (size_t) n_runs * RUN_SIZE;
+  }
+  if ((size_t) n_blocks * ARRAY_VALUE_SIZE < size) {
+    type = CONTAINER_ARRAY;
+    size = (size_t) n_blocks * ARRAY_VALUE_SIZE;
+  }
+
+  void* data = malloc(size);
+  if (data == NULL)
+    return false;
+
+  uint16_t* values = data;
+  if (type == CONTAINER_BITMAP) {
+    memcpy(data, words, BITMAP_SIZE);
+  } else if (type == CONTAINER_ARRAY) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+      for (uint64_t word = words[i]; word != 0; word &= word - 1)
+        values[n++] = (uint16_t) (64 * i + lowest_bit(word));
+    }
+  } else {
+    uint32_t pos = 0, start = 0, end;
+    for (uint32_t n = 0; n < n_runs; n++) {
+      // Each run begins with a set bit, so the search cannot fail.
+      bool found = words_next(words, pos, true, &start);
+      assert(found);
+      (void) found;
+      if (!words_next(words, start, false, &end))
+        end = BTOEP_BITMAP_CHUNK_SIZE;
+      values[2 * n] = (uint16_t) start;
+      values[2 * n + 1] = (uint16_t) (end - start - 1);
+      pos = end;
+    }
+  }
+
+  free(container->data);
+  container->type = type;
+  container->n = (type == CONTAINER_RUN) ? n_runs : n_blocks;
+  container->data = data;
+  return true;
+}
+
+/*
+ * Operations on the whole bitmap.
+ */
+
+// Returns the position of the first container whose key is not less than key.
+static size_t find_container(const btoep_bitmap* bitmap, uint64_t key) {
+  size_t low = 0, high = bitmap->n_containers;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (bitmap->containers[mid].key < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static bool insert_container(btoep_bitmap* bitmap, size_t i, uint64_t key) {
+  if (bitmap->n_containers == bitmap->capacity) {
+    size_t capacity = (bitmap->capacity == 0) ? 16 : 2 * bitmap->capacity;
+    if (capacity > SIZE_MAX / sizeof(btoep_bitmap_container))
+      return false;
+    btoep_bitmap_container* containers =
+        realloc(bitmap->containers, capacity * sizeof(btoep_bitmap_container));
+    if (containers == NULL)
+      return false;
+    bitmap->containers = containers;
+    bitmap->capacity = capacity;
+  }
+
+  memmove(bitmap->containers + i + 1, bitmap->containers + i,
+          (bitmap->n_containers - i) * sizeof(btoep_bitmap_container));
+  bitmap->containers[i].key = key;
+  bitmap->containers[i].type = CONTAINER_ARRAY;
+  bitmap->containers[i].n = 0;
+  bitmap->containers[i].data = NULL;
+  bitmap->n_containers++;
+  return true;
+}
+
+static void remove_container(btoep_bitmap* bitmap, size_t i) {
+  bitmap->data_size -= container_data_size(&bitmap->containers[i]);
+  free(bitmap->containers[i].data);
+  memmove(bitmap->containers + i, bitmap->containers + i + 1,
+          (bitmap->n_containers - i - 1) * sizeof(btoep_bitmap_container));
+  bitmap->n_containers--;
+}
+
+void btoep_bitmap_init(btoep_bitmap* bitmap) {
+  bitmap->containers = NULL;
+  bitmap->n_containers = 0;
+  bitmap->capacity = 0;
+  bitmap->data_size = 0;
+}
+
+void btoep_bitmap_free(btoep_bitmap* bitmap) {
+  for (size_t i = 0; i < bitmap->n_containers; i++)
+    free(bitmap->containers[i].data);
+  free(bitmap->containers);
+  btoep_bitmap_init(bitmap);
+}
+
+bool btoep_bitmap_set(btoep_bitmap* bitmap, uint64_t first, uint64_t n,
+                      bool value) {
+  while (n != 0) {
+    uint64_t key = first >> BTOEP_BITMAP_CHUNK_BITS;
+    uint32_t pos = first & CHUNK_MASK;
+    uint32_t count = BTOEP_BITMAP_CHUNK_SIZE - pos;
+    if (count > n)
+      count = (uint32_t) n;
+
+    size_t i = find_container(bitmap, key);
+    bool exists = i < bitmap->n_containers && bitmap->containers[i].key == key;
+    if (!value && count == BTOEP_BITMAP_CHUNK_SIZE) {
+      if (exists)
+        remove_container(bitmap, i);
+    } else if (value && count == BTOEP_BITMAP_CHUNK_SIZE) {
+      // Complete chunks are common and consist of a single run.
+      uint16_t* run = malloc(RUN_SIZE);
+      if (run == NULL || (!exists && !insert_container(bitmap, i, key))) {
+        free(run);
+        return false;
+      }
+      run[0] = 0;
+      run[1] = CHUNK_MASK;
+      btoep_bitmap_container* container = &bitmap->containers[i];
+      bitmap->data_size += RUN_SIZE - container_data_size(container);
+      free(container->data);
+      container->type = CONTAINER_RUN;
+      container->n = 1;
+      container->data = run;
+    } else if (exists || value) {
+      uint64_t words[CHUNK_WORDS];
+      if (exists)
+        container_to_words(&bitmap->containers[i], words);
+      else
+        memset(words, 0, sizeof(words));
+      words_set(words, pos, count, value);
+
+      uint32_t unused;
+      if (!words_next(words, 0, true, &unused)) {
+        remove_container(bitmap, i);
+      } else {
+        if (!exists && !insert_container(bitmap, i, key))
+          return false;
+        btoep_bitmap_container* container = &bitmap->containers[i];
+        size_t old_size = container_data_size(container);
+        if (!container_from_words(container, words)) {
+          if (!exists)
+            remove_container(bitmap, i);
+          return false;
+        }
+        bitmap->data_size += container_data_size(container) - old_size;
+      }
+    }
+
+    first += count;
+    n -= count;
+  }
+
+  return true;
+}
+
+bool btoep_bitmap_contains(const btoep_bitmap* bitmap, uint64_t block) {
+  uint64_t key = block >> BTOEP_BITMAP_CHUNK_BITS;
+  size_t i = find_container(bitmap, key);
+  return i < bitmap->n_containers && bitmap->containers[i].key == key &&
+         container_contains(&bitmap->containers[i], block & CHUNK_MASK);
+}
+
+bool btoep_bitmap_next(const btoep_bitmap* bitmap, uint64_t block, bool value,
+                       uint64_t* result) {
+  uint64_t key = block >> BTOEP_BITMAP_CHUNK_BITS;
+  uint32_t pos = block & CHUNK_MASK, found;
+  size_t i = find_container(bitmap, key);
+
+  if (value) {
+    for (; i < bitmap->n_containers; i++) {
+      const btoep_bitmap_container* container = &bitmap->containers[i];
+      if (container_next(container, (container->key == key) ? pos : 0, true,
+                         &found)) {
+        *result = (container->key << BTOEP_BITMAP_CHUNK_BITS) | found;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Chunks without a container do not contain any blocks.
+  for (;;) {
+    if (i == bitmap->n_containers || bitmap->containers[i].key != key) {
+      *result = (key << BTOEP_BITMAP_CHUNK_BITS) | pos;
+      return true;
+    }
+    if (container_next(&bitmap->containers[i], pos, false, &found)) {
+      *result = (key << BTOEP_BITMAP_CHUNK_BITS) | found;
+      return true;
+    }
+    if (key == UINT64_MAX >> BTOEP_BITMAP_CHUNK_BITS)
+      return false;
+    i++;
+    key++;
+    pos = 0;
+  }
+}
+
+bool btoep_bitmap_prev(const btoep_bitmap* bitmap, uint64_t block, bool value,
+                       uint64_t* result) {
+  uint64_t key = block >> BTOEP_BITMAP_CHUNK_BITS;
+  uint32_t pos = block & CHUNK_MASK, found;
+  // Number of containers whose key is less than or equal to key.
+  size_t i = find_container(bitmap, key + 1);
+
+  if (value) {
+    while (i-- > 0) {
+      const btoep_bitmap_container* container = &bitmap->containers[i];
+      if (container_prev(container, (container->key == key) ? pos : CHUNK_MASK,
+                         true, &found)) {
+        *result = (container->key << BTOEP_BITMAP_CHUNK_BITS) | found;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  for (;;) {
+    if (i == 0 || bitmap->containers[i - 1].key != key) {
+      *result = (key << BTOEP_BITMAP_CHUNK_BITS) | pos;
+      return true;
+    }
+    if (container_prev(&bitmap->containers[i - 1], pos, false, &found)) {
+      *result = (key << BTOEP_BITMAP_CHUNK_BITS) | found;
+      return true;
+    }
+    if (key == 0)
+      return false;
+    i--;
+    key--;
+    pos = CHUNK_MASK;
+  }
+}
+
+size_t btoep_bitmap_memory_usage(const btoep_bitmap* bitmap) {
+  return bitmap->capacity * sizeof(btoep_bitmap_container) + bitmap->data_size;
+}
@@ -0,0 +1,72 @@
+#ifndef __BTOEP__BITMAP_H__
+#define __BTOEP__BITMAP_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A compressed set of block numbers, in the style of roaring bitmaps. Block
+ * numbers are split into chunks of BTOEP_BITMAP_CHUNK_SIZE blocks, and each
+ * chunk that contains at least one block is stored in a container of one of
+ * three types, whichever is smallest:
+ *
+ *  - a sorted array of 16-bit block numbers, for sparse chunks,
+ *  - a plain bitmap of BTOEP_BITMAP_CHUNK_SIZE bits, for dense chunks,
+ *  - a sorted array of runs of consecutive blocks, for mostly contiguous ones.
+ *
+ * Looking up a single block only involves one container, and the memory usage
+ * of each container is bounded by the size of a plain bitmap.
+ */
+
+#define BTOEP_BITMAP_CHUNK_BITS 16
+#define BTOEP_BITMAP_CHUNK_SIZE (1 << BTOEP_BITMAP_CHUNK_BITS)
+
+typedef struct {
+  uint64_t key;
+  uint8_t type;
+  // Number of blocks (array and bitmap containers) or runs (run containers).
+  uint32_t n;
+  void* data;
+} btoep_bitmap_container;
+
+typedef struct btoep_bitmap {
+  btoep_bitmap_container* containers;
+  size_t n_containers;
+  size_t capacity;
+  // Total size of the data of all containers.
+  size_t data_size;
+} btoep_bitmap;
+
+void btoep_bitmap_init(btoep_bitmap* bitmap);
+
+void btoep_bitmap_free(btoep_bitmap* bitmap);
+
+/*
+ * Adds or removes the blocks [first, first + n). This returns false if memory
+ * cannot be allocated, in which case the bitmap might only be partially
+ * modified.
+ */
+bool btoep_bitmap_set(btoep_bitmap* bitmap, uint64_t first, uint64_t n,
+                      bool value);
+
+bool btoep_bitmap_contains(const btoep_bitmap* bitmap, uint64_t block);
+
+/*
+ * Finds the first block after or at the given block that is (value = true) or
+ * is not (value = false) contained in the bitmap.
+ */
+bool btoep_bitmap_next(const btoep_bitmap* bitmap, uint64_t block, bool value,
+                       uint64_t* result);
+
+/*
+ * Finds the last block before or at the given block that is (value = true) or
+ * is not (value = false) contained in the bitmap.
+ */
+bool btoep_bitmap_prev(const btoep_bitmap* bitmap, uint64_t block, bool value,
+                       uint64_t* result);
+
+/* Returns the number of bytes that the bitmap occupies in memory. */
+size_t btoep_bitmap_memory_usage(const btoep_bitmap* bitmap);
+
+#endif  // __BTOEP__BITMAP_H__
@@ -0,0 +1,45 @@
+#ifndef __BTOEP__BITS_H__
+#define __BTOEP__BITS_H__
+
+#include <stdint.h>
+
+/*
+ * Bit operations on 64-bit words. The lowest and highest bit of zero are
+ * undefined.
+ */
+
+static inline unsigned lowest_bit(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(word);
+#else
+  unsigned n = 0;
+  while ((word & 1) == 0) {
+    word >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static inline unsigned highest_bit(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - __builtin_clzll(word);
+#else
+  unsigned n = 63;
+  while ((word >> 63) == 0) {
+    word <<= 1;
+    n--;
+  }
+  return n;
+#endif
+}
+
+static inline unsigned count_bits(uint64_t word) {
+  word = word - ((word >> 1) & UINT64_C(0x5555555555555555));
+  word = (word & UINT64_C(0x3333333333333333)) +
+         ((word >> 2) & UINT64_C(0x3333333333333333));
+  word = (word + (word >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+  return (unsigned) ((word * UINT64_C(0x0101010101010101)) >> 56);
+}
+
+#endif  // __BTOEP__BITS_H__
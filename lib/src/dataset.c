@@ -1,3 +1,8 @@
+#ifdef __linux__
+// Required for splice and copy_file_range.
+# define _GNU_SOURCE
+#endif
+
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -6,15 +11,27 @@
 #include <string.h>
 
 #include "../include/btoep/dataset.h"
+#include "../include/btoep/stream.h"
+#include "atomic.h"
+#include "bitmap.h"
+#include "mutex.h"
+#include "uleb128.h"
 
 #ifndef _MSC_VER
 # include <errno.h>
+# include <limits.h>
 # include <sys/types.h>
 # include <sys/stat.h>
+# include <sys/uio.h>
 # include <fcntl.h>
+# include <sys/mman.h>
 # include <unistd.h>
 #endif
 
+#ifdef __linux__
+# include <sys/sendfile.h>
+#endif
+
 static bool set_last_error_info(btoep_dataset* dataset, int error_code,
                                 const char* func, bool system_error,
                                 const char* system_func) {
@@ -30,6 +47,7 @@ static bool set_last_error_info(btoep_dataset* dataset, int error_code,
     dataset->last_error.system_error_code = 0;
   }
   dataset->last_error.system_func = system_func;
+  dataset->last_error.conflict_offset = 0;
   return false;
 }
 
@@ -37,6 +55,8 @@ static bool set_last_error_info(btoep_dataset* dataset, int error_code,
   set_last_error_info(dataset, error, __func__, false, NULL)
 #define set_io_error(dataset, system_func) \
   set_last_error_info(dataset, B_ERR_INPUT_OUTPUT, __func__, true, system_func)
+#define set_system_error(dataset, error, system_func) \
+  set_last_error_info(dataset, error, __func__, true, system_func)
 
 static bool fd_open(btoep_dataset* dataset, btoep_fd* fd, btoep_path path,
                     int mode) {
@@ -128,6 +148,48 @@ static bool fd_truncate(btoep_dataset* dataset, btoep_fd fd, uint64_t size) {
   return true;
 }
 
+/*
+ * Allocates storage for the first size bytes of the file, without changing any
+ * existing data. This does not reduce the size of the file, except on Windows,
+ * where it may truncate the file to the given size. File systems that cannot
+ * allocate storage in advance cause B_ERR_CANNOT_PREALLOCATE.
+ */
+static bool fd_preallocate(btoep_dataset* dataset, btoep_fd fd, uint64_t size) {
+#ifdef _MSC_VER
+  FILE_ALLOCATION_INFO info = { .AllocationSize = { .QuadPart = size } };
+  if (!SetFileInformationByHandle(fd, FileAllocationInfo, &info, sizeof(info))) {
+    if (GetLastError() == ERROR_INVALID_PARAMETER ||
+        GetLastError() == ERROR_NOT_SUPPORTED)
+      return set_system_error(dataset, B_ERR_CANNOT_PREALLOCATE,
+                              "SetFileInformationByHandle");
+    return set_io_error(dataset, "SetFileInformationByHandle");
+  }
+#elif defined(__linux__)
+  // Unlike posix_fallocate, this never falls back to writing zeros.
+  if (size != 0 && fallocate(fd, 0, 0, (off_t) size) != 0) {
+    if (errno == EOPNOTSUPP || errno == ENOSYS)
+      return set_system_error(dataset, B_ERR_CANNOT_PREALLOCATE,
+                              "fallocate");
+    return set_io_error(dataset, "fallocate");
+  }
+#elif defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+  int ret = (size == 0) ? 0 : posix_fallocate(fd, 0, (off_t) size);
+  if (ret != 0) {
+    // Unlike most functions, posix_fallocate does not set errno.
+    errno = ret;
+    if (ret == EOPNOTSUPP || ret == EINVAL)
+      return set_system_error(dataset, B_ERR_CANNOT_PREALLOCATE,
+                              "posix_fallocate");
+    return set_io_error(dataset, "posix_fallocate");
+  }
+#else
+  (void) fd;
+  (void) size;
+  return set_error(dataset, B_ERR_CANNOT_PREALLOCATE);
+#endif
+  return true;
+}
+
 #ifdef _MSC_VER
 static inline DWORD limit_dword(size_t sz) {
   return (sz < MAXDWORD) ? (DWORD) sz : MAXDWORD;
@@ -137,8 +199,12 @@ static inline DWORD limit_dword(size_t sz) {
 static bool fd_read(btoep_dataset* dataset, btoep_fd fd, void* out, size_t* n_read) {
 #ifdef _MSC_VER
   DWORD count = limit_dword(*n_read);
-  if (!ReadFile(fd, out, count, &count, NULL))
-    return set_io_error(dataset, "ReadFile");
+  if (!ReadFile(fd, out, count, &count, NULL)) {
+    // This is how pipes, e.g., stdin, signal the end of the file.
+    if (GetLastError() != ERROR_BROKEN_PIPE)
+      return set_io_error(dataset, "ReadFile");
+    count = 0;
+  }
   *n_read = count;
 #else
   ssize_t ret = read(fd, out, *n_read);
@@ -150,13 +216,15 @@ static bool fd_read(btoep_dataset* dataset, btoep_fd fd, void* out, size_t* n_re
 }
 
 static bool fd_write(btoep_dataset* dataset, btoep_fd fd, const void* data, size_t length) {
-  assert(!dataset->read_only);
+  // Read-only datasets may still write to other files, see btoep_data_read_to_fd.
+  assert(!dataset->read_only ||
+         (fd != dataset->data_fd && fd != dataset->index_fd));
 
   const uint8_t* bytes = data;
   while (length > 0) {
 #ifdef _MSC_VER
     DWORD written;
-    if (!WriteFile(fd, data, limit_dword(length), &written, NULL))
+    if (!WriteFile(fd, bytes, limit_dword(length), &written, NULL))
       return set_io_error(dataset, "WriteFile");
 #else
     ssize_t written = write(fd, bytes, length);
@@ -170,6 +238,142 @@ static bool fd_write(btoep_dataset* dataset, btoep_fd fd, const void* data, size
   return true;
 }
 
+/*
+ * Like fd_read and fd_write, but these operate at the given offset, and neither
+ * uses nor changes the file position. This allows multiple threads to use the
+ * same file at the same time. On Windows, the file position does change, but
+ * it is never used for files that are accessed this way.
+ */
+
+static bool fd_pread(btoep_dataset* dataset, btoep_fd fd, uint64_t offset,
+                     void* out, size_t* n_read) {
+#ifdef _MSC_VER
+  OVERLAPPED overlapped = {
+    .Offset = (DWORD) offset,
+    .OffsetHigh = (DWORD) (offset >> 32)
+  };
+  DWORD count = limit_dword(*n_read);
+  if (!ReadFile(fd, out, count, &count, &overlapped)) {
+    // Reading at or beyond the end of the file is not an error.
+    if (GetLastError() != ERROR_HANDLE_EOF)
+      return set_io_error(dataset, "ReadFile");
+    count = 0;
+  }
+  *n_read = count;
+#else
+  ssize_t ret = pread(fd, out, *n_read, (off_t) offset);
+  if (ret == -1)
+    return set_io_error(dataset, "pread");
+  *n_read = ret;
+#endif
+  return true;
+}
+
+static bool fd_pwrite(btoep_dataset* dataset, btoep_fd fd, uint64_t offset,
+                      const void* data, size_t length) {
+  assert(!dataset->read_only);
+
+  const uint8_t* bytes = data;
+  while (length > 0) {
+#ifdef _MSC_VER
+    OVERLAPPED overlapped = {
+      .Offset = (DWORD) offset,
+      .OffsetHigh = (DWORD) (offset >> 32)
+    };
+    DWORD written;
+    if (!WriteFile(fd, bytes, limit_dword(length), &written, &overlapped))
+      return set_io_error(dataset, "WriteFile");
+#else
+    ssize_t written = pwrite(fd, bytes, length, (off_t) offset);
+    if (written == -1)
+      return set_io_error(dataset, "pwrite");
+    assert(written >= 0 && (size_t) written <= length);
+#endif
+    bytes += written;
+    offset += written;
+    length -= written;
+  }
+  return true;
+}
+
+#ifdef _MSC_VER
+typedef struct {
+  void* iov_base;
+  size_t iov_len;
+} data_iovec;
+#else
+typedef struct iovec data_iovec;
+#endif
+
+/*
+ * Like fd_pread and fd_pwrite, but these process multiple buffers with a single
+ * system call, and may process fewer bytes than requested, including only part
+ * of a buffer. Windows does not have an equivalent that works with arbitrary
+ * buffers, so only the first buffer is processed there.
+ */
+
+#ifndef _MSC_VER
+static int max_iov(size_t n) {
+  // glibc only defines IOV_MAX for X/Open applications.
+#ifdef IOV_MAX
+  long limit = IOV_MAX;
+#else
+  long limit = sysconf(_SC_IOV_MAX);
+  if (limit <= 0)
+    limit = 16;
+#endif
+  return (n > (size_t) limit) ? (int) limit : (int) n;
+}
+#endif
+
+static bool fd_preadv(btoep_dataset* dataset, btoep_fd fd, uint64_t offset,
+                      const data_iovec* iov, size_t n, size_t* n_read) {
+  assert(n != 0);
+#ifndef _MSC_VER
+  if (n > 1) {
+    ssize_t ret = preadv(fd, iov, max_iov(n), (off_t) offset);
+    if (ret == -1)
+      return set_io_error(dataset, "preadv");
+    *n_read = ret;
+    return true;
+  }
+#endif
+  *n_read = iov[0].iov_len;
+  return fd_pread(dataset, fd, offset, iov[0].iov_base, n_read);
+}
+
+static bool fd_pwritev(btoep_dataset* dataset, btoep_fd fd, uint64_t offset,
+                       const data_iovec* iov, size_t n, size_t* n_written) {
+  assert(n != 0);
+#ifndef _MSC_VER
+  if (n > 1) {
+    assert(!dataset->read_only);
+    ssize_t ret = pwritev(fd, iov, max_iov(n), (off_t) offset);
+    if (ret == -1)
+      return set_io_error(dataset, "pwritev");
+    *n_written = ret;
+    return true;
+  }
+#endif
+  *n_written = iov[0].iov_len;
+  return fd_pwrite(dataset, fd, offset, iov[0].iov_base, iov[0].iov_len);
+}
+
+static bool fd_get_size(btoep_dataset* dataset, btoep_fd fd, uint64_t* size) {
+#ifdef _MSC_VER
+  LARGE_INTEGER liFileSize;
+  if (!GetFileSizeEx(fd, &liFileSize))
+    return set_io_error(dataset, "GetFileSizeEx");
+  *size = (uint64_t) liFileSize.QuadPart;
+#else
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return set_io_error(dataset, "fstat");
+  *size = (uint64_t) st.st_size;
+#endif
+  return true;
+}
+
 static bool fd_close(btoep_dataset* dataset, btoep_fd fd) {
 #ifdef _MSC_VER
   if (!CloseHandle(fd))
@@ -181,6 +385,117 @@ static bool fd_close(btoep_dataset* dataset, btoep_fd fd) {
   return true;
 }
 
+/*
+ * Unlike fd_read, this function keeps reading until either the requested number
+ * of bytes has been read or the end of the file has been reached.
+ */
+static bool fd_read_fully(btoep_dataset* dataset, btoep_fd fd, void* out, size_t* n_read) {
+  size_t total = 0;
+  while (total < *n_read) {
+    size_t n = *n_read - total;
+    if (!fd_read(dataset, fd, ((uint8_t*) out) + total, &n))
+      return false;
+    if (n == 0)
+      break;
+    total += n;
+  }
+  *n_read = total;
+  return true;
+}
+
+/*
+ * Retrieves the last modification time of a file. The unit of the returned
+ * value depends on the platform, so it should only be used for comparisons.
+ */
+static bool fd_get_mtime(btoep_dataset* dataset, btoep_fd fd, uint64_t* mtime) {
+#ifdef _MSC_VER
+  FILETIME ftLastWriteTime;
+  if (!GetFileTime(fd, NULL, NULL, &ftLastWriteTime))
+    return set_io_error(dataset, "GetFileTime");
+  *mtime = ((uint64_t) ftLastWriteTime.dwHighDateTime << 32) |
+           ftLastWriteTime.dwLowDateTime;
+#else
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return set_io_error(dataset, "fstat");
+# ifdef __APPLE__
+  *mtime = (uint64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+# else
+  *mtime = (uint64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+# endif
+#endif
+  return true;
+}
+
+static bool path_delete(btoep_dataset* dataset, btoep_path path) {
+#ifdef _MSC_VER
+  return DeleteFile(path) || set_io_error(dataset, "DeleteFile");
+#else
+  return unlink(path) == 0 || set_io_error(dataset, "unlink");
+#endif
+}
+
+/*
+ * Atomically replaces the file at path, which is open as *fd, with the file at
+ * new_path, which is open as new_fd. Either way, new_fd is consumed, and *fd
+ * refers to the file at path afterwards, which is the new file on success.
+ */
+static bool path_replace(btoep_dataset* dataset, btoep_path path, btoep_fd* fd,
+                         btoep_path new_path, btoep_fd new_fd) {
+#ifdef _MSC_VER
+  // Files cannot be replaced while they are open, so the file at path has to be
+  // opened again afterwards.
+  // TODO: Return values
+  CloseHandle(new_fd);
+  CloseHandle(*fd);
+  bool ok = ReplaceFile(path, new_path, NULL, 0, NULL, NULL) ||
+            set_io_error(dataset, "ReplaceFile");
+  return fd_open(dataset, fd, path, B_OPEN_EXISTING_READ_WRITE) && ok;
+#else
+  if (rename(new_path, path) != 0) {
+    set_io_error(dataset, "rename");
+    close(new_fd); // TODO: Return value
+    return false;
+  }
+  close(*fd); // TODO: Return value
+  *fd = new_fd;
+  return true;
+#endif
+}
+
+static inline void write_le64(uint8_t* out, uint64_t value) {
+  for (int i = 0; i < 8; i++)
+    out[i] = (uint8_t) (value >> (8 * i));
+}
+
+static inline uint64_t read_le64(const uint8_t* in) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++)
+    value |= (uint64_t) in[i] << (8 * i);
+  return value;
+}
+
+static inline void write_le32(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    out[i] = (uint8_t) (value >> (8 * i));
+}
+
+static inline uint32_t read_le32(const uint8_t* in) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++)
+    value |= (uint32_t) in[i] << (8 * i);
+  return value;
+}
+
+static inline void write_le16(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t) value;
+  out[1] = (uint8_t) (value >> 8);
+}
+
+static inline uint16_t read_le16(const uint8_t* in) {
+  return (uint16_t) (in[0] | (in[1] << 8));
+}
+
 static bool copy_path(char* out, const char* in, const char* def, const char* ext) {
   int n = (in == NULL) ? snprintf(out, OS_MAX_PATH, "%s%s", def, ext)
                        : snprintf(out, OS_MAX_PATH, "%s", in);
@@ -188,6 +503,30 @@ static bool copy_path(char* out, const char* in, const char* def, const char* ex
   return n < OS_MAX_PATH;
 }
 
+/*
+ * Ensures that the given array can hold at least length elements, and grows it
+ * exponentially if it cannot. On success, this returns the (possibly moved)
+ * array and updates the capacity. On failure, this returns NULL, and the
+ * existing array remains valid.
+ */
+static void* reserve_array(void* array, size_t* capacity, size_t length,
+                           size_t element_size) {
+  if (length <= *capacity && array != NULL)
+    return array;
+
+  size_t new_capacity = (*capacity == 0) ? 64 : *capacity;
+  while (new_capacity < length) {
+    if (new_capacity > SIZE_MAX / (2 * element_size))
+      return NULL;
+    new_capacity *= 2;
+  }
+
+  void* new_array = realloc(array, new_capacity * element_size);
+  if (new_array != NULL)
+    *capacity = new_capacity;
+  return new_array;
+}
+
 static bool btoep_lock(btoep_dataset* dataset) {
 #ifdef _MSC_VER
   HANDLE hFile = CreateFile(dataset->lock_path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -248,15 +587,129 @@ static bool open_dataset_fds(btoep_dataset* dataset, int mode) {
   return false;
 }
 
+static void index_cache_invalidate_page(btoep_index_cache_page* page);
+static bool index_paged_open(btoep_dataset* dataset, bool create);
+static void index_paged_discard(btoep_dataset* dataset);
+static void index_table_discard(btoep_dataset* dataset);
+static void index_bitmap_discard(btoep_dataset* dataset);
+static void index_checkpoints_discard(btoep_dataset* dataset);
+static bool index_journal_open(btoep_dataset* dataset, bool created);
+static bool index_journal_compact(btoep_dataset* dataset);
+
+/*
+ * Read-only datasets map the index file into memory, if possible, which allows
+ * decoding the index in place, without copying it into the index cache and
+ * without any system calls. Failing to map the file is not an error; the index
+ * cache is used instead.
+ */
+static void index_map_open(btoep_dataset* dataset) {
+  dataset->index_map = NULL;
+  dataset->index_map_size = 0;
+
+  uint64_t size = dataset->total_index_size_on_disk;
+  if (!dataset->read_only || size == 0 || size > SIZE_MAX)
+    return;
+
+#ifdef _MSC_VER
+  HANDLE handle = CreateFileMapping(dataset->index_fd, NULL, PAGE_READONLY,
+                                    0, 0, NULL);
+  if (handle == NULL)
+    return;
+  const uint8_t* map = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+  if (map == NULL) {
+    CloseHandle(handle);
+    return;
+  }
+  dataset->index_map_handle = handle;
+#else
+  const uint8_t* map = mmap(NULL, (size_t) size, PROT_READ, MAP_SHARED,
+                            dataset->index_fd, 0);
+  if (map == MAP_FAILED)
+    return;
+#endif
+
+  dataset->index_map = map;
+  dataset->index_map_size = size;
+}
+
+static void index_map_close(btoep_dataset* dataset) {
+  if (dataset->index_map == NULL)
+    return;
+
+#ifdef _MSC_VER
+  UnmapViewOfFile(dataset->index_map);
+  CloseHandle(dataset->index_map_handle);
+#else
+  munmap((void*) dataset->index_map, (size_t) dataset->index_map_size);
+#endif
+  dataset->index_map = NULL;
+}
+
+/*
+ * Unlike the index mapping, mappings of the data file are created on demand,
+ * see btoep_data_view_acquire. Failing to map the data file is an error.
+ */
+static bool data_map_open(btoep_dataset* dataset, btoep_data_map* map,
+                          uint64_t size) {
+  assert(map->address == NULL);
+  if (size > SIZE_MAX)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+
+#ifdef _MSC_VER
+  HANDLE handle = CreateFileMapping(dataset->data_fd, NULL, PAGE_READONLY,
+                                    0, 0, NULL);
+  if (handle == NULL)
+    return set_io_error(dataset, "CreateFileMapping");
+  const uint8_t* address = MapViewOfFile(handle, FILE_MAP_READ, 0, 0,
+                                         (SIZE_T) size);
+  if (address == NULL) {
+    set_io_error(dataset, "MapViewOfFile");
+    CloseHandle(handle);
+    return false;
+  }
+  map->handle = handle;
+#else
+  const uint8_t* address = mmap(NULL, (size_t) size, PROT_READ, MAP_SHARED,
+                                dataset->data_fd, 0);
+  if (address == MAP_FAILED)
+    return set_io_error(dataset, "mmap");
+#endif
+
+  map->address = address;
+  map->size = size;
+  map->n_views = 0;
+  return true;
+}
+
+static void data_map_close(btoep_data_map* map) {
+  if (map->address == NULL)
+    return;
+
+#ifdef _MSC_VER
+  UnmapViewOfFile(map->address);
+  CloseHandle(map->handle);
+#else
+  munmap((void*) map->address, (size_t) map->size);
+#endif
+  map->address = NULL;
+}
+
 bool btoep_open(btoep_dataset* dataset, btoep_path data_path,
                 btoep_path index_path, btoep_path lock_path, int mode) {
   if (dataset == NULL || data_path == NULL ||
       !copy_path(dataset->data_path, data_path, NULL, NULL) ||
       !copy_path(dataset->index_path, index_path, data_path, ".idx") ||
-      !copy_path(dataset->lock_path, lock_path, data_path, ".lck")) {
+      !copy_path(dataset->lock_path, lock_path, data_path, ".lck") ||
+      !copy_path(dataset->checkpoint_path, NULL, dataset->index_path, ".ckp") ||
+      !copy_path(dataset->journal_path, NULL, dataset->index_path, ".log") ||
+      !copy_path(dataset->changes_path, NULL, dataset->index_path, ".chg")) {
     return set_error(dataset, B_ERR_INVALID_ARGUMENT);
   }
 
+  bool create_paged_index = (mode & B_CREATE_PAGED_INDEX) != 0;
+  dataset->index_uses_journal = (mode & B_INDEX_JOURNAL) != 0;
+  mode &= ~(B_CREATE_PAGED_INDEX | B_INDEX_JOURNAL);
+
   if (!btoep_lock(dataset))
     return false;
 
@@ -279,6 +732,8 @@ bool btoep_open(btoep_dataset* dataset, btoep_path data_path,
   dataset->total_index_size = dataset->total_index_size_on_disk;
   dataset->current_index_offset = 0;
 
+  index_map_open(dataset);
+
   // This is merely to prevent iterators from being used with the wrong dataset,
   // and is a best-effort way to give different datasets very different index
   // revision counters. Shifting the random value to the left means that
@@ -286,16 +741,103 @@ bool btoep_open(btoep_dataset* dataset, btoep_path data_path,
   // collisions.
   dataset->index_rev = ((uint64_t) rand()) << (64 - 8 * sizeof(int));
 
-  dataset->index_cache_range = btoep_mkrange(0, 0);
-  dataset->index_cache_is_dirty = false;
+  for (size_t i = 0; i < BTOEP_INDEX_CACHE_PAGES; i++)
+    index_cache_invalidate_page(&dataset->index_cache[i]);
+  dataset->index_cache_clock = 0;
+  dataset->index_cache_mru = 0;
+
+  dataset->index_batch_length = 0;
+  dataset->index_batch_pos = 0;
+  dataset->index_batch_rev = dataset->index_rev - 1;
+  dataset->last_edit_rev = dataset->index_rev - 1;
+
+  dataset->index_table = NULL;
+  dataset->index_table_length = 0;
+  dataset->index_table_capacity = 0;
+  dataset->index_table_is_loaded = false;
+
+  dataset->index_bitmap = NULL;
+
+  dataset->checkpoints = NULL;
+  dataset->n_checkpoints = 0;
+  dataset->checkpoints_capacity = 0;
+  dataset->checkpoints_are_loaded = false;
+  dataset->checkpoints_are_dirty = false;
+  dataset->checkpoint_file_was_read = false;
+  dataset->checkpoints_were_scanned = false;
+
+  dataset->journal = NULL;
+  dataset->journal_length = 0;
+  dataset->journal_capacity = 0;
+  dataset->journal_n_written = 0;
+
+  dataset->changes = NULL;
+  dataset->n_changes = 0;
+  dataset->changes_capacity = 0;
+  dataset->changes_are_loaded = false;
+  dataset->changes_are_dirty = false;
+
+  for (size_t i = 0; i < BTOEP_INDEX_SNAPSHOT_SLOTS; i++) {
+    dataset->snapshot_slots[i].ranges = NULL;
+    dataset->snapshot_slots[i].capacity = 0;
+    dataset->snapshot_slots[i].n_readers = 0;
+  }
+  dataset->current_snapshot = -1;
+
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS; i++)
+    dataset->data_maps[i].address = NULL;
+  dataset->current_data_map = NULL;
+
+  if (mode == B_CREATE_NEW_READ_WRITE) {
+    // The change file of a new dataset is left over from a previous dataset.
+    // There usually is no such file, so errors are ignored.
+    btoep_last_error_info last_error = dataset->last_error;
+    path_delete(dataset, dataset->changes_path);
+    dataset->last_error = last_error;
+  }
+
+  if (!index_paged_open(dataset, create_paged_index) ||
+      !index_journal_open(dataset, mode == B_CREATE_NEW_READ_WRITE)) {
+    // TODO: Return values
+    index_table_discard(dataset);
+    index_bitmap_discard(dataset);
+    index_checkpoints_discard(dataset);
+    index_paged_discard(dataset);
+    free(dataset->journal);
+    index_map_close(dataset);
+    fd_close(dataset, dataset->data_fd);
+    fd_close(dataset, dataset->index_fd);
+    btoep_unlock(dataset);
+    return false;
+  }
 
+  mutex_init(&dataset->index_lock);
   return true;
 }
 
 bool btoep_close(btoep_dataset* dataset) {
+  if (!dataset->read_only && !index_journal_compact(dataset))
+    return false;
+
   if (!btoep_index_flush(dataset))
     return false;
 
+  index_table_discard(dataset);
+  index_bitmap_discard(dataset);
+  index_checkpoints_discard(dataset);
+  index_paged_discard(dataset);
+  free(dataset->journal);
+  free(dataset->changes);
+  for (size_t i = 0; i < BTOEP_INDEX_SNAPSHOT_SLOTS; i++)
+    free(dataset->snapshot_slots[i].ranges);
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS; i++) {
+    assert(dataset->data_maps[i].address == NULL ||
+           dataset->data_maps[i].n_views == 0);
+    data_map_close(&dataset->data_maps[i]);
+  }
+  mutex_destroy(&dataset->index_lock);
+  index_map_close(dataset);
+
   // TODO: Return values
   fd_close(dataset, dataset->data_fd);
   fd_close(dataset, dataset->index_fd);
@@ -317,6 +859,11 @@ const char* btoep_strerror(int error_code) {
   case B_ERR_READ_OUT_OF_BOUNDS:   return "Read out of bounds";
   case B_ERR_INVALID_ARGUMENT:     return "Invalid argument";
   case B_ERR_DEAD_INDEX_ITERATOR:  return "Index iterator is too old";
+  case B_ERR_OUT_OF_MEMORY:        return "Out of memory";
+  case B_ERR_SNAPSHOTS_IN_USE:     return "Too many index snapshots in use";
+  case B_ERR_NOT_PUBLISHED:        return "Index is not published";
+  case B_ERR_DATA_VIEWS_IN_USE:    return "Too many data views in use";
+  case B_ERR_CANNOT_PREALLOCATE:   return "Cannot preallocate storage";
   default:                         return NULL;
   }
 }
@@ -331,6 +878,11 @@ const char* btoep_strerror_name(int error_code) {
   case B_ERR_READ_OUT_OF_BOUNDS:   return "ERR_READ_OUT_OF_BOUNDS";
   case B_ERR_INVALID_ARGUMENT:     return "ERR_INVALID_ARGUMENT";
   case B_ERR_DEAD_INDEX_ITERATOR:  return "ERR_DEAD_INDEX_ITERATOR";
+  case B_ERR_OUT_OF_MEMORY:        return "ERR_OUT_OF_MEMORY";
+  case B_ERR_SNAPSHOTS_IN_USE:     return "ERR_SNAPSHOTS_IN_USE";
+  case B_ERR_NOT_PUBLISHED:        return "ERR_NOT_PUBLISHED";
+  case B_ERR_DATA_VIEWS_IN_USE:    return "ERR_DATA_VIEWS_IN_USE";
+  case B_ERR_CANNOT_PREALLOCATE:   return "ERR_CANNOT_PREALLOCATE";
   default:                         return NULL;
   }
 }
@@ -340,65 +892,170 @@ bool btoep_data_add_range(btoep_dataset* dataset, btoep_range range, const void*
          btoep_index_add(dataset, range);
 }
 
-bool btoep_data_write(btoep_dataset* dataset, btoep_range range, const void* data, size_t data_size, int conflict_mode) {
-  if (dataset->read_only)
-    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
+/*
+ * Ensures that the data file contains the given data at the given offset. The
+ * comparison stops at the first byte that differs, whose offset is reported
+ * as part of the error information.
+ */
+static bool data_verify(btoep_dataset* dataset, uint64_t offset,
+                        const uint8_t* data, size_t length) {
+  uint8_t buffer[64 * 1024];
+  while (length != 0) {
+    size_t n_read = (length < sizeof(buffer)) ? length : sizeof(buffer);
+    if (!fd_pread(dataset, dataset->data_fd, offset, buffer, &n_read))
+      return false;
+    // The index refers to data beyond the end of the data file.
+    if (n_read == 0)
+      return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+    // memcmp is much faster than comparing individual bytes, so the exact
+    // position is only determined once a difference has been found.
+    if (memcmp(buffer, data, n_read) != 0) {
+      size_t i = 0;
+      while (buffer[i] == data[i])
+        i++;
+      set_error(dataset, B_ERR_DATA_CONFLICT);
+      dataset->last_error.conflict_offset = offset + i;
+      return false;
+    }
+    offset += n_read;
+    data += n_read;
+    length -= n_read;
+  }
+  return true;
+}
 
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
-    return false;
+/*
+ * Reads or writes of adjacent buffers, which are collected and then processed
+ * with as few system calls as possible.
+ */
 
-  if (data_size < range.length)
-    range.length = data_size;
+#define DATA_BATCH_MAX_BUFFERS 64
 
-  btoep_range entry;
+typedef struct {
+  bool is_write;
+  uint64_t offset;
+  uint64_t length;
+  size_t n_buffers;
+  data_iovec buffers[DATA_BATCH_MAX_BUFFERS];
+} data_batch;
+
+static void data_batch_init(data_batch* batch, bool is_write) {
+  batch->is_write = is_write;
+  batch->offset = 0;
+  batch->length = 0;
+  batch->n_buffers = 0;
+}
+
+static bool data_batch_flush(btoep_dataset* dataset, data_batch* batch) {
+  data_iovec* iov = batch->buffers;
+  size_t n = batch->n_buffers;
+  uint64_t offset = batch->offset;
+  batch->n_buffers = 0;
+  batch->length = 0;
+
+  while (n != 0) {
+    size_t n_done;
+    if (batch->is_write) {
+      if (!fd_pwritev(dataset, dataset->data_fd, offset, iov, n, &n_done))
+        return false;
+    } else {
+      if (!fd_preadv(dataset, dataset->data_fd, offset, iov, n, &n_done))
+        return false;
+      // The index refers to data beyond the end of the data file.
+      if (n_done == 0)
+        return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+    }
 
-  if (!fd_seek(dataset, dataset->data_fd, range.offset, SEEK_SET, NULL))
+    // Skip the buffers that have been processed completely, and continue with
+    // the rest of the first buffer that has not.
+    offset += n_done;
+    while (n != 0 && n_done >= iov->iov_len) {
+      n_done -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n_done != 0) {
+      iov->iov_base = (uint8_t*) iov->iov_base + n_done;
+      iov->iov_len -= n_done;
+    }
+  }
+
+  return true;
+}
+
+static bool data_batch_add(btoep_dataset* dataset, data_batch* batch,
+                           uint64_t offset, const void* data, size_t length) {
+  if (length == 0)
+    return true;
+
+  if (batch->n_buffers != 0 &&
+      (offset != batch->offset + batch->length ||
+       batch->n_buffers == DATA_BATCH_MAX_BUFFERS)) {
+    if (!data_batch_flush(dataset, batch))
+      return false;
+  }
+
+  if (batch->n_buffers == 0)
+    batch->offset = offset;
+  batch->buffers[batch->n_buffers].iov_base = (void*) data;
+  batch->buffers[batch->n_buffers].iov_len = length;
+  batch->n_buffers++;
+  batch->length += length;
+  return true;
+}
+
+/*
+ * Writes a single range like btoep_data_write, except that the data that needs
+ * to be written is only added to the given batch. The iterator must not be
+ * positioned after the given range.
+ */
+static bool data_write_range(btoep_dataset* dataset,
+                             btoep_index_iterator* iterator, data_batch* batch,
+                             btoep_range range, const uint8_t* remaining_data,
+                             int conflict_mode) {
+  if (!btoep_index_iterator_seek(iterator, range.offset))
     return false;
 
-  const uint8_t* remaining_data = data;
+  btoep_range entry;
+
   while (range.length != 0) {
     // Try to find an index entry that covers at least some area after the start
     // of the remaining data.
-    while (!btoep_index_iterator_is_eof(&iterator)) {
-      if (!btoep_index_iterator_peek(&iterator, &entry))
+    while (!btoep_index_iterator_is_eof(iterator)) {
+      if (!btoep_index_iterator_peek(iterator, &entry))
         return false;
       if (btoep_range_intersect(&entry, range))
         break;
-      if (!btoep_index_iterator_skip(&iterator))
+      if (!btoep_index_iterator_skip(iterator))
         return false;
     }
 
     // If no entry exists, we can write the rest of the data.
     // If an entry exists, we can write up to the entry.
     uint64_t safe_length = range.length;
-    if (!btoep_index_iterator_is_eof(&iterator))
+    if (!btoep_index_iterator_is_eof(iterator))
       safe_length = entry.offset - range.offset;
 
-    if (!fd_write(dataset, dataset->data_fd, remaining_data, safe_length))
+    if (!data_batch_add(dataset, batch, range.offset, remaining_data,
+                        safe_length))
       return false;
 
     range = btoep_range_remove_left(range, safe_length);
     remaining_data += safe_length;
 
-    if (!btoep_index_iterator_is_eof(&iterator)) {
+    if (!btoep_index_iterator_is_eof(iterator)) {
       // This is existing data.
       if (conflict_mode == BTOEP_CONFLICT_KEEP_OLD) {
         // Simply ignore the data and skip ahead.
         // TODO: Fail if the data does not exist because the file is too short?
-        if (!fd_seek(dataset, dataset->data_fd, entry.length, SEEK_CUR, NULL))
-          return false;
       } else if (conflict_mode == BTOEP_CONFLICT_ERROR) {
         // Ensure the data is the same.
-        uint8_t buf[8 * 1024];
-        size_t n_read = entry.length; // TODO: Loop etc.
-        if (!fd_read(dataset, dataset->data_fd, buf, &n_read))
+        if (!data_verify(dataset, entry.offset, remaining_data, entry.length))
           return false;
-        if (memcmp(buf, remaining_data, n_read) != 0)
-          return set_error(dataset, B_ERR_DATA_CONFLICT);
       } else {
         assert(conflict_mode == BTOEP_CONFLICT_OVERWRITE);
-        if (!fd_write(dataset, dataset->data_fd, remaining_data, entry.length))
+        if (!data_batch_add(dataset, batch, entry.offset, remaining_data,
+                            entry.length))
           return false;
       }
       range = btoep_range_remove_left(range, entry.length);
@@ -411,10 +1068,57 @@ bool btoep_data_write(btoep_dataset* dataset, btoep_range range, const void* dat
   return true;
 }
 
+bool btoep_data_write(btoep_dataset* dataset, btoep_range range, const void* data, size_t data_size, int conflict_mode) {
+  if (dataset->read_only)
+    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
+
+  if (data_size < range.length)
+    range.length = data_size;
+
+  btoep_index_iterator iterator;
+  data_batch batch;
+  data_batch_init(&batch, true);
+  return btoep_index_iterator_start(dataset, &iterator) &&
+         data_write_range(dataset, &iterator, &batch, range, data,
+                          conflict_mode) &&
+         data_batch_flush(dataset, &batch);
+}
+
+bool btoep_data_writev(btoep_dataset* dataset, const btoep_range* ranges,
+                       const void* const* data, size_t n_ranges,
+                       int conflict_mode) {
+  if (dataset->read_only)
+    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
+
+  for (size_t i = 1; i < n_ranges; i++) {
+    if (ranges[i].offset < ranges[i - 1].offset + ranges[i - 1].length)
+      return set_error(dataset, B_ERR_INVALID_ARGUMENT);
+  }
+
+  btoep_index_iterator iterator;
+  data_batch batch;
+  data_batch_init(&batch, true);
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+  for (size_t i = 0; i < n_ranges; i++) {
+    if (!data_write_range(dataset, &iterator, &batch, ranges[i], data[i],
+                          conflict_mode))
+      return false;
+  }
+  return data_batch_flush(dataset, &batch);
+}
+
 bool btoep_data_read_range(btoep_dataset* dataset, btoep_range range, void* data, size_t* data_size) {
-  // First, ensure that the given range exists.
+  // First, ensure that the given range exists. Index queries use shared state,
+  // so concurrent calls take turns, but reading the data does not require the
+  // lock.
   bool valid;
-  if (!btoep_index_contains(dataset, range, &valid))
+  if (dataset->read_only)
+    mutex_lock(&dataset->index_lock);
+  bool ok = btoep_index_contains(dataset, range, &valid);
+  if (dataset->read_only)
+    mutex_unlock(&dataset->index_lock);
+  if (!ok)
     return false;
   if (!valid)
     return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
@@ -425,11 +1129,15 @@ bool btoep_data_read_range(btoep_dataset* dataset, btoep_range range, void* data
     *data_size = range.length;
   }
 
+  // The index has been validated, so the size of the data file does not need
+  // to be checked before each read.
   while (range.length != 0) {
     size_t n_read = range.length;
-    if (!btoep_data_read(dataset, range.offset, data, &n_read))
+    if (!fd_pread(dataset, dataset->data_fd, range.offset, data, &n_read))
       return false;
-    assert(n_read != 0);
+    // The index refers to data beyond the end of the data file.
+    if (n_read == 0)
+      return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
     range = btoep_range_remove_left(range, n_read);
     data = ((uint8_t*) data) + n_read;
   }
@@ -437,33 +1145,300 @@ bool btoep_data_read_range(btoep_dataset* dataset, btoep_range range, void* data
   return true;
 }
 
+/*
+ * Checks that all given ranges exist in a single pass over the index. The
+ * ranges must be sorted by their offsets.
+ */
+static bool data_ranges_exist(btoep_dataset* dataset, const btoep_range* ranges,
+                              size_t n_ranges, bool* valid) {
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+
+  *valid = true;
+  for (size_t i = 0; i < n_ranges && *valid; i++) {
+    btoep_range range = ranges[i];
+    if (i != 0 && range.offset < ranges[i - 1].offset)
+      return set_error(dataset, B_ERR_INVALID_ARGUMENT);
+
+    if (range.length == 0) {
+      if (!btoep_index_contains(dataset, range, valid))
+        return false;
+    } else {
+      // Only the first entry that ends after the offset can contain the range.
+      btoep_range entry;
+      if (!btoep_index_iterator_seek(&iterator, range.offset))
+        return false;
+      *valid = !btoep_index_iterator_is_eof(&iterator);
+      if (*valid) {
+        if (!btoep_index_iterator_peek(&iterator, &entry))
+          return false;
+        *valid = btoep_range_is_subset(entry, range);
+      }
+    }
+  }
+
+  return true;
+}
+
+bool btoep_data_readv(btoep_dataset* dataset, const btoep_range* ranges,
+                      void* const* data, size_t n_ranges) {
+  // As in btoep_data_read_range, only the index queries require the lock.
+  bool valid;
+  if (dataset->read_only)
+    mutex_lock(&dataset->index_lock);
+  bool ok = data_ranges_exist(dataset, ranges, n_ranges, &valid);
+  if (dataset->read_only)
+    mutex_unlock(&dataset->index_lock);
+  if (!ok)
+    return false;
+  if (!valid)
+    return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+
+  data_batch batch;
+  data_batch_init(&batch, false);
+  for (size_t i = 0; i < n_ranges; i++) {
+    if (ranges[i].length > SIZE_MAX)
+      return set_error(dataset, B_ERR_INVALID_ARGUMENT);
+    if (!data_batch_add(dataset, &batch, ranges[i].offset, data[i],
+                        (size_t) ranges[i].length))
+      return false;
+  }
+  return data_batch_flush(dataset, &batch);
+}
+
+#ifdef __linux__
+/*
+ * Ways of moving data from the data file to another file within the kernel, in
+ * the order in which they are attempted. Not all file systems and file types
+ * support each of them, and the last resort is to read and write the data.
+ */
+#define DATA_TRANSFER_COPY_FILE_RANGE 0
+#define DATA_TRANSFER_SPLICE          1
+#define DATA_TRANSFER_SENDFILE        2
+#define DATA_TRANSFER_BUFFERED        3
+
+// Linux never transfers more than this many bytes at once anyway.
+#define DATA_TRANSFER_MAX_LENGTH      0x7ffff000
+
+static int data_transfer_method(btoep_fd fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return DATA_TRANSFER_SENDFILE;
+  if (S_ISREG(st.st_mode))
+    return DATA_TRANSFER_COPY_FILE_RANGE;
+  if (S_ISFIFO(st.st_mode))
+    return DATA_TRANSFER_SPLICE;
+  return DATA_TRANSFER_SENDFILE;
+}
+
+static bool is_unsupported_transfer(int error) {
+  return error == EINVAL || error == ENOSYS || error == EXDEV ||
+         error == EOPNOTSUPP || error == EBADF;
+}
+#endif
+
+bool btoep_data_read_to_fd(btoep_dataset* dataset, btoep_range range,
+                           btoep_fd fd) {
+  // As in btoep_data_read_range, only the index query requires the lock.
+  bool valid;
+  if (dataset->read_only)
+    mutex_lock(&dataset->index_lock);
+  bool ok = btoep_index_contains(dataset, range, &valid);
+  if (dataset->read_only)
+    mutex_unlock(&dataset->index_lock);
+  if (!ok)
+    return false;
+  if (!valid)
+    return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+
+#ifdef __linux__
+  int method = data_transfer_method(fd);
+  while (range.length != 0 && method != DATA_TRANSFER_BUFFERED) {
+    size_t length = (range.length < DATA_TRANSFER_MAX_LENGTH) ?
+                    (size_t) range.length : DATA_TRANSFER_MAX_LENGTH;
+    loff_t offset = (loff_t) range.offset;
+    off_t sendfile_offset = (off_t) range.offset;
+    const char* func;
+    ssize_t ret;
+    if (method == DATA_TRANSFER_COPY_FILE_RANGE) {
+      func = "copy_file_range";
+      ret = copy_file_range(dataset->data_fd, &offset, fd, NULL, length, 0);
+    } else if (method == DATA_TRANSFER_SPLICE) {
+      func = "splice";
+      ret = splice(dataset->data_fd, &offset, fd, NULL, length, SPLICE_F_MOVE);
+    } else {
+      func = "sendfile";
+      ret = sendfile(fd, dataset->data_fd, &sendfile_offset, length);
+    }
+
+    if (ret == -1) {
+      if (!is_unsupported_transfer(errno))
+        return set_io_error(dataset, func);
+      // Nothing has been written, so another method can take over.
+      method = (method == DATA_TRANSFER_SENDFILE) ? DATA_TRANSFER_BUFFERED :
+                                                    DATA_TRANSFER_SENDFILE;
+    } else if (ret == 0) {
+      // The index refers to data beyond the end of the data file.
+      return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+    } else {
+      range = btoep_range_remove_left(range, (uint64_t) ret);
+    }
+  }
+#endif
+
+  uint8_t buffer[64 * 1024];
+  while (range.length != 0) {
+    size_t n_read = (range.length < sizeof(buffer)) ?
+                    (size_t) range.length : sizeof(buffer);
+    if (!fd_pread(dataset, dataset->data_fd, range.offset, buffer, &n_read))
+      return false;
+    if (n_read == 0)
+      return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+    if (!fd_write(dataset, fd, buffer, n_read))
+      return false;
+    range = btoep_range_remove_left(range, n_read);
+  }
+
+  return true;
+}
+
+/*
+ * Moves up to max_length bytes from the source file into the data file at the
+ * given offset, and sets n_written to the number of bytes that were moved,
+ * which is zero only at the end of the source file. On Linux, this happens
+ * within the kernel, if the file types permit it, and method is updated if the
+ * kernel does not support the current method.
+ */
+static bool data_write_from_source(btoep_dataset* dataset, btoep_fd fd,
+                                   int* method, uint64_t offset,
+                                   uint64_t max_length, uint8_t* buffer,
+                                   size_t buffer_size, size_t* n_written) {
+#ifdef __linux__
+  while (*method != DATA_TRANSFER_BUFFERED) {
+    size_t length = (max_length < DATA_TRANSFER_MAX_LENGTH) ?
+                    (size_t) max_length : DATA_TRANSFER_MAX_LENGTH;
+    loff_t data_offset = (loff_t) offset;
+    const char* func;
+    ssize_t ret;
+    if (*method == DATA_TRANSFER_COPY_FILE_RANGE) {
+      // This reads from the current position within the source file.
+      func = "copy_file_range";
+      ret = copy_file_range(fd, NULL, dataset->data_fd, &data_offset, length, 0);
+    } else {
+      assert(*method == DATA_TRANSFER_SPLICE);
+      func = "splice";
+      ret = splice(fd, NULL, dataset->data_fd, &data_offset, length,
+                   SPLICE_F_MOVE);
+    }
+
+    if (ret != -1) {
+      *n_written = (size_t) ret;
+      return true;
+    }
+    if (!is_unsupported_transfer(errno))
+      return set_io_error(dataset, func);
+    // Nothing has been read, so reading and writing can take over.
+    *method = DATA_TRANSFER_BUFFERED;
+  }
+#else
+  (void) method;
+#endif
+
+  size_t n_read = (max_length < buffer_size) ? (size_t) max_length : buffer_size;
+  if (!fd_read(dataset, fd, buffer, &n_read) ||
+      !fd_pwrite(dataset, dataset->data_fd, offset, buffer, n_read))
+    return false;
+  *n_written = n_read;
+  return true;
+}
+
+bool btoep_data_write_from_fd(btoep_dataset* dataset, uint64_t offset,
+                              btoep_fd fd, int conflict_mode,
+                              uint64_t* length) {
+  *length = 0;
+  if (dataset->read_only)
+    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
+
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+
+#ifdef __linux__
+  // Sockets and other files can only be read.
+  int method = data_transfer_method(fd);
+  if (method == DATA_TRANSFER_SENDFILE)
+    method = DATA_TRANSFER_BUFFERED;
+#else
+  int method = 0;
+#endif
+
+  uint8_t buffer[64 * 1024];
+  for (;;) {
+    // The iterator only moves forward, so the index is only scanned once.
+    uint64_t pos = offset + *length;
+    if (!btoep_index_iterator_seek(&iterator, pos))
+      return false;
+
+    // Find the end of the data or the gap at the current position.
+    bool is_existing = false;
+    uint64_t max_length = (uint64_t) -1 - pos;
+    if (!btoep_index_iterator_is_eof(&iterator)) {
+      btoep_range entry;
+      if (!btoep_index_iterator_peek(&iterator, &entry))
+        return false;
+      is_existing = entry.offset <= pos;
+      max_length = is_existing ? entry.offset + entry.length - pos :
+                                 entry.offset - pos;
+    }
+
+    size_t n;
+    if (!is_existing || conflict_mode == BTOEP_CONFLICT_OVERWRITE) {
+      if (!data_write_from_source(dataset, fd, &method, pos, max_length, buffer,
+                                  sizeof(buffer), &n))
+        return false;
+    } else {
+      // Existing data is either ignored or compared to the new data.
+      n = (max_length < sizeof(buffer)) ? (size_t) max_length : sizeof(buffer);
+      if (!fd_read(dataset, fd, buffer, &n))
+        return false;
+      if (conflict_mode == BTOEP_CONFLICT_ERROR &&
+          !data_verify(dataset, pos, buffer, n))
+        return false;
+    }
+
+    if (n == 0)
+      return true;
+    *length += n;
+  }
+}
+
 bool btoep_data_read(btoep_dataset* dataset, uint64_t offset, void* data, size_t* length) {
   uint64_t size;
   if (!btoep_data_get_size(dataset, &size))
     return false;
   if (offset > size)
     return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
-  if (!fd_seek(dataset, dataset->data_fd, offset, SEEK_SET, NULL))
-    return false;
-  return fd_read(dataset, dataset->data_fd, data, length);
+  return fd_pread(dataset, dataset->data_fd, offset, data, length);
 }
 
 bool btoep_data_get_size(btoep_dataset* dataset, uint64_t* size) {
-  return fd_seek(dataset, dataset->data_fd, 0, SEEK_END, size);
+  return fd_get_size(dataset, dataset->data_fd, size);
 }
 
-bool btoep_data_set_size(btoep_dataset* dataset, uint64_t size, bool allow_destructive) {
+bool btoep_data_set_size(btoep_dataset* dataset, uint64_t size, int flags) {
   if (dataset->read_only)
     return set_error(dataset, B_ERR_DATASET_READ_ONLY);
 
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS; i++) {
+    btoep_data_map* map = &dataset->data_maps[i];
+    if (map->address != NULL && map->n_views != 0 && map->size > size)
+      return set_error(dataset, B_ERR_DATA_VIEWS_IN_USE);
+  }
+
   btoep_range relevant_range = btoep_max_range_from(size);
 
-  if (allow_destructive) {
-    // This might not actually remove anything from the index, in which case the
-    // action was not destructive.
-    if (!btoep_index_remove(dataset, relevant_range))
-      return false;
-  } else {
+  if (!(flags & BTOEP_SIZE_ALLOW_DESTRUCTIVE)) {
     bool is_destructive;
     if (!btoep_index_contains_any(dataset, relevant_range, &is_destructive))
       return false;
@@ -471,35 +1446,134 @@ bool btoep_data_set_size(btoep_dataset* dataset, uint64_t size, bool allow_destr
       return set_error(dataset, B_ERR_SIZE_TOO_SMALL);
   }
 
+  // Preallocating before anything else ensures that neither the index nor the
+  // size changes if it fails. Only storage beyond the end of the file needs to
+  // be allocated, and on Windows, allocating less than the size of the file
+  // would truncate it.
+  if (flags & BTOEP_SIZE_PREALLOCATE) {
+    uint64_t current_size;
+    if (!btoep_data_get_size(dataset, &current_size) ||
+        (size > current_size && !fd_preallocate(dataset, dataset->data_fd, size)))
+      return false;
+  }
+
+  // This might not actually remove anything from the index, in which case the
+  // action was not destructive.
+  if ((flags & BTOEP_SIZE_ALLOW_DESTRUCTIVE) &&
+      !btoep_index_remove(dataset, relevant_range))
+    return false;
+
+  // Accessing a mapping beyond the end of the file is an error, and Windows
+  // does not permit truncating mapped files at all.
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS; i++) {
+    btoep_data_map* map = &dataset->data_maps[i];
+    if (map->address != NULL && map->size > size) {
+      assert(map->n_views == 0);
+      data_map_close(map);
+      if (map == dataset->current_data_map)
+        dataset->current_data_map = NULL;
+    }
+  }
+
   return fd_truncate(dataset, dataset->data_fd, size);
 }
 
-static void btoep_index_cache_mark_dirty(btoep_dataset* dataset, btoep_range range) {
-  if (dataset->index_cache_is_dirty) {
-    dataset->index_cache_dirty_range =
-        btoep_range_outer(dataset->index_cache_dirty_range, range);
-  } else {
-    dataset->index_cache_is_dirty = true;
-    dataset->index_cache_dirty_range = range;
+/*
+ * Replaces the current mapping of the data file with one that covers at least
+ * the given size. The previous mapping is only removed if no views point into
+ * it.
+ */
+static bool data_map_grow(btoep_dataset* dataset, uint64_t min_size) {
+  uint64_t size;
+  if (!fd_get_size(dataset, dataset->data_fd, &size))
+    return false;
+  // The index refers to data beyond the end of the data file.
+  if (size < min_size)
+    return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+
+  btoep_data_map* map = NULL;
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS && map == NULL; i++) {
+    btoep_data_map* slot = &dataset->data_maps[i];
+    if (slot->address == NULL)
+      map = slot;
+    else if (slot == dataset->current_data_map && slot->n_views == 0)
+      map = slot;
+  }
+  if (map == NULL)
+    return set_error(dataset, B_ERR_DATA_VIEWS_IN_USE);
+
+  if (map == dataset->current_data_map) {
+    data_map_close(map);
+    dataset->current_data_map = NULL;
   }
+  if (!data_map_open(dataset, map, size))
+    return false;
 
-  assert(btoep_range_is_subset(dataset->index_cache_range,
-                               dataset->index_cache_dirty_range));
+  btoep_data_map* previous = dataset->current_data_map;
+  if (previous != NULL && previous->n_views == 0)
+    data_map_close(previous);
+  dataset->current_data_map = map;
+  return true;
 }
 
-static bool btoep_index_resize(btoep_dataset* dataset, uint64_t new_size) {
-  dataset->total_index_size = new_size;
-  // TODO: Make this work without requiring the entire index to be in the cache
-  dataset->index_cache_range.length = new_size - dataset->index_cache_range.offset;
-  if (dataset->index_cache_is_dirty) {
-    if (!btoep_range_intersect(&dataset->index_cache_dirty_range,
-                               dataset->index_cache_range)) {
-      dataset->index_cache_is_dirty = false;
-    }
+static bool data_view_acquire(btoep_dataset* dataset, btoep_range range,
+                              const void** ptr) {
+  bool valid;
+  if (!btoep_index_contains(dataset, range, &valid))
+    return false;
+  if (!valid)
+    return set_error(dataset, B_ERR_READ_OUT_OF_BOUNDS);
+
+  // Empty files cannot be mapped, and empty views do not need a mapping.
+  if (range.length == 0) {
+    static const uint8_t empty_view;
+    *ptr = &empty_view;
+    return true;
+  }
+
+  uint64_t end = range.offset + range.length;
+  btoep_data_map* map = dataset->current_data_map;
+  if (map == NULL || map->size < end) {
+    if (!data_map_grow(dataset, end))
+      return false;
+    map = dataset->current_data_map;
   }
+
+  map->n_views++;
+  *ptr = map->address + range.offset;
   return true;
 }
 
+bool btoep_data_view_acquire(btoep_dataset* dataset, btoep_range range,
+                             const void** ptr) {
+  if (dataset->read_only)
+    mutex_lock(&dataset->index_lock);
+  bool ok = data_view_acquire(dataset, range, ptr);
+  if (dataset->read_only)
+    mutex_unlock(&dataset->index_lock);
+  return ok;
+}
+
+void btoep_data_view_release(btoep_dataset* dataset, const void* ptr) {
+  if (dataset->read_only)
+    mutex_lock(&dataset->index_lock);
+
+  const uint8_t* address = ptr;
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS; i++) {
+    btoep_data_map* map = &dataset->data_maps[i];
+    if (map->address != NULL && address >= map->address &&
+        address < map->address + map->size) {
+      assert(map->n_views != 0);
+      if (--map->n_views == 0 && map != dataset->current_data_map)
+        data_map_close(map);
+      break;
+    }
+  }
+
+  if (dataset->read_only)
+    mutex_unlock(&dataset->index_lock);
+}
+
 static bool btoep_set_index_fd_offset(btoep_dataset* dataset, uint64_t offset) {
   if (dataset->current_index_offset != offset) {
     if (!fd_seek(dataset, dataset->index_fd, offset, SEEK_SET, NULL))
@@ -509,353 +1583,2982 @@ static bool btoep_set_index_fd_offset(btoep_dataset* dataset, uint64_t offset) {
   return true;
 }
 
-static bool btoep_read_index(btoep_dataset* dataset, uint64_t offset, uint8_t* dest, size_t min_length, size_t max_length, size_t* actual_length) {
-  if (!btoep_set_index_fd_offset(dataset, offset))
-    return false;
-  *actual_length = max_length;
-  // TODO: This might read less data. Fix that.
-  if (!fd_read(dataset, dataset->index_fd, dest, actual_length))
+/*
+ * The index cache consists of a fixed number of pages. Each page holds an
+ * aligned part of the index, which is read from the index file when the page is
+ * first accessed. Modifications only affect the cached pages, and are written
+ * to the index file when the page is evicted or when the index is flushed.
+ *
+ * Pages that end beyond the end of the index file may contain arbitrary data
+ * after the end of the file, which is never written to the index file. Unless
+ * the index uses the paged format, the index file only contains the index.
+ */
+
+static uint64_t index_file_size(btoep_dataset* dataset) {
+  return dataset->index_is_paged ?
+         dataset->index_n_pages * BTOEP_INDEX_PAGE_SIZE :
+         dataset->total_index_size;
+}
+
+static void index_cache_invalidate_page(btoep_index_cache_page* page) {
+  page->is_valid = false;
+  page->is_dirty = false;
+  page->last_used = 0;
+}
+
+static bool index_cache_write_back(btoep_dataset* dataset, btoep_index_cache_page* page) {
+  if (!page->is_dirty)
+    return true;
+
+  btoep_range range = page->dirty_range;
+  btoep_range file_range = { 0, index_file_size(dataset) };
+  if (btoep_range_intersect(&range, file_range)) {
+    if (!btoep_set_index_fd_offset(dataset, range.offset) ||
+        !fd_write(dataset, dataset->index_fd,
+                  page->data + (range.offset - page->offset), range.length))
+      return false;
+
+    dataset->current_index_offset = range.offset + range.length;
+    if (!dataset->index_is_paged &&
+        dataset->current_index_offset > dataset->total_index_size_on_disk)
+      dataset->total_index_size_on_disk = dataset->current_index_offset;
+  }
+
+  page->is_dirty = false;
+  return true;
+}
+
+static bool index_cache_load_page(btoep_dataset* dataset, btoep_index_cache_page* page, uint64_t page_offset) {
+  if (!index_cache_write_back(dataset, page))
     return false;
-  assert(*actual_length != 0 || min_length == 0);
-  if (*actual_length < min_length) // TODO: Think about this again
-    return false; // TODO: Set an error
-  dataset->current_index_offset = offset + *actual_length;
+  index_cache_invalidate_page(page);
+
+  // Parts of the page that do not exist in the index file yet are left
+  // uninitialized; they will be written before they become part of the index.
+  if (page_offset < (dataset->index_is_paged ? index_file_size(dataset) :
+                                              dataset->total_index_size_on_disk)) {
+    size_t n_read = BTOEP_INDEX_PAGE_SIZE;
+    if (!btoep_set_index_fd_offset(dataset, page_offset) ||
+        !fd_read_fully(dataset, dataset->index_fd, page->data, &n_read))
+      return false;
+    dataset->current_index_offset = page_offset + n_read;
+  }
+
+  page->offset = page_offset;
+  page->is_valid = true;
   return true;
 }
 
 /*
- * This function ensures that the given range is available in the cache. If it
- * is not, more data is read from the file.
- *
- * This function may succeed without filling the cache sufficiently if the file
- * itself does not contain more data.
+ * Provides access to the cached index data at the given offset. The returned
+ * length is the number of bytes until the end of the page, regardless of the
+ * size of the index. If the index file is mapped into memory, the data is
+ * accessed directly, and the returned length extends to the end of the file.
  */
-static bool btoep_index_fill_cache(btoep_dataset* dataset, btoep_range range) {
-  btoep_range index_range = { 0, dataset->total_index_size };
-  if (!btoep_range_intersect(&range, index_range))
+static bool index_cache_access(btoep_dataset* dataset, uint64_t offset, uint8_t** data, size_t* length) {
+  if (dataset->index_map != NULL) {
+    // The file might be shorter than a damaged paged index claims.
+    if (offset >= dataset->index_map_size)
+      return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+    // The mapping is read-only, but so is the dataset.
+    *data = (uint8_t*) dataset->index_map + offset;
+    *length = (size_t) (dataset->index_map_size - offset);
     return true;
+  }
 
-  // If the range is already in the cache, don't do anything.
-  if (btoep_range_is_subset(dataset->index_cache_range, range))
-    return true;
+  uint64_t page_offset = offset - offset % BTOEP_INDEX_PAGE_SIZE;
+  btoep_index_cache_page* page = &dataset->index_cache[dataset->index_cache_mru];
+
+  if (!page->is_valid || page->offset != page_offset) {
+    // Find the page, or the least recently used page if it is not in the cache.
+    size_t lru = 0;
+    size_t i;
+    for (i = 0; i < BTOEP_INDEX_CACHE_PAGES; i++) {
+      page = &dataset->index_cache[i];
+      if (page->is_valid && page->offset == page_offset)
+        break;
+      if (page->last_used < dataset->index_cache[lru].last_used)
+        lru = i;
+    }
+
+    if (i == BTOEP_INDEX_CACHE_PAGES) {
+      i = lru;
+      page = &dataset->index_cache[i];
+      if (!index_cache_load_page(dataset, page, page_offset))
+        return false;
+    }
 
-  assert(range.length <= BTOEP_INDEX_CACHE_SIZE);
+    dataset->index_cache_mru = i;
+  }
+
+  page->last_used = ++dataset->index_cache_clock;
+  *data = page->data + (offset - page_offset);
+  *length = BTOEP_INDEX_PAGE_SIZE - (offset - page_offset);
+  return true;
+}
 
-  // Does the required range fit into the cache with its current offset?
-  btoep_range max_range = { dataset->index_cache_range.offset, BTOEP_INDEX_CACHE_SIZE };
-  if (!btoep_range_is_subset(range, max_range)) {
-    // TODO: Keep the existing data in the cache (move it), don't just throw it away.
-    if (!btoep_index_flush(dataset))
+static bool index_cache_read(btoep_dataset* dataset, uint64_t offset, void* out, size_t length) {
+  uint8_t* bytes = out;
+  while (length != 0) {
+    uint8_t* data;
+    size_t n;
+    if (!index_cache_access(dataset, offset, &data, &n))
       return false;
-    dataset->index_cache_range = btoep_mkrange(range.offset, 0);
+    if (n > length)
+      n = length;
+    memcpy(bytes, data, n);
+    bytes += n;
+    offset += n;
+    length -= n;
   }
+  return true;
+}
 
-  size_t read_bytes;
-  if (!btoep_read_index(dataset,
-                        dataset->index_cache_range.offset + dataset->index_cache_range.length,
-                        dataset->index_cache + dataset->index_cache_range.length,
-                        range.length,
-                        BTOEP_INDEX_CACHE_SIZE - dataset->index_cache_range.length,
-                        &read_bytes))
-    return false;
-  dataset->index_cache_range.length += read_bytes;
+static bool index_cache_write(btoep_dataset* dataset, uint64_t offset, const void* in, size_t length) {
+  const uint8_t* bytes = in;
+  while (length != 0) {
+    uint8_t* data;
+    size_t n;
+    if (!index_cache_access(dataset, offset, &data, &n))
+      return false;
+    if (n > length)
+      n = length;
+    memcpy(data, bytes, n);
+
+    btoep_index_cache_page* page = &dataset->index_cache[dataset->index_cache_mru];
+    btoep_range range = { offset, n };
+    page->dirty_range = page->is_dirty ? btoep_range_outer(page->dirty_range, range) : range;
+    page->is_dirty = true;
+
+    bytes += n;
+    offset += n;
+    length -= n;
+  }
+  return true;
+}
 
+/*
+ * Moves length bytes of the index from src to dest, similar to memmove.
+ */
+static bool index_cache_move(btoep_dataset* dataset, uint64_t dest, uint64_t src, uint64_t length) {
+  uint8_t buffer[BTOEP_INDEX_PAGE_SIZE];
+  while (length != 0) {
+    size_t n = (length < sizeof(buffer)) ? length : sizeof(buffer);
+    // When moving data towards the end, start at the end to avoid overwriting
+    // data before it has been moved.
+    uint64_t chunk_offset = (dest > src) ? length - n : 0;
+    if (!index_cache_read(dataset, src + chunk_offset, buffer, n) ||
+        !index_cache_write(dataset, dest + chunk_offset, buffer, n))
+      return false;
+    if (dest < src) {
+      src += n;
+      dest += n;
+    }
+    length -= n;
+  }
   return true;
 }
 
-bool btoep_index_iterator_start(btoep_dataset* dataset, btoep_index_iterator* iterator) {
-  iterator->index_offset = 0;
-  iterator->data_offset = 0;
-  iterator->dataset = dataset;
-  iterator->index_rev = dataset->index_rev;
+static bool btoep_index_resize(btoep_dataset* dataset, uint64_t new_size) {
+  dataset->total_index_size = new_size;
+  if (dataset->index_is_paged)
+    return true;
+
+  // Discard pages (and modifications) that are beyond the end of the index.
+  btoep_range index_range = { 0, new_size };
+  for (size_t i = 0; i < BTOEP_INDEX_CACHE_PAGES; i++) {
+    btoep_index_cache_page* page = &dataset->index_cache[i];
+    if (page->is_valid && page->offset >= new_size) {
+      index_cache_invalidate_page(page);
+    } else if (page->is_dirty) {
+      page->is_dirty = btoep_range_intersect(&page->dirty_range, index_range);
+    }
+  }
   return true;
 }
 
-// TODO: Make this function prettier
-static inline bool btoep_index_uleb128(btoep_dataset* dataset, uint64_t* where, uint64_t* result) {
-  assert(*where >= dataset->index_cache_range.offset);
+/*
+ * The paged index format stores the index in fixed-size pages, which allows
+ * modifying the index without rewriting all following entries. The first page
+ * contains a header. Each other page is either a leaf or unused. Leaves contain
+ * a sequence of complete index entries, and leave room for more entries to be
+ * inserted. The concatenation of all leaves, in the order of the linked list
+ * that they form, is identical to the compact index format.
+ *
+ * All numbers are stored in little-endian byte order. The header consists of:
+ *
+ *   magic (8 bytes), version, page size, first leaf, first unused page,
+ *   number of pages, size of the (logical) index, flags, number of entries,
+ *   total length of all entries, end of the last entry, fingerprint (8 bytes
+ *   each).
+ *
+ * The statistics at the end of the header are only valid if the flags contain
+ * PAGED_INDEX_HAS_STATS. They are updated along with the index, so they never
+ * require decoding the index. Version 1 headers end after the index size.
+ *
+ * Each leaf and each unused page begins with the number of the next page
+ * (4 bytes), the number of bytes that are used by index entries (2 bytes, zero
+ * for unused pages), and two reserved bytes.
+ *
+ * The magic value starts with eight bytes that have the most significant bit
+ * set. Since no ULEB128 value within the compact format is this long, a compact
+ * index can never be mistaken for a paged index.
+ */
 
-  *result = 0;
-  uint8_t byte;
-  uint64_t exponent = 0;
-  while (1) {
-    if (*where >= dataset->index_cache_range.offset + dataset->index_cache_range.length)
-      return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
-    byte = dataset->index_cache[(*where)++ - dataset->index_cache_range.offset];
-    *result |= (uint64_t) (byte & 0x7f) << exponent;
-    if (byte & 0x80) {
-      exponent += 7;
-      if (exponent >= 56)
-        return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
-    } else {
-      break;
+#define PAGED_INDEX_MAGIC          "\xc2\xd4\xcf\xc5\xd0\xc9\xc4\xd8"
+#define PAGED_INDEX_VERSION        2
+#define PAGED_INDEX_HEADER_SIZE    96
+// Version 1 headers end before the flags and do not contain statistics.
+#define PAGED_INDEX_V1_HEADER_SIZE 56
+#define PAGED_INDEX_HAS_STATS      1
+#define LEAF_HEADER_SIZE           8
+#define LEAF_CAPACITY              (BTOEP_INDEX_PAGE_SIZE - LEAF_HEADER_SIZE)
+// Leaves that are created by splitting another leaf are only filled up to this
+// size, which leaves room for future insertions.
+#define LEAF_FILL_TARGET           (LEAF_CAPACITY * 3 / 4)
+
+static inline uint64_t page_offset(uint64_t page) {
+  return page * BTOEP_INDEX_PAGE_SIZE;
+}
+
+/*
+ * Reads the header of a paged index, or initializes a new paged index if the
+ * index file is empty and create is true. Compact indexes are not affected.
+ */
+static bool index_paged_open(btoep_dataset* dataset, bool create) {
+  dataset->index_is_paged = false;
+  dataset->index_header_is_dirty = false;
+  dataset->index_leaves = NULL;
+  dataset->n_index_leaves = 0;
+  dataset->index_leaves_capacity = 0;
+  dataset->index_leaf_mru = 0;
+  dataset->index_leaves_are_loaded = false;
+
+  // The statistics of an empty index are trivial, but other compact indexes
+  // need to be scanned first.
+  memset(&dataset->index_stats, 0, sizeof(btoep_index_stats));
+  dataset->index_stats_are_known = dataset->total_index_size_on_disk == 0;
+
+  if (dataset->total_index_size_on_disk == 0) {
+    if (create && !dataset->read_only) {
+      dataset->index_is_paged = true;
+      dataset->index_header_is_dirty = true;
+      dataset->index_paged_version = PAGED_INDEX_VERSION;
+      dataset->index_n_pages = 1;
+      dataset->index_free_page = 0;
+      dataset->index_first_leaf = 0;
+      dataset->index_leaves_are_loaded = true;
     }
+    return true;
+  }
+
+  uint8_t header[PAGED_INDEX_HEADER_SIZE];
+  size_t n_read = sizeof(header);
+  if (!btoep_set_index_fd_offset(dataset, 0) ||
+      !fd_read_fully(dataset, dataset->index_fd, header, &n_read))
+    return false;
+  dataset->current_index_offset = n_read;
+
+  if (n_read < 8 || memcmp(header, PAGED_INDEX_MAGIC, 8) != 0)
+    return true;
+
+  uint64_t version = (n_read >= 16) ? read_le64(header + 8) : 0;
+  size_t header_size = (version == 1) ? PAGED_INDEX_V1_HEADER_SIZE
+                                      : PAGED_INDEX_HEADER_SIZE;
+  if ((version != 1 && version != PAGED_INDEX_VERSION) ||
+      n_read < header_size ||
+      read_le64(header + 16) != BTOEP_INDEX_PAGE_SIZE ||
+      read_le64(header + 40) == 0 ||
+      read_le64(header + 40) > UINT32_MAX)
+    return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+
+  dataset->index_is_paged = true;
+  dataset->index_paged_version = (unsigned) version;
+  dataset->index_first_leaf = read_le64(header + 24);
+  dataset->index_free_page = read_le64(header + 32);
+  dataset->index_n_pages = read_le64(header + 40);
+  dataset->total_index_size = dataset->total_index_size_on_disk =
+      read_le64(header + 48);
+
+  if (version != 1 && (read_le64(header + 56) & PAGED_INDEX_HAS_STATS)) {
+    dataset->index_stats.n_entries = read_le64(header + 64);
+    dataset->index_stats.n_bytes = read_le64(header + 72);
+    dataset->index_stats.end = read_le64(header + 80);
+    dataset->index_stats.fingerprint = read_le64(header + 88);
+    dataset->index_stats_are_known = true;
   }
+  return true;
+}
 
+static bool index_paged_write_header(btoep_dataset* dataset) {
+  uint8_t header[PAGED_INDEX_HEADER_SIZE];
+  memcpy(header, PAGED_INDEX_MAGIC, 8);
+  write_le64(header + 8, PAGED_INDEX_VERSION);
+  write_le64(header + 16, BTOEP_INDEX_PAGE_SIZE);
+  write_le64(header + 24, dataset->index_leaves_are_loaded ?
+                          (dataset->n_index_leaves == 0 ? 0 :
+                           dataset->index_leaves[0].page) :
+                          dataset->index_first_leaf);
+  write_le64(header + 32, dataset->index_free_page);
+  write_le64(header + 40, dataset->index_n_pages);
+  write_le64(header + 48, dataset->total_index_size);
+  // Older headers are upgraded, but statistics are only stored if they are
+  // known, since computing them would require scanning the index.
+  const btoep_index_stats* stats = &dataset->index_stats;
+  write_le64(header + 56, dataset->index_stats_are_known ? PAGED_INDEX_HAS_STATS : 0);
+  write_le64(header + 64, stats->n_entries);
+  write_le64(header + 72, stats->n_bytes);
+  write_le64(header + 80, stats->end);
+  write_le64(header + 88, stats->fingerprint);
+  if (!index_cache_write(dataset, 0, header, sizeof(header)))
+    return false;
+  dataset->index_paged_version = PAGED_INDEX_VERSION;
+  dataset->index_header_is_dirty = false;
   return true;
 }
 
-// TODO: Make this function prettier
-static inline void write_uleb128(uint8_t* out, uint64_t value, size_t* length) {
-  do {
-    *out = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
-    value >>= 7;
-    out++;
-    (*length)++;
-  } while (value > 0);
+static void index_paged_discard(btoep_dataset* dataset) {
+  free(dataset->index_leaves);
+  dataset->index_leaves = NULL;
+  dataset->n_index_leaves = 0;
+  dataset->index_leaves_capacity = 0;
+  dataset->index_leaves_are_loaded = false;
+}
+
+static bool index_leaves_splice(btoep_dataset* dataset, size_t start,
+                                size_t end, const btoep_index_leaf* leaves,
+                                size_t n) {
+  assert(start <= end && end <= dataset->n_index_leaves);
+
+  size_t new_length = dataset->n_index_leaves - (end - start) + n;
+  btoep_index_leaf* array = reserve_array(dataset->index_leaves,
+                                          &dataset->index_leaves_capacity,
+                                          new_length, sizeof(btoep_index_leaf));
+  if (array == NULL)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+  dataset->index_leaves = array;
+
+  memmove(array + start + n, array + end,
+          (dataset->n_index_leaves - end) * sizeof(btoep_index_leaf));
+  memcpy(array + start, leaves, n * sizeof(btoep_index_leaf));
+  dataset->n_index_leaves = new_length;
+  return true;
+}
+
+/*
+ * Loads the list of leaves into memory. This only reads the header of each
+ * leaf.
+ */
+static bool index_paged_load(btoep_dataset* dataset) {
+  if (dataset->index_leaves_are_loaded)
+    return true;
+
+  dataset->n_index_leaves = 0;
+  uint64_t index_offset = 0;
+  uint64_t page = dataset->index_first_leaf;
+  while (page != 0) {
+    // A list that is longer than the number of pages must contain a cycle.
+    if (page >= dataset->index_n_pages ||
+        dataset->n_index_leaves == dataset->index_n_pages)
+      return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+
+    // Unless the index file is mapped, this bypasses the index cache to avoid
+    // evicting other pages.
+    uint8_t header[LEAF_HEADER_SIZE];
+    size_t n_read = sizeof(header);
+    if (dataset->index_map != NULL) {
+      if (!index_cache_read(dataset, page_offset(page), header, n_read))
+        return false;
+    } else {
+      if (!btoep_set_index_fd_offset(dataset, page_offset(page)) ||
+          !fd_read_fully(dataset, dataset->index_fd, header, &n_read))
+        return false;
+      dataset->current_index_offset += n_read;
+    }
+
+    btoep_index_leaf leaf = {
+      .index_offset = index_offset,
+      .page = (uint32_t) page,
+      .used = read_le16(header + 4)
+    };
+    if (n_read != sizeof(header) || leaf.used == 0 ||
+        leaf.used > LEAF_CAPACITY)
+      return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+
+    if (!index_leaves_splice(dataset, dataset->n_index_leaves,
+                             dataset->n_index_leaves, &leaf, 1))
+      return false;
+
+    index_offset += leaf.used;
+    page = read_le32(header);
+  }
+
+  if (index_offset != dataset->total_index_size)
+    return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+
+  dataset->index_leaves_are_loaded = true;
+  return true;
+}
+
+/*
+ * Finds the leaf that contains the given offset within the index. If the
+ * offset is the end of the index, this returns the last leaf.
+ */
+static size_t index_paged_find_leaf(btoep_dataset* dataset, uint64_t offset) {
+  assert(dataset->n_index_leaves != 0);
+
+  btoep_index_leaf* leaf = &dataset->index_leaves[dataset->index_leaf_mru];
+  if (offset >= leaf->index_offset && offset - leaf->index_offset < leaf->used)
+    return dataset->index_leaf_mru;
+
+  size_t lo = 0, hi = dataset->n_index_leaves;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (dataset->index_leaves[mid].index_offset <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return dataset->index_leaf_mru = lo;
+}
+
+static bool index_leaf_write_header(btoep_dataset* dataset, uint64_t page,
+                                    uint64_t next, uint64_t used) {
+  uint8_t header[LEAF_HEADER_SIZE] = { 0 };
+  write_le32(header, (uint32_t) next);
+  write_le16(header + 4, (uint16_t) used);
+  return index_cache_write(dataset, page_offset(page), header, sizeof(header));
+}
+
+static bool index_paged_alloc_page(btoep_dataset* dataset, uint64_t* page) {
+  if (dataset->index_free_page != 0) {
+    uint8_t next[4];
+    *page = dataset->index_free_page;
+    if (!index_cache_read(dataset, page_offset(*page), next, sizeof(next)))
+      return false;
+    dataset->index_free_page = read_le32(next);
+  } else {
+    if (dataset->index_n_pages == UINT32_MAX)
+      return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+    *page = dataset->index_n_pages++;
+  }
+  dataset->index_header_is_dirty = true;
+  return true;
+}
+
+static bool index_paged_free_page(btoep_dataset* dataset, uint64_t page) {
+  if (!index_leaf_write_header(dataset, page, dataset->index_free_page, 0))
+    return false;
+  dataset->index_free_page = page;
+  dataset->index_header_is_dirty = true;
+  return true;
+}
+
+/*
+ * Replaces the bytes between start and end within leaf i with the given data.
+ * The leaf is split into multiple leaves if the data does not fit, and removed
+ * if it becomes empty. The caller is responsible for updating links between
+ * leaves and their index offsets.
+ */
+static bool index_leaf_replace(btoep_dataset* dataset, size_t i, size_t start,
+                               size_t end, const uint8_t* data,
+                               size_t length) {
+  btoep_index_leaf* leaf = &dataset->index_leaves[i];
+  uint64_t payload = page_offset(leaf->page) + LEAF_HEADER_SIZE;
+  size_t used = leaf->used;
+  assert(start <= end && end <= used);
+
+  uint64_t new_used = used - (end - start) + length;
+  if (new_used == 0) {
+    return index_paged_free_page(dataset, leaf->page) &&
+           index_leaves_splice(dataset, i, i + 1, NULL, 0);
+  }
+
+  if (new_used <= LEAF_CAPACITY) {
+    if (start + length != end &&
+        !index_cache_move(dataset, payload + start + length, payload + end,
+                          used - end))
+      return false;
+    if (!index_cache_write(dataset, payload + start, data, length))
+      return false;
+    leaf->used = (uint32_t) new_used;
+    return true;
+  }
+
+  // The leaf needs to be split. Since leaves must consist of complete entries,
+  // this requires finding the boundaries of entries within the new contents.
+  uint8_t head[LEAF_CAPACITY], tail[LEAF_CAPACITY], chunk[LEAF_CAPACITY];
+  if (!index_cache_read(dataset, payload, head, start) ||
+      !index_cache_read(dataset, payload + end, tail, used - end))
+    return false;
+
+  const uint8_t* parts[3] = { head, data, tail };
+  size_t part_lengths[3] = { start, length, used - end };
+  size_t chunk_length = 0, n_terminators = 0, n_chunks = 0, n_remaining = new_used;
+  for (int p = 0; p < 3; p++) {
+    for (size_t k = 0; k < part_lengths[p]; k++) {
+      if (chunk_length == LEAF_CAPACITY)
+        return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+      uint8_t byte = parts[p][k];
+      chunk[chunk_length++] = byte;
+      n_remaining--;
+      // Each entry consists of two ULEB128 values.
+      if ((byte & 0x80) == 0 && (++n_terminators % 2) == 0 &&
+          (chunk_length >= LEAF_FILL_TARGET || n_remaining == 0)) {
+        btoep_index_leaf new_leaf = { .used = (uint32_t) chunk_length };
+        if (n_chunks == 0) {
+          new_leaf.page = dataset->index_leaves[i].page;
+          dataset->index_leaves[i] = new_leaf;
+        } else {
+          uint64_t page;
+          if (!index_paged_alloc_page(dataset, &page))
+            return false;
+          new_leaf.page = (uint32_t) page;
+          if (!index_leaves_splice(dataset, i + n_chunks, i + n_chunks,
+                                   &new_leaf, 1))
+            return false;
+        }
+        if (!index_cache_write(dataset,
+                               page_offset(new_leaf.page) + LEAF_HEADER_SIZE,
+                               chunk, chunk_length))
+          return false;
+        n_chunks++;
+        chunk_length = 0;
+      }
+    }
+  }
+
+  if (chunk_length != 0)
+    return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+  return true;
+}
+
+/*
+ * Replaces replace_length bytes at the given offset within a paged index with
+ * the given data, which only requires modifying the affected leaves. The
+ * replaced bytes and the new data must consist of complete entries.
+ */
+static bool index_paged_splice(btoep_dataset* dataset, uint64_t offset,
+                               uint64_t replace_length, const uint8_t* data,
+                               size_t length) {
+  if (!index_paged_load(dataset))
+    return false;
+
+  if (dataset->n_index_leaves == 0) {
+    if (length == 0)
+      return true;
+    uint64_t page;
+    if (!index_paged_alloc_page(dataset, &page))
+      return false;
+    btoep_index_leaf leaf = { .index_offset = 0, .page = (uint32_t) page };
+    if (!index_leaves_splice(dataset, 0, 0, &leaf, 1))
+      return false;
+  }
+
+  size_t n_leaves_before = dataset->n_index_leaves;
+  size_t first = index_paged_find_leaf(dataset, offset);
+  size_t last = (replace_length == 0) ? first :
+                index_paged_find_leaf(dataset, offset + replace_length - 1);
+  uint64_t start = offset - dataset->index_leaves[first].index_offset;
+  uint64_t end = offset + replace_length - dataset->index_leaves[last].index_offset;
+
+  // Process the leaves in reverse order so that the indices of leaves that
+  // have not been processed yet do not change.
+  if (last != first) {
+    if (!index_leaf_replace(dataset, last, 0, end, NULL, 0))
+      return false;
+    for (size_t i = last - 1; i > first; i--) {
+      if (!index_leaf_replace(dataset, i, 0, dataset->index_leaves[i].used,
+                              NULL, 0))
+        return false;
+    }
+    end = dataset->index_leaves[first].used;
+  }
+  uint32_t first_page = dataset->index_leaves[first].page;
+  if (!index_leaf_replace(dataset, first, start, end, data, length))
+    return false;
+
+  // Update the headers of all leaves that have changed, including the link of
+  // the previous leaf unless the first leaf still exists, and the offsets of
+  // all following leaves.
+  size_t n_new_leaves = dataset->n_index_leaves + (last - first + 1) -
+                        n_leaves_before;
+  bool first_page_changed = n_new_leaves == 0 ||
+                            dataset->index_leaves[first].page != first_page;
+  size_t i = (first == 0 || !first_page_changed) ? first : first - 1;
+  for (; i < dataset->n_index_leaves; i++) {
+    btoep_index_leaf* leaf = &dataset->index_leaves[i];
+    if (i != 0)
+      leaf->index_offset = leaf[-1].index_offset + leaf[-1].used;
+    if (i < first + n_new_leaves || i + 1 == first) {
+      uint64_t next = (i + 1 == dataset->n_index_leaves) ? 0 : leaf[1].page;
+      if (!index_leaf_write_header(dataset, leaf->page, next, leaf->used))
+        return false;
+    }
+  }
+
+  if (first == 0 && first_page_changed)
+    dataset->index_header_is_dirty = true;
+  dataset->index_leaf_mru = 0;
+  return true;
+}
+
+/*
+ * Provides access to the index data at the given offset within the index. The
+ * returned length is the number of bytes that can be accessed directly, which,
+ * unlike index_cache_access, is limited by the end of the index.
+ */
+static bool index_access(btoep_dataset* dataset, uint64_t offset, uint8_t** data, size_t* length) {
+  assert(offset < dataset->total_index_size);
+
+  if (!dataset->index_is_paged) {
+    if (!index_cache_access(dataset, offset, data, length))
+      return false;
+    if (*length > dataset->total_index_size - offset)
+      *length = dataset->total_index_size - offset;
+    return true;
+  }
+
+  if (!index_paged_load(dataset))
+    return false;
+
+  btoep_index_leaf* leaf = &dataset->index_leaves[index_paged_find_leaf(dataset, offset)];
+  uint64_t offset_in_leaf = offset - leaf->index_offset;
+  if (!index_cache_access(dataset, page_offset(leaf->page) + LEAF_HEADER_SIZE + offset_in_leaf, data, length))
+    return false;
+  if (*length > leaf->used - offset_in_leaf)
+    *length = leaf->used - offset_in_leaf;
+  return true;
+}
+
+bool btoep_index_iterator_start(btoep_dataset* dataset, btoep_index_iterator* iterator) {
+  iterator->index_offset = 0;
+  iterator->data_offset = 0;
+  iterator->dataset = dataset;
+  iterator->index_rev = dataset->index_rev;
+  return true;
+}
+
+// TODO: Make this function prettier
+static inline bool btoep_index_uleb128(btoep_dataset* dataset, uint64_t* where, uint64_t* result) {
+  *result = 0;
+  uint8_t* data;
+  size_t available = 0;
+  uint8_t byte;
+  uint64_t exponent = 0;
+  while (1) {
+    if (*where >= dataset->total_index_size)
+      return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+    if (available == 0 && !index_access(dataset, *where, &data, &available))
+      return false;
+    byte = *data++;
+    available--;
+    (*where)++;
+    *result |= (uint64_t) (byte & 0x7f) << exponent;
+    if (byte & 0x80) {
+      exponent += 7;
+      if (exponent >= 56)
+        return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+    } else {
+      break;
+    }
+  }
+
+  return true;
+}
+
+// TODO: Make this function prettier
+static inline void write_uleb128(uint8_t* out, uint64_t value, size_t* length) {
+  do {
+    *out = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+    out++;
+    (*length)++;
+  } while (value > 0);
+}
+
+/*
+ * Index entries are decoded in batches, which are kept in the dataset until the
+ * index changes. Sequential iteration, including peeking before advancing, is
+ * therefore served from the batch.
+ */
+static bool index_batch_find(btoep_dataset* dataset, btoep_index_iterator* iterator) {
+  if (dataset->index_batch_rev != dataset->index_rev)
+    return false;
+
+  for (size_t i = dataset->index_batch_pos;
+       i < dataset->index_batch_length && i <= dataset->index_batch_pos + 1;
+       i++) {
+    uint64_t start = (i == 0) ? dataset->index_batch_offset :
+                                dataset->index_batch_ends[i - 1];
+    if (start == iterator->index_offset) {
+      dataset->index_batch_pos = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool index_batch_decode(btoep_dataset* dataset, btoep_index_iterator* iterator) {
+  uint64_t offset = iterator->index_offset;
+  if (offset >= dataset->total_index_size)
+    return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+
+  // Decode as many entries as possible from contiguous data within the cache.
+  uint8_t* data;
+  size_t available;
+  if (!index_access(dataset, offset, &data, &available))
+    return false;
+  btoep_uleb128_pair pairs[BTOEP_INDEX_BATCH_SIZE];
+  size_t n = btoep_uleb128_decode_pairs(data, available, pairs,
+                                        BTOEP_INDEX_BATCH_SIZE);
+
+  if (n == 0) {
+    // The entry is not contiguous (or not valid), so decode it byte by byte.
+    uint64_t end = offset;
+    if (!btoep_index_uleb128(dataset, &end, &pairs[0].first) ||
+        !btoep_index_uleb128(dataset, &end, &pairs[0].second))
+      return false;
+    pairs[0].end = end - offset;
+    n = 1;
+  }
+
+  uint64_t data_offset = iterator->data_offset;
+  for (size_t i = 0; i < n; i++) {
+    btoep_range* range = &dataset->index_batch[i];
+    int is_first = data_offset == 0;
+    if (is_first) {
+      range->offset = pairs[i].first;
+    } else {
+      range->offset = data_offset + pairs[i].first + 1;
+    }
+    range->length = pairs[i].second + 1;
+    data_offset = range->offset + range->length;
+    dataset->index_batch_ends[i] = offset + pairs[i].end;
+  }
+
+  dataset->index_batch_offset = offset;
+  dataset->index_batch_length = n;
+  dataset->index_batch_pos = 0;
+  dataset->index_batch_rev = dataset->index_rev;
+  return true;
+}
+
+static bool btoep_index_read(btoep_index_iterator* iterator, uint64_t* next_offset, btoep_range* range) {
+  btoep_dataset* dataset = iterator->dataset;
+  if (iterator->index_rev != dataset->index_rev)
+    return set_error(dataset, B_ERR_DEAD_INDEX_ITERATOR);
+
+  if (dataset->journal_length != 0) {
+    if (iterator->index_offset >= dataset->index_table_length)
+      return set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+    *range = dataset->index_table[iterator->index_offset];
+    *next_offset = iterator->index_offset + 1;
+    return true;
+  }
+
+  if (!index_batch_find(dataset, iterator) &&
+      !index_batch_decode(dataset, iterator))
+    return false;
+
+  *range = dataset->index_batch[dataset->index_batch_pos];
+  *next_offset = dataset->index_batch_ends[dataset->index_batch_pos];
+  return true;
+}
+
+bool btoep_index_iterator_next(btoep_index_iterator* iterator, btoep_range* range) {
+  uint64_t offset_in_index;
+  bool ret = btoep_index_read(iterator, &offset_in_index, range);
+  if (ret) {
+    iterator->index_offset = offset_in_index;
+    iterator->data_offset = range->offset + range->length;
+  }
+  return ret;
+}
+
+bool btoep_index_iterator_peek(btoep_index_iterator* iterator, btoep_range* range) {
+  uint64_t offset_in_index;
+  return btoep_index_read(iterator, &offset_in_index, range);
+}
+
+bool btoep_index_iterator_skip(btoep_index_iterator* iterator) {
+  btoep_range range;
+  return btoep_index_iterator_next(iterator, &range);
+}
+
+bool btoep_index_iterator_is_eof(btoep_index_iterator* iterator) {
+  btoep_dataset* dataset = iterator->dataset;
+  uint64_t end = (dataset->journal_length != 0) ? dataset->index_table_length :
+                                                  dataset->total_index_size;
+  assert(iterator->index_offset <= end);
+  return iterator->index_offset == end;
+}
+
+/*
+ * The decoded index table contains all index entries as absolute ranges, in
+ * ascending order. It is loaded on demand and updated along with the index.
+ * Failing to allocate memory for the table is not an error; the table is simply
+ * discarded, and callers fall back to iterating over the index.
+ */
+
+static void index_table_discard(btoep_dataset* dataset) {
+  free(dataset->index_table);
+  dataset->index_table = NULL;
+  dataset->index_table_length = 0;
+  dataset->index_table_capacity = 0;
+  dataset->index_table_is_loaded = false;
+}
+
+static bool index_table_reserve(btoep_dataset* dataset, size_t length) {
+  btoep_range* table = reserve_array(dataset->index_table,
+                                     &dataset->index_table_capacity, length,
+                                     sizeof(btoep_range));
+  if (table == NULL)
+    return false;
+  dataset->index_table = table;
+  return true;
+}
+
+static bool index_table_load(btoep_dataset* dataset) {
+  if (dataset->index_table_is_loaded)
+    return true;
+
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+
+  dataset->index_table_length = 0;
+  while (!btoep_index_iterator_is_eof(&iterator)) {
+    btoep_range entry;
+    if (!btoep_index_iterator_next(&iterator, &entry)) {
+      index_table_discard(dataset);
+      return false;
+    }
+
+    if (!index_table_reserve(dataset, dataset->index_table_length + 1)) {
+      index_table_discard(dataset);
+      return true;
+    }
+
+    dataset->index_table[dataset->index_table_length++] = entry;
+  }
+
+  dataset->index_table_is_loaded = true;
+  return true;
+}
+
+/*
+ * Returns the position of the first entry in the table that ends after the
+ * given offset, or the length of the table if there is no such entry.
+ */
+static size_t index_table_search(btoep_dataset* dataset, uint64_t offset) {
+  size_t low = 0, high = dataset->index_table_length;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    btoep_range entry = dataset->index_table[mid];
+    if (entry.offset + entry.length > offset)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return low;
+}
+
+/*
+ * Replaces the entries in [start, end) with n_entries new entries. If the table
+ * cannot be resized, it is discarded.
+ */
+static void index_table_splice(btoep_dataset* dataset, size_t start, size_t end,
+                               const btoep_range* entries, size_t n_entries) {
+  assert(start <= end && end <= dataset->index_table_length);
+
+  size_t new_length = dataset->index_table_length - (end - start) + n_entries;
+  if (!index_table_reserve(dataset, new_length)) {
+    index_table_discard(dataset);
+    return;
+  }
+
+  memmove(dataset->index_table + start + n_entries, dataset->index_table + end,
+          (dataset->index_table_length - end) * sizeof(btoep_range));
+  memcpy(dataset->index_table + start, entries, n_entries * sizeof(btoep_range));
+  dataset->index_table_length = new_length;
+}
+
+/*
+ * Adds the given ranges to the table, or removes them from it, in a single
+ * pass. The ranges must be sorted and must not overlap. If memory cannot be
+ * allocated, the table is discarded.
+ */
+static void index_table_apply(btoep_dataset* dataset, const btoep_range* ranges,
+                              size_t n_ranges, bool is_removal) {
+  if (!dataset->index_table_is_loaded)
+    return;
+
+  // Each range can at most split one entry into two.
+  size_t length = dataset->index_table_length;
+  btoep_range* table = dataset->index_table;
+  size_t capacity = length + n_ranges;
+  btoep_range* result = NULL;
+  if (capacity >= length && capacity <= SIZE_MAX / sizeof(btoep_range))
+    result = malloc(capacity * sizeof(btoep_range));
+  if (result == NULL) {
+    index_table_discard(dataset);
+    return;
+  }
+
+  size_t i = 0, j = 0, n = 0;
+  if (!is_removal) {
+    while (i < length || j < n_ranges) {
+      btoep_range next;
+      if (j == n_ranges || (i < length && table[i].offset < ranges[j].offset))
+        next = table[i++];
+      else
+        next = ranges[j++];
+      if (n == 0 || !btoep_range_union(&result[n - 1], next))
+        result[n++] = next;
+    }
+  } else {
+    for (; i < length; i++) {
+      btoep_range entry = table[i];
+      while (j < n_ranges && ranges[j].offset + ranges[j].length <= entry.offset)
+        j++;
+      // Ranges that overlap the end of this entry may also affect the next one,
+      // so j only advances past ranges that end before the entry.
+      for (size_t k = j; k < n_ranges && entry.length != 0 &&
+                         ranges[k].offset < entry.offset + entry.length; k++) {
+        btoep_range right_part_of_split_entry;
+        btoep_range_remove(&entry, &right_part_of_split_entry, ranges[k]);
+        if (entry.length != 0)
+          result[n++] = entry;
+        entry = right_part_of_split_entry;
+      }
+      if (entry.length != 0)
+        result[n++] = entry;
+    }
+  }
+
+  free(table);
+  dataset->index_table = result;
+  dataset->index_table_length = n;
+  dataset->index_table_capacity = capacity;
+}
+
+/*
+ * In fragmented indexes, e.g., of datasets that are received in pieces of a
+ * fixed size, the decoded index table requires 16 bytes for every entry. If all
+ * entries begin and end at multiples of a common block size, a compressed
+ * bitmap of the blocks that contain data holds the same information, often in
+ * a fraction of the memory, and finding the entry that contains an offset only
+ * requires looking at the containers around it. The bitmap replaces the table
+ * whenever it is smaller. It is updated along with the index as long as entries
+ * remain aligned; otherwise, it is discarded and rebuilt on the next query.
+ */
+
+// Smaller indexes keep the decoded table, which is cheap enough.
+#define BTOEP_INDEX_BITMAP_MIN_ENTRIES 1024
+
+static void index_bitmap_discard(btoep_dataset* dataset) {
+  if (dataset->index_bitmap != NULL) {
+    btoep_bitmap_free(dataset->index_bitmap);
+    free(dataset->index_bitmap);
+    dataset->index_bitmap = NULL;
+  }
+}
+
+/*
+ * Replaces the decoded index table, which must be loaded, with a bitmap if the
+ * bitmap is smaller.
+ */
+static void index_bitmap_build(btoep_dataset* dataset) {
+  // The journal requires the decoded index table.
+  size_t n = dataset->index_table_length;
+  if (n < BTOEP_INDEX_BITMAP_MIN_ENTRIES || dataset->index_uses_journal ||
+      dataset->journal_length != 0)
+    return;
+
+  // Use the largest block size that all entries are aligned to. Only the end of
+  // the last entry does not need to be aligned.
+  const btoep_range* table = dataset->index_table;
+  uint64_t end = table[n - 1].offset + table[n - 1].length;
+  uint64_t boundaries = table[n - 1].offset;
+  for (size_t i = 0; i < n - 1; i++)
+    boundaries |= table[i].offset | (table[i].offset + table[i].length);
+  unsigned shift = 0;
+  while (shift < 63 && ((boundaries >> shift) & 1) == 0)
+    shift++;
+
+  // Each chunk of blocks that contains data requires a container, so skip
+  // building the bitmap if that alone would exceed the size of the table.
+  size_t table_size = n * sizeof(btoep_range);
+  unsigned chunk_shift = shift + BTOEP_BITMAP_CHUNK_BITS;
+  uint64_t n_chunks = 0, next_chunk = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t first = table[i].offset >> chunk_shift;
+    uint64_t last = (table[i].offset + table[i].length - 1) >> chunk_shift;
+    if (first < next_chunk)
+      first = next_chunk;
+    if (first <= last)
+      n_chunks += last - first + 1;
+    next_chunk = last + 1;
+  }
+  if (n_chunks >= table_size / sizeof(btoep_bitmap_container))
+    return;
+
+  btoep_bitmap* bitmap = malloc(sizeof(btoep_bitmap));
+  if (bitmap == NULL)
+    return;
+  btoep_bitmap_init(bitmap);
+
+  for (size_t i = 0; i < n; i++) {
+    uint64_t first = table[i].offset >> shift;
+    uint64_t last = (table[i].offset + table[i].length - 1) >> shift;
+    if (!btoep_bitmap_set(bitmap, first, last - first + 1, true) ||
+        btoep_bitmap_memory_usage(bitmap) >= table_size) {
+      btoep_bitmap_free(bitmap);
+      free(bitmap);
+      return;
+    }
+  }
+
+  index_table_discard(dataset);
+  dataset->index_bitmap = bitmap;
+  dataset->index_bitmap_shift = shift;
+  dataset->index_bitmap_end = end;
+}
+
+/*
+ * Equivalent to index_table_search, but based on the bitmap.
+ */
+static void index_bitmap_find_entry(btoep_dataset* dataset, uint64_t offset,
+                                    bool* found, btoep_range* entry) {
+  const btoep_bitmap* bitmap = dataset->index_bitmap;
+  unsigned shift = dataset->index_bitmap_shift;
+  uint64_t end = dataset->index_bitmap_end;
+  if (!(*found = (offset < end)))
+    return;
+
+  // The block that contains the end of the last entry contains data, so there
+  // is at least one block at or after the given offset that contains data.
+  uint64_t block = offset >> shift, first, missing;
+  if (btoep_bitmap_contains(bitmap, block))
+    first = btoep_bitmap_prev(bitmap, block, false, &missing) ? missing + 1 : 0;
+  else
+    btoep_bitmap_next(bitmap, block, true, &first);
+
+  uint64_t entry_end = end;
+  if (btoep_bitmap_next(bitmap, first, false, &missing) &&
+      missing <= (end - 1) >> shift)
+    entry_end = missing << shift;
+  *entry = btoep_mkrange(first << shift, entry_end - (first << shift));
+}
+
+/*
+ * Applies changes to the bitmap, or discards the bitmap if they would result in
+ * entries that are not aligned to blocks. Changes that affect the end of the
+ * last entry, other than by adding data, also discard the bitmap. The ranges
+ * must be sorted and must not overlap.
+ */
+static void index_bitmap_apply(btoep_dataset* dataset, const btoep_range* ranges,
+                               size_t n_ranges, bool is_removal) {
+  btoep_bitmap* bitmap = dataset->index_bitmap;
+  if (bitmap == NULL)
+    return;
+
+  unsigned shift = dataset->index_bitmap_shift;
+  uint64_t mask = (UINT64_C(1) << shift) - 1;
+  for (size_t i = 0; i < n_ranges; i++) {
+    uint64_t offset = ranges[i].offset, end = offset + ranges[i].length;
+    uint64_t last_end = dataset->index_bitmap_end;
+    // Start of the block that contains the end of the last entry.
+    uint64_t last_block = ((last_end - 1) >> shift) << shift;
+
+    bool ok;
+    if (is_removal) {
+      ok = (offset & mask) == 0 && (end & mask) == 0 && end <= last_block &&
+           btoep_bitmap_set(bitmap, offset >> shift, (end - offset) >> shift,
+                            false);
+    } else {
+      // The end of the current last entry must not remain unaligned unless it
+      // remains the end of the last entry.
+      ok = (offset & mask) == 0 &&
+           ((end & mask) == 0 || end >= last_end) &&
+           ((last_end & mask) == 0 || end <= last_block || offset <= last_end) &&
+           btoep_bitmap_set(bitmap, offset >> shift,
+                            ((end - 1) >> shift) - (offset >> shift) + 1, true);
+      if (end > last_end)
+        dataset->index_bitmap_end = end;
+    }
+
+    if (!ok) {
+      index_bitmap_discard(dataset);
+      return;
+    }
+  }
+}
+
+/*
+ * Each index entry is stored relative to the end of the previous entry, so
+ * reaching an entry requires decoding all entries before it. A checkpoint
+ * records the state of an iterator at the beginning of an entry, that is, the
+ * position within the index and the end of the previous entry. There is one
+ * checkpoint for roughly every BTOEP_INDEX_CHECKPOINT_INTERVAL entries, so
+ * seeking only requires a binary search and decoding a few entries.
+ *
+ * Checkpoints are stored in a separate file next to the index file, which is
+ * only trusted if the size and the modification time of the index file match
+ * the values stored in it. If the file is missing or outdated, the checkpoints
+ * are created by scanning the index once. They are written to the file when the
+ * index is flushed, unless the index is so small that scanning it is cheap.
+ */
+
+#define BTOEP_INDEX_CHECKPOINT_INTERVAL       128
+#define BTOEP_INDEX_CHECKPOINT_MIN_INDEX_SIZE 16384
+
+#define CHECKPOINT_FILE_MAGIC       "BTOEPCKP"
+#define CHECKPOINT_FILE_VERSION     1
+#define CHECKPOINT_FILE_HEADER_SIZE 40
+#define CHECKPOINT_FILE_ENTRY_SIZE  24
+
+static void index_checkpoints_discard(btoep_dataset* dataset) {
+  free(dataset->checkpoints);
+  dataset->checkpoints = NULL;
+  dataset->n_checkpoints = 0;
+  dataset->checkpoints_capacity = 0;
+  dataset->checkpoints_are_loaded = false;
+  dataset->checkpoints_are_dirty = false;
+}
+
+/*
+ * Discards checkpoints that can no longer be maintained. This also ensures that
+ * the checkpoint file is deleted when the index is flushed.
+ */
+static void index_checkpoints_invalidate(btoep_dataset* dataset) {
+  index_checkpoints_discard(dataset);
+  dataset->checkpoints_are_dirty = !dataset->read_only;
+}
+
+/*
+ * Replaces the checkpoints in [start, end) with n new checkpoints. This only
+ * fails if memory cannot be allocated.
+ */
+static bool index_checkpoints_splice(btoep_dataset* dataset, size_t start,
+                                     size_t end,
+                                     const btoep_index_checkpoint* checkpoints,
+                                     size_t n) {
+  assert(start <= end && end <= dataset->n_checkpoints);
+
+  size_t new_length = dataset->n_checkpoints - (end - start) + n;
+  btoep_index_checkpoint* array = reserve_array(dataset->checkpoints,
+                                                &dataset->checkpoints_capacity,
+                                                new_length,
+                                                sizeof(btoep_index_checkpoint));
+  if (array == NULL)
+    return false;
+  dataset->checkpoints = array;
+
+  memmove(array + start + n, array + end,
+          (dataset->n_checkpoints - end) * sizeof(btoep_index_checkpoint));
+  memcpy(array + start, checkpoints, n * sizeof(btoep_index_checkpoint));
+  dataset->n_checkpoints = new_length;
+  return true;
+}
+
+/*
+ * Rebuilds the checkpoints between checkpoint i and the next checkpoint by
+ * scanning the index entries in between, creating a checkpoint every interval
+ * entries. This only fails if the index cannot be read. If memory cannot be
+ * allocated, all checkpoints are invalidated.
+ */
+static bool index_checkpoints_rescan(btoep_dataset* dataset, size_t i,
+                                     uint64_t interval) {
+  uint64_t end = (i + 1 < dataset->n_checkpoints) ?
+                 dataset->checkpoints[i + 1].index_offset :
+                 dataset->total_index_size;
+
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+  iterator.index_offset = dataset->checkpoints[i].index_offset;
+  iterator.data_offset = dataset->checkpoints[i].data_offset;
+
+  dataset->checkpoints[i].n_entries = 0;
+  while (iterator.index_offset < end) {
+    if (dataset->checkpoints[i].n_entries == interval) {
+      btoep_index_checkpoint next = {
+        .index_offset = iterator.index_offset,
+        .data_offset = iterator.data_offset,
+        .n_entries = 0
+      };
+      if (!index_checkpoints_splice(dataset, i + 1, i + 1, &next, 1)) {
+        index_checkpoints_invalidate(dataset);
+        return true;
+      }
+      i++;
+    }
+
+    if (!btoep_index_iterator_skip(&iterator))
+      return false;
+    dataset->checkpoints[i].n_entries++;
+  }
+
+  return true;
+}
+
+/*
+ * Attempts to load checkpoints from the checkpoint file. This returns false if
+ * the file does not exist, cannot be read, or does not match the index.
+ */
+static bool index_checkpoints_read_file(btoep_dataset* dataset) {
+  dataset->checkpoint_file_was_read = true;
+
+  btoep_fd fd;
+  if (!fd_open(dataset, &fd, dataset->checkpoint_path, B_OPEN_EXISTING_READ_ONLY))
+    return false;
+
+  uint8_t header[CHECKPOINT_FILE_HEADER_SIZE];
+  size_t n_read = sizeof(header);
+  uint64_t index_mtime;
+  bool valid = fd_read_fully(dataset, fd, header, &n_read) &&
+               n_read == sizeof(header) &&
+               memcmp(header, CHECKPOINT_FILE_MAGIC, 8) == 0 &&
+               read_le64(header + 8) == CHECKPOINT_FILE_VERSION &&
+               dataset->total_index_size == dataset->total_index_size_on_disk &&
+               read_le64(header + 16) == dataset->total_index_size &&
+               fd_get_mtime(dataset, dataset->index_fd, &index_mtime) &&
+               read_le64(header + 24) == index_mtime;
+
+  uint64_t n_checkpoints = valid ? read_le64(header + 32) : 0;
+  valid = valid && n_checkpoints != 0 &&
+          n_checkpoints <= SIZE_MAX / CHECKPOINT_FILE_ENTRY_SIZE;
+
+  uint8_t* buffer = NULL;
+  if (valid) {
+    size_t size = (size_t) n_checkpoints * CHECKPOINT_FILE_ENTRY_SIZE;
+    n_read = size;
+    valid = (buffer = malloc(size)) != NULL &&
+            fd_read_fully(dataset, fd, buffer, &n_read) && n_read == size;
+  }
+
+  fd_close(dataset, fd); // TODO: Return value
+
+  dataset->n_checkpoints = 0;
+  for (size_t i = 0; valid && i < n_checkpoints; i++) {
+    const uint8_t* entry = buffer + i * CHECKPOINT_FILE_ENTRY_SIZE;
+    btoep_index_checkpoint checkpoint = {
+      .index_offset = read_le64(entry),
+      .data_offset = read_le64(entry + 8),
+      .n_entries = read_le64(entry + 16)
+    };
+
+    // Reject anything that could not have been produced by this library.
+    if (i == 0) {
+      valid = checkpoint.index_offset == 0 && checkpoint.data_offset == 0;
+    } else {
+      const btoep_index_checkpoint* prev = &dataset->checkpoints[i - 1];
+      valid = prev->n_entries != 0 &&
+              checkpoint.index_offset > prev->index_offset &&
+              checkpoint.index_offset < dataset->total_index_size &&
+              checkpoint.data_offset > prev->data_offset;
+    }
+
+    valid = valid && index_checkpoints_splice(dataset, i, i, &checkpoint, 1);
+  }
+
+  free(buffer);
+
+  if (!valid) {
+    dataset->n_checkpoints = 0;
+    return false;
+  }
+
+  dataset->checkpoints_are_loaded = true;
+  dataset->checkpoints_are_dirty = false;
+  return true;
+}
+
+/*
+ * Writes checkpoints to the checkpoint file, or deletes the file if there is
+ * no point in keeping it. Since the file is merely a cache, errors are ignored;
+ * an outdated file is detected when it is read.
+ */
+static void index_checkpoints_write_file(btoep_dataset* dataset) {
+  if (!dataset->checkpoints_are_dirty || dataset->read_only)
+    return;
+  dataset->checkpoints_are_dirty = false;
+
+  assert(dataset->total_index_size == dataset->total_index_size_on_disk);
+
+  uint64_t index_mtime;
+  uint8_t* buffer = NULL;
+  size_t size = CHECKPOINT_FILE_HEADER_SIZE +
+                dataset->n_checkpoints * CHECKPOINT_FILE_ENTRY_SIZE;
+  if (dataset->checkpoints_are_loaded &&
+      dataset->total_index_size >= BTOEP_INDEX_CHECKPOINT_MIN_INDEX_SIZE &&
+      fd_get_mtime(dataset, dataset->index_fd, &index_mtime)) {
+    buffer = malloc(size);
+  }
+
+  btoep_fd fd;
+  bool created;
+  if (buffer == NULL ||
+      !fd_open_or_create(dataset, &fd, dataset->checkpoint_path, &created)) {
+    free(buffer);
+    path_delete(dataset, dataset->checkpoint_path);
+    return;
+  }
+
+  memcpy(buffer, CHECKPOINT_FILE_MAGIC, 8);
+  write_le64(buffer + 8, CHECKPOINT_FILE_VERSION);
+  write_le64(buffer + 16, dataset->total_index_size);
+  write_le64(buffer + 24, index_mtime);
+  write_le64(buffer + 32, dataset->n_checkpoints);
+  for (size_t i = 0; i < dataset->n_checkpoints; i++) {
+    uint8_t* entry = buffer + CHECKPOINT_FILE_HEADER_SIZE +
+                     i * CHECKPOINT_FILE_ENTRY_SIZE;
+    write_le64(entry, dataset->checkpoints[i].index_offset);
+    write_le64(entry + 8, dataset->checkpoints[i].data_offset);
+    write_le64(entry + 16, dataset->checkpoints[i].n_entries);
+  }
+
+  bool ok = fd_write(dataset, fd, buffer, size) &&
+            fd_truncate(dataset, fd, size);
+  free(buffer);
+  ok = fd_close(dataset, fd) && ok;
+  if (!ok)
+    path_delete(dataset, dataset->checkpoint_path);
+}
+
+/*
+ * Ensures that checkpoints are loaded, if possible. Unless allow_scan is true,
+ * this only attempts to read the checkpoint file. This only fails if the index
+ * cannot be read. If memory cannot be allocated, this succeeds without loading
+ * checkpoints.
+ */
+static bool index_checkpoints_load(btoep_dataset* dataset, bool allow_scan) {
+  if (dataset->checkpoints_are_loaded)
+    return true;
+
+  if (!dataset->checkpoint_file_was_read) {
+    // Errors are ignored since the file is merely a cache, and must not replace
+    // information about a previous error.
+    btoep_last_error_info last_error = dataset->last_error;
+    bool loaded = index_checkpoints_read_file(dataset);
+    dataset->last_error = last_error;
+    if (loaded)
+      return true;
+  }
+
+  if (!allow_scan)
+    return true;
+
+  btoep_index_checkpoint first = { 0, 0, 0 };
+  dataset->n_checkpoints = 0;
+  if (!index_checkpoints_splice(dataset, 0, 0, &first, 1))
+    return true;
+
+  dataset->checkpoints_are_loaded = true;
+  dataset->checkpoints_were_scanned = true;
+  if (!index_checkpoints_rescan(dataset, 0, BTOEP_INDEX_CHECKPOINT_INTERVAL)) {
+    index_checkpoints_discard(dataset);
+    return false;
+  }
+
+  // Persist the checkpoints, unless the index turns out to be small.
+  dataset->checkpoints_are_dirty = !dataset->read_only;
+  return true;
+}
+
+/*
+ * Returns the position of the last checkpoint at which the end of the previous
+ * entry is not after the given data offset.
+ */
+static size_t index_checkpoints_search(btoep_dataset* dataset, uint64_t data_offset) {
+  size_t low = 1, high = dataset->n_checkpoints;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (dataset->checkpoints[mid].data_offset > data_offset)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return low - 1;
+}
+
+/*
+ * Adapts checkpoints after n_replaced_entries entries, stored at
+ * [replace_start, replace_start + replace_length) within the index, have been
+ * replaced with n_inserted_entries entries, stored in insert_size bytes. All
+ * entries outside of the replaced area must still represent the same ranges.
+ */
+static void index_checkpoints_update(btoep_dataset* dataset,
+                                     uint64_t replace_start,
+                                     uint64_t replace_length,
+                                     uint64_t insert_size,
+                                     uint64_t n_replaced_entries,
+                                     uint64_t n_inserted_entries) {
+  if (!dataset->checkpoints_are_loaded)
+    return;
+
+  dataset->checkpoints_are_dirty = true;
+
+  // Find the checkpoint that precedes the first replaced entry.
+  size_t i = 0;
+  while (i + 1 < dataset->n_checkpoints &&
+         dataset->checkpoints[i + 1].index_offset <= replace_start) {
+    i++;
+  }
+
+  // Checkpoints within the replaced area are gone.
+  uint64_t replace_end = replace_start + replace_length;
+  uint64_t n_entries = dataset->checkpoints[i].n_entries;
+  size_t end = i + 1;
+  while (end < dataset->n_checkpoints &&
+         dataset->checkpoints[end].index_offset < replace_end) {
+    n_entries += dataset->checkpoints[end++].n_entries;
+  }
+  index_checkpoints_splice(dataset, i + 1, end, NULL, 0);
+
+  // All following entries have moved.
+  for (size_t j = i + 1; j < dataset->n_checkpoints; j++) {
+    dataset->checkpoints[j].index_offset -= replace_length;
+    dataset->checkpoints[j].index_offset += insert_size;
+  }
+
+  assert(n_entries >= n_replaced_entries);
+  n_entries = n_entries - n_replaced_entries + n_inserted_entries;
+  dataset->checkpoints[i].n_entries = n_entries;
+
+  if (n_entries == 0 && i != 0) {
+    index_checkpoints_splice(dataset, i, i + 1, NULL, 0);
+  } else if (n_entries > 2 * BTOEP_INDEX_CHECKPOINT_INTERVAL) {
+    // Split the segment into segments of roughly equal size.
+    uint64_t n_segments = (n_entries + BTOEP_INDEX_CHECKPOINT_INTERVAL - 1) /
+                          BTOEP_INDEX_CHECKPOINT_INTERVAL;
+    uint64_t interval = (n_entries + n_segments - 1) / n_segments;
+    if (!index_checkpoints_rescan(dataset, i, interval))
+      index_checkpoints_invalidate(dataset);
+  }
+}
+
+bool btoep_index_iterator_seek(btoep_index_iterator* iterator, uint64_t data_offset) {
+  btoep_dataset* dataset = iterator->dataset;
+  if (dataset->journal_length != 0) {
+    // The decoded index table is always loaded in this case.
+    if (!btoep_index_iterator_start(dataset, iterator))
+      return false;
+    size_t pos = index_table_search(dataset, data_offset);
+    iterator->index_offset = pos;
+    if (pos != 0) {
+      btoep_range prev = dataset->index_table[pos - 1];
+      iterator->data_offset = prev.offset + prev.length;
+    }
+    return true;
+  }
+
+  if (!index_checkpoints_load(dataset, true))
+    return false;
+
+  // An iterator can continue from its current position if all entries before
+  // it end before the given offset.
+  bool can_continue = iterator->index_rev == dataset->index_rev &&
+                      iterator->data_offset <= data_offset;
+
+  if (dataset->checkpoints_are_loaded) {
+    const btoep_index_checkpoint* checkpoint =
+        &dataset->checkpoints[index_checkpoints_search(dataset, data_offset)];
+    if (!can_continue || checkpoint->index_offset > iterator->index_offset) {
+      if (!btoep_index_iterator_start(dataset, iterator))
+        return false;
+      iterator->index_offset = checkpoint->index_offset;
+      iterator->data_offset = checkpoint->data_offset;
+    }
+  } else if (!can_continue) {
+    if (!btoep_index_iterator_start(dataset, iterator))
+      return false;
+  }
+
+  while (!btoep_index_iterator_is_eof(iterator)) {
+    btoep_range entry;
+    if (!btoep_index_iterator_peek(iterator, &entry))
+      return false;
+    if (entry.offset + entry.length > data_offset)
+      break;
+    if (!btoep_index_iterator_skip(iterator))
+      return false;
+  }
+
+  return true;
+}
+
+/*
+ * Adapts an iterator to the most recent change to the index, which is possible
+ * if the iterator was valid right before the change, and if the change did not
+ * affect the iterator's position. All entries before the changed area remain
+ * the same, and so do all entries after it, except for their position within
+ * the index. The last replaced entry is always an unchanged copy of the entry
+ * that followed the actual change, unless the change reached the end of the
+ * index.
+ */
+static bool index_iterator_follow_edit(btoep_index_iterator* iterator) {
+  btoep_dataset* dataset = iterator->dataset;
+  if (dataset->journal_length != 0 ||
+      dataset->last_edit_rev != dataset->index_rev ||
+      iterator->index_rev + 1 != dataset->index_rev)
+    return false;
+
+  if (iterator->index_offset > dataset->last_edit_start) {
+    if (iterator->index_offset < dataset->last_edit_end ||
+        dataset->last_edit_end == dataset->last_edit_old_size)
+      return false;
+    iterator->index_offset = iterator->index_offset -
+                             dataset->last_edit_old_size +
+                             dataset->total_index_size;
+  }
+
+  iterator->index_rev = dataset->index_rev;
+  return true;
+}
+
+bool btoep_index_cursor_start(btoep_dataset* dataset, btoep_index_cursor* cursor) {
+  cursor->data_offset = 0;
+  return btoep_index_iterator_start(dataset, &cursor->iterator);
+}
+
+bool btoep_index_cursor_seek(btoep_index_cursor* cursor, uint64_t data_offset) {
+  cursor->data_offset = data_offset;
+  return btoep_index_iterator_seek(&cursor->iterator, data_offset);
+}
+
+bool btoep_index_cursor_peek(btoep_index_cursor* cursor, bool* exists,
+                             btoep_range* range) {
+  btoep_index_iterator* iterator = &cursor->iterator;
+  if (iterator->index_rev != iterator->dataset->index_rev &&
+      !index_iterator_follow_edit(iterator) &&
+      !btoep_index_iterator_seek(iterator, cursor->data_offset))
+    return false;
+
+  // Entries might have been inserted before the data offset.
+  while ((*exists = !btoep_index_iterator_is_eof(iterator))) {
+    if (!btoep_index_iterator_peek(iterator, range))
+      return false;
+    if (range->offset + range->length > cursor->data_offset)
+      break;
+    if (!btoep_index_iterator_skip(iterator))
+      return false;
+  }
+
+  if (*exists && range->offset < cursor->data_offset)
+    *range = btoep_range_remove_left(*range, cursor->data_offset - range->offset);
+  return true;
+}
+
+bool btoep_index_cursor_next(btoep_index_cursor* cursor, bool* exists,
+                             btoep_range* range) {
+  if (!btoep_index_cursor_peek(cursor, exists, range))
+    return false;
+  if (*exists) {
+    if (!btoep_index_iterator_skip(&cursor->iterator))
+      return false;
+    cursor->data_offset = range->offset + range->length;
+  }
+  return true;
+}
+
+/*
+ * Consumes up to capacity entries at once, but only entries that end at or
+ * before the given data offset. This copies entries directly from the decoded
+ * batch, or from the decoded index table while the journal contains records.
+ */
+static bool index_iterator_read_batch(btoep_index_iterator* iterator,
+                                      uint64_t limit, btoep_range* out,
+                                      size_t capacity, size_t* n_out) {
+  btoep_dataset* dataset = iterator->dataset;
+  if (iterator->index_rev != dataset->index_rev)
+    return set_error(dataset, B_ERR_DEAD_INDEX_ITERATOR);
+
+  *n_out = 0;
+  if (capacity == 0 || btoep_index_iterator_is_eof(iterator))
+    return true;
+
+  const btoep_range* entries;
+  size_t available;
+  if (dataset->journal_length != 0) {
+    entries = dataset->index_table + iterator->index_offset;
+    available = dataset->index_table_length - (size_t) iterator->index_offset;
+  } else {
+    if (!index_batch_find(dataset, iterator) &&
+        !index_batch_decode(dataset, iterator))
+      return false;
+    entries = dataset->index_batch + dataset->index_batch_pos;
+    available = dataset->index_batch_length - dataset->index_batch_pos;
+  }
+
+  size_t n = 0;
+  while (n < available && n < capacity &&
+         entries[n].offset + entries[n].length <= limit) {
+    out[n] = entries[n];
+    n++;
+  }
+  if (n == 0)
+    return true;
+
+  if (dataset->journal_length != 0) {
+    iterator->index_offset += n;
+  } else {
+    // The next lookup finds the following entry right after this position.
+    dataset->index_batch_pos += n - 1;
+    iterator->index_offset = dataset->index_batch_ends[dataset->index_batch_pos];
+  }
+  iterator->data_offset = out[n - 1].offset + out[n - 1].length;
+  *n_out = n;
+  return true;
+}
+
+bool btoep_index_get_ranges(btoep_dataset* dataset, btoep_range window,
+                            int mode, btoep_range* ranges, size_t capacity,
+                            size_t* n_ranges, btoep_index_cursor* cursor) {
+  if (mode != BTOEP_FIND_DATA && mode != BTOEP_FIND_NO_DATA)
+    return set_error(dataset, B_ERR_INVALID_ARGUMENT);
+
+  *n_ranges = 0;
+  uint64_t window_end = window.offset + window.length;
+
+  btoep_index_cursor local_cursor;
+  if (cursor == NULL) {
+    cursor = &local_cursor;
+    if (!btoep_index_cursor_start(dataset, cursor))
+      return false;
+  }
+  if (cursor->data_offset < window.offset &&
+      !btoep_index_cursor_seek(cursor, window.offset))
+    return false;
+
+  uint64_t position = cursor->data_offset;
+  if (position >= window_end || capacity == 0)
+    return true;
+
+  // This moves the iterator to the first entry that ends after the position,
+  // even if the index has changed since the cursor was last used.
+  bool exists;
+  btoep_range entry;
+  if (!btoep_index_cursor_peek(cursor, &exists, &entry))
+    return false;
+
+  // Entries that end within the window are consumed in batches. Each of them
+  // produces at most one result, either the (remaining) entry itself, or the
+  // gap before it, so the iterator never passes entries that have not been
+  // fully reported yet.
+  btoep_index_iterator* iterator = &cursor->iterator;
+  size_t n = 0;
+  while (n < capacity) {
+    btoep_range batch[BTOEP_INDEX_BATCH_SIZE];
+    size_t n_batch = capacity - n;
+    if (n_batch > BTOEP_INDEX_BATCH_SIZE)
+      n_batch = BTOEP_INDEX_BATCH_SIZE;
+    if (!index_iterator_read_batch(iterator, window_end, batch, n_batch, &n_batch))
+      return false;
+    if (n_batch == 0)
+      break;
+
+    for (size_t i = 0; i < n_batch; i++) {
+      entry = batch[i];
+      if (entry.offset < position)
+        entry = btoep_range_remove_left(entry, position - entry.offset);
+      if (mode == BTOEP_FIND_DATA)
+        ranges[n++] = entry;
+      else if (entry.offset > position)
+        ranges[n++] = btoep_mkrange(position, entry.offset - position);
+      position = entry.offset + entry.length;
+    }
+  }
+
+  // The next entry, if any, does not end within the window.
+  if (n < capacity) {
+    uint64_t next_start = window_end;
+    if (!btoep_index_iterator_is_eof(iterator)) {
+      if (!btoep_index_iterator_peek(iterator, &entry))
+        return false;
+      if (entry.offset < window_end)
+        next_start = (entry.offset < position) ? position : entry.offset;
+    }
+    if (mode == BTOEP_FIND_DATA && next_start < window_end)
+      ranges[n++] = btoep_mkrange(next_start, window_end - next_start);
+    else if (mode == BTOEP_FIND_NO_DATA && next_start > position)
+      ranges[n++] = btoep_mkrange(position, next_start - position);
+    position = window_end;
+  }
+
+  cursor->data_offset = position;
+  *n_ranges = n;
+  return true;
+}
+
+/*
+ * Finds the first index entry that ends after the given offset.
+ */
+static bool index_find_entry(btoep_dataset* dataset, uint64_t offset,
+                             bool* found, btoep_range* entry) {
+  // Decoding the entire index is not worth it if the checkpoint file allows
+  // finding the entry quickly, e.g., in short-lived processes. If the index had
+  // to be scanned to create checkpoints, decoding it is not much more work.
+  if (!dataset->index_table_is_loaded && dataset->index_bitmap == NULL) {
+    if (!index_checkpoints_load(dataset, false))
+      return false;
+    if (!dataset->checkpoints_are_loaded || dataset->checkpoints_were_scanned) {
+      if (!index_table_load(dataset))
+        return false;
+      if (dataset->index_table_is_loaded)
+        index_bitmap_build(dataset);
+    }
+  }
+
+  if (dataset->index_bitmap != NULL) {
+    index_bitmap_find_entry(dataset, offset, found, entry);
+    return true;
+  }
+
+  if (dataset->index_table_is_loaded) {
+    size_t pos = index_table_search(dataset, offset);
+    if ((*found = (pos != dataset->index_table_length)))
+      *entry = dataset->index_table[pos];
+    return true;
+  }
+
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator) ||
+      !btoep_index_iterator_seek(&iterator, offset))
+    return false;
+
+  if ((*found = !btoep_index_iterator_is_eof(&iterator)))
+    return btoep_index_iterator_peek(&iterator, entry);
+  return true;
+}
+
+// The maximum size of an encoded index entry, i.e., of two ULEB128 values.
+#define MAX_INDEX_ENTRY_SIZE 20
+
+/*
+ * The fingerprint of an index is the sum of the hashes of its entries, so that
+ * it can be updated when entries are replaced, regardless of their position.
+ * The hash is based on the finalizer of SplitMix64.
+ */
+static inline uint64_t index_entry_hash(btoep_range entry) {
+  uint64_t h = entry.offset * UINT64_C(0x9e3779b97f4a7c15) + entry.length;
+  h = (h ^ (h >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  h = (h ^ (h >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return h ^ (h >> 31);
+}
+
+typedef struct {
+  btoep_dataset* dataset;
+  uint8_t* buffer;
+  size_t buffer_capacity;
+  bool buffer_is_allocated;
+  size_t insert_size;
+  uint64_t prev_entry_end;
+  uint64_t replace_start;
+  uint64_t replace_length;
+  uint64_t n_replaced_entries;
+  uint64_t n_inserted_entries;
+  // Changes to the statistics of the index.
+  uint64_t n_replaced_bytes;
+  uint64_t n_inserted_bytes;
+  uint64_t fingerprint_delta;
+  // If the decoded index table is loaded, the inserted entries are collected so
+  // that the replaced entries in the table can be updated in a single step.
+  bool updates_table;
+  size_t table_start;
+  btoep_range* entries;
+  size_t entries_capacity;
+} index_editor;
+
+/*
+ * The given buffer is used as long as the inserted entries fit into it, and is
+ * replaced with a larger buffer on the heap otherwise.
+ */
+static void editor_init(btoep_dataset* dataset, index_editor* editor,
+                        uint8_t* buffer, size_t buffer_capacity) {
+  editor->dataset = dataset;
+  editor->buffer = buffer;
+  editor->buffer_capacity = buffer_capacity;
+  editor->buffer_is_allocated = false;
+  editor->insert_size = 0;
+  editor->replace_length = 0;
+  editor->n_replaced_entries = 0;
+  editor->n_inserted_entries = 0;
+  editor->n_replaced_bytes = 0;
+  editor->n_inserted_bytes = 0;
+  editor->fingerprint_delta = 0;
+  editor->updates_table = false;
+  editor->entries = NULL;
+  editor->entries_capacity = 0;
+}
+
+static void editor_discard(index_editor* editor) {
+  if (editor->buffer_is_allocated)
+    free(editor->buffer);
+  free(editor->entries);
+}
+
+/*
+ * The first replaced entry is the first entry that ends after the given data
+ * offset, which is where the iterator must be when this is called.
+ */
+static void editor_set_start(index_editor* editor, btoep_index_iterator* iterator,
+                             uint64_t data_offset) {
+  btoep_dataset* dataset = editor->dataset;
+  editor->replace_start = iterator->index_offset;
+  editor->prev_entry_end = iterator->data_offset;
+  if ((editor->updates_table = dataset->index_table_is_loaded))
+    editor->table_start = index_table_search(dataset, data_offset);
+}
+
+/*
+ * Reads the next entry, which will be replaced when the changes are committed.
+ */
+static bool editor_consume(index_editor* editor, btoep_index_iterator* iterator, btoep_range* entry) {
+  if (!btoep_index_iterator_next(iterator, entry))
+    return false;
+  editor->n_replaced_entries++;
+  editor->n_replaced_bytes += entry->length;
+  editor->fingerprint_delta -= index_entry_hash(*entry);
+  return true;
+}
+
+static void editor_set_end(index_editor* editor, uint64_t replace_end) {
+  assert(editor->replace_start <= replace_end);
+  editor->replace_length = replace_end - editor->replace_start;
+}
+
+static bool editor_reserve(index_editor* editor) {
+  if (editor->insert_size + MAX_INDEX_ENTRY_SIZE <= editor->buffer_capacity)
+    return true;
+
+  size_t capacity = editor->buffer_capacity;
+  uint8_t* buffer = reserve_array(editor->buffer_is_allocated ? editor->buffer : NULL,
+                                  &capacity,
+                                  editor->insert_size + MAX_INDEX_ENTRY_SIZE, 1);
+  if (buffer == NULL)
+    return set_error(editor->dataset, B_ERR_OUT_OF_MEMORY);
+  if (!editor->buffer_is_allocated)
+    memcpy(buffer, editor->buffer, editor->insert_size);
+  editor->buffer = buffer;
+  editor->buffer_capacity = capacity;
+  editor->buffer_is_allocated = true;
+  return true;
+}
+
+static bool editor_write_range(index_editor* editor, const btoep_range* range) {
+  bool is_first = editor->prev_entry_end == 0;
+  assert(range->length > 0 && (range->offset != 0 || is_first));
+
+  if (!editor_reserve(editor))
+    return false;
+
+  if (editor->updates_table) {
+    btoep_range* entries = reserve_array(editor->entries,
+                                         &editor->entries_capacity,
+                                         editor->n_inserted_entries + 1,
+                                         sizeof(btoep_range));
+    if (entries == NULL) {
+      index_table_discard(editor->dataset);
+      editor->updates_table = false;
+    } else {
+      editor->entries = entries;
+      entries[editor->n_inserted_entries] = *range;
+    }
+  }
+
+  uint64_t relative_offset = range->offset - editor->prev_entry_end;
+  if (!is_first)
+    relative_offset--;
+  write_uleb128(editor->buffer + editor->insert_size, relative_offset, &editor->insert_size);
+  write_uleb128(editor->buffer + editor->insert_size, range->length - 1, &editor->insert_size);
+  editor->prev_entry_end = range->offset + range->length;
+  editor->n_inserted_entries++;
+  editor->n_inserted_bytes += range->length;
+  editor->fingerprint_delta += index_entry_hash(*range);
+  return true;
+}
+
+static bool editor_commit(index_editor* editor) {
+  // Now reassemble the index. Unless the size of the replaced entries did not
+  // change, this requires moving all following entries.
+  btoep_dataset* dataset = editor->dataset;
+
+  uint64_t replace_end = editor->replace_start + editor->replace_length;
+  uint64_t insert_end = editor->replace_start + editor->insert_size;
+  uint64_t old_index_size = dataset->total_index_size;
+  uint64_t new_index_size = old_index_size + editor->insert_size - editor->replace_length;
+
+  // Pages that are evicted from the cache are only written up to the end of a
+  // compact index, so it must grow before anything is written beyond its end.
+  if (!dataset->index_is_paged && new_index_size > old_index_size &&
+      !btoep_index_resize(dataset, new_index_size))
+    return false;
+
+  if (dataset->index_is_paged) {
+    // Only the affected leaves need to be modified.
+    if (!index_paged_splice(dataset, editor->replace_start,
+                            editor->replace_length, editor->buffer,
+                            editor->insert_size))
+      return false; // TODO: Mark the cache as corrupted
+  } else {
+    if (insert_end != replace_end &&
+        !index_cache_move(dataset, insert_end, replace_end,
+                          old_index_size - replace_end))
+      return false; // TODO: Mark the cache as corrupted
+
+    if (!index_cache_write(dataset, editor->replace_start, editor->buffer,
+                           editor->insert_size))
+      return false; // TODO: Mark the cache as corrupted
+  }
+
+  // Adapt the size of the index.
+  if (!btoep_index_resize(dataset, new_index_size))
+    return false; // TODO: Mark the cache as corrupted
+
+  // Prevent existing iterators from being used, but allow cursors to follow
+  // the change.
+  dataset->index_rev++;
+  dataset->last_edit_rev = dataset->index_rev;
+  dataset->last_edit_start = editor->replace_start;
+  dataset->last_edit_end = replace_end;
+  dataset->last_edit_old_size = old_index_size;
+
+  if (dataset->index_stats_are_known) {
+    btoep_index_stats* stats = &dataset->index_stats;
+    stats->n_entries += editor->n_inserted_entries - editor->n_replaced_entries;
+    stats->n_bytes += editor->n_inserted_bytes - editor->n_replaced_bytes;
+    stats->fingerprint += editor->fingerprint_delta;
+    // Only a change at the end of the index can change its end.
+    if (replace_end == old_index_size)
+      stats->end = editor->prev_entry_end;
+    if (dataset->index_is_paged)
+      dataset->index_header_is_dirty = true;
+  }
+
+  index_checkpoints_update(dataset, editor->replace_start,
+                           editor->replace_length, editor->insert_size,
+                           editor->n_replaced_entries,
+                           editor->n_inserted_entries);
+
+  if (editor->updates_table && dataset->index_table_is_loaded) {
+    index_table_splice(dataset, editor->table_start,
+                       editor->table_start + editor->n_replaced_entries,
+                       editor->entries, editor->n_inserted_entries);
+  }
+
+  return true;
+}
+
+/*
+ * Merges the given ranges into the index in a single pass. The ranges must be
+ * sorted, must not be empty, and must be neither adjacent nor overlapping. All
+ * entries between the first and the last range are rewritten at once, so the
+ * rest of the index only needs to be moved once.
+ */
+static bool index_add_sorted(btoep_dataset* dataset, const btoep_range* ranges,
+                             size_t n_ranges) {
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+
+  btoep_range entry, pending;
+  bool has_pending = false;
+
+  index_editor editor;
+  uint8_t editor_buffer[2 * MAX_INDEX_ENTRY_SIZE];
+  editor_init(dataset, &editor, editor_buffer, sizeof(editor_buffer));
+
+  // First, skip all entries to the left of the first range, that is, all
+  // entries that end before the first range begins.
+  uint64_t first_relevant_offset = (ranges[0].offset == 0) ? 0 : ranges[0].offset - 1;
+  if (!btoep_index_iterator_seek(&iterator, first_relevant_offset))
+    goto fail;
+
+  editor_set_start(&editor, &iterator, first_relevant_offset);
+
+  // Next, merge the ranges with the existing entries in order. The pending
+  // range is only written once it cannot be merged with anything else.
+  size_t i = 0;
+  while (i < n_ranges || has_pending) {
+    bool is_eof = btoep_index_iterator_is_eof(&iterator);
+    if (!is_eof && !btoep_index_iterator_peek(&iterator, &entry))
+      goto fail;
+
+    btoep_range next;
+    if (i < n_ranges && (is_eof || ranges[i].offset <= entry.offset)) {
+      next = ranges[i++];
+    } else if (!is_eof) {
+      // Once all ranges have been added, only entries that can be merged with
+      // the pending range are relevant.
+      btoep_range merged = pending;
+      if (i == n_ranges && !btoep_range_union(&merged, entry))
+        break;
+      if (!editor_consume(&editor, &iterator, &next))
+        goto fail;
+    } else {
+      break;
+    }
+
+    if (has_pending && btoep_range_union(&pending, next))
+      continue;
+    if (has_pending && !editor_write_range(&editor, &pending))
+      goto fail;
+    pending = next;
+    has_pending = true;
+  }
+
+  if (!editor_write_range(&editor, &pending))
+    goto fail;
+
+  // If we are not at the end of the index yet, we will also need to modify the next entry.
+  if (!btoep_index_iterator_is_eof(&iterator)) {
+    if (!editor_consume(&editor, &iterator, &entry) ||
+        !editor_write_range(&editor, &entry))
+      goto fail;
+  }
+
+  editor_set_end(&editor, iterator.index_offset);
+  if (!editor_commit(&editor))
+    goto fail;
+
+  index_bitmap_apply(dataset, ranges, n_ranges, false);
+  editor_discard(&editor);
+  return true;
+
+fail:
+  editor_discard(&editor);
+  return false;
+}
+
+/*
+ * Removes the given ranges from the index in a single pass. The ranges must be
+ * sorted, must not be empty, and must not overlap.
+ */
+static bool index_remove_sorted(btoep_dataset* dataset, const btoep_range* ranges,
+                                size_t n_ranges) {
+  btoep_index_iterator iterator;
+  if (!btoep_index_iterator_start(dataset, &iterator))
+    return false;
+
+  btoep_range entry;
+  bool has_entry = false;
+
+  index_editor editor;
+  uint8_t editor_buffer[2 * MAX_INDEX_ENTRY_SIZE];
+  editor_init(dataset, &editor, editor_buffer, sizeof(editor_buffer));
+
+  // First, skip all entries to the left of the first range that we need to
+  // delete.
+  if (!btoep_index_iterator_seek(&iterator, ranges[0].offset))
+    goto fail;
+
+  editor_set_start(&editor, &iterator, ranges[0].offset);
+
+  // The current entry may be split by multiple ranges. Whatever remains of it
+  // to the right of a range is compared to the next range.
+  size_t i = 0;
+  while (i < n_ranges) {
+    if (!has_entry) {
+      if (btoep_index_iterator_is_eof(&iterator))
+        break;
+      if (!editor_consume(&editor, &iterator, &entry))
+        goto fail;
+      has_entry = true;
+    }
+
+    btoep_range range = ranges[i];
+    if (entry.offset + entry.length <= range.offset) {
+      if (!editor_write_range(&editor, &entry))
+        goto fail;
+      has_entry = false;
+    } else if (entry.offset >= range.offset + range.length) {
+      i++;
+    } else {
+      btoep_range right_part_of_split_entry;
+      btoep_range_remove(&entry, &right_part_of_split_entry, range);
+      if (entry.length != 0 && !editor_write_range(&editor, &entry))
+        goto fail;
+      entry = right_part_of_split_entry;
+      if ((has_entry = (entry.length != 0)))
+        i++;
+    }
+  }
+
+  // The end of the current entry has not changed, so the next entry remains
+  // valid. Otherwise, the next entry needs to be modified as well.
+  if (has_entry) {
+    if (!editor_write_range(&editor, &entry))
+      goto fail;
+  } else if (!btoep_index_iterator_is_eof(&iterator)) {
+    if (!editor_consume(&editor, &iterator, &entry) ||
+        !editor_write_range(&editor, &entry))
+      goto fail;
+  }
+
+  editor_set_end(&editor, iterator.index_offset);
+  if (!editor_commit(&editor))
+    goto fail;
+
+  index_bitmap_apply(dataset, ranges, n_ranges, true);
+  editor_discard(&editor);
+  return true;
+
+fail:
+  editor_discard(&editor);
+  return false;
+}
+
+static int compare_ranges(const void* a, const void* b) {
+  uint64_t offset_a = ((const btoep_range*) a)->offset;
+  uint64_t offset_b = ((const btoep_range*) b)->offset;
+  return (offset_a > offset_b) - (offset_a < offset_b);
+}
+
+/*
+ * Copies the given ranges into a new array, sorts them, and merges adjacent
+ * and overlapping ranges. Empty ranges are dropped. The caller must free the
+ * array.
+ */
+static bool coalesce_ranges(btoep_dataset* dataset, const btoep_range* ranges,
+                            size_t n_ranges, btoep_range** out, size_t* n_out) {
+  btoep_range* sorted = NULL;
+  if (n_ranges != 0 &&
+      (n_ranges > SIZE_MAX / sizeof(btoep_range) ||
+       (sorted = malloc(n_ranges * sizeof(btoep_range))) == NULL))
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+
+  size_t n = 0;
+  for (size_t i = 0; i < n_ranges; i++) {
+    if (ranges[i].length != 0)
+      sorted[n++] = ranges[i];
+  }
+
+  if (n != 0) {
+    qsort(sorted, n, sizeof(btoep_range), compare_ranges);
+    size_t n_merged = 1;
+    for (size_t i = 1; i < n; i++) {
+      if (!btoep_range_union(&sorted[n_merged - 1], sorted[i]))
+        sorted[n_merged++] = sorted[i];
+    }
+    n = n_merged;
+  }
+
+  *out = sorted;
+  *n_out = n;
+  return true;
+}
+
+/*
+ * The index journal records changes to the index without modifying the index
+ * itself. Adding or removing a range appends a record to the journal and
+ * updates the decoded index table, which then serves all queries. Flushing the
+ * index only appends new records to the journal file, so the cost of each
+ * change does not depend on the size of the index.
+ *
+ * Compaction applies all records to the index, flushes the index, and deletes
+ * the journal file. This happens when the journal becomes too long, when the
+ * dataset is closed, and when the dataset is opened without B_INDEX_JOURNAL.
+ * Applying the same records more than once produces the same index, so if the
+ * process is interrupted before the journal file is deleted, the records are
+ * simply applied again when the dataset is opened next time.
+ *
+ * The journal file consists of a header, which contains a magic value and the
+ * version (8 bytes each), followed by records. Each record contains the offset
+ * and the length of the range (8 bytes each), the type of the record (4 bytes),
+ * and a checksum of the preceding 20 bytes (4 bytes). Reading stops at the
+ * first incomplete or damaged record, which was not written completely.
+ */
+
+#define BTOEP_INDEX_JOURNAL_MAX_LENGTH 4096
+
+#define JOURNAL_FILE_MAGIC       "BTOEPLOG"
+#define JOURNAL_FILE_VERSION     1
+#define JOURNAL_FILE_HEADER_SIZE 16
+#define JOURNAL_FILE_RECORD_SIZE 24
+
+#define JOURNAL_RECORD_ADD    1
+#define JOURNAL_RECORD_REMOVE 2
+
+static bool index_flush_base(btoep_dataset* dataset);
+
+// FNV-1a, which is sufficient to detect incomplete writes.
+static uint32_t journal_checksum(const uint8_t* data, size_t length) {
+  uint32_t hash = 0x811c9dc5;
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ data[i]) * 0x01000193;
+  return hash;
+}
+
+static bool index_journal_reserve(btoep_dataset* dataset, size_t length) {
+  btoep_index_journal_record* journal = reserve_array(
+      dataset->journal, &dataset->journal_capacity, length,
+      sizeof(btoep_index_journal_record));
+  if (journal == NULL)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+  dataset->journal = journal;
+  return true;
+}
+
+/*
+ * Applies consecutive records of the same type to the index in a single pass.
+ * The journal must be empty when this is called, otherwise the changes would
+ * only be applied to the decoded index table.
+ */
+static bool index_journal_replay(btoep_dataset* dataset,
+                                 const btoep_index_journal_record* records,
+                                 size_t n_records) {
+  assert(dataset->journal_length == 0);
+
+  btoep_range* ranges = malloc(BTOEP_INDEX_JOURNAL_MAX_LENGTH * sizeof(btoep_range));
+  if (ranges == NULL)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+
+  bool ok = true;
+  size_t i = 0;
+  while (ok && i < n_records) {
+    bool is_removal = records[i].is_removal;
+    size_t n = 0;
+    while (i < n_records && records[i].is_removal == is_removal &&
+           n < BTOEP_INDEX_JOURNAL_MAX_LENGTH) {
+      ranges[n++] = records[i++].range;
+    }
+
+    btoep_range* sorted;
+    if (!(ok = coalesce_ranges(dataset, ranges, n, &sorted, &n)))
+      break;
+    if (n != 0) {
+      ok = is_removal ? index_remove_sorted(dataset, sorted, n)
+                      : index_add_sorted(dataset, sorted, n);
+    }
+    free(sorted);
+  }
+
+  free(ranges);
+  return ok;
+}
+
+/*
+ * Folds all journal records into the index. The decoded index table already
+ * reflects the records, so it is set aside while the index is modified.
+ */
+static bool index_journal_compact(btoep_dataset* dataset) {
+  if (dataset->journal_length == 0 && dataset->journal_n_written == 0)
+    return true;
+
+  btoep_range* table = dataset->index_table;
+  size_t table_length = dataset->index_table_length;
+  size_t table_capacity = dataset->index_table_capacity;
+  bool table_is_loaded = dataset->index_table_is_loaded;
+  dataset->index_table = NULL;
+  dataset->index_table_length = 0;
+  dataset->index_table_capacity = 0;
+  dataset->index_table_is_loaded = false;
+
+  size_t n_records = dataset->journal_length;
+  dataset->journal_length = 0;
+  dataset->index_rev++;
+
+  bool ok = index_journal_replay(dataset, dataset->journal, n_records);
+
+  index_table_discard(dataset);
+  dataset->index_table = table;
+  dataset->index_table_length = table_length;
+  dataset->index_table_capacity = table_capacity;
+  dataset->index_table_is_loaded = table_is_loaded;
+
+  if (!ok) {
+    // The index is in an unknown state, but the journal file is still intact.
+    index_table_discard(dataset);
+    return false; // TODO: Mark the cache as corrupted
+  }
+
+  if (!index_flush_base(dataset))
+    return false;
+
+  if (dataset->journal_n_written != 0 &&
+      !path_delete(dataset, dataset->journal_path))
+    return false;
+  dataset->journal_n_written = 0;
+  return true;
+}
+
+/*
+ * Records the given changes in the journal. The ranges must be sorted, must
+ * not be empty, and must be neither adjacent nor overlapping.
+ */
+static bool index_journal_append(btoep_dataset* dataset,
+                                 const btoep_range* ranges, size_t n_ranges,
+                                 bool is_removal) {
+  // The journal cannot be used without the decoded index table.
+  index_bitmap_discard(dataset);
+  if (dataset->journal_length == 0 && !index_table_load(dataset))
+    return false;
+
+  if (!dataset->index_table_is_loaded ||
+      !index_journal_reserve(dataset, dataset->journal_length + n_ranges)) {
+    if (!index_journal_compact(dataset))
+      return false;
+    return is_removal ? index_remove_sorted(dataset, ranges, n_ranges)
+                      : index_add_sorted(dataset, ranges, n_ranges);
+  }
+
+  for (size_t i = 0; i < n_ranges; i++) {
+    btoep_index_journal_record* record = &dataset->journal[dataset->journal_length++];
+    record->range = ranges[i];
+    record->is_removal = is_removal;
+  }
+
+  index_table_apply(dataset, ranges, n_ranges, is_removal);
+
+  // Prevent existing iterators from being used.
+  dataset->index_rev++;
+
+  if (!dataset->index_table_is_loaded ||
+      dataset->journal_length >= BTOEP_INDEX_JOURNAL_MAX_LENGTH)
+    return index_journal_compact(dataset);
+  return true;
+}
+
+/*
+ * Appends all records that have not been written yet to the journal file.
+ */
+static bool index_journal_write(btoep_dataset* dataset) {
+  if (dataset->journal_n_written == dataset->journal_length)
+    return true;
+
+  size_t n_records = dataset->journal_length - dataset->journal_n_written;
+  size_t size = n_records * JOURNAL_FILE_RECORD_SIZE;
+  bool write_header = dataset->journal_n_written == 0;
+  if (write_header)
+    size += JOURNAL_FILE_HEADER_SIZE;
+
+  uint8_t* buffer = malloc(size);
+  if (buffer == NULL)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+
+  uint8_t* out = buffer;
+  if (write_header) {
+    memcpy(out, JOURNAL_FILE_MAGIC, 8);
+    write_le64(out + 8, JOURNAL_FILE_VERSION);
+    out += JOURNAL_FILE_HEADER_SIZE;
+  }
+
+  for (size_t i = dataset->journal_n_written; i < dataset->journal_length; i++) {
+    const btoep_index_journal_record* record = &dataset->journal[i];
+    write_le64(out, record->range.offset);
+    write_le64(out + 8, record->range.length);
+    write_le32(out + 16, record->is_removal ? JOURNAL_RECORD_REMOVE :
+                                              JOURNAL_RECORD_ADD);
+    write_le32(out + 20, journal_checksum(out, 20));
+    out += JOURNAL_FILE_RECORD_SIZE;
+  }
+
+  // Records that were not written completely before are overwritten.
+  uint64_t offset = write_header ? 0 : JOURNAL_FILE_HEADER_SIZE +
+      (uint64_t) dataset->journal_n_written * JOURNAL_FILE_RECORD_SIZE;
+
+  btoep_fd fd;
+  bool created;
+  bool ok = fd_open_or_create(dataset, &fd, dataset->journal_path, &created);
+  if (ok) {
+    ok = fd_seek(dataset, fd, offset, SEEK_SET, NULL) &&
+         fd_write(dataset, fd, buffer, size);
+    ok = fd_close(dataset, fd) && ok;
+  }
+  free(buffer);
+
+  if (ok)
+    dataset->journal_n_written = dataset->journal_length;
+  return ok;
+}
+
+/*
+ * Reads the journal file, if it exists, and applies its records to the decoded
+ * index table. Unless the dataset uses the journal, the records are folded into
+ * the index immediately. The journal file of a new dataset is left over from a
+ * previous dataset and must be ignored.
+ */
+static bool index_journal_open(btoep_dataset* dataset, bool created) {
+  if (created) {
+    // There usually is no such file, so errors are ignored.
+    btoep_last_error_info last_error = dataset->last_error;
+    path_delete(dataset, dataset->journal_path);
+    dataset->last_error = last_error;
+    return true;
+  }
+
+  btoep_fd fd;
+  if (!fd_open(dataset, &fd, dataset->journal_path, B_OPEN_EXISTING_READ_ONLY)) {
+#ifdef _MSC_VER
+    return GetLastError() == ERROR_FILE_NOT_FOUND;
+#else
+    return errno == ENOENT;
+#endif
+  }
+
+  uint64_t size;
+  uint8_t* buffer = NULL;
+  size_t n_read = 0;
+  bool ok = fd_seek(dataset, fd, 0, SEEK_END, &size) &&
+            fd_seek(dataset, fd, 0, SEEK_SET, NULL);
+  if (ok && size > SIZE_MAX) {
+    ok = set_error(dataset, B_ERR_OUT_OF_MEMORY);
+  } else if (ok && size != 0) {
+    n_read = (size_t) size;
+    ok = ((buffer = malloc(n_read)) != NULL ||
+          set_error(dataset, B_ERR_OUT_OF_MEMORY)) &&
+         fd_read_fully(dataset, fd, buffer, &n_read);
+  }
+  ok = fd_close(dataset, fd) && ok;
+
+  // An empty file or an incomplete header are the result of an interrupted
+  // write, just like incomplete records.
+  if (ok && n_read >= JOURNAL_FILE_HEADER_SIZE &&
+      (memcmp(buffer, JOURNAL_FILE_MAGIC, 8) != 0 ||
+       read_le64(buffer + 8) != JOURNAL_FILE_VERSION)) {
+    ok = set_error(dataset, B_ERR_INVALID_INDEX_FORMAT);
+  }
+
+  size_t n_records = 0;
+  if (ok && n_read >= JOURNAL_FILE_HEADER_SIZE) {
+    size_t max_records = (n_read - JOURNAL_FILE_HEADER_SIZE) / JOURNAL_FILE_RECORD_SIZE;
+    ok = index_journal_reserve(dataset, max_records);
+    for (size_t i = 0; ok && i < max_records; i++) {
+      const uint8_t* in = buffer + JOURNAL_FILE_HEADER_SIZE +
+                          i * JOURNAL_FILE_RECORD_SIZE;
+      uint32_t type = read_le32(in + 16);
+      btoep_range range = { read_le64(in), read_le64(in + 8) };
+      if (read_le32(in + 20) != journal_checksum(in, 20) ||
+          (type != JOURNAL_RECORD_ADD && type != JOURNAL_RECORD_REMOVE) ||
+          range.length == 0 || range.offset + range.length < range.offset)
+        break;
+      dataset->journal[n_records].range = range;
+      dataset->journal[n_records].is_removal = type == JOURNAL_RECORD_REMOVE;
+      n_records++;
+    }
+  }
+  free(buffer);
+  if (!ok)
+    return false;
+
+  if (n_records == 0) {
+    // There is nothing to recover, but the file must not be appended to.
+    return dataset->read_only || path_delete(dataset, dataset->journal_path);
+  }
+
+  dataset->journal_n_written = n_records;
+
+  if (!dataset->read_only && dataset->index_uses_journal &&
+      !index_table_load(dataset))
+    return false;
+
+  if (!dataset->read_only &&
+      (!dataset->index_uses_journal || !dataset->index_table_is_loaded)) {
+    // Fold the records into the index right away.
+    return index_journal_replay(dataset, dataset->journal, n_records) &&
+           index_journal_compact(dataset);
+  }
+
+  if (!index_table_load(dataset))
+    return false;
+
+  // The records are applied one at a time since their order matters.
+  for (size_t i = 0; i < n_records; i++) {
+    index_table_apply(dataset, &dataset->journal[i].range, 1,
+                      dataset->journal[i].is_removal);
+  }
+  if (!dataset->index_table_is_loaded)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+
+  dataset->journal_length = n_records;
+  dataset->index_rev++;
+  return true;
+}
+
+/*
+ * The index revision identifies a state of the index. Unlike index_rev, which
+ * only needs to be unique within a process, it is persistent, and it increases
+ * with every change to the index. A bounded change log records which parts of
+ * the data recent changes affected, so that peers that know an earlier revision
+ * only need to exchange those parts.
+ *
+ * Both are stored in a separate file next to the index file, which is written
+ * when the index is flushed. Just like the checkpoint file, it also contains the
+ * size and the modification time of the index file, as well as the number of
+ * journal records at that revision, and the log is only trusted if they match
+ * the index. This avoids scanning the index whenever the file is read or
+ * written. Otherwise, the index was modified without updating the file, e.g.,
+ * because a process was interrupted in between, so the revision is incremented
+ * and the log is cleared. If there is no such file, the revision
+ * starts at the modification time of the index file, which is almost certainly
+ * larger than any revision that the index had before.
+ */
+
+#define CHANGE_FILE_MAGIC       "BTOEPCHG"
+#define CHANGE_FILE_VERSION     1
+#define CHANGE_FILE_HEADER_SIZE 64
+#define CHANGE_FILE_RECORD_SIZE 24
+
+static void index_changes_clear(btoep_dataset* dataset) {
+  dataset->changes_first_revision = dataset->revision;
+  dataset->n_changes = 0;
+  dataset->changes_are_dirty = true;
+}
+
+/*
+ * Reads the change file, which is small since the log is bounded, and checks
+ * that it matches the index. This returns false if the file does not exist or
+ * cannot be read, and sets is_valid to false if the file is outdated.
+ */
+static bool index_changes_read_file(btoep_dataset* dataset, bool* is_valid) {
+  btoep_fd fd;
+  if (!fd_open(dataset, &fd, dataset->changes_path, B_OPEN_EXISTING_READ_ONLY))
+    return false;
+
+  uint8_t* buffer = malloc(CHANGE_FILE_HEADER_SIZE + CHANGE_FILE_RECORD_SIZE *
+                           BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH + 1);
+  size_t n_read = CHANGE_FILE_HEADER_SIZE + CHANGE_FILE_RECORD_SIZE *
+                  BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH + 1;
+  bool ok = buffer != NULL && fd_read_fully(dataset, fd, buffer, &n_read) &&
+            n_read >= CHANGE_FILE_HEADER_SIZE &&
+            memcmp(buffer, CHANGE_FILE_MAGIC, 8) == 0 &&
+            read_le64(buffer + 8) == CHANGE_FILE_VERSION;
+  fd_close(dataset, fd); // TODO: Return value
+  if (!ok) {
+    free(buffer);
+    return false;
+  }
+
+  dataset->revision = read_le64(buffer + 16);
+  dataset->changes_first_revision = read_le64(buffer + 24);
+  uint64_t n_records = read_le64(buffer + 56);
+  uint64_t index_mtime;
+  *is_valid = dataset->changes_first_revision <= dataset->revision &&
+              dataset->total_index_size == dataset->total_index_size_on_disk &&
+              read_le64(buffer + 32) == dataset->total_index_size &&
+              fd_get_mtime(dataset, dataset->index_fd, &index_mtime) &&
+              read_le64(buffer + 40) == index_mtime &&
+              read_le64(buffer + 48) == dataset->journal_length &&
+              n_records <= BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH &&
+              n_read == CHANGE_FILE_HEADER_SIZE +
+                        n_records * CHANGE_FILE_RECORD_SIZE;
+
+  btoep_index_change* changes = NULL;
+  if (*is_valid && n_records != 0) {
+    changes = reserve_array(NULL, &dataset->changes_capacity, (size_t) n_records,
+                            sizeof(btoep_index_change));
+    *is_valid = changes != NULL;
+  }
+
+  uint64_t prev_revision = dataset->changes_first_revision;
+  for (size_t i = 0; *is_valid && i < n_records; i++) {
+    const uint8_t* in = buffer + CHANGE_FILE_HEADER_SIZE +
+                        i * CHANGE_FILE_RECORD_SIZE;
+    btoep_index_change* change = &changes[i];
+    change->revision = read_le64(in);
+    change->range = btoep_mkrange(read_le64(in + 8), read_le64(in + 16));
+    *is_valid = change->revision > dataset->changes_first_revision &&
+                change->revision >= prev_revision &&
+                change->revision <= dataset->revision &&
+                change->range.length != 0 &&
+                change->range.offset + change->range.length > change->range.offset;
+    prev_revision = change->revision;
+  }
+  free(buffer);
+
+  if (*is_valid) {
+    dataset->changes = changes;
+    dataset->n_changes = (size_t) n_records;
+  } else {
+    free(changes);
+    dataset->changes_capacity = 0;
+  }
+  return true;
 }
 
-static bool btoep_index_read(btoep_index_iterator* iterator, uint64_t* next_offset, btoep_range* range) {
-  if (iterator->index_rev != iterator->dataset->index_rev)
-    return set_error(iterator->dataset, B_ERR_DEAD_INDEX_ITERATOR);
+/*
+ * Loads the revision and the change log. This must happen before the index is
+ * first modified, since the file refers to the index before the modification.
+ */
+static bool index_changes_load(btoep_dataset* dataset) {
+  if (dataset->changes_are_loaded)
+    return true;
 
-  btoep_range cache_range = { iterator->index_offset, 1024 };
-  if (!btoep_index_fill_cache(iterator->dataset, cache_range))
-    return false;
+  // Errors are ignored since a damaged file is equivalent to a missing one,
+  // and must not replace information about a previous error.
+  btoep_last_error_info last_error = dataset->last_error;
+  bool is_valid = false;
+  bool exists = index_changes_read_file(dataset, &is_valid);
+  dataset->last_error = last_error;
 
-  uint64_t missing_bytes, existing_bytes;
-  *next_offset = iterator->index_offset;
-  if (!btoep_index_uleb128(iterator->dataset, next_offset, &missing_bytes))
-    return false;
-  if (!btoep_index_uleb128(iterator->dataset, next_offset, &existing_bytes))
-    return false;
+  if (!exists) {
+    uint64_t mtime;
+    if (!fd_get_mtime(dataset, dataset->index_fd, &mtime))
+      return false;
+    dataset->revision = mtime;
+    index_changes_clear(dataset);
+  } else if (!is_valid) {
+    dataset->revision++;
+    index_changes_clear(dataset);
+  }
 
-  int is_first = iterator->data_offset == 0;
-  if (is_first) {
-    range->offset = missing_bytes;
-  } else {
-    range->offset = iterator->data_offset + missing_bytes + 1;
+  dataset->changes_are_loaded = true;
+  return true;
+}
+
+/*
+ * Records that a change to the index affected the given ranges, which must be
+ * sorted. If the log becomes too long, the oldest revisions are discarded,
+ * a quarter of the log at a time.
+ */
+static void index_changes_append(btoep_dataset* dataset,
+                                 const btoep_range* ranges, size_t n_ranges) {
+  assert(dataset->changes_are_loaded);
+
+  dataset->revision++;
+  dataset->changes_are_dirty = true;
+  if (n_ranges > BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH) {
+    index_changes_clear(dataset);
+    return;
   }
 
-  range->length = existing_bytes + 1;
+  size_t new_length = dataset->n_changes + n_ranges;
+  if (new_length > BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH) {
+    size_t target = BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH / 4 * 3;
+    size_t n_dropped = (n_ranges >= target) ? dataset->n_changes
+                                            : new_length - target;
+    // Either all or none of the changes of a revision are in the log.
+    while (n_dropped < dataset->n_changes &&
+           dataset->changes[n_dropped].revision ==
+           dataset->changes[n_dropped - 1].revision) {
+      n_dropped++;
+    }
+    dataset->changes_first_revision = dataset->changes[n_dropped - 1].revision;
+    dataset->n_changes -= n_dropped;
+    memmove(dataset->changes, dataset->changes + n_dropped,
+            dataset->n_changes * sizeof(btoep_index_change));
+    new_length = dataset->n_changes + n_ranges;
+  }
 
-  return 1;
-}
+  btoep_index_change* changes = reserve_array(dataset->changes,
+                                              &dataset->changes_capacity,
+                                              new_length,
+                                              sizeof(btoep_index_change));
+  if (changes == NULL) {
+    // Forgetting changes is always safe.
+    index_changes_clear(dataset);
+    return;
+  }
+  dataset->changes = changes;
 
-bool btoep_index_iterator_next(btoep_index_iterator* iterator, btoep_range* range) {
-  uint64_t offset_in_index;
-  bool ret = btoep_index_read(iterator, &offset_in_index, range);
-  if (ret) {
-    iterator->index_offset = offset_in_index;
-    iterator->data_offset = range->offset + range->length;
+  for (size_t i = 0; i < n_ranges; i++) {
+    changes[dataset->n_changes].revision = dataset->revision;
+    changes[dataset->n_changes].range = ranges[i];
+    dataset->n_changes++;
   }
-  return ret;
 }
 
-bool btoep_index_iterator_peek(btoep_index_iterator* iterator, btoep_range* range) {
-  uint64_t offset_in_index;
-  return btoep_index_read(iterator, &offset_in_index, range);
-}
+static bool index_changes_write_file(btoep_dataset* dataset) {
+  if (!dataset->changes_are_dirty || dataset->read_only)
+    return true;
 
-bool btoep_index_iterator_skip(btoep_index_iterator* iterator) {
-  btoep_range range;
-  return btoep_index_iterator_next(iterator, &range);
-}
+  // The index and the journal must have been written already.
+  assert(dataset->total_index_size == dataset->total_index_size_on_disk);
+  assert(dataset->journal_n_written == dataset->journal_length);
 
-bool btoep_index_iterator_is_eof(btoep_index_iterator* iterator) {
-  assert(iterator->index_offset <= iterator->dataset->total_index_size);
-  return iterator->index_offset == iterator->dataset->total_index_size;
-}
+  uint64_t index_mtime;
+  if (!fd_get_mtime(dataset, dataset->index_fd, &index_mtime))
+    return false;
 
-typedef struct {
-  btoep_dataset* dataset;
-  uint8_t* buffer;
-  size_t insert_size;
-  uint64_t prev_entry_end;
-  uint64_t replace_start;
-  uint64_t replace_length;
-} index_editor;
+  size_t size = CHANGE_FILE_HEADER_SIZE +
+                dataset->n_changes * CHANGE_FILE_RECORD_SIZE;
+  uint8_t* buffer = malloc(size);
+  if (buffer == NULL)
+    return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+
+  memcpy(buffer, CHANGE_FILE_MAGIC, 8);
+  write_le64(buffer + 8, CHANGE_FILE_VERSION);
+  write_le64(buffer + 16, dataset->revision);
+  write_le64(buffer + 24, dataset->changes_first_revision);
+  write_le64(buffer + 32, dataset->total_index_size);
+  write_le64(buffer + 40, index_mtime);
+  write_le64(buffer + 48, dataset->journal_length);
+  write_le64(buffer + 56, dataset->n_changes);
+  for (size_t i = 0; i < dataset->n_changes; i++) {
+    uint8_t* out = buffer + CHANGE_FILE_HEADER_SIZE + i * CHANGE_FILE_RECORD_SIZE;
+    write_le64(out, dataset->changes[i].revision);
+    write_le64(out + 8, dataset->changes[i].range.offset);
+    write_le64(out + 16, dataset->changes[i].range.length);
+  }
 
-static void editor_init(btoep_dataset* dataset, index_editor* editor, uint8_t* buffer) {
-  editor->dataset = dataset;
-  editor->buffer = buffer;
-  editor->insert_size = 0;
-  editor->replace_length = 0;
-}
+  btoep_fd fd;
+  bool created;
+  bool ok = fd_open_or_create(dataset, &fd, dataset->changes_path, &created);
+  if (ok) {
+    ok = fd_write(dataset, fd, buffer, size) && fd_truncate(dataset, fd, size);
+    ok = fd_close(dataset, fd) && ok;
+  }
+  free(buffer);
 
-static void editor_set_start(index_editor* editor, uint64_t replace_start, uint64_t prev_entry_end) {
-  editor->replace_start = replace_start;
-  editor->prev_entry_end = prev_entry_end;
+  if (ok)
+    dataset->changes_are_dirty = false;
+  return ok;
 }
 
-static void editor_set_end(index_editor* editor, uint64_t replace_end) {
-  assert(editor->replace_start <= replace_end);
-  editor->replace_length = replace_end - editor->replace_start;
+/*
+ * Applies changes either to the index or to the journal.
+ */
+static bool index_update(btoep_dataset* dataset, const btoep_range* ranges,
+                         size_t n_ranges, bool is_removal) {
+  if (!index_changes_load(dataset))
+    return false;
+
+  bool ok;
+  if (dataset->index_uses_journal || dataset->journal_length != 0)
+    ok = index_journal_append(dataset, ranges, n_ranges, is_removal);
+  else if (is_removal)
+    ok = index_remove_sorted(dataset, ranges, n_ranges);
+  else
+    ok = index_add_sorted(dataset, ranges, n_ranges);
+
+  // Even a failed change might have modified parts of the index.
+  index_changes_append(dataset, ranges, n_ranges);
+  return ok;
 }
 
-static void editor_write_range(index_editor* editor, const btoep_range* range) {
-  bool is_first = editor->prev_entry_end == 0;
-  // TODO: Maybe handle length == 0 better? This would remove special handling from btoep-add.c
-  assert(range->length > 0 && (range->offset != 0 || is_first));
+// TODO: Avoid writing the same entry if a duplicate entry is added (just to avoid dirtying the cache)
+bool btoep_index_add(btoep_dataset* dataset, btoep_range range) {
+  if (dataset->read_only)
+    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
 
-  uint64_t relative_offset = range->offset - editor->prev_entry_end;
-  if (!is_first)
-    relative_offset--;
-  write_uleb128(editor->buffer + editor->insert_size, relative_offset, &editor->insert_size);
-  write_uleb128(editor->buffer + editor->insert_size, range->length - 1, &editor->insert_size);
-  editor->prev_entry_end = range->offset + range->length;
+  if (range.length == 0)
+    return true;
+
+  return index_update(dataset, &range, 1, false);
 }
 
-static bool editor_commit(index_editor* editor) {
-  // Now reassemble the index. This is a little tricky if it doesn't fit into the cache.
-  btoep_dataset* dataset = editor->dataset;
+bool btoep_index_add_many(btoep_dataset* dataset, const btoep_range* ranges,
+                          size_t n_ranges) {
+  if (dataset->read_only)
+    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
 
-  // TODO: Make this work if it does not fit into the cache.
-  // TODO: Don't put everything into the cache if the size of the entries did not change.
-  btoep_range cache_range = {
-    .offset = editor->replace_start,
-    .length = dataset->total_index_size - editor->replace_start
-  };
-  if (!btoep_index_fill_cache(dataset, cache_range))
+  btoep_range* sorted;
+  if (!coalesce_ranges(dataset, ranges, n_ranges, &sorted, &n_ranges))
     return false;
 
-  uint64_t replace_end = editor->replace_start + editor->replace_length;
-
-  memmove(dataset->index_cache + editor->replace_start + editor->insert_size,
-          dataset->index_cache + replace_end,
-          dataset->total_index_size - replace_end);
-  memcpy(dataset->index_cache + editor->replace_start - dataset->index_cache_range.offset, editor->buffer, editor->insert_size);
-
-  // Adapt the size of the index.
-  uint64_t new_index_size = dataset->total_index_size + editor->insert_size - editor->replace_length;
-  if (!btoep_index_resize(dataset, new_index_size))
-    return false; // TODO: Mark the cache as corrupted
+  bool ok = n_ranges == 0 || index_update(dataset, sorted, n_ranges, false);
+  free(sorted);
+  return ok;
+}
 
-  // Make sure the changes in the cache will be written to disk eventually.
-  // TODO: Make this work if the data does not fit into the cache
-  cache_range.length = new_index_size - editor->replace_start;
-  btoep_index_cache_mark_dirty(dataset, cache_range);
+bool btoep_index_remove(btoep_dataset* dataset, btoep_range range) {
+  if (dataset->read_only)
+    return set_error(dataset, B_ERR_DATASET_READ_ONLY);
 
-  // Prevent existing iterators from being used.
-  dataset->index_rev++;
+  if (range.length == 0)
+    return true;
 
-  return true;
+  return index_update(dataset, &range, 1, true);
 }
 
-// TODO: Avoid writing the same entry if a duplicate entry is added (just to avoid dirtying the cache)
-bool btoep_index_add(btoep_dataset* dataset, btoep_range range) {
+bool btoep_index_remove_many(btoep_dataset* dataset, const btoep_range* ranges,
+                             size_t n_ranges) {
   if (dataset->read_only)
     return set_error(dataset, B_ERR_DATASET_READ_ONLY);
 
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
+  btoep_range* sorted;
+  if (!coalesce_ranges(dataset, ranges, n_ranges, &sorted, &n_ranges))
     return false;
 
-  btoep_range entry;
-
-  index_editor editor;
-  uint8_t editor_buffer[40];
-  editor_init(dataset, &editor, editor_buffer);
+  bool ok = n_ranges == 0 || index_update(dataset, sorted, n_ranges, true);
+  free(sorted);
+  return ok;
+}
 
-  // First, skip all entries to the left of the new range.
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_peek(&iterator, &entry))
+/*
+ * Encodes all entries of the source in the compact format, which is also the
+ * logical content of a paged index, and computes their statistics.
+ */
+static bool index_encode_source(btoep_dataset* dataset,
+                                btoep_index_source* source, uint8_t** out,
+                                size_t* size, btoep_index_stats* stats) {
+  uint8_t* buffer = NULL;
+  size_t length = 0, capacity = 0;
+  memset(stats, 0, sizeof(btoep_index_stats));
+
+  for (;;) {
+    bool exists;
+    btoep_range entry;
+    if (!btoep_index_source_next(source, &exists, &entry)) {
+      dataset->last_error = source->last_error;
+      free(buffer);
       return false;
-    if (entry.offset + entry.length >= range.offset)
+    }
+    if (!exists)
       break;
-    if (!btoep_index_iterator_skip(&iterator))
-      return false;
-  }
 
-  editor_set_start(&editor, iterator.index_offset, iterator.data_offset);
+    if (capacity - length < MAX_INDEX_ENTRY_SIZE) {
+      uint8_t* new_buffer = reserve_array(buffer, &capacity,
+                                          length + MAX_INDEX_ENTRY_SIZE, 1);
+      if (new_buffer == NULL) {
+        free(buffer);
+        return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+      }
+      buffer = new_buffer;
+    }
 
-  // Next, find all entries that we can merge.
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_peek(&iterator, &entry))
-      return false;
-    if (!btoep_range_union(&range, entry))
-      break;
-    if (!btoep_index_iterator_skip(&iterator))
-      return false;
+    // Sources only produce entries that are neither adjacent nor overlapping.
+    uint64_t relative_offset = entry.offset;
+    if (stats->n_entries != 0)
+      relative_offset -= stats->end + 1;
+    write_uleb128(buffer + length, relative_offset, &length);
+    write_uleb128(buffer + length, entry.length - 1, &length);
+
+    stats->n_entries++;
+    stats->n_bytes += entry.length;
+    stats->end = entry.offset + entry.length;
+    stats->fingerprint += index_entry_hash(entry);
   }
 
-  // Create the new entry outside of the index.
-  editor_write_range(&editor, &range);
+  *out = buffer;
+  *size = length;
+  return true;
+}
 
-  // If we are not at the end of the index yet, we will also need to modify the next entry.
-  if (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_next(&iterator, &entry))
-      return false;
-    editor_write_range(&editor, &entry);
-  }
+/*
+ * Points the dataset at the given index file and reads it from scratch. All
+ * state derived from the previous index file is discarded, so it must have been
+ * flushed.
+ */
+static bool index_reset(btoep_dataset* dataset, btoep_fd fd, bool create_paged) {
+  dataset->index_fd = fd;
+  for (size_t i = 0; i < BTOEP_INDEX_CACHE_PAGES; i++)
+    index_cache_invalidate_page(&dataset->index_cache[i]);
+  index_paged_discard(dataset);
+  index_table_discard(dataset);
+  index_bitmap_discard(dataset);
+  index_checkpoints_invalidate(dataset);
+  dataset->index_rev++;
 
-  editor_set_end(&editor, iterator.index_offset);
-  return editor_commit(&editor);
+  if (!fd_seek(dataset, fd, 0, SEEK_END, &dataset->total_index_size_on_disk))
+    return false;
+  dataset->current_index_offset = dataset->total_index_size_on_disk;
+  dataset->total_index_size = dataset->total_index_size_on_disk;
+  return index_paged_open(dataset, create_paged);
 }
 
-bool btoep_index_remove(btoep_dataset* dataset, btoep_range range) {
+bool btoep_index_replace(btoep_dataset* dataset, btoep_index_source* source) {
   if (dataset->read_only)
     return set_error(dataset, B_ERR_DATASET_READ_ONLY);
 
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
-    return false;
-
-  btoep_range entry;
+  btoep_path_buffer new_path;
+  if (!copy_path(new_path, NULL, dataset->index_path, ".tmp"))
+    return set_error(dataset, B_ERR_INVALID_ARGUMENT);
 
-  index_editor editor;
-  uint8_t editor_buffer[40];
-  editor_init(dataset, &editor, editor_buffer);
+  uint8_t* buffer;
+  size_t size;
+  btoep_index_stats stats;
+  if (!index_changes_load(dataset) ||
+      !index_encode_source(dataset, source, &buffer, &size, &stats))
+    return false;
 
-  // First, skip all entries to the left of the range that we need to delete.
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_peek(&iterator, &entry))
-      return false;
-    if (entry.offset + entry.length >= range.offset)
-      break;
-    if (!btoep_index_iterator_skip(&iterator))
-      return false;
+  // Journal records refer to the current index and must never be applied to the
+  // new index. Folding them into the current index first means that neither
+  // index file is ever accompanied by a journal file, even after a crash. The
+  // current index is flushed so that it remains usable if the replacement
+  // fails.
+  if (!index_journal_compact(dataset) || !btoep_index_flush(dataset)) {
+    free(buffer);
+    return false;
   }
 
-  editor_set_start(&editor, iterator.index_offset, iterator.data_offset);
+  // The new index is written to a separate file, which only replaces the index
+  // file once it is complete. Such a file might be left over from an
+  // interrupted replacement. There usually is none, so errors are ignored.
+  btoep_last_error_info last_error = dataset->last_error;
+  path_delete(dataset, new_path);
+  dataset->last_error = last_error;
+
+  btoep_fd index_fd = dataset->index_fd;
+  btoep_fd new_fd;
+  if (!fd_open(dataset, &new_fd, new_path, B_CREATE_NEW_READ_WRITE)) {
+    free(buffer);
+    return false;
+  }
 
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_peek(&iterator, &entry))
-      return false;
-    if (!btoep_range_overlaps(entry, range))
-      break;
-    if (!btoep_index_iterator_skip(&iterator))
-      return false;
+  uint64_t old_index_size = dataset->total_index_size;
+  bool is_paged = dataset->index_is_paged;
+  bool ok = index_reset(dataset, new_fd, is_paged);
+  if (ok && is_paged) {
+    // Leaves are filled and allocated in order.
+    ok = index_paged_splice(dataset, 0, 0, buffer, size) &&
+         btoep_index_resize(dataset, size);
+    dataset->index_stats = stats;
+    dataset->index_stats_are_known = true;
+    dataset->index_header_is_dirty = true;
+  } else if (ok) {
+    ok = fd_write(dataset, new_fd, buffer, size);
+    dataset->current_index_offset = size;
+    dataset->total_index_size = dataset->total_index_size_on_disk = size;
+  }
+  free(buffer);
 
-    btoep_range right_part_of_split_entry;
-    btoep_range_remove(&entry, &right_part_of_split_entry, range);
-    if (entry.length != 0)
-      editor_write_range(&editor, &entry); // This can only happen for the first entry, TOOD: assert that
-    if (right_part_of_split_entry.length != 0)
-      editor_write_range(&editor, &right_part_of_split_entry); // This can only happen for the last entry, TODO: assert that
+  ok = ok && index_flush_base(dataset);
+  if (ok) {
+    ok = path_replace(dataset, dataset->index_path, &index_fd, new_path, new_fd);
+  } else {
+    fd_close(dataset, new_fd); // TODO: Return value
   }
 
-  // If we are not at the end of the index yet, we will also need to modify the next entry.
-  // TODO: This is only necessary if we did not create a right part for the previous entry. Assert that.
-  if (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_next(&iterator, &entry))
-      return false;
-    editor_write_range(&editor, &entry);
+  if (!ok) {
+    // The index file has not been replaced, and the new file is useless.
+    last_error = dataset->last_error;
+    path_delete(dataset, new_path);
+    index_reset(dataset, index_fd, false); // TODO: Return value
+    dataset->last_error = last_error;
+    return false;
   }
 
-  editor_set_end(&editor, iterator.index_offset);
-  return editor_commit(&editor);
+  if (!index_reset(dataset, index_fd, false))
+    return false;
+
+  // The change affects the entire index, so there is no point in logging it.
+  dataset->revision++;
+  index_changes_clear(dataset);
+
+  // Cursors follow the change like any other edit, which in this case affects
+  // the entire index.
+  dataset->index_rev++;
+  dataset->last_edit_rev = dataset->index_rev;
+  dataset->last_edit_start = 0;
+  dataset->last_edit_end = old_index_size;
+  dataset->last_edit_old_size = old_index_size;
+
+  dataset->index_stats = stats;
+  dataset->index_stats_are_known = true;
+  return true;
 }
 
 bool btoep_index_find_offset(btoep_dataset* dataset, uint64_t start, int mode,
                              bool* exists, uint64_t* offset) {
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
+  bool found;
+  btoep_range range;
+  if (!index_find_entry(dataset, start, &found, &range))
     return false;
 
-  btoep_range range;
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    if (!btoep_index_iterator_next(&iterator, &range))
-      return false;
+  if (found) {
     if (range.offset > start) {
       *offset = (mode == BTOEP_FIND_DATA) ? range.offset : start;
-      *exists = true;
-      return true;
-    } else if (btoep_range_contains(range, start)) {
+    } else {
+      assert(btoep_range_contains(range, start));
       *offset = (mode == BTOEP_FIND_DATA) ? start : range.offset + range.length;
-      *exists = true;
-      return true;
     }
+    *exists = true;
+    return true;
   }
 
   if ((*exists = (mode == BTOEP_FIND_NO_DATA)))
@@ -874,70 +4577,270 @@ bool btoep_index_contains(btoep_dataset* dataset, btoep_range range, bool* resul
     return true;
   }
 
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
+  // Only the entry that contains the first offset can contain the whole range.
+  bool found;
+  btoep_range entry;
+  if (!index_find_entry(dataset, range.offset, &found, &entry))
     return false;
 
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    btoep_range entry;
-    if (!btoep_index_iterator_next(&iterator, &entry))
+  *result = found && btoep_range_is_subset(entry, range);
+  return true;
+}
+
+bool btoep_index_contains_any(btoep_dataset* dataset, btoep_range range, bool* result) {
+  // If the first entry that ends after the start of the range does not
+  // intersect with the range, no other entry does.
+  bool found;
+  btoep_range entry;
+  if (!index_find_entry(dataset, range.offset, &found, &entry))
+    return false;
+
+  *result = found && btoep_range_intersect(&entry, range);
+  return true;
+}
+
+bool btoep_index_get_stats(btoep_dataset* dataset, btoep_index_stats* stats) {
+  // While the journal contains records, the statistics of the index file are
+  // outdated, but the decoded index table is loaded and cheap to scan.
+  bool use_cached = dataset->index_stats_are_known && dataset->journal_length == 0;
+  if (use_cached) {
+    *stats = dataset->index_stats;
+  } else {
+    btoep_index_iterator iterator;
+    if (!btoep_index_iterator_start(dataset, &iterator))
       return false;
 
-    if (btoep_range_is_subset(entry, range)) {
-      *result = true;
-      return true;
+    memset(stats, 0, sizeof(btoep_index_stats));
+    while (!btoep_index_iterator_is_eof(&iterator)) {
+      btoep_range entry;
+      if (!btoep_index_iterator_next(&iterator, &entry))
+        return false;
+      stats->n_entries++;
+      stats->n_bytes += entry.length;
+      stats->end = entry.offset + entry.length;
+      stats->fingerprint += index_entry_hash(entry);
     }
 
-    if (entry.offset >= range.offset)
-      break;
+    if (dataset->journal_length == 0) {
+      dataset->index_stats = *stats;
+      dataset->index_stats_are_known = true;
+      // Older paged indexes store the statistics from now on.
+      if (dataset->index_is_paged && !dataset->read_only)
+        dataset->index_header_is_dirty = true;
+    }
   }
 
-  *result = false;
+  stats->format_version = dataset->index_is_paged ? dataset->index_paged_version : 0;
   return true;
 }
 
-bool btoep_index_contains_any(btoep_dataset* dataset, btoep_range range, bool* result) {
-  btoep_index_iterator iterator;
-  if (!btoep_index_iterator_start(dataset, &iterator))
+bool btoep_index_get_revision(btoep_dataset* dataset, uint64_t* revision) {
+  if (!index_changes_load(dataset))
     return false;
+  *revision = dataset->revision;
+  return true;
+}
 
-  while (!btoep_index_iterator_is_eof(&iterator)) {
-    btoep_range entry;
-    if (!btoep_index_iterator_next(&iterator, &entry))
-      return false;
+bool btoep_index_get_changes(btoep_dataset* dataset, uint64_t since,
+                             btoep_range* ranges, size_t* n_ranges,
+                             bool* is_complete) {
+  if (!index_changes_load(dataset))
+    return false;
 
-    if (btoep_range_intersect(&entry, range)) {
-      *result = true;
-      return true;
+  *n_ranges = 0;
+  *is_complete = since >= dataset->changes_first_revision &&
+                 since <= dataset->revision;
+  if (!*is_complete)
+    return true;
+
+  // Changes are in the order of their revisions.
+  size_t start = dataset->n_changes;
+  while (start != 0 && dataset->changes[start - 1].revision > since)
+    start--;
+
+  size_t n = dataset->n_changes - start;
+  for (size_t i = 0; i < n; i++)
+    ranges[i] = dataset->changes[start + i].range;
+
+  if (n != 0) {
+    qsort(ranges, n, sizeof(btoep_range), compare_ranges);
+    size_t n_merged = 1;
+    for (size_t i = 1; i < n; i++) {
+      if (!btoep_range_union(&ranges[n_merged - 1], ranges[i]))
+        ranges[n_merged++] = ranges[i];
     }
+    n = n_merged;
+  }
+
+  *n_ranges = n;
+  return true;
+}
+
+/*
+ * Index snapshots. A reader pins the slot of the current snapshot by
+ * incrementing its reader count, and then checks that the slot is still
+ * current. Since the writer only ever rebuilds slots that are neither current
+ * nor pinned, and only makes a slot current once the snapshot is complete, a
+ * reader that passes this check uses a complete snapshot that cannot change
+ * until it is released. A reader that fails the check never touches the
+ * snapshot, so it does not matter if the slot is being rebuilt.
+ */
+
+bool btoep_index_snapshot_publish(btoep_dataset* dataset) {
+  btoep_index_stats stats;
+  uint64_t revision, data_size;
+  if (!btoep_index_get_stats(dataset, &stats) ||
+      !btoep_index_get_revision(dataset, &revision) ||
+      !btoep_data_get_size(dataset, &data_size))
+    return false;
 
-    if (entry.offset >= range.offset + range.length)
+  long current = atomic_load_long(&dataset->current_snapshot);
+  btoep_index_snapshot_slot* slot = NULL;
+  long i;
+  for (i = 0; i < BTOEP_INDEX_SNAPSHOT_SLOTS; i++) {
+    slot = &dataset->snapshot_slots[i];
+    if (i != current && atomic_load_long(&slot->n_readers) == 0)
       break;
   }
+  if (i == BTOEP_INDEX_SNAPSHOT_SLOTS)
+    return set_error(dataset, B_ERR_SNAPSHOTS_IN_USE);
+
+  if (stats.n_entries > slot->capacity) {
+    if (stats.n_entries > SIZE_MAX / sizeof(btoep_range))
+      return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+    size_t capacity = (size_t) stats.n_entries;
+    btoep_range* ranges = realloc(slot->ranges, capacity * sizeof(btoep_range));
+    if (ranges == NULL)
+      return set_error(dataset, B_ERR_OUT_OF_MEMORY);
+    slot->ranges = ranges;
+    slot->capacity = capacity;
+  }
+
+  size_t n_ranges = 0;
+  if (stats.n_entries != 0 &&
+      !btoep_index_get_ranges(dataset, btoep_max_range_from(0), BTOEP_FIND_DATA,
+                              slot->ranges, slot->capacity, &n_ranges, NULL))
+    return false;
+  assert(n_ranges == stats.n_entries);
 
-  *result = false;
+  slot->snapshot.revision = revision;
+  slot->snapshot.data_size = data_size;
+  slot->snapshot.ranges = slot->ranges;
+  slot->snapshot.n_ranges = n_ranges;
+  atomic_store_long(&dataset->current_snapshot, i);
   return true;
 }
 
-bool btoep_index_flush(btoep_dataset* dataset) {
-  if (!dataset->index_cache_is_dirty)
-    return true;
+const btoep_index_snapshot* btoep_index_snapshot_acquire(btoep_dataset* dataset) {
+  for (;;) {
+    long current = atomic_load_long(&dataset->current_snapshot);
+    if (current < 0)
+      return NULL;
+    btoep_index_snapshot_slot* slot = &dataset->snapshot_slots[current];
+    atomic_increment_long(&slot->n_readers);
+    if (atomic_load_long(&dataset->current_snapshot) == current)
+      return &slot->snapshot;
+    // Another snapshot was published in the meantime.
+    atomic_decrement_long(&slot->n_readers);
+  }
+}
+
+void btoep_index_snapshot_release(const btoep_index_snapshot* snapshot) {
+  btoep_index_snapshot_slot* slot = (btoep_index_snapshot_slot*) snapshot;
+  atomic_decrement_long(&slot->n_readers);
+}
+
+/*
+ * Returns the position of the first entry in the snapshot that ends after the
+ * given offset, or the number of entries if there is no such entry.
+ */
+static size_t index_snapshot_search(const btoep_index_snapshot* snapshot,
+                                    uint64_t offset) {
+  size_t low = 0, high = snapshot->n_ranges;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    btoep_range entry = snapshot->ranges[mid];
+    if (entry.offset + entry.length > offset)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return low;
+}
+
+bool btoep_index_snapshot_find_offset(const btoep_index_snapshot* snapshot,
+                                      uint64_t start, int mode,
+                                      uint64_t* offset) {
+  size_t i = index_snapshot_search(snapshot, start);
+  if (i == snapshot->n_ranges) {
+    *offset = start;
+    return mode == BTOEP_FIND_NO_DATA;
+  }
+
+  btoep_range entry = snapshot->ranges[i];
+  if (entry.offset > start)
+    *offset = (mode == BTOEP_FIND_DATA) ? entry.offset : start;
+  else
+    *offset = (mode == BTOEP_FIND_DATA) ? start : entry.offset + entry.length;
+  return true;
+}
 
-  if (!btoep_set_index_fd_offset(dataset, dataset->index_cache_dirty_range.offset))
+bool btoep_index_snapshot_contains(const btoep_index_snapshot* snapshot,
+                                   btoep_range range) {
+  if (range.length == 0)
+    return range.offset <= snapshot->data_size;
+
+  size_t i = index_snapshot_search(snapshot, range.offset);
+  return i != snapshot->n_ranges &&
+         btoep_range_is_subset(snapshot->ranges[i], range);
+}
+
+bool btoep_index_snapshot_contains_any(const btoep_index_snapshot* snapshot,
+                                       btoep_range range) {
+  size_t i = index_snapshot_search(snapshot, range.offset);
+  if (i == snapshot->n_ranges)
     return false;
+  btoep_range entry = snapshot->ranges[i];
+  return btoep_range_intersect(&entry, range);
+}
+
+static bool index_flush_base(btoep_dataset* dataset) {
+  if (dataset->index_is_paged &&
+      (dataset->index_header_is_dirty ||
+       dataset->total_index_size_on_disk != dataset->total_index_size)) {
+    if (!index_paged_write_header(dataset))
+      return false;
+  }
+
+  for (size_t i = 0; i < BTOEP_INDEX_CACHE_PAGES; i++) {
+    if (!index_cache_write_back(dataset, &dataset->index_cache[i]))
+      return false;
+  }
 
-  if (dataset->total_index_size_on_disk != dataset->total_index_size) {
+  if (dataset->index_is_paged) {
+    // Unused pages remain in the index file.
+    dataset->total_index_size_on_disk = dataset->total_index_size;
+  } else if (dataset->total_index_size_on_disk != dataset->total_index_size) {
+    // Pages are never written beyond the end of the index, but the index file
+    // still contains old data if the index has become smaller.
     if (!fd_truncate(dataset, dataset->index_fd, dataset->total_index_size))
       return false;
     dataset->total_index_size_on_disk = dataset->total_index_size;
   }
 
-  if (!fd_write(dataset, dataset->index_fd,
-                dataset->index_cache + dataset->index_cache_dirty_range.offset,
-                dataset->index_cache_dirty_range.length))
-    return false;
-
-  dataset->index_cache_is_dirty = false;
+  // This must happen after writing the index since the checkpoint file refers
+  // to the modification time of the index file. Errors are ignored, and must
+  // not replace information about a previous error.
+  btoep_last_error_info last_error = dataset->last_error;
+  index_checkpoints_write_file(dataset);
+  dataset->last_error = last_error;
 
   return true;
 }
+
+bool btoep_index_flush(btoep_dataset* dataset) {
+  // The change file refers to the index, including the journal, so it must be
+  // written last.
+  return index_journal_write(dataset) && index_flush_base(dataset) &&
+         index_changes_write_file(dataset);
+}
@@ -0,0 +1,367 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/btoep/eliasfano.h"
+#include "bits.h"
+
+static bool set_ef_error(btoep_last_error_info* info, int error_code,
+                         const char* func) {
+  info->code = error_code;
+  info->func = func;
+  info->system_error_code = 0;
+  info->system_func = NULL;
+  return false;
+}
+
+#define set_error(info, error) set_ef_error(info, error, __func__)
+
+// A ULEB128 value that represents any 64-bit integer takes up to ten bytes.
+#define MAX_ULEB128_LENGTH 10
+#define HEADER_MAX_SIZE    (BTOEP_EF_MAGIC_SIZE + 2 * MAX_ULEB128_LENGTH)
+
+static inline uint64_t div_ceil(uint64_t a, uint64_t b) {
+  return a / b + (a % b != 0);
+}
+
+static inline unsigned choose_low_bits(uint64_t n_values, uint64_t max_value) {
+  return (max_value / n_values == 0) ? 0 : highest_bit(max_value / n_values);
+}
+
+static size_t write_uleb128(uint8_t* out, uint64_t value) {
+  size_t length = 0;
+  do {
+    out[length++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+  } while (value > 0);
+  return length;
+}
+
+static bool read_uleb128(const uint8_t* in, size_t size, size_t* pos,
+                         uint64_t* value) {
+  *value = 0;
+  for (unsigned i = 0; i < MAX_ULEB128_LENGTH && *pos < size; i++) {
+    uint8_t b = in[(*pos)++];
+    if (i == MAX_ULEB128_LENGTH - 1 && b > 1)
+      return false;
+    *value |= (uint64_t) (b & 0x7f) << (7 * i);
+    if ((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Encoder
+ */
+
+static void write_bits(uint8_t* out, uint64_t pos, uint64_t value,
+                       unsigned n_bits) {
+  while (n_bits != 0) {
+    unsigned shift = pos % 8;
+    unsigned n = (8 - shift < n_bits) ? 8 - shift : n_bits;
+    out[pos / 8] |= (uint8_t) ((value & ((1u << n) - 1)) << shift);
+    value >>= n;
+    pos += n;
+    n_bits -= n;
+  }
+}
+
+bool btoep_ef_encoder_init(btoep_ef_encoder* encoder, uint64_t n_ranges,
+                           uint64_t end) {
+  uint8_t header[HEADER_MAX_SIZE];
+  size_t header_size = BTOEP_EF_MAGIC_SIZE;
+  memcpy(header, BTOEP_EF_MAGIC, BTOEP_EF_MAGIC_SIZE);
+  header_size += write_uleb128(header + header_size, n_ranges);
+
+  encoder->n_values = 2 * n_ranges;
+  encoder->n_added = 0;
+  encoder->end = end;
+  encoder->prev_end = 0;
+  encoder->low_bits = 0;
+  uint64_t low_size = 0, high_size = 0;
+  if (n_ranges != 0) {
+    if (n_ranges > UINT64_MAX / 128 || end < 2 * n_ranges - 1)
+      return set_error(&encoder->last_error, B_ERR_INVALID_ARGUMENT);
+    header_size += write_uleb128(header + header_size, end);
+    encoder->low_bits = choose_low_bits(encoder->n_values, end);
+    low_size = div_ceil(encoder->n_values * encoder->low_bits, 8);
+    high_size = div_ceil(encoder->n_values + (end >> encoder->low_bits), 8);
+  }
+
+  uint64_t size = header_size + low_size + high_size;
+  if (size > SIZE_MAX ||
+      (encoder->data = calloc(1, (size_t) size)) == NULL)
+    return set_error(&encoder->last_error, B_ERR_OUT_OF_MEMORY);
+
+  memcpy(encoder->data, header, header_size);
+  encoder->size = (size_t) size;
+  encoder->low = encoder->data + header_size;
+  encoder->high = encoder->low + low_size;
+  return true;
+}
+
+static void encoder_add_value(btoep_ef_encoder* encoder, uint64_t value) {
+  uint64_t j = encoder->n_added++;
+  write_bits(encoder->low, j * encoder->low_bits, value, encoder->low_bits);
+  uint64_t pos = (value >> encoder->low_bits) + j;
+  encoder->high[pos / 8] |= (uint8_t) (1u << (pos % 8));
+}
+
+bool btoep_ef_encoder_add(btoep_ef_encoder* encoder, btoep_range range) {
+  // Values beyond the end of the last entry would not fit into the bit arrays.
+  uint64_t range_end = range.offset + range.length;
+  bool is_last = (encoder->n_added + 2 == encoder->n_values);
+  if (encoder->n_added == encoder->n_values || range.length == 0 ||
+      range_end < range.offset || range_end > encoder->end ||
+      (is_last && range_end != encoder->end) ||
+      (encoder->n_added != 0 && range.offset <= encoder->prev_end))
+    return set_error(&encoder->last_error, B_ERR_INVALID_ARGUMENT);
+
+  encoder_add_value(encoder, range.offset);
+  encoder_add_value(encoder, range_end);
+  encoder->prev_end = range_end;
+  return true;
+}
+
+void btoep_ef_encoder_free(btoep_ef_encoder* encoder) {
+  free(encoder->data);
+  encoder->data = NULL;
+}
+
+/*
+ * Decoder
+ */
+
+static inline uint64_t load_word(const uint8_t* data, size_t size,
+                                 uint64_t byte) {
+  uint64_t word = 0;
+  size_t n = (byte >= size) ? 0 : (size - byte < 8) ? size - byte : 8;
+  for (size_t i = n; i-- > 0;)
+    word = (word << 8) | data[byte + i];
+  return word;
+}
+
+static inline uint64_t high_word(const btoep_ef_index* index, uint64_t i) {
+  return load_word(index->high, index->high_size, 8 * i);
+}
+
+static inline uint64_t get_low(const btoep_ef_index* index, uint64_t j) {
+  if (index->low_bits == 0)
+    return 0;
+  uint64_t pos = j * index->low_bits;
+  unsigned shift = pos % 8;
+  uint64_t value = load_word(index->low, index->low_size, pos / 8) >> shift;
+  if (shift + index->low_bits > 64)
+    value |= (uint64_t) index->low[pos / 8 + 8] << (64 - shift);
+  return value & ((UINT64_C(1) << index->low_bits) - 1);
+}
+
+/* Returns the position of the n-th set bit within the word. */
+static inline unsigned select_in_word(uint64_t word, unsigned n) {
+  while (n-- != 0)
+    word &= word - 1;
+  return lowest_bit(word);
+}
+
+/*
+ * Finds the n-th one (or zero) within the high bit vector, starting at the
+ * closest sample. The bit must exist.
+ */
+static uint64_t high_select(const btoep_ef_index* index, bool value,
+                            uint64_t n) {
+  const uint64_t* samples = value ? index->one_samples : index->zero_samples;
+  uint64_t pos = samples[n / BTOEP_EF_SAMPLE_RATE];
+  n %= BTOEP_EF_SAMPLE_RATE;
+
+  uint64_t i = pos / 64;
+  uint64_t word = value ? high_word(index, i) : ~high_word(index, i);
+  word &= ~UINT64_C(0) << (pos % 64);
+  unsigned count;
+  while (n >= (count = count_bits(word))) {
+    n -= count;
+    i++;
+    word = value ? high_word(index, i) : ~high_word(index, i);
+  }
+  return 64 * i + select_in_word(word, (unsigned) n);
+}
+
+static inline uint64_t get_value(const btoep_ef_index* index, uint64_t j) {
+  uint64_t high = high_select(index, true, j) - j;
+  return (high << index->low_bits) | get_low(index, j);
+}
+
+/*
+ * Returns the number of values that are less than or equal to x. Only the
+ * values that share the high bits of x need to be compared. There are only a
+ * few of those on average, but values that are not distributed uniformly can
+ * share the same high bits, so they are searched by bisection.
+ */
+static uint64_t ef_rank(const btoep_ef_index* index, uint64_t x) {
+  uint64_t high = x >> index->low_bits;
+  if (index->n_values == 0 || high > index->n_zeros)
+    return index->n_values;
+
+  // The values with these high bits lie between the preceding zero and the
+  // next one, if any.
+  uint64_t lo = (high == 0) ? 0 : high_select(index, false, high - 1) + 1 - high;
+  uint64_t hi = (high == index->n_zeros) ? index->n_values
+                                         : high_select(index, false, high) - high;
+  uint64_t low = x & ((UINT64_C(1) << index->low_bits) - 1);
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (get_low(index, mid) <= low)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static inline uint64_t* alloc_samples(uint64_t n) {
+  uint64_t n_samples = div_ceil(n, BTOEP_EF_SAMPLE_RATE);
+  if (n_samples > SIZE_MAX / sizeof(uint64_t))
+    return NULL;
+  // Always allocate at least one sample to simplify error handling.
+  return malloc(n_samples == 0 ? 1 : (size_t) n_samples * sizeof(uint64_t));
+}
+
+/*
+ * Samples the positions of ones and zeros in the high bit vector, and ensures
+ * that all values are strictly increasing, so that queries never leave the
+ * bounds of the bit arrays.
+ */
+static bool build_samples(btoep_ef_index* index, uint64_t max_value) {
+  uint64_t n_ones = 0, n_zeros = 0, prev_value = 0;
+  uint64_t n_bits = index->n_values + index->n_zeros;
+  uint64_t n_words = div_ceil(8 * (uint64_t) index->high_size, 64);
+  for (uint64_t i = 0; i < n_words; i++) {
+    uint64_t word = high_word(index, i);
+    uint64_t valid_bits = (n_bits - 64 * i < 64) ? n_bits - 64 * i : 64;
+    if (valid_bits < 64 && (word >> valid_bits) != 0)
+      return false;
+
+    uint64_t zeros = ~word & ((valid_bits == 64) ? ~UINT64_C(0) :
+                              (UINT64_C(1) << valid_bits) - 1);
+    // Samples are further apart than the length of a word.
+    unsigned n_new_zeros = count_bits(zeros);
+    uint64_t next_sample = div_ceil(n_zeros, BTOEP_EF_SAMPLE_RATE) *
+                           BTOEP_EF_SAMPLE_RATE;
+    if (next_sample < n_zeros + n_new_zeros) {
+      unsigned pos = select_in_word(zeros, (unsigned) (next_sample - n_zeros));
+      index->zero_samples[next_sample / BTOEP_EF_SAMPLE_RATE] = 64 * i + pos;
+    }
+    n_zeros += n_new_zeros;
+
+    for (; word != 0; word &= word - 1) {
+      uint64_t pos = 64 * i + lowest_bit(word);
+      if (n_ones == index->n_values)
+        return false;
+      if (n_ones % BTOEP_EF_SAMPLE_RATE == 0)
+        index->one_samples[n_ones / BTOEP_EF_SAMPLE_RATE] = pos;
+      uint64_t value = ((pos - n_ones) << index->low_bits) |
+                       get_low(index, n_ones);
+      if (n_ones != 0 && value <= prev_value)
+        return false;
+      prev_value = value;
+      n_ones++;
+    }
+  }
+
+  return n_ones == index->n_values && n_zeros == index->n_zeros &&
+         prev_value == max_value;
+}
+
+bool btoep_ef_index_open(btoep_ef_index* index, const void* data, size_t size) {
+  const uint8_t* in = data;
+  size_t pos = BTOEP_EF_MAGIC_SIZE;
+  uint64_t max_value = 0;
+  if (size < BTOEP_EF_MAGIC_SIZE ||
+      memcmp(in, BTOEP_EF_MAGIC, BTOEP_EF_MAGIC_SIZE) != 0 ||
+      !read_uleb128(in, size, &pos, &index->n_ranges))
+    return set_error(&index->last_error, B_ERR_INVALID_INDEX_FORMAT);
+
+  index->n_values = 0;
+  index->n_zeros = 0;
+  index->low_bits = 0;
+  uint64_t low_size = 0, high_size = 0;
+  if (index->n_ranges != 0) {
+    // Each entry takes at least two bits in the high bit vector.
+    if (index->n_ranges > (uint64_t) size * 4 ||
+        !read_uleb128(in, size, &pos, &max_value) ||
+        max_value < 2 * index->n_ranges - 1)
+      return set_error(&index->last_error, B_ERR_INVALID_INDEX_FORMAT);
+    index->n_values = 2 * index->n_ranges;
+    index->low_bits = choose_low_bits(index->n_values, max_value);
+    index->n_zeros = max_value >> index->low_bits;
+    low_size = div_ceil(index->n_values * index->low_bits, 8);
+    high_size = div_ceil(index->n_values + index->n_zeros, 8);
+  }
+
+  if (size - pos != low_size + high_size)
+    return set_error(&index->last_error, B_ERR_INVALID_INDEX_FORMAT);
+
+  index->low = in + pos;
+  index->low_size = (size_t) low_size;
+  index->high = index->low + low_size;
+  index->high_size = (size_t) high_size;
+
+  index->one_samples = alloc_samples(index->n_values);
+  index->zero_samples = alloc_samples(index->n_zeros);
+  if (index->one_samples == NULL || index->zero_samples == NULL) {
+    btoep_ef_index_close(index);
+    return set_error(&index->last_error, B_ERR_OUT_OF_MEMORY);
+  }
+
+  if (!build_samples(index, max_value)) {
+    btoep_ef_index_close(index);
+    return set_error(&index->last_error, B_ERR_INVALID_INDEX_FORMAT);
+  }
+
+  return true;
+}
+
+void btoep_ef_index_close(btoep_ef_index* index) {
+  free(index->one_samples);
+  free(index->zero_samples);
+  index->one_samples = NULL;
+  index->zero_samples = NULL;
+}
+
+btoep_range btoep_ef_index_get(const btoep_ef_index* index, uint64_t i) {
+  uint64_t offset = get_value(index, 2 * i);
+  return btoep_mkrange(offset, get_value(index, 2 * i + 1) - offset);
+}
+
+bool btoep_ef_index_find_offset(const btoep_ef_index* index, uint64_t start,
+                                int mode, uint64_t* offset) {
+  // An odd number of boundaries up to the start means that an entry contains
+  // the start, and the next boundary is the end of that entry.
+  uint64_t rank = ef_rank(index, start);
+  bool is_inside = rank % 2 != 0;
+  if (is_inside == (mode == BTOEP_FIND_DATA)) {
+    *offset = start;
+    return true;
+  }
+
+  if (rank == index->n_values)
+    return false;
+  *offset = get_value(index, rank);
+  return true;
+}
+
+bool btoep_ef_index_contains(const btoep_ef_index* index, btoep_range range) {
+  if (range.length == 0)
+    return true;
+  uint64_t rank = ef_rank(index, range.offset);
+  return rank % 2 != 0 &&
+         get_value(index, rank) - range.offset >= range.length;
+}
+
+bool btoep_ef_index_contains_any(const btoep_ef_index* index,
+                                 btoep_range range) {
+  if (range.length == 0)
+    return false;
+  uint64_t rank = ef_rank(index, range.offset);
+  return rank % 2 != 0 || (rank != index->n_values &&
+                           get_value(index, rank) - range.offset < range.length);
+}
@@ -0,0 +1,44 @@
+#ifndef __BTOEP__MUTEX_H__
+#define __BTOEP__MUTEX_H__
+
+#include "../include/btoep/dataset.h"
+
+/*
+ * A minimal mutex, which is only used to protect shared state in the few places
+ * where concurrent calls are permitted. See btoep_mutex.
+ */
+
+static inline void mutex_init(btoep_mutex* mutex) {
+#ifdef _MSC_VER
+  InitializeSRWLock(mutex);
+#else
+  pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void mutex_destroy(btoep_mutex* mutex) {
+#ifdef _MSC_VER
+  // Slim reader/writer locks do not need to be destroyed.
+  (void) mutex;
+#else
+  pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void mutex_lock(btoep_mutex* mutex) {
+#ifdef _MSC_VER
+  AcquireSRWLockExclusive(mutex);
+#else
+  pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void mutex_unlock(btoep_mutex* mutex) {
+#ifdef _MSC_VER
+  ReleaseSRWLockExclusive(mutex);
+#else
+  pthread_mutex_unlock(mutex);
+#endif
+}
+
+#endif  // __BTOEP__MUTEX_H__
@@ -0,0 +1,643 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/btoep/shm.h"
+#include "atomic.h"
+
+#ifndef _MSC_VER
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+static bool set_shm_error(btoep_last_error_info* info, int error_code,
+                          const char* func, const char* system_func) {
+  info->code = error_code;
+  info->func = func;
+  if (system_func != NULL) {
+#ifdef _MSC_VER
+    info->system_error_code = GetLastError();
+#else
+    info->system_error_code = errno;
+#endif
+  } else {
+    info->system_error_code = 0;
+  }
+  info->system_func = system_func;
+  info->conflict_offset = 0;
+  return false;
+}
+
+#define set_error(info, error) \
+  set_shm_error(info, error, __func__, NULL)
+#define set_io_error(info, system_func) \
+  set_shm_error(info, B_ERR_INPUT_OUTPUT, __func__, system_func)
+
+#define SHM_CONTROL_MAGIC "BTOEPSHC"
+#define SHM_TABLE_MAGIC   "BTOEPSHT"
+
+#define SHM_MIN_CAPACITY 64
+
+/*
+ * Both segments are only shared between processes on the same host, so values
+ * are stored in native byte order.
+ */
+
+typedef struct {
+  char magic[8];
+  volatile uint64_t generation;
+  volatile uint64_t is_closed;
+} shm_control;
+
+typedef struct {
+  char magic[8];
+  volatile uint64_t sequence;
+  volatile uint64_t is_replaced;
+  uint64_t capacity;
+  volatile uint64_t revision;
+  volatile uint64_t data_size;
+  volatile uint64_t n_ranges;
+  volatile btoep_range ranges[];
+} shm_table;
+
+static inline size_t table_size(uint64_t capacity) {
+  return sizeof(shm_table) + (size_t) capacity * sizeof(btoep_range);
+}
+
+/*
+ * The name of the control segment is derived from the absolute path of the
+ * index file. The name of each table segment also contains its generation.
+ */
+static bool get_base_name(btoep_last_error_info* error, char* name,
+                          btoep_path data_path, btoep_path index_path) {
+  char path[OS_MAX_PATH], absolute_path[OS_MAX_PATH];
+  int n = (index_path == NULL) ? snprintf(path, OS_MAX_PATH, "%s.idx", data_path)
+                               : snprintf(path, OS_MAX_PATH, "%s", index_path);
+  if (n < 0 || n >= OS_MAX_PATH)
+    return set_error(error, B_ERR_INVALID_ARGUMENT);
+
+#ifdef _MSC_VER
+  DWORD length = GetFullPathNameA(path, OS_MAX_PATH, absolute_path, NULL);
+  if (length == 0 || length >= OS_MAX_PATH)
+    return set_io_error(error, "GetFullPathNameA");
+#else
+  if (realpath(path, absolute_path) == NULL)
+    return set_io_error(error, "realpath");
+#endif
+
+  // FNV-1a
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (const char* c = absolute_path; *c != 0; c++)
+    hash = (hash ^ (uint8_t) *c) * UINT64_C(0x100000001b3);
+  snprintf(name, BTOEP_SHM_NAME_SIZE, BTOEP_SHM_NAME_PREFIX "%016" PRIx64, hash);
+  return true;
+}
+
+static bool get_table_name(btoep_last_error_info* error, char* out,
+                           const char* base_name, uint64_t generation) {
+  int n = snprintf(out, BTOEP_SHM_NAME_SIZE, "%s-%" PRIu64, base_name,
+                   generation);
+  if (n < 0 || n >= (int) BTOEP_SHM_NAME_SIZE)
+    return set_error(error, B_ERR_INVALID_ARGUMENT);
+  return true;
+}
+
+static bool mapping_create(btoep_last_error_info* error, const char* name,
+                           size_t size, bool exclusive,
+                           btoep_shm_mapping* mapping) {
+#ifdef _MSC_VER
+  uint64_t size64 = size;
+  HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                     (DWORD) (size64 >> 32), (DWORD) size64,
+                                     name);
+  if (handle == NULL)
+    return set_io_error(error, "CreateFileMappingA");
+  if (exclusive && GetLastError() == ERROR_ALREADY_EXISTS) {
+    CloseHandle(handle);
+    return set_io_error(error, "CreateFileMappingA");
+  }
+  void* address = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (address == NULL) {
+    set_io_error(error, "MapViewOfFile");
+    CloseHandle(handle);
+    return false;
+  }
+  mapping->handle = handle;
+#else
+  // A segment with the same name might be left over from a process that did
+  // not exit cleanly. It is not in use by any current publisher.
+  if (exclusive)
+    shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | (exclusive ? O_EXCL : 0), 0644);
+  if (fd == -1)
+    return set_io_error(error, "shm_open");
+  if (ftruncate(fd, (off_t) size) != 0) {
+    set_io_error(error, "ftruncate");
+    close(fd);
+    return false;
+  }
+  void* address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (address == MAP_FAILED) {
+    set_io_error(error, "mmap");
+    close(fd);
+    return false;
+  }
+  close(fd);
+#endif
+  mapping->address = address;
+  mapping->size = size;
+  return true;
+}
+
+/*
+ * Maps an existing segment. If it does not exist, this fails with
+ * B_ERR_NOT_PUBLISHED.
+ */
+static bool mapping_open(btoep_last_error_info* error, const char* name,
+                         size_t min_size, bool writable,
+                         btoep_shm_mapping* mapping) {
+#ifdef _MSC_VER
+  DWORD access = writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ;
+  HANDLE handle = OpenFileMappingA(access, FALSE, name);
+  if (handle == NULL) {
+    if (GetLastError() == ERROR_FILE_NOT_FOUND)
+      return set_error(error, B_ERR_NOT_PUBLISHED);
+    return set_io_error(error, "OpenFileMappingA");
+  }
+  void* address = MapViewOfFile(handle, access, 0, 0, 0);
+  MEMORY_BASIC_INFORMATION info;
+  if (address == NULL || VirtualQuery(address, &info, sizeof(info)) == 0) {
+    set_io_error(error, "MapViewOfFile");
+    if (address != NULL)
+      UnmapViewOfFile(address);
+    CloseHandle(handle);
+    return false;
+  }
+  size_t size = info.RegionSize;
+  mapping->handle = handle;
+#else
+  int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+  if (fd == -1) {
+    if (errno == ENOENT)
+      return set_error(error, B_ERR_NOT_PUBLISHED);
+    return set_io_error(error, "shm_open");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    set_io_error(error, "fstat");
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t) st.st_size;
+  void* address = NULL;
+  if (size >= min_size) {
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    address = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+      set_io_error(error, "mmap");
+      close(fd);
+      return false;
+    }
+  }
+  close(fd);
+#endif
+  mapping->address = address;
+  mapping->size = size;
+  if (size < min_size) {
+    // The publisher has not initialized the segment yet.
+#ifdef _MSC_VER
+    UnmapViewOfFile(address);
+    CloseHandle(handle);
+#endif
+    return set_error(error, B_ERR_NOT_PUBLISHED);
+  }
+  return true;
+}
+
+static void mapping_close(btoep_shm_mapping* mapping) {
+  if (mapping->address == NULL)
+    return;
+#ifdef _MSC_VER
+  UnmapViewOfFile(mapping->address);
+  CloseHandle(mapping->handle);
+#else
+  munmap(mapping->address, mapping->size);
+#endif
+  mapping->address = NULL;
+}
+
+static void mapping_unlink(const char* name) {
+#ifdef _MSC_VER
+  // Named mappings disappear once the last handle has been closed.
+  (void) name;
+#else
+  shm_unlink(name);
+#endif
+}
+
+/*
+ * Writers make the sequence odd before modifying the table, and even again
+ * afterwards.
+ */
+
+static void table_begin_write(shm_table* table) {
+  atomic_store_u64(&table->sequence, table->sequence + 1);
+  atomic_fence();
+}
+
+static void table_end_write(shm_table* table) {
+  atomic_fence();
+  atomic_store_u64(&table->sequence, table->sequence + 1);
+}
+
+static void table_write(shm_table* table, uint64_t revision, uint64_t data_size,
+                        const btoep_range* ranges, size_t n_ranges) {
+  table_begin_write(table);
+  table->revision = revision;
+  table->data_size = data_size;
+  table->n_ranges = n_ranges;
+  for (size_t i = 0; i < n_ranges; i++) {
+    table->ranges[i].offset = ranges[i].offset;
+    table->ranges[i].length = ranges[i].length;
+  }
+  table_end_write(table);
+}
+
+static bool publisher_create_table(btoep_shm_publisher* publisher,
+                                   uint64_t generation, uint64_t capacity,
+                                   btoep_shm_mapping* mapping) {
+  char name[BTOEP_SHM_NAME_SIZE];
+  if (!get_table_name(&publisher->last_error, name, publisher->name, generation))
+    return false;
+  if (capacity > (SIZE_MAX - sizeof(shm_table)) / sizeof(btoep_range))
+    return set_error(&publisher->last_error, B_ERR_OUT_OF_MEMORY);
+  if (!mapping_create(&publisher->last_error, name, table_size(capacity), true,
+                      mapping))
+    return false;
+
+  shm_table* table = mapping->address;
+  table->sequence = 0;
+  table->is_replaced = 0;
+  table->capacity = capacity;
+  table->revision = 0;
+  table->data_size = 0;
+  table->n_ranges = 0;
+  memcpy(table->magic, SHM_TABLE_MAGIC, 8);
+  return true;
+}
+
+static void publisher_retire_table(btoep_shm_publisher* publisher) {
+  shm_table* table = publisher->table.address;
+  table_begin_write(table);
+  table->is_replaced = 1;
+  table_end_write(table);
+  mapping_close(&publisher->table);
+
+  char name[BTOEP_SHM_NAME_SIZE];
+  if (get_table_name(&publisher->last_error, name, publisher->name,
+                     publisher->generation))
+    mapping_unlink(name);
+}
+
+/*
+ * Copies the current index into the buffer of the publisher.
+ */
+static bool publisher_load(btoep_shm_publisher* publisher, uint64_t* revision,
+                           uint64_t* data_size, size_t* n_ranges) {
+  btoep_dataset* dataset = publisher->dataset;
+  btoep_index_stats stats;
+  if (!btoep_index_get_stats(dataset, &stats) ||
+      !btoep_index_get_revision(dataset, revision) ||
+      !btoep_data_get_size(dataset, data_size)) {
+    btoep_last_error(dataset, &publisher->last_error);
+    return false;
+  }
+
+  if (stats.n_entries > publisher->buffer_capacity) {
+    if (stats.n_entries > SIZE_MAX / sizeof(btoep_range))
+      return set_error(&publisher->last_error, B_ERR_OUT_OF_MEMORY);
+    size_t capacity = (size_t) stats.n_entries;
+    btoep_range* buffer = realloc(publisher->buffer,
+                                  capacity * sizeof(btoep_range));
+    if (buffer == NULL)
+      return set_error(&publisher->last_error, B_ERR_OUT_OF_MEMORY);
+    publisher->buffer = buffer;
+    publisher->buffer_capacity = capacity;
+  }
+
+  *n_ranges = 0;
+  if (stats.n_entries != 0 &&
+      !btoep_index_get_ranges(dataset, btoep_max_range_from(0), BTOEP_FIND_DATA,
+                              publisher->buffer, (size_t) stats.n_entries,
+                              n_ranges, NULL)) {
+    btoep_last_error(dataset, &publisher->last_error);
+    return false;
+  }
+  return true;
+}
+
+bool btoep_shm_publisher_open(btoep_shm_publisher* publisher,
+                              btoep_dataset* dataset) {
+  publisher->dataset = dataset;
+  publisher->buffer = NULL;
+  publisher->buffer_capacity = 0;
+  publisher->control.address = NULL;
+  publisher->table.address = NULL;
+
+  // Only the process that modifies the dataset may publish it, which ensures
+  // that there is never more than one publisher. Otherwise, a second publisher
+  // would take over the tables of the first one.
+  if (dataset->read_only)
+    return set_error(&publisher->last_error, B_ERR_DATASET_READ_ONLY);
+
+  uint64_t revision, data_size;
+  size_t n_ranges;
+  if (!get_base_name(&publisher->last_error, publisher->name,
+                     dataset->data_path, dataset->index_path) ||
+      !publisher_load(publisher, &revision, &data_size, &n_ranges) ||
+      !mapping_create(&publisher->last_error, publisher->name,
+                      sizeof(shm_control), false, &publisher->control)) {
+    free(publisher->buffer);
+    return false;
+  }
+
+  // If a previous publisher did not exit cleanly, its control segment still
+  // exists, and readers might still be using its last table.
+  shm_control* control = publisher->control.address;
+  uint64_t stale_generation = 0;
+  if (memcmp(control->magic, SHM_CONTROL_MAGIC, 8) == 0)
+    stale_generation = atomic_load_u64(&control->generation);
+
+  publisher->generation = stale_generation + 1;
+  publisher->capacity = n_ranges < SHM_MIN_CAPACITY ? SHM_MIN_CAPACITY
+                                                    : 2 * (uint64_t) n_ranges;
+  if (!publisher_create_table(publisher, publisher->generation,
+                              publisher->capacity, &publisher->table)) {
+    mapping_close(&publisher->control);
+    free(publisher->buffer);
+    return false;
+  }
+  table_write(publisher->table.address, revision, data_size, publisher->buffer,
+              n_ranges);
+
+  memcpy(control->magic, SHM_CONTROL_MAGIC, 8);
+  atomic_store_u64(&control->generation, publisher->generation);
+  atomic_store_u64(&control->is_closed, 0);
+
+  if (stale_generation != 0) {
+    char name[BTOEP_SHM_NAME_SIZE];
+    btoep_shm_mapping stale;
+    btoep_last_error_info error;
+    if (get_table_name(&error, name, publisher->name, stale_generation) &&
+        mapping_open(&error, name, sizeof(shm_table), true, &stale)) {
+      // The previous publisher might have died while updating the table,
+      // leaving the sequence odd. The table is marked as replaced first, and
+      // only then is the sequence made even again, so readers that are waiting
+      // for the update to complete switch to the new table instead.
+      shm_table* table = stale.address;
+      table->is_replaced = 1;
+      atomic_fence();
+      atomic_store_u64(&table->sequence, (table->sequence | 1) + 1);
+      mapping_close(&stale);
+      mapping_unlink(name);
+    }
+  }
+
+  return true;
+}
+
+bool btoep_shm_publish(btoep_shm_publisher* publisher) {
+  uint64_t revision, data_size;
+  size_t n_ranges;
+  if (!publisher_load(publisher, &revision, &data_size, &n_ranges))
+    return false;
+
+  if (n_ranges > publisher->capacity) {
+    // Readers switch to the new table once the old one has been replaced.
+    btoep_shm_mapping table;
+    uint64_t capacity = 2 * (uint64_t) n_ranges;
+    if (!publisher_create_table(publisher, publisher->generation + 1, capacity,
+                                &table))
+      return false;
+    table_write(table.address, revision, data_size, publisher->buffer,
+                n_ranges);
+    shm_control* control = publisher->control.address;
+    atomic_store_u64(&control->generation, publisher->generation + 1);
+    publisher_retire_table(publisher);
+    publisher->table = table;
+    publisher->generation++;
+    publisher->capacity = capacity;
+    return true;
+  }
+
+  table_write(publisher->table.address, revision, data_size, publisher->buffer,
+              n_ranges);
+  return true;
+}
+
+void btoep_shm_publisher_close(btoep_shm_publisher* publisher) {
+  shm_control* control = publisher->control.address;
+  atomic_store_u64(&control->is_closed, 1);
+  publisher_retire_table(publisher);
+  mapping_close(&publisher->control);
+  mapping_unlink(publisher->name);
+  free(publisher->buffer);
+}
+
+/*
+ * Maps the current table. This fails with B_ERR_NOT_PUBLISHED if the publisher
+ * has closed the published index.
+ */
+static bool reader_open_table(btoep_shm_reader* reader) {
+  const shm_control* control = reader->control.address;
+  uint64_t generation = atomic_load_u64(&control->generation);
+  if (atomic_load_u64(&control->is_closed) != 0 || generation == 0)
+    return set_error(&reader->last_error, B_ERR_NOT_PUBLISHED);
+
+  char name[BTOEP_SHM_NAME_SIZE];
+  btoep_shm_mapping table;
+  if (!get_table_name(&reader->last_error, name, reader->name, generation) ||
+      !mapping_open(&reader->last_error, name, sizeof(shm_table), false, &table))
+    return false;
+
+  const shm_table* header = table.address;
+  if (memcmp(header->magic, SHM_TABLE_MAGIC, 8) != 0 ||
+      header->capacity > (table.size - sizeof(shm_table)) / sizeof(btoep_range)) {
+    mapping_close(&table);
+    return set_error(&reader->last_error, B_ERR_NOT_PUBLISHED);
+  }
+
+  mapping_close(&reader->table);
+  reader->table = table;
+  reader->generation = generation;
+  reader->capacity = header->capacity;
+  return true;
+}
+
+bool btoep_shm_reader_open(btoep_shm_reader* reader, btoep_path data_path,
+                           btoep_path index_path) {
+  reader->control.address = NULL;
+  reader->table.address = NULL;
+
+  if (!get_base_name(&reader->last_error, reader->name, data_path, index_path)) {
+    // Without an index file, there is nothing to publish.
+    if (reader->last_error.code == B_ERR_INPUT_OUTPUT)
+      set_error(&reader->last_error, B_ERR_NOT_PUBLISHED);
+    return false;
+  }
+
+  if (!mapping_open(&reader->last_error, reader->name, sizeof(shm_control),
+                    false, &reader->control))
+    return false;
+
+  const shm_control* control = reader->control.address;
+  if (memcmp(control->magic, SHM_CONTROL_MAGIC, 8) != 0 ||
+      !reader_open_table(reader)) {
+    mapping_close(&reader->control);
+    return set_error(&reader->last_error, B_ERR_NOT_PUBLISHED);
+  }
+
+  return true;
+}
+
+void btoep_shm_reader_close(btoep_shm_reader* reader) {
+  mapping_close(&reader->table);
+  mapping_close(&reader->control);
+}
+
+/*
+ * Starts a query, and returns the sequence value that the table must still have
+ * once the query is complete. If the table has been replaced, this switches to
+ * the current table.
+ */
+static bool reader_begin(btoep_shm_reader* reader, uint64_t* sequence) {
+  const shm_control* control = reader->control.address;
+  for (;;) {
+    const shm_table* table = reader->table.address;
+    uint64_t value = atomic_load_u64(&table->sequence);
+    // An update is in progress. If the publisher died during the update, the
+    // sequence stays odd until another publisher replaces the table, so the
+    // reader must not wait for the sequence alone.
+    if ((value & 1) && !table->is_replaced &&
+        atomic_load_u64(&control->generation) == reader->generation)
+      continue;
+    if ((value & 1) || table->is_replaced) {
+      if (!reader_open_table(reader))
+        return false;
+      continue;
+    }
+    *sequence = value;
+    return true;
+  }
+}
+
+static bool reader_validate(btoep_shm_reader* reader, uint64_t sequence) {
+  const shm_table* table = reader->table.address;
+  atomic_fence();
+  return atomic_load_u64(&table->sequence) == sequence;
+}
+
+/*
+ * Finds the first entry that ends after the given offset. Entries might be
+ * inconsistent while the table is being updated, but the result is discarded
+ * in that case, so this only needs to stay within the bounds of the table.
+ */
+static uint64_t table_search(const btoep_shm_reader* reader, uint64_t offset,
+                             uint64_t* n_ranges) {
+  const shm_table* table = reader->table.address;
+  uint64_t n = table->n_ranges;
+  if (n > reader->capacity)
+    n = reader->capacity;
+  uint64_t low = 0, high = n;
+  while (low < high) {
+    uint64_t mid = low + (high - low) / 2;
+    if (table->ranges[mid].offset + table->ranges[mid].length > offset)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  *n_ranges = n;
+  return low;
+}
+
+static inline btoep_range table_get(const btoep_shm_reader* reader, uint64_t i) {
+  const shm_table* table = reader->table.address;
+  return btoep_mkrange(table->ranges[i].offset, table->ranges[i].length);
+}
+
+bool btoep_shm_reader_get_revision(btoep_shm_reader* reader,
+                                   uint64_t* revision) {
+  uint64_t sequence;
+  do {
+    if (!reader_begin(reader, &sequence))
+      return false;
+    *revision = ((const shm_table*) reader->table.address)->revision;
+  } while (!reader_validate(reader, sequence));
+  return true;
+}
+
+bool btoep_shm_reader_find_offset(btoep_shm_reader* reader, uint64_t start,
+                                  int mode, bool* exists, uint64_t* offset) {
+  if (mode != BTOEP_FIND_DATA && mode != BTOEP_FIND_NO_DATA)
+    return set_error(&reader->last_error, B_ERR_INVALID_ARGUMENT);
+
+  uint64_t sequence;
+  do {
+    if (!reader_begin(reader, &sequence))
+      return false;
+    uint64_t n_ranges;
+    uint64_t i = table_search(reader, start, &n_ranges);
+    if (i == n_ranges) {
+      *exists = mode == BTOEP_FIND_NO_DATA;
+      *offset = start;
+    } else {
+      btoep_range entry = table_get(reader, i);
+      *exists = true;
+      if (entry.offset > start)
+        *offset = (mode == BTOEP_FIND_DATA) ? entry.offset : start;
+      else
+        *offset = (mode == BTOEP_FIND_DATA) ? start : entry.offset + entry.length;
+    }
+  } while (!reader_validate(reader, sequence));
+  return true;
+}
+
+bool btoep_shm_reader_contains(btoep_shm_reader* reader, btoep_range range,
+                               bool* result) {
+  uint64_t sequence;
+  do {
+    if (!reader_begin(reader, &sequence))
+      return false;
+    if (range.length == 0) {
+      const shm_table* table = reader->table.address;
+      *result = range.offset <= table->data_size;
+    } else {
+      uint64_t n_ranges;
+      uint64_t i = table_search(reader, range.offset, &n_ranges);
+      *result = i != n_ranges &&
+                btoep_range_is_subset(table_get(reader, i), range);
+    }
+  } while (!reader_validate(reader, sequence));
+  return true;
+}
+
+bool btoep_shm_reader_contains_any(btoep_shm_reader* reader, btoep_range range,
+                                   bool* result) {
+  uint64_t sequence;
+  do {
+    if (!reader_begin(reader, &sequence))
+      return false;
+    uint64_t n_ranges;
+    uint64_t i = table_search(reader, range.offset, &n_ranges);
+    *result = false;
+    if (i != n_ranges) {
+      btoep_range entry = table_get(reader, i);
+      *result = btoep_range_intersect(&entry, range);
+    }
+  } while (!reader_validate(reader, sequence));
+  return true;
+}
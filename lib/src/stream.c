@@ -0,0 +1,323 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/btoep/stream.h"
+#include "uleb128.h"
+
+#ifndef _MSC_VER
+# include <errno.h>
+#endif
+
+static bool set_stream_error(btoep_last_error_info* info, int error_code,
+                             const char* func, const char* system_func) {
+  info->code = error_code;
+  info->func = func;
+  if (system_func != NULL) {
+#ifdef _MSC_VER
+    info->system_error_code = GetLastError();
+#else
+    info->system_error_code = errno;
+#endif
+  } else {
+    info->system_error_code = 0;
+  }
+  info->system_func = system_func;
+  return false;
+}
+
+#define set_error(info, error) \
+  set_stream_error(info, error, __func__, NULL)
+#define set_io_error(info, system_func) \
+  set_stream_error(info, B_ERR_INPUT_OUTPUT, __func__, system_func)
+
+void btoep_index_source_init_file(btoep_index_source* source, FILE* file) {
+  source->file = file;
+  source->buffer_pos = 0;
+  source->buffer_length = 0;
+  source->is_eof = false;
+  source->batch_pos = 0;
+  source->batch_length = 0;
+  source->prev_end = 0;
+  source->has_prev = false;
+  source->is_array = false;
+  source->dataset = NULL;
+}
+
+void btoep_index_source_init_array(btoep_index_source* source,
+                                   const btoep_range* ranges, size_t n_ranges) {
+  source->file = NULL;
+  source->prev_end = 0;
+  source->has_prev = false;
+  source->is_array = true;
+  source->ranges = ranges;
+  source->n_ranges = n_ranges;
+  source->ranges_pos = 0;
+  source->dataset = NULL;
+}
+
+bool btoep_index_source_init_dataset(btoep_index_source* source,
+                                     btoep_dataset* dataset) {
+  source->file = NULL;
+  source->is_array = false;
+  source->dataset = dataset;
+  if (!btoep_index_iterator_start(dataset, &source->iterator)) {
+    btoep_last_error(dataset, &source->last_error);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Decodes all complete entries in the buffer, or reads more data if there are
+ * none. Entries are stored relative to the end of the previous entry.
+ */
+static bool file_source_decode(btoep_index_source* source) {
+  btoep_uleb128_pair pairs[BTOEP_INDEX_BATCH_SIZE];
+  size_t available = source->buffer_length - source->buffer_pos;
+  size_t n = btoep_uleb128_decode_pairs(source->buffer + source->buffer_pos,
+                                        available, pairs,
+                                        BTOEP_INDEX_BATCH_SIZE);
+  if (n == 0) {
+    // A complete entry always fits into the remaining space.
+    if (source->is_eof || available >= 2 * BTOEP_ULEB128_MAX_LENGTH)
+      return available == 0 ||
+             set_error(&source->last_error, B_ERR_INVALID_INDEX_FORMAT);
+
+    memmove(source->buffer, source->buffer + source->buffer_pos, available);
+    source->buffer_pos = 0;
+    size_t n_read = fread(source->buffer + available, 1,
+                          BTOEP_INDEX_STREAM_BUFFER_SIZE - available,
+                          source->file);
+    if (n_read == 0) {
+      if (ferror(source->file))
+        return set_io_error(&source->last_error, "fread");
+      source->is_eof = true;
+    }
+    source->buffer_length = available + n_read;
+    return true;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    uint64_t offset = pairs[i].first;
+    if (source->has_prev) {
+      offset = source->prev_end + pairs[i].first + 1;
+      if (offset <= source->prev_end)
+        return set_error(&source->last_error, B_ERR_INVALID_INDEX_FORMAT);
+    }
+    uint64_t length = pairs[i].second + 1;
+    if (offset + length < offset)
+      return set_error(&source->last_error, B_ERR_INVALID_INDEX_FORMAT);
+    source->batch[i] = btoep_mkrange(offset, length);
+    source->prev_end = offset + length;
+    source->has_prev = true;
+  }
+
+  source->buffer_pos += pairs[n - 1].end;
+  source->batch_pos = 0;
+  source->batch_length = n;
+  return true;
+}
+
+bool btoep_index_source_next(btoep_index_source* source, bool* exists,
+                             btoep_range* range) {
+  if (source->dataset != NULL) {
+    *exists = !btoep_index_iterator_is_eof(&source->iterator);
+    if (*exists && !btoep_index_iterator_next(&source->iterator, range)) {
+      btoep_last_error(source->dataset, &source->last_error);
+      return false;
+    }
+    return true;
+  }
+
+  if (source->is_array) {
+    if (!(*exists = source->ranges_pos != source->n_ranges))
+      return true;
+    btoep_range next = source->ranges[source->ranges_pos];
+    if (next.length == 0 || next.offset + next.length < next.offset ||
+        (source->has_prev && next.offset <= source->prev_end))
+      return set_error(&source->last_error, B_ERR_INVALID_ARGUMENT);
+    source->ranges_pos++;
+    source->prev_end = next.offset + next.length;
+    source->has_prev = true;
+    *range = next;
+    return true;
+  }
+
+  while (source->batch_pos == source->batch_length) {
+    if (source->is_eof && source->buffer_pos == source->buffer_length) {
+      *exists = false;
+      return true;
+    }
+    if (!file_source_decode(source))
+      return false;
+  }
+
+  *range = source->batch[source->batch_pos++];
+  *exists = true;
+  return true;
+}
+
+void btoep_index_writer_init(btoep_index_writer* writer, FILE* file) {
+  writer->file = file;
+  writer->prev_end = 0;
+  writer->has_prev = false;
+}
+
+static inline void write_uleb128(uint8_t* out, uint64_t value, size_t* length) {
+  do {
+    out[(*length)++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+  } while (value > 0);
+}
+
+bool btoep_index_writer_write(btoep_index_writer* writer, btoep_range range) {
+  assert(range.length != 0);
+  assert(!writer->has_prev || range.offset > writer->prev_end);
+
+  uint8_t encoded[20];
+  size_t length = 0;
+  uint64_t relative_offset = writer->has_prev ? range.offset - writer->prev_end - 1
+                                              : range.offset;
+  write_uleb128(encoded, relative_offset, &length);
+  write_uleb128(encoded, range.length - 1, &length);
+  if (fwrite(encoded, 1, length, writer->file) != length)
+    return set_io_error(&writer->last_error, "fwrite");
+
+  writer->prev_end = range.offset + range.length;
+  writer->has_prev = true;
+  return true;
+}
+
+/*
+ * The sources are merged by sweeping over all entry boundaries in ascending
+ * order. Each input is either before or inside its current entry, so its next
+ * boundary is either the start or the end of that entry. A min-heap of inputs,
+ * ordered by their next boundary, yields the boundaries in order, and counting
+ * the inputs that are inside an entry is enough to evaluate all operations.
+ */
+
+typedef struct {
+  btoep_index_source* source;
+  btoep_range entry;
+  bool is_inside;
+} merge_input;
+
+static inline uint64_t next_boundary(const merge_input* input) {
+  return input->is_inside ? input->entry.offset + input->entry.length
+                          : input->entry.offset;
+}
+
+static void heap_sift_down(merge_input** heap, size_t n, size_t i) {
+  merge_input* input = heap[i];
+  uint64_t boundary = next_boundary(input);
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= n)
+      break;
+    if (child + 1 < n && next_boundary(heap[child + 1]) < next_boundary(heap[child]))
+      child++;
+    if (next_boundary(heap[child]) >= boundary)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = input;
+}
+
+bool btoep_index_combine(btoep_index_source* const* sources, size_t n_sources,
+                         int op, btoep_index_writer* writer,
+                         btoep_last_error_info* error) {
+  if ((op != BTOEP_INDEX_UNION && op != BTOEP_INDEX_INTERSECTION &&
+       op != BTOEP_INDEX_DIFFERENCE) ||
+      (op == BTOEP_INDEX_DIFFERENCE && n_sources == 0))
+    return set_error(error, B_ERR_INVALID_ARGUMENT);
+
+  if (n_sources == 0)
+    return true;
+
+  merge_input* inputs = NULL;
+  merge_input** heap = NULL;
+  if (n_sources <= SIZE_MAX / sizeof(merge_input)) {
+    inputs = malloc(n_sources * sizeof(merge_input));
+    heap = malloc(n_sources * sizeof(merge_input*));
+  }
+  if (inputs == NULL || heap == NULL) {
+    free(inputs);
+    free(heap);
+    return set_error(error, B_ERR_OUT_OF_MEMORY);
+  }
+
+  bool ok = true, done = false;
+  size_t n_heap = 0;
+  for (size_t i = 0; i < n_sources && ok; i++) {
+    bool exists;
+    inputs[i].source = sources[i];
+    inputs[i].is_inside = false;
+    ok = btoep_index_source_next(sources[i], &exists, &inputs[i].entry);
+    if (!ok)
+      *error = sources[i]->last_error;
+    else if (exists)
+      heap[n_heap++] = &inputs[i];
+    else if (op == BTOEP_INDEX_INTERSECTION || (op == BTOEP_INDEX_DIFFERENCE && i == 0))
+      done = true;
+  }
+  for (size_t i = n_heap / 2; i-- > 0;)
+    heap_sift_down(heap, n_heap, i);
+
+  size_t n_inside = 0;
+  bool first_is_inside = false, is_inside_result = false;
+  uint64_t result_start = 0;
+  while (ok && !done && n_heap != 0) {
+    // Apply all boundaries at the same position before evaluating the result,
+    // so that adjacent entries are merged.
+    uint64_t position = next_boundary(heap[0]);
+    while (ok && n_heap != 0 && next_boundary(heap[0]) == position) {
+      merge_input* input = heap[0];
+      bool is_first = (input == &inputs[0]);
+      if (!input->is_inside) {
+        input->is_inside = true;
+        n_inside++;
+        first_is_inside = first_is_inside || is_first;
+      } else {
+        bool exists;
+        input->is_inside = false;
+        n_inside--;
+        first_is_inside = first_is_inside && !is_first;
+        if (!(ok = btoep_index_source_next(input->source, &exists, &input->entry))) {
+          *error = input->source->last_error;
+          break;
+        }
+        if (!exists) {
+          heap[0] = heap[--n_heap];
+          // No further data can be part of the result.
+          done = op == BTOEP_INDEX_INTERSECTION ||
+                 (op == BTOEP_INDEX_DIFFERENCE && is_first);
+        }
+      }
+      if (n_heap != 0)
+        heap_sift_down(heap, n_heap, 0);
+    }
+
+    bool is_inside;
+    if (op == BTOEP_INDEX_UNION)
+      is_inside = n_inside != 0;
+    else if (op == BTOEP_INDEX_INTERSECTION)
+      is_inside = n_inside == n_sources;
+    else
+      is_inside = first_is_inside && n_inside == 1;
+
+    if (ok && is_inside && !is_inside_result) {
+      result_start = position;
+    } else if (ok && !is_inside && is_inside_result) {
+      btoep_range range = btoep_mkrange(result_start, position - result_start);
+      if (!(ok = btoep_index_writer_write(writer, range)))
+        *error = writer->last_error;
+    }
+    is_inside_result = is_inside;
+  }
+
+  free(inputs);
+  free(heap);
+  return ok;
+}
@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "uleb128.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+# define BTOEP_ULEB128_X86_64
+# include <immintrin.h>
+#endif
+
+static inline bool decode_value(const uint8_t* in, size_t length, size_t* pos,
+                                uint64_t* value) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < BTOEP_ULEB128_MAX_LENGTH; i++) {
+    if (*pos + i >= length)
+      return false;
+    uint8_t byte = in[*pos + i];
+    result |= (uint64_t) (byte & 0x7f) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      *pos += i + 1;
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Decodes pairs starting at the given position within the buffer, one byte at a
+ * time. All other implementations use this for the last few bytes.
+ */
+static size_t decode_pairs_from(const uint8_t* in, size_t length, size_t pos,
+                                btoep_uleb128_pair* out, size_t max_pairs) {
+  size_t n = 0;
+  while (n < max_pairs) {
+    size_t end = pos;
+    if (!decode_value(in, length, &end, &out[n].first) ||
+        !decode_value(in, length, &end, &out[n].second))
+      break;
+    out[n++].end = pos = end;
+  }
+  return n;
+}
+
+static bool scalar_is_supported(void) {
+  return true;
+}
+
+static size_t decode_pairs_scalar(const uint8_t* in, size_t length,
+                                  btoep_uleb128_pair* out, size_t max_pairs) {
+  return decode_pairs_from(in, length, 0, out, max_pairs);
+}
+
+#ifdef BTOEP_ULEB128_X86_64
+
+/*
+ * The SIMD implementations determine which bytes terminate a value for an
+ * entire block at once, based on the most significant bit of each byte. The
+ * length of each value then follows from the positions of the terminating
+ * bytes, and each value is extracted from a single unaligned 64-bit load,
+ * without checking bounds or branching on individual bytes.
+ */
+
+static inline uint64_t load_le64(const uint8_t* in) {
+  // x86-64 is little-endian.
+  uint64_t word;
+  memcpy(&word, in, sizeof(word));
+  return word;
+}
+
+static inline uint64_t value_mask(unsigned length) {
+  return UINT64_C(0x7f7f7f7f7f7f7f7f) >> (8 * (8 - length));
+}
+
+// Removes the most significant bit of each byte by moving the 7-bit groups
+// together, which is what the pext instruction does in a single step.
+static inline uint64_t compress_groups(uint64_t word) {
+  word = ((word & UINT64_C(0x7f007f007f007f00)) >> 1) |
+         (word & UINT64_C(0x007f007f007f007f));
+  word = ((word & UINT64_C(0x3fff00003fff0000)) >> 2) |
+         (word & UINT64_C(0x00003fff00003fff));
+  word = ((word & UINT64_C(0x0fffffff00000000)) >> 4) |
+         (word & UINT64_C(0x000000000fffffff));
+  return word;
+}
+
+/*
+ * Decodes all complete pairs within each block of BLOCK_SIZE bytes. Since
+ * values are extracted using 64-bit loads, this stops eight bytes before the
+ * end of the buffer, and leaves the rest to decode_pairs_from. Values that are
+ * too long also end up there, which then stops decoding.
+ */
+#define DECODE_PAIRS_IN_BLOCKS(BLOCK_SIZE, LOAD_TERMINATORS, EXTRACT)          \
+  size_t pos = 0, n = 0;                                                       \
+  while (n < max_pairs && pos + BLOCK_SIZE + 8 <= length) {                    \
+    uint64_t terminators = LOAD_TERMINATORS(in + pos);                         \
+    unsigned offset = 0;                                                       \
+    while (n < max_pairs) {                                                    \
+      uint64_t t = terminators >> offset;                                      \
+      if (t == 0)                                                              \
+        break;                                                                 \
+      unsigned first_length = __builtin_ctzll(t) + 1;                          \
+      t >>= first_length;                                                      \
+      if (t == 0)                                                              \
+        break;                                                                 \
+      unsigned second_length = __builtin_ctzll(t) + 1;                         \
+      if (first_length > BTOEP_ULEB128_MAX_LENGTH ||                           \
+          second_length > BTOEP_ULEB128_MAX_LENGTH)                            \
+        break;                                                                 \
+      const uint8_t* value = in + pos + offset;                                \
+      out[n].first = EXTRACT(value, first_length);                             \
+      out[n].second = EXTRACT(value + first_length, second_length);            \
+      offset += first_length + second_length;                                  \
+      out[n++].end = pos + offset;                                             \
+    }                                                                          \
+    if (offset == 0)                                                           \
+      break;                                                                   \
+    pos += offset;                                                             \
+  }                                                                            \
+  return n + decode_pairs_from(in, length, pos, out + n, max_pairs - n);
+
+static inline uint64_t load_terminators_sse2(const uint8_t* in) {
+  __m128i block = _mm_loadu_si128((const __m128i*) in);
+  return (uint16_t) ~_mm_movemask_epi8(block);
+}
+
+static inline uint64_t extract_value_sse2(const uint8_t* in, unsigned length) {
+  return compress_groups(load_le64(in) & value_mask(length));
+}
+
+static bool sse2_is_supported(void) {
+  // SSE2 is part of the x86-64 baseline.
+  return true;
+}
+
+static size_t decode_pairs_sse2(const uint8_t* in, size_t length,
+                                btoep_uleb128_pair* out, size_t max_pairs) {
+  DECODE_PAIRS_IN_BLOCKS(16, load_terminators_sse2, extract_value_sse2)
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t load_terminators_avx2(const uint8_t* in) {
+  __m256i block = _mm256_loadu_si256((const __m256i*) in);
+  return (uint32_t) ~_mm256_movemask_epi8(block);
+}
+
+__attribute__((target("bmi2")))
+static inline uint64_t extract_value_bmi2(const uint8_t* in, unsigned length) {
+  return _pext_u64(load_le64(in), value_mask(length));
+}
+
+static bool avx2_is_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+}
+
+__attribute__((target("avx2,bmi2")))
+static size_t decode_pairs_avx2(const uint8_t* in, size_t length,
+                                btoep_uleb128_pair* out, size_t max_pairs) {
+  DECODE_PAIRS_IN_BLOCKS(32, load_terminators_avx2, extract_value_bmi2)
+}
+
+#endif  // BTOEP_ULEB128_X86_64
+
+const btoep_uleb128_decoder btoep_uleb128_decoders[] = {
+  { "scalar", scalar_is_supported, decode_pairs_scalar },
+#ifdef BTOEP_ULEB128_X86_64
+  { "sse2", sse2_is_supported, decode_pairs_sse2 },
+  { "avx2+bmi2", avx2_is_supported, decode_pairs_avx2 },
+#endif
+};
+
+const size_t btoep_uleb128_n_decoders =
+    sizeof(btoep_uleb128_decoders) / sizeof(btoep_uleb128_decoder);
+
+size_t btoep_uleb128_decode_pairs(const uint8_t* in, size_t length,
+                                  btoep_uleb128_pair* out, size_t max_pairs) {
+  // Selecting the same implementation more than once is harmless, so this does
+  // not need to be synchronized.
+  static size_t (*decode_pairs)(const uint8_t*, size_t, btoep_uleb128_pair*,
+                                size_t) = NULL;
+  if (decode_pairs == NULL) {
+    for (size_t i = 0; i < btoep_uleb128_n_decoders; i++) {
+      if (btoep_uleb128_decoders[i].is_supported())
+        decode_pairs = btoep_uleb128_decoders[i].decode_pairs;
+    }
+  }
+  return decode_pairs(in, length, out, max_pairs);
+}
@@ -0,0 +1,46 @@
+#ifndef __BTOEP__ULEB128_H__
+#define __BTOEP__ULEB128_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Maximum length of a ULEB128 value within an index. Longer values are
+ * considered invalid.
+ */
+#define BTOEP_ULEB128_MAX_LENGTH 8
+
+/* A pair of ULEB128 values, which is how index entries are encoded. */
+typedef struct {
+  uint64_t first;
+  uint64_t second;
+  // Offset of the end of the pair within the decoded buffer.
+  size_t end;
+} btoep_uleb128_pair;
+
+/*
+ * Decodes up to max_pairs pairs of ULEB128 values from the given buffer.
+ * Decoding stops at the first pair that is incomplete or that contains a value
+ * that is too long, and the number of decoded pairs is returned.
+ *
+ * This uses the fastest implementation that the CPU supports.
+ */
+size_t btoep_uleb128_decode_pairs(const uint8_t* in, size_t length,
+                                  btoep_uleb128_pair* out, size_t max_pairs);
+
+/*
+ * All implementations of btoep_uleb128_decode_pairs, in order of increasing
+ * performance. This is only exposed for testing and benchmarking.
+ */
+typedef struct {
+  const char* name;
+  bool (*is_supported)(void);
+  size_t (*decode_pairs)(const uint8_t* in, size_t length,
+                         btoep_uleb128_pair* out, size_t max_pairs);
+} btoep_uleb128_decoder;
+
+extern const btoep_uleb128_decoder btoep_uleb128_decoders[];
+extern const size_t btoep_uleb128_n_decoders;
+
+#endif  // __BTOEP__ULEB128_H__
@@ -92,6 +92,42 @@ class AddTest(SystemTest):
     self.assertEqual(self.readDataset(dataset), b'Hello world\r\n')
     self.assertEqual(self.readIndex(dataset), b'\x00\x0c')
 
+  def test_add_large_file(self):
+    # Data from files and pipes is moved within the kernel where possible, in
+    # which case existing data must still be handled correctly.
+    data = bytes(range(256)) * 1024
+    dataset = self.createDataset(b'', b'')
+    self.cmd(['--dataset', dataset, '--offset=100000'], input = data[100000:150000])
+    path = self.createTempTestFile(data)
+    for on_conflict in ['error', 'keep']:
+      self.cmd(['--dataset', dataset, '--offset=0', '--source', path,
+                '--on-conflict=' + on_conflict])
+      self.assertEqual(self.readDataset(dataset), data)
+      self.assertEqual(self.readIndex(dataset), b'\x00\xff\xff\x0f')
+    self.cmd(['--dataset', dataset, '--offset=0', '--on-conflict=error'],
+             input = data)
+    self.assertEqual(self.readDataset(dataset), data)
+
+    # Conflicts are detected anywhere within existing data.
+    conflicting = bytearray(data)
+    conflicting[140000] ^= 1
+    path = self.createTempTestFile(bytes(conflicting))
+    self.assertErrorMessage(
+        ['--dataset', dataset, '--offset=0', '--source', path],
+        message = 'Data conflicts with existing data',
+        lib_error_name = 'ERR_DATA_CONFLICT',
+        lib_error_code = '5')
+    stderr = self.cmd_stderr(['--dataset', dataset, '--offset=0',
+                              '--source', path],
+                             expected_returncode = ExitCode.APP_ERROR)
+    self.assertIn('\nConflict offset: 140000\n', stderr)
+    self.cmd(['--dataset', dataset, '--offset=0', '--source', path,
+              '--on-conflict=keep'])
+    self.assertEqual(self.readDataset(dataset), data)
+    self.cmd(['--dataset', dataset, '--offset=0', '--on-conflict=overwrite'],
+             input = bytes(conflicting))
+    self.assertEqual(self.readDataset(dataset), bytes(conflicting))
+
   def test_fs_error(self):
     # Test that the command fails if only the data file is missing
     dataset = self.createDataset(None, b'foo')
@@ -126,12 +162,16 @@ class AddTest(SystemTest):
     self.assertIsNone(self.readIndex(dataset))
 
   def test_invalid_source(self):
-    # Test --source with a directory.
+    # Test --source with a directory. Only Windows refuses to open it, otherwise
+    # reading from it fails within the library.
     empty_dir = self.createTempTestDir()
     dataset = self.reserveDataset()
     self.assertErrorMessage(
         ['--dataset', dataset, '--offset=0', '--source', empty_dir],
         message = True,
+        has_ext_message = not self.isWindows,
+        lib_error_name = None if self.isWindows else 'ERR_INPUT_OUTPUT',
+        lib_error_code = None if self.isWindows else '1',
         sys_error_name = 'EACCES' if self.isWindows else 'EISDIR',
         sys_error_code = '13' if self.isWindows else '21')
 
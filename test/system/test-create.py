@@ -1,5 +1,6 @@
 from helper import ExitCode, SystemTest
 import os
+import subprocess
 import unittest
 
 class CreateTest(SystemTest):
@@ -7,7 +8,7 @@ class CreateTest(SystemTest):
   def test_info(self):
     self.assertInfo([
       '--dataset', '--index-path', '--lockfile-path',
-      '--size'
+      '--size', '--index-format', '--preallocate'
     ])
 
   def assertCreate(self, dataset, size = None):
@@ -26,6 +27,55 @@ class CreateTest(SystemTest):
     # Create a new dataset with a given size.
     self.assertCreate(self.reserveDataset(), size = 10000)
 
+  def test_index_format(self):
+    # The compact format can be selected explicitly.
+    dataset = self.reserveDataset()
+    self.cmd(['--dataset', dataset, '--index-format=compact'])
+    self.assertEqual(self.readIndex(dataset), b'')
+
+    # The paged format starts with a header.
+    dataset = self.reserveDataset()
+    self.cmd(['--dataset', dataset, '--index-format=paged'])
+    self.assertEqual(self.readIndex(dataset)[0:8],
+                     b'\xc2\xd4\xcf\xc5\xd0\xc9\xc4\xd8')
+
+    # Other tools work with either format, and btoep-get-index always produces
+    # the compact format.
+    subprocess.run(['btoep-add', '--dataset', dataset, '--offset=3'],
+                   input = b'foo', check = True)
+    result = subprocess.run(['btoep-get-index', '--dataset', dataset],
+                            capture_output = True, check = True)
+    self.assertEqual(result.stdout, b'\x03\x02')
+
+    # Unknown formats are rejected.
+    stderr = self.cmd_stderr(['--dataset', self.reserveDataset(),
+                              '--index-format=foo'],
+                             expected_returncode = ExitCode.USAGE_ERROR)
+    self.assertTrue(stderr.startswith('Error: Failed to understand argument'))
+
+  def test_preallocate(self):
+    # Preallocation either succeeds or is reported as unsupported.
+    dataset = self.reserveDataset()
+    size = 1024 * 1024
+    result = subprocess.run([self.arg0(), '--dataset', dataset,
+                             '--size', str(size), '--preallocate'],
+                            capture_output = True, timeout = 10)
+    if ExitCode(result.returncode) == ExitCode.SUCCESS:
+      self.assertEqual(os.path.getsize(dataset), size)
+      if hasattr(os.stat(dataset), 'st_blocks'):
+        self.assertGreaterEqual(os.stat(dataset).st_blocks * 512, size)
+    else:
+      self.assertEqual(ExitCode(result.returncode), ExitCode.APP_ERROR)
+      self.assertIn('Library error name: ERR_CANNOT_PREALLOCATE\n',
+                    result.stderr.decode())
+
+    # Without a size, there is nothing to preallocate.
+    stderr = self.cmd_stderr(['--dataset', self.reserveDataset(),
+                              '--preallocate'],
+                             expected_returncode = ExitCode.USAGE_ERROR)
+    self.assertTrue(stderr.startswith(
+        'Error: The --preallocate option requires --size.\n'))
+
   def test_fs_error(self):
     # Test that the command fails if the dataset already exists.
     dataset = self.createDataset(b'', b'')
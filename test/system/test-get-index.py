@@ -1,20 +1,48 @@
 from helper import ExitCode, SystemTest
+import subprocess
 import unittest
 
+def uleb128(value):
+  out = bytearray()
+  while True:
+    out.append((value & 0x7f) | (0x80 if value > 0x7f else 0))
+    value >>= 7
+    if value == 0:
+      return bytes(out)
+
+def read_uleb128(data):
+  value, shift = 0, 0
+  for (i, b) in enumerate(data):
+    value |= (b & 0x7f) << shift
+    shift += 7
+    if b < 0x80:
+      return (value, data[i + 1:])
+
 class GetIndexTest(SystemTest):
 
   def test_info(self):
     self.assertInfo([
       '--dataset', '--index-path', '--lockfile-path',
-      '--min-range-length'
+      '--min-range-length', '--format', '--since'
     ])
 
-  def cmdGetIndex(self, dataset, min_range_length=None):
+  def cmdGetIndex(self, dataset, min_range_length=None, format=None,
+                  since=None):
     args = ['--dataset', dataset]
     if min_range_length is not None:
       args.append('--min-range-length=' + str(min_range_length))
+    if format is not None:
+      args.append('--format=' + format)
+    if since is not None:
+      args.append('--since=' + str(since))
     return self.cmd_stdout(args)
 
+  def cmdGetChanges(self, dataset, since):
+    output = self.cmdGetIndex(dataset, since=since)
+    (revision, output) = read_uleb128(output)
+    (n_removed, output) = read_uleb128(output)
+    return (revision, n_removed, output)
+
   def test_get_index(self):
     # Test an empty dataset with an empty index
     dataset = self.createDataset(b'', b'')
@@ -68,6 +96,62 @@ class GetIndexTest(SystemTest):
     index = self.cmdGetIndex(dataset, min_range_length=12)
     self.assertEqual(index, b'')
 
+  def test_elias_fano(self):
+    magic = b'\xc2\xd4\xcf\xc5\xd0\xc5\xc6\x01'
+
+    # An empty index only contains the number of ranges.
+    dataset = self.createDataset(b'', b'')
+    index = self.cmdGetIndex(dataset, format='elias-fano')
+    self.assertEqual(index, magic + b'\x00')
+
+    # A single range [0, 1) has the boundaries 0 and 1, which set bits 0 and 2.
+    dataset = self.createDataset(b'\x00' * 1024, b'\x00\x00')
+    index = self.cmdGetIndex(dataset, format='elias-fano')
+    self.assertEqual(index, magic + b'\x01\x01\x05')
+    index = self.cmdGetIndex(dataset, format='elias-fano', min_range_length=2)
+    self.assertEqual(index, magic + b'\x00')
+
+    # In a highly fragmented index, every other bit is set. The number of ranges
+    # is 20000, and the last range ends at 39999.
+    dataset = self.createDataset(b'\x00' * 1024 * 512, b'\x00\x00' * 20000)
+    index = self.cmdGetIndex(dataset, format='elias-fano')
+    self.assertEqual(index, magic + b'\xa0\x9c\x01\xbf\xb8\x02' +
+                            b'\x55' * 10000)
+
+    # The default format is the compact format.
+    index = self.cmdGetIndex(dataset, format='compact')
+    self.assertEqual(index, b'\x00\x00' * 20000)
+
+  def test_since(self):
+    max_end = 2**64 - 1
+
+    # If the revision is unknown, everything has changed.
+    dataset = self.createDataset(b'\x00' * 1000, b'\x00\x00')
+    (rev, n_removed, ranges) = self.cmdGetChanges(dataset, 0)
+    self.assertEqual(n_removed, 1)
+    self.assertEqual(ranges, b'\x01' + uleb128(max_end - 2) + b'\x00\x00')
+    self.assertEqual(self.cmdGetChanges(dataset, rev), (rev, 0, b''))
+
+    # Adding data only produces added ranges.
+    subprocess.run(['btoep-add', '--dataset', dataset, '--offset=10'],
+                   input = b'\x00' * 5, check = True)
+    self.assertEqual(self.cmdGetChanges(dataset, rev),
+                     (rev + 1, 0, b'\x0a\x04'))
+
+    # Truncating the dataset removes everything after the new size.
+    subprocess.run(['btoep-set-size', '--dataset', dataset, '--size=12',
+                    '--force'], check = True)
+    self.assertEqual(self.cmdGetChanges(dataset, rev + 1),
+                     (rev + 2, 1, b'\x0c' + uleb128(max_end - 13)))
+    self.assertEqual(self.cmdGetChanges(dataset, rev),
+                     (rev + 2, 1, b'\x0c' + uleb128(max_end - 13) + b'\x0a\x01'))
+
+    # Only the compact format is supported.
+    stderr = self.cmd_stderr(['--dataset', dataset, '--since=0',
+                              '--format=compact'],
+                             expected_returncode = ExitCode.USAGE_ERROR)
+    self.assertIn('The --since option cannot be combined', stderr)
+
   def test_fs_error(self):
     # Test that the command fails if the dataset does not exist.
     dataset = self.reserveDataset()
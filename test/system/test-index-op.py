@@ -0,0 +1,83 @@
+from helper import ExitCode, SystemTest
+import unittest
+
+class IndexOpTest(SystemTest):
+
+  def test_info(self):
+    self.assertInfo(['--input', '--op'])
+
+  def cmdIndexOp(self, op, *indexes, **kwargs):
+    args = ['--op=' + op]
+    for index in indexes:
+      args.append('--input=' + self.createTempTestFile(index))
+    return self.cmd_stdout(args, **kwargs)
+
+  def test_index_op(self):
+    # [0, 10), [20, 30), [100, 101)
+    a = b'\x00\x09\x09\x09\x45\x00'
+    # [5, 25), [100, 200)
+    b = b'\x05\x13\x4a\x63'
+    # [0, 1000)
+    c = b'\x00\xe7\x07'
+
+    # [0, 30), [100, 200)
+    self.assertEqual(self.cmdIndexOp('union', a, b), b'\x00\x1d\x45\x63')
+    # [5, 10), [20, 25), [100, 101)
+    self.assertEqual(self.cmdIndexOp('intersection', a, b),
+                     b'\x05\x04\x09\x04\x4a\x00')
+    # [0, 5), [25, 30)
+    self.assertEqual(self.cmdIndexOp('difference', a, b), b'\x00\x04\x13\x04')
+    # [10, 20), [101, 200)
+    self.assertEqual(self.cmdIndexOp('difference', b, a), b'\x0a\x09\x50\x62')
+
+    # More than two inputs.
+    self.assertEqual(self.cmdIndexOp('union', a, b, c), c)
+    self.assertEqual(self.cmdIndexOp('intersection', a, b, c),
+                     b'\x05\x04\x09\x04\x4a\x00')
+    self.assertEqual(self.cmdIndexOp('difference', c, a, b),
+                     b'\x1e\x45\x63\x9f\x06')
+
+    # Empty inputs.
+    self.assertEqual(self.cmdIndexOp('union', b'', b''), b'')
+    self.assertEqual(self.cmdIndexOp('union', a, b''), a)
+    self.assertEqual(self.cmdIndexOp('intersection', a, b''), b'')
+    self.assertEqual(self.cmdIndexOp('difference', a, b''), a)
+    self.assertEqual(self.cmdIndexOp('difference', b'', a), b'')
+
+    # Highly fragmented inputs, one of which is read from stdin.
+    fragmented = b'\x00\x00' * 20000
+    args = ['--op=intersection', '--input=-',
+            '--input=' + self.createTempTestFile(c)]
+    result = self.cmd_stdout(args, input=fragmented)
+    self.assertEqual(result, b'\x00\x00' * 500)
+
+  def test_usage_errors(self):
+    stderr = self.cmd_stderr(['--op=union'],
+                             expected_returncode=ExitCode.USAGE_ERROR)
+    self.assertIn('The --input option is required', stderr)
+    stderr = self.cmd_stderr(['--input=-'],
+                             expected_returncode=ExitCode.USAGE_ERROR)
+    self.assertIn('The --op option is required', stderr)
+    stderr = self.cmd_stderr(['--op=union', '--input=-', '--input=-'],
+                             expected_returncode=ExitCode.USAGE_ERROR)
+    self.assertIn('can only be used once', stderr)
+
+  def test_invalid_index(self):
+    # The last entry is incomplete.
+    index = self.createTempTestFile(b'\x00\x09\x09')
+    self.assertErrorMessage(
+        ['--op=union', '--input=' + index],
+        message = 'Invalid index format',
+        lib_error_name = 'ERR_INVALID_INDEX_FORMAT',
+        lib_error_code = '4')
+
+  def test_fs_error(self):
+    # Test that the command fails if an input does not exist.
+    self.assertErrorMessage(
+        ['--op=union', '--input=' + self.reserveDataset()],
+        message = True,
+        sys_error_name = 'ENOENT',
+        sys_error_code = '2')
+
+if __name__ == '__main__':
+  unittest.main()
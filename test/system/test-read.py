@@ -1,4 +1,5 @@
 from helper import ExitCode, SystemTest
+import subprocess
 import unittest
 
 class ReadTest(SystemTest):
@@ -84,6 +85,21 @@ class ReadTest(SystemTest):
     self.assertEqual(self.cmdRead(dataset, offset=1024 * 511), b'\x0a' * 1024)
     self.assertOutOfBounds(dataset, length=1024 * 513)
 
+  def test_output_file(self):
+    # Standard output might be a regular file instead of a pipe.
+    data = bytes(range(256)) * 1024 * 2
+    dataset = self.createDataset(data, b'\x00\xff\xff\x1f')
+    for mode, prefix in [('wb', b''), ('ab', b'prefix')]:
+      path = self.createTempTestFile(b'prefix')
+      with open(path, mode) as out:
+        result = subprocess.run([self.arg0(), '--dataset', dataset,
+                                 '--offset=1000'],
+                                stdout=out, stderr=subprocess.PIPE, timeout=10)
+      self.assertEqual(ExitCode(result.returncode), ExitCode.SUCCESS)
+      self.assertEqual(result.stderr, b'')
+      with open(path, 'rb') as out:
+        self.assertEqual(out.read(), prefix + data[1000:1024 * 512])
+
   def test_fs_error(self):
     # Test that the command fails if the dataset does not exist.
     dataset = self.reserveDataset()
@@ -0,0 +1,80 @@
+from helper import ExitCode, SystemTest
+import struct
+import subprocess
+import unittest
+
+class SetIndexTest(SystemTest):
+
+  def test_info(self):
+    self.assertInfo([
+      '--dataset', '--index-path', '--lockfile-path',
+      '--source', '--source-format'
+    ])
+
+  def test_set_index(self):
+    # Replace an existing index with the output of btoep-get-index.
+    dataset = self.createDataset(b'\x00' * 1024, b'\x00\x00\x05\x03')
+    self.cmd(['--dataset', dataset], input = b'\x81\x01\x7f\x00\x7f')
+    self.assertEqual(self.readIndex(dataset), b'\x81\x01\x7f\x00\x7f')
+
+    # The same ranges, but as an array of offsets and lengths.
+    self.cmd(['--dataset', dataset, '--source-format=compact'],
+             input = b'')
+    self.assertEqual(self.readIndex(dataset), b'')
+    source = self.createTempTestFile(struct.pack('<4Q', 129, 128, 258, 128))
+    self.cmd(['--dataset', dataset, '--source', source,
+              '--source-format=binary'])
+    self.assertEqual(self.readIndex(dataset), b'\x81\x01\x7f\x00\x7f')
+
+    # Paged indexes keep their format.
+    paged = self.reserveDataset()
+    subprocess.run(['btoep-create', '--dataset', paged, '--index-format=paged'],
+                   check = True)
+    self.cmd(['--dataset', paged, '--source', '-'], input = b'\x03\x02' * 1000)
+    result = subprocess.run(['btoep-get-index', '--dataset', paged],
+                            capture_output = True, check = True)
+    self.assertEqual(result.stdout, b'\x03\x02' * 1000)
+    self.assertEqual(self.readIndex(paged)[0:8],
+                     b'\xc2\xd4\xcf\xc5\xd0\xc9\xc4\xd8')
+
+  def test_invalid_source(self):
+    # Invalid input does not modify the index.
+    dataset = self.createDataset(b'', b'\x00\x05')
+    self.assertErrorMessage(
+        ['--dataset', dataset],
+        input = b'\x00\x05\x80',
+        message = 'Invalid index format',
+        lib_error_name = 'ERR_INVALID_INDEX_FORMAT',
+        lib_error_code = '4')
+    self.assertEqual(self.readIndex(dataset), b'\x00\x05')
+
+    # Binary ranges must be sorted, and must not be adjacent.
+    self.assertErrorMessage(
+        ['--dataset', dataset, '--source-format=binary'],
+        input = struct.pack('<4Q', 10, 5, 15, 5),
+        message = 'Invalid argument',
+        lib_error_name = 'ERR_INVALID_ARGUMENT',
+        lib_error_code = '7')
+    self.assertEqual(self.readIndex(dataset), b'\x00\x05')
+
+    stderr = self.cmd_stderr(['--dataset', dataset, '--source-format=binary'],
+                             input = b'\x00' * 20,
+                             expected_returncode = ExitCode.APP_ERROR)
+    self.assertEqual(stderr, 'Error: The input ends with an incomplete range.\n')
+    self.assertEqual(self.readIndex(dataset), b'\x00\x05')
+
+  def test_fs_error(self):
+    # Test that the command fails if the dataset does not exist.
+    dataset = self.reserveDataset()
+    self.assertErrorMessage(
+        ['--dataset', dataset],
+        input = b'',
+        message = 'System input/output error',
+        has_ext_message = True,
+        lib_error_name = 'ERR_INPUT_OUTPUT',
+        lib_error_code = '1',
+        sys_error_name = 'ERROR_FILE_NOT_FOUND' if self.isWindows else 'ENOENT',
+        sys_error_code = '2')
+
+if __name__ == '__main__':
+  unittest.main()
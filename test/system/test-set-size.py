@@ -1,5 +1,6 @@
 from helper import ExitCode, SystemTest
 import os
+import subprocess
 import unittest
 
 class SetSizeTest(SystemTest):
@@ -7,7 +8,7 @@ class SetSizeTest(SystemTest):
   def test_info(self):
     self.assertInfo([
       '--dataset', '--index-path', '--lockfile-path',
-      '--size', '--force'
+      '--size', '--force', '--preallocate'
     ])
 
   def assertSetSize(self, dataset, size, force = False):
@@ -17,9 +18,12 @@ class SetSizeTest(SystemTest):
     self.cmd(args)
     self.assertEqual(size, os.path.getsize(dataset))
 
-  def assertFailDestructive(self, dataset, size):
+  def assertFailDestructive(self, dataset, size, preallocate = False):
+    args = ['--dataset', dataset, '--size', str(size)]
+    if preallocate:
+      args.append('--preallocate')
     self.assertErrorMessage(
-        ['--dataset', dataset, '--size', str(size)],
+        args,
         message = 'Size too small to contain data',
         lib_error_name = 'ERR_SIZE_TOO_SMALL',
         lib_error_code = '3')
@@ -44,5 +48,36 @@ class SetSizeTest(SystemTest):
     # The index should now be empty.
     self.assertEqual(self.readIndex(dataset), b'')
 
+  def test_preallocate(self):
+    # Destructive changes are rejected before anything is allocated.
+    dataset = self.createDataset(b'\x11' * 256, b'\x00\xff\x01')
+    self.assertFailDestructive(dataset, 100, preallocate=True)
+    self.assertEqual(self.readDataset(dataset), b'\x11' * 256)
+
+    # Preallocation does not modify existing data, and does not prevent the
+    # file from shrinking.
+    for size in [1024 * 1024, 512]:
+      result = subprocess.run([self.arg0(), '--dataset', dataset,
+                               '--size', str(size), '--preallocate'],
+                              capture_output = True, timeout = 10)
+      if ExitCode(result.returncode) != ExitCode.SUCCESS:
+        # Unsupported file systems must be reported.
+        self.assertEqual(ExitCode(result.returncode), ExitCode.APP_ERROR)
+        self.assertIn('Library error name: ERR_CANNOT_PREALLOCATE\n',
+                      result.stderr.decode())
+        self.assertEqual(os.path.getsize(dataset), 256)
+        return
+      self.assertEqual(os.path.getsize(dataset), size)
+      if hasattr(os.stat(dataset), 'st_blocks'):
+        self.assertGreaterEqual(os.stat(dataset).st_blocks * 512, size)
+      self.assertEqual(self.readDataset(dataset)[0:256], b'\x11' * 256)
+
+    # Destructive changes still require --force.
+    self.assertFailDestructive(dataset, 100)
+    self.assertFailDestructive(dataset, 100, preallocate=True)
+    self.assertEqual(os.path.getsize(dataset), 512)
+    self.cmd(['--dataset', dataset, '--size=100', '--preallocate', '--force'])
+    self.assertEqual(self.readDataset(dataset), b'\x11' * 100)
+
 if __name__ == '__main__':
   unittest.main()
@@ -0,0 +1,82 @@
+from helper import ExitCode, SystemTest
+import subprocess
+import unittest
+
+class StatTest(SystemTest):
+
+  def test_info(self):
+    self.assertInfo([
+      '--dataset', '--index-path', '--lockfile-path'
+    ])
+
+  def cmdStat(self, dataset):
+    stdout = self.cmd_stdout(['--dataset', dataset], text=True)
+    lines = [line.split(': ') for line in stdout.splitlines()]
+    return { key: value for (key, value) in lines }
+
+  def test_stat(self):
+    # Test an empty dataset with an empty index
+    dataset = self.createDataset(b'', b'')
+    stats = self.cmdStat(dataset)
+    self.assertEqual(stats['format'], 'compact')
+    self.assertEqual(stats['ranges'], '0')
+    self.assertEqual(stats['bytes'], '0')
+    self.assertEqual(stats['end'], '0')
+    self.assertEqual(stats['size'], '0')
+    self.assertRegex(stats['fingerprint'], r'^[0-9a-f]{16}$')
+    self.assertRegex(stats['revision'], r'^[0-9]+$')
+
+    # Test a 512 KiB dataset with two ranges
+    compact = self.createDataset(b'\x00' * 1024 * 512, b'\x81\x01\x7f\x00\x7f')
+    stats = self.cmdStat(compact)
+    self.assertEqual(stats['format'], 'compact')
+    self.assertEqual(stats['ranges'], '2')
+    self.assertEqual(stats['bytes'], '256')
+    self.assertEqual(stats['end'], '386')
+    self.assertEqual(stats['size'], str(1024 * 512))
+
+    # The same ranges in a paged index have the same fingerprint.
+    paged = self.reserveDataset()
+    subprocess.run(['btoep-create', '--dataset', paged, '--index-format=paged',
+                    '--size=1000'], check = True)
+    for offset in [258, 129]:
+      subprocess.run(['btoep-add', '--dataset', paged, '--offset=' + str(offset)],
+                     input = b'\x00' * 128, check = True)
+    paged_stats = self.cmdStat(paged)
+    self.assertEqual(paged_stats['format'], 'paged (version 2)')
+    self.assertEqual(paged_stats['ranges'], '2')
+    self.assertEqual(paged_stats['bytes'], '256')
+    self.assertEqual(paged_stats['end'], '386')
+    self.assertEqual(paged_stats['size'], '1000')
+    self.assertEqual(paged_stats['fingerprint'], stats['fingerprint'])
+
+    # Each change increases the revision.
+    revision = int(paged_stats['revision'])
+    subprocess.run(['btoep-add', '--dataset', paged, '--offset=0'],
+                   input = b'\x00', check = True)
+    paged_stats = self.cmdStat(paged)
+    self.assertEqual(int(paged_stats['revision']), revision + 1)
+
+  def test_invalid_index(self):
+    # A truncated entry cannot be decoded.
+    dataset = self.createDataset(b'', b'\x00\x05\x80')
+    self.assertErrorMessage(
+        ['--dataset', dataset],
+        message = 'Invalid index format',
+        lib_error_name = 'ERR_INVALID_INDEX_FORMAT',
+        lib_error_code = '4')
+
+  def test_fs_error(self):
+    # Test that the command fails if the dataset does not exist.
+    dataset = self.reserveDataset()
+    self.assertErrorMessage(
+        ['--dataset', dataset],
+        message = 'System input/output error',
+        has_ext_message = True,
+        lib_error_name = 'ERR_INPUT_OUTPUT',
+        lib_error_code = '1',
+        sys_error_name = 'ERROR_FILE_NOT_FOUND' if self.isWindows else 'ENOENT',
+        sys_error_code = '2')
+
+if __name__ == '__main__':
+  unittest.main()
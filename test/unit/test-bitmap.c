@@ -0,0 +1,129 @@
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../lib/src/bitmap.h"
+
+// The model covers a few chunks, starting at an offset that is not zero.
+#define N_BLOCKS (4 * BTOEP_BITMAP_CHUNK_SIZE)
+#define BASE     (UINT64_C(1) << 40)
+
+static bool model[N_BLOCKS];
+
+static bool model_next(uint64_t block, bool value, uint64_t* result) {
+  for (; block < N_BLOCKS; block++) {
+    if (model[block] == value) {
+      *result = BASE + block;
+      return true;
+    }
+  }
+  *result = BASE + N_BLOCKS;
+  return !value;
+}
+
+static bool model_prev(uint64_t block, bool value, uint64_t* result) {
+  for (uint64_t b = block + 1; b-- > 0;) {
+    if (model[b] == value) {
+      *result = BASE + b;
+      return true;
+    }
+  }
+  *result = BASE - 1;
+  return !value;
+}
+
+static uint64_t random_length(void) {
+  // Single blocks, short runs, and runs that span multiple chunks.
+  switch (rand() % 4) {
+  case 0:  return 1;
+  case 1:  return 1 + rand() % 64;
+  case 2:  return 1 + rand() % 4096;
+  default: return 1 + rand() % (2 * BTOEP_BITMAP_CHUNK_SIZE);
+  }
+}
+
+static void check_model(btoep_bitmap* bitmap) {
+  for (int i = 0; i < 250; i++) {
+    uint64_t block = rand() % N_BLOCKS;
+    assert(btoep_bitmap_contains(bitmap, BASE + block) == model[block]);
+
+    for (int value = 0; value <= 1; value++) {
+      uint64_t expected, actual;
+      bool exists = model_next(block, value, &expected);
+      assert(btoep_bitmap_next(bitmap, BASE + block, value, &actual) == exists);
+      assert(!exists || actual == expected);
+
+      exists = model_prev(block, value, &expected);
+      assert(btoep_bitmap_prev(bitmap, BASE + block, value, &actual) == exists);
+      assert(!exists || actual == expected);
+    }
+  }
+
+  // Nothing is stored outside of the model.
+  uint64_t result;
+  assert(!btoep_bitmap_contains(bitmap, 0));
+  assert(!btoep_bitmap_contains(bitmap, BASE - 1));
+  assert(!btoep_bitmap_contains(bitmap, BASE + N_BLOCKS));
+  assert(!btoep_bitmap_next(bitmap, BASE + N_BLOCKS, true, &result));
+  assert(!btoep_bitmap_prev(bitmap, BASE - 1, true, &result));
+  assert(btoep_bitmap_next(bitmap, UINT64_MAX - 5, false, &result));
+  assert(result == UINT64_MAX - 5);
+  assert(btoep_bitmap_prev(bitmap, 0, false, &result) && result == 0);
+}
+
+static void test_bitmap(void) {
+  btoep_bitmap bitmap;
+  btoep_bitmap_init(&bitmap);
+  memset(model, 0, sizeof(model));
+  check_model(&bitmap);
+  assert(btoep_bitmap_memory_usage(&bitmap) == 0);
+
+  // Random changes, with a bias towards adding blocks first and removing them
+  // later, so that all container types are used.
+  for (int i = 0; i < 600; i++) {
+    uint64_t first = rand() % N_BLOCKS;
+    uint64_t n = random_length();
+    if (first + n > N_BLOCKS)
+      n = N_BLOCKS - first;
+    bool value = (i < 300) ? (rand() % 3 != 0) : (rand() % 3 == 0);
+    assert(btoep_bitmap_set(&bitmap, BASE + first, n, value));
+    memset(model + first, value, n);
+    if (i % 50 == 0)
+      check_model(&bitmap);
+  }
+  check_model(&bitmap);
+
+  // A complete chunk is a single run, and an empty chunk takes no space.
+  btoep_bitmap_free(&bitmap);
+  memset(model, 0, sizeof(model));
+  assert(btoep_bitmap_set(&bitmap, BASE, N_BLOCKS, true));
+  memset(model, 1, sizeof(model));
+  check_model(&bitmap);
+  size_t full_size = btoep_bitmap_memory_usage(&bitmap);
+  assert(full_size < 1024);
+  assert(btoep_bitmap_set(&bitmap, BASE + BTOEP_BITMAP_CHUNK_SIZE,
+                          BTOEP_BITMAP_CHUNK_SIZE, false));
+  memset(model + BTOEP_BITMAP_CHUNK_SIZE, 0, BTOEP_BITMAP_CHUNK_SIZE);
+  check_model(&bitmap);
+  assert(btoep_bitmap_memory_usage(&bitmap) < full_size);
+
+  // Every other block is the worst case, for which a plain bitmap is used.
+  for (uint64_t b = 0; b < BTOEP_BITMAP_CHUNK_SIZE; b += 2) {
+    assert(btoep_bitmap_set(&bitmap, BASE + b, 1, false));
+    model[b] = false;
+  }
+  check_model(&bitmap);
+  assert(btoep_bitmap_memory_usage(&bitmap) <
+         full_size + BTOEP_BITMAP_CHUNK_SIZE / 8);
+
+  // Removing everything leaves no containers behind.
+  assert(btoep_bitmap_set(&bitmap, BASE, N_BLOCKS, false));
+  memset(model, 0, sizeof(model));
+  check_model(&bitmap);
+  assert(bitmap.n_containers == 0);
+
+  btoep_bitmap_free(&bitmap);
+}
+
+TEST_MAIN(test_bitmap)
@@ -2,8 +2,13 @@
 
 #include <btoep/dataset.h>
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 
+#ifndef _MSC_VER
+# include <pthread.h>
+#endif
+
 static inline bool memeqb(const uint8_t* ptr, uint8_t value, size_t n) {
   for (size_t i = 0; i < n; i++)
     if (ptr[i] != value) return false;
@@ -121,6 +126,7 @@ static void test_data(void) {
   assert(!btoep_data_add_range(&dataset, range, buffer, BTOEP_CONFLICT_ERROR));
   btoep_last_error(&dataset, &error);
   assert(error.code == B_ERR_DATA_CONFLICT);
+  assert(error.conflict_offset == 1024);
 
   // This should not have updated the index.
   assert(btoep_index_iterator_start(&dataset, &iterator));
@@ -235,4 +241,331 @@ static void test_data(void) {
   assert(btoep_close(&dataset));
 }
 
-TEST_MAIN(test_data)
+#ifndef _MSC_VER
+
+#define N_READERS       4
+#define N_READ_RANGES   100
+#define N_READS         2000
+
+static inline uint8_t data_at(uint64_t offset) {
+  return (uint8_t) (offset * 7 + (offset >> 8));
+}
+
+/*
+ * Reads random parts of the ranges [1000 * i, 1000 * i + 500).
+ */
+static void* concurrent_reader_main(void* arg) {
+  btoep_dataset* dataset = arg;
+  unsigned seed = (unsigned) (size_t) &seed;
+  uint8_t buffer[500];
+  for (int i = 0; i < N_READS; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint64_t start = 1000 * ((seed >> 8) % N_READ_RANGES) + (seed >> 20) % 250;
+    size_t length = 1 + (seed >> 4) % 250;
+    assert(btoep_data_read_range(dataset, btoep_mkrange(start, length), buffer,
+                                 NULL));
+    for (size_t j = 0; j < length; j++)
+      assert(buffer[j] == data_at(start + j));
+    // Reading gaps always fails.
+    assert(!btoep_data_read_range(dataset, btoep_mkrange(start + 500, 1), buffer,
+                                  NULL));
+  }
+  return NULL;
+}
+
+static void test_data_concurrent_reads(void) {
+  btoep_dataset dataset;
+  uint8_t buffer[500];
+  pthread_t readers[N_READERS];
+
+  assert(btoep_open(&dataset, "test_data_concurrent", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  for (uint64_t i = 0; i < N_READ_RANGES; i++) {
+    for (size_t j = 0; j < sizeof(buffer); j++)
+      buffer[j] = data_at(1000 * i + j);
+    assert(btoep_data_add_range(&dataset, btoep_mkrange(1000 * i, sizeof(buffer)),
+                                buffer, BTOEP_CONFLICT_ERROR));
+  }
+  assert(btoep_close(&dataset));
+
+  // Threads can share a read-only dataset.
+  assert(btoep_open(&dataset, "test_data_concurrent", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  for (int i = 0; i < N_READERS; i++)
+    assert(pthread_create(&readers[i], NULL, concurrent_reader_main, &dataset) == 0);
+  for (int i = 0; i < N_READERS; i++)
+    assert(pthread_join(readers[i], NULL) == 0);
+  assert(btoep_close(&dataset));
+
+  remove("test_data_concurrent");
+  remove("test_data_concurrent.idx");
+  remove("test_data_concurrent.idx.chg");
+}
+
+#endif
+
+static void test_data_views(void) {
+  btoep_dataset dataset;
+  btoep_last_error_info error;
+  const void* view;
+  const void* other_view;
+  const void* empty_view;
+  uint8_t buffer[4096];
+
+  assert(btoep_open(&dataset, "test_data_views", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  memset(buffer, 'a', sizeof(buffer));
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(0, 100), buffer,
+                              BTOEP_CONFLICT_ERROR));
+
+  // Views are restricted to existing ranges, just like reads.
+  assert(!btoep_data_view_acquire(&dataset, btoep_mkrange(50, 51), &view));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_READ_OUT_OF_BOUNDS);
+  assert(btoep_data_view_acquire(&dataset, btoep_mkrange(100, 0), &empty_view));
+  assert(btoep_data_view_acquire(&dataset, btoep_mkrange(10, 90), &view));
+  assert(memeqb(view, 'a', 90));
+
+  // Views remain valid when the data file grows, and reflect modifications.
+  memset(buffer, 'b', sizeof(buffer));
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(100, sizeof(buffer)),
+                              buffer, BTOEP_CONFLICT_ERROR));
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(0, 20), buffer,
+                              BTOEP_CONFLICT_OVERWRITE));
+  assert(btoep_data_view_acquire(&dataset, btoep_mkrange(10, 4000), &other_view));
+  assert(memeqb(view, 'b', 10) && memeqb((const uint8_t*) view + 10, 'a', 80));
+  assert(memeqb(other_view, 'b', 10));
+  assert(memeqb((const uint8_t*) other_view + 10, 'a', 80));
+  assert(memeqb((const uint8_t*) other_view + 90, 'b', 3910));
+
+  // The data file cannot be truncated while views point beyond the new size.
+  assert(!btoep_data_set_size(&dataset, 50, true));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_DATA_VIEWS_IN_USE);
+  btoep_data_view_release(&dataset, view);
+  assert(!btoep_data_set_size(&dataset, 50, true));
+  btoep_data_view_release(&dataset, other_view);
+  btoep_data_view_release(&dataset, empty_view);
+  assert(btoep_data_set_size(&dataset, 50, true));
+  assert(!btoep_data_view_acquire(&dataset, btoep_mkrange(10, 41), &view));
+  assert(btoep_data_view_acquire(&dataset, btoep_mkrange(10, 40), &view));
+  assert(memeqb(view, 'b', 10) && memeqb((const uint8_t*) view + 10, 'a', 30));
+  btoep_data_view_release(&dataset, view);
+
+  // Old mappings remain until all views into them have been released.
+  const void* views[BTOEP_DATA_MAP_SLOTS];
+  for (size_t i = 0; i < BTOEP_DATA_MAP_SLOTS; i++) {
+    assert(btoep_data_add_range(&dataset, btoep_mkrange(50 + i, 1), buffer,
+                                BTOEP_CONFLICT_ERROR));
+    assert(btoep_data_view_acquire(&dataset, btoep_mkrange(0, 51 + i), &views[i]));
+  }
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(100, 1), buffer,
+                              BTOEP_CONFLICT_ERROR));
+  assert(!btoep_data_view_acquire(&dataset, btoep_mkrange(100, 1), &view));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_DATA_VIEWS_IN_USE);
+  btoep_data_view_release(&dataset, views[0]);
+  assert(btoep_data_view_acquire(&dataset, btoep_mkrange(100, 1), &view));
+  assert(*(const uint8_t*) view == 'b');
+  btoep_data_view_release(&dataset, view);
+  for (size_t i = 1; i < BTOEP_DATA_MAP_SLOTS; i++)
+    btoep_data_view_release(&dataset, views[i]);
+
+  assert(btoep_close(&dataset));
+  remove("test_data_views");
+  remove("test_data_views.idx");
+  remove("test_data_views.idx.chg");
+}
+
+static void test_data_vectored(void) {
+  btoep_dataset dataset;
+  btoep_last_error_info error;
+  uint8_t a[100], b[100], c[100], out[3][100];
+
+  assert(btoep_open(&dataset, "test_data_vectored", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memset(c, 'c', sizeof(c));
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(120, 20), b,
+                              BTOEP_CONFLICT_ERROR));
+
+  // Ranges must be sorted and must not overlap.
+  btoep_range ranges[3] = {
+    btoep_mkrange(200, 50), btoep_mkrange(100, 100), btoep_mkrange(300, 100)
+  };
+  const void* data[3] = { a, b, c };
+  assert(!btoep_data_writev(&dataset, ranges, data, 3, BTOEP_CONFLICT_ERROR));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_INVALID_ARGUMENT);
+  ranges[0] = btoep_mkrange(50, 51);
+  assert(!btoep_data_writev(&dataset, ranges, data, 3, BTOEP_CONFLICT_ERROR));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_INVALID_ARGUMENT);
+
+  // Existing data is handled just like in btoep_data_write.
+  ranges[0] = btoep_mkrange(50, 50);
+  assert(!btoep_data_writev(&dataset, ranges + 1, data, 1, BTOEP_CONFLICT_ERROR));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_DATA_CONFLICT);
+  assert(btoep_data_writev(&dataset, ranges, data, 3, BTOEP_CONFLICT_KEEP_OLD));
+  assert(btoep_index_add_many(&dataset, ranges, 3));
+
+  // Reads must be sorted and must be within existing ranges.
+  btoep_range reads[3] = {
+    btoep_mkrange(90, 20), btoep_mkrange(110, 50), btoep_mkrange(350, 50)
+  };
+  void* buffers[3] = { out[0], out[1], out[2] };
+  assert(btoep_data_readv(&dataset, reads, buffers, 3));
+  assert(memeqb(out[0], 'a', 10) && memeqb(out[0] + 10, 'b', 10));
+  assert(memeqb(out[1], 'b', 10) && memeqb(out[1] + 10, 'b', 20));
+  assert(memeqb(out[1] + 30, 'b', 20));
+  assert(memeqb(out[2], 'c', 50));
+  reads[2] = btoep_mkrange(250, 50);
+  assert(!btoep_data_readv(&dataset, reads, buffers, 3));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_READ_OUT_OF_BOUNDS);
+  reads[2] = btoep_mkrange(100, 10);
+  assert(!btoep_data_readv(&dataset, reads, buffers, 3));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_INVALID_ARGUMENT);
+
+  // Overwriting replaces existing data.
+  data[0] = c;
+  data[1] = c;
+  assert(btoep_data_writev(&dataset, ranges, data, 2, BTOEP_CONFLICT_OVERWRITE));
+  reads[0] = btoep_mkrange(50, 100);
+  reads[1] = btoep_mkrange(150, 50);
+  assert(btoep_data_readv(&dataset, reads, buffers, 2));
+  assert(memeqb(out[0], 'c', 100) && memeqb(out[1], 'c', 50));
+
+  // Many small ranges exceed the size of a single batch.
+  btoep_range small_ranges[200];
+  const void* small_data[200];
+  void* small_buffers[200];
+  uint8_t small_out[200][2];
+  for (size_t i = 0; i < 200; i++) {
+    small_ranges[i] = btoep_mkrange(1000 + 2 * i, 2);
+    small_data[i] = (i % 2 == 0) ? a : b;
+    small_buffers[i] = small_out[i];
+  }
+  assert(btoep_data_writev(&dataset, small_ranges, small_data, 200,
+                           BTOEP_CONFLICT_ERROR));
+  assert(btoep_index_add(&dataset, btoep_mkrange(1000, 400)));
+  assert(btoep_data_readv(&dataset, small_ranges, small_buffers, 200));
+  for (size_t i = 0; i < 200; i++)
+    assert(memeqb(small_out[i], (i % 2 == 0) ? 'a' : 'b', 2));
+
+  assert(btoep_close(&dataset));
+  remove("test_data_vectored");
+  remove("test_data_vectored.idx");
+  remove("test_data_vectored.idx.chg");
+}
+
+static void test_data_conflicts(void) {
+  btoep_dataset dataset;
+  btoep_last_error_info error;
+  static uint8_t buffer[256 * 1024];
+
+  assert(btoep_open(&dataset, "test_data_conflicts", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  for (size_t i = 0; i < sizeof(buffer); i++)
+    buffer[i] = (uint8_t) (i * 13);
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                              buffer, BTOEP_CONFLICT_ERROR));
+
+  // Identical data never conflicts, no matter how large the overlap is.
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                              buffer, BTOEP_CONFLICT_ERROR));
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(1500, 200000),
+                              buffer + 500, BTOEP_CONFLICT_ERROR));
+
+  // Differences are detected anywhere within existing data.
+  size_t positions[] = { 0, 8191, 8192, 100000, sizeof(buffer) - 1 };
+  for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+    buffer[positions[i]] ^= 0x80;
+    assert(!btoep_data_add_range(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                                 buffer, BTOEP_CONFLICT_ERROR));
+    btoep_last_error(&dataset, &error);
+    assert(error.code == B_ERR_DATA_CONFLICT);
+    assert(error.conflict_offset == 1000 + positions[i]);
+    buffer[positions[i]] ^= 0x80;
+  }
+
+  assert(btoep_close(&dataset));
+  remove("test_data_conflicts");
+  remove("test_data_conflicts.idx");
+  remove("test_data_conflicts.idx.chg");
+}
+
+static void test_data_preallocate(void) {
+  btoep_dataset dataset;
+  btoep_last_error_info error;
+  uint64_t data_size;
+  uint8_t buffer[100];
+  bool b;
+
+  assert(btoep_open(&dataset, "test_data_preallocate", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  memset(buffer, 'x', sizeof(buffer));
+  assert(btoep_data_add_range(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                              buffer, BTOEP_CONFLICT_ERROR));
+
+  // Without BTOEP_SIZE_ALLOW_DESTRUCTIVE, existing data is protected before
+  // anything is allocated or truncated.
+  assert(!btoep_data_set_size(&dataset, 1050, BTOEP_SIZE_PREALLOCATE));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_SIZE_TOO_SMALL);
+  assert(btoep_data_get_size(&dataset, &data_size));
+  assert(data_size == 1100);
+  assert(btoep_data_read_range(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                               buffer, NULL));
+  assert(memeqb(buffer, 'x', sizeof(buffer)));
+
+  // Preallocation must either succeed or be reported, and it must not affect
+  // existing data.
+  if (btoep_data_set_size(&dataset, 1024 * 1024, BTOEP_SIZE_PREALLOCATE)) {
+    assert(btoep_data_get_size(&dataset, &data_size));
+    assert(data_size == 1024 * 1024);
+  } else {
+    btoep_last_error(&dataset, &error);
+    assert(error.code == B_ERR_CANNOT_PREALLOCATE);
+    assert(btoep_data_get_size(&dataset, &data_size));
+    assert(data_size == 1100);
+  }
+  assert(btoep_index_contains(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                              &b));
+  assert(b);
+  assert(btoep_data_read_range(&dataset, btoep_mkrange(1000, sizeof(buffer)),
+                               buffer, NULL));
+  assert(memeqb(buffer, 'x', sizeof(buffer)));
+
+  // Shrinking the file does not require allocating anything, so it succeeds
+  // even if the file system does not support preallocation.
+  assert(btoep_data_set_size(&dataset, 1050, BTOEP_SIZE_PREALLOCATE |
+                                             BTOEP_SIZE_ALLOW_DESTRUCTIVE));
+  assert(btoep_data_get_size(&dataset, &data_size));
+  assert(data_size == 1050);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(1000, 50), &b));
+  assert(b);
+  assert(btoep_index_contains_any(&dataset, btoep_max_range_from(1050), &b));
+  assert(!b);
+
+  assert(btoep_close(&dataset));
+  remove("test_data_preallocate");
+  remove("test_data_preallocate.idx");
+  remove("test_data_preallocate.idx.chg");
+}
+
+static void test_data_all(void) {
+  test_data();
+  test_data_preallocate();
+  test_data_conflicts();
+  test_data_vectored();
+  test_data_views();
+#ifndef _MSC_VER
+  test_data_concurrent_reads();
+#endif
+}
+
+TEST_MAIN(test_data_all)
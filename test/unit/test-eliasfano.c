@@ -0,0 +1,228 @@
+#include "test.h"
+
+#include <btoep/eliasfano.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RANGES 5000
+
+static btoep_range ranges[MAX_RANGES];
+
+static uint64_t random_u64(void) {
+  uint64_t value = 0;
+  for (int i = 0; i < 4; i++)
+    value = (value << 16) | (rand() & 0xffff);
+  return value;
+}
+
+/* Returns the index of the first range that ends after the given offset. */
+static size_t model_find(size_t n_ranges, uint64_t offset) {
+  size_t lo = 0, hi = n_ranges;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ranges[mid].offset + ranges[mid].length <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void encode(size_t n_ranges, btoep_ef_encoder* encoder) {
+  uint64_t end = (n_ranges == 0) ? 0 : ranges[n_ranges - 1].offset +
+                                       ranges[n_ranges - 1].length;
+  assert(btoep_ef_encoder_init(encoder, n_ranges, end));
+  for (size_t i = 0; i < n_ranges; i++)
+    assert(btoep_ef_encoder_add(encoder, ranges[i]));
+  // No more ranges can be added.
+  assert(!btoep_ef_encoder_add(encoder, btoep_mkrange(end + 1, 1)));
+  assert(encoder->last_error.code == B_ERR_INVALID_ARGUMENT);
+}
+
+static void check_query(const btoep_ef_index* index, size_t n_ranges,
+                        uint64_t offset, uint64_t length) {
+  size_t i = model_find(n_ranges, offset);
+  bool inside = i < n_ranges && ranges[i].offset <= offset;
+
+  uint64_t result;
+  bool exists = btoep_ef_index_find_offset(index, offset, BTOEP_FIND_DATA, &result);
+  assert(exists == (i < n_ranges));
+  assert(!exists || result == (inside ? offset : ranges[i].offset));
+  exists = btoep_ef_index_find_offset(index, offset, BTOEP_FIND_NO_DATA, &result);
+  assert(exists && result == (inside ? ranges[i].offset + ranges[i].length : offset));
+
+  if (offset + length < offset)
+    length = UINT64_MAX - offset;
+  btoep_range range = btoep_mkrange(offset, length);
+  bool contains = length == 0 ||
+                  (inside && btoep_range_is_subset(ranges[i], range));
+  assert(btoep_ef_index_contains(index, range) == contains);
+  bool contains_any = length != 0 && i < n_ranges &&
+                      (inside || ranges[i].offset - offset < length);
+  assert(btoep_ef_index_contains_any(index, range) == contains_any);
+}
+
+static void check_round_trip(size_t n_ranges) {
+  btoep_ef_encoder encoder;
+  btoep_ef_index index;
+  encode(n_ranges, &encoder);
+  assert(btoep_ef_index_open(&index, encoder.data, encoder.size));
+  assert(index.n_ranges == n_ranges);
+
+  for (size_t i = 0; i < n_ranges; i++) {
+    btoep_range range = btoep_ef_index_get(&index, i);
+    assert(range.offset == ranges[i].offset && range.length == ranges[i].length);
+  }
+
+  for (size_t i = 0; i < n_ranges; i++) {
+    // Boundaries, and offsets close to them.
+    uint64_t start = ranges[i].offset, end = start + ranges[i].length;
+    check_query(&index, n_ranges, start, 1);
+    check_query(&index, n_ranges, start, ranges[i].length);
+    check_query(&index, n_ranges, start, ranges[i].length + 1);
+    check_query(&index, n_ranges, end, 1);
+    check_query(&index, n_ranges, end - 1, 2);
+    if (start != 0)
+      check_query(&index, n_ranges, start - 1, 1 + rand() % 3);
+  }
+  for (int i = 0; i < 2000; i++) {
+    uint64_t end = (n_ranges == 0) ? 1000 : ranges[n_ranges - 1].offset +
+                                            ranges[n_ranges - 1].length;
+    check_query(&index, n_ranges, random_u64() % end, random_u64() % 5000);
+  }
+  check_query(&index, n_ranges, UINT64_MAX - 1, 1);
+  check_query(&index, n_ranges, 0, 0);
+
+  btoep_ef_index_close(&index);
+  btoep_ef_encoder_free(&encoder);
+}
+
+static size_t random_ranges(uint64_t start, uint64_t max_gap,
+                            uint64_t max_length) {
+  size_t n_ranges = rand() % MAX_RANGES;
+  uint64_t offset = start;
+  for (size_t i = 0; i < n_ranges; i++) {
+    ranges[i] = btoep_mkrange(offset, 1 + random_u64() % max_length);
+    offset = ranges[i].offset + ranges[i].length + 1 + random_u64() % max_gap;
+  }
+  return n_ranges;
+}
+
+static void test_round_trip(void) {
+  check_round_trip(0);
+
+  srand(1357);
+  for (int round = 0; round < 8; round++) {
+    // Dense and sparse indexes, and the latter close to the end of the address
+    // space, so that almost all bits are low bits.
+    check_round_trip(random_ranges(round, 2, 2));
+    check_round_trip(random_ranges(rand(), 300, 4000));
+    check_round_trip(random_ranges(0, UINT64_C(1) << 40, 1 << 20));
+    check_round_trip(random_ranges(UINT64_MAX - (UINT64_C(1) << 58), UINT64_C(1) << 45, 10));
+  }
+
+  // A range that ends at the end of the address space.
+  ranges[0] = btoep_mkrange(5, UINT64_MAX - 5);
+  check_round_trip(1);
+  ranges[0] = btoep_mkrange(0, 1);
+  ranges[1] = btoep_mkrange(UINT64_MAX - 1, 1);
+  check_round_trip(2);
+}
+
+static void test_size(void) {
+  btoep_ef_encoder encoder;
+
+  // An empty index only consists of the magic value and the number of ranges.
+  encode(0, &encoder);
+  assert(encoder.size == BTOEP_EF_MAGIC_SIZE + 1);
+  assert(memcmp(encoder.data, BTOEP_EF_MAGIC "\x00", encoder.size) == 0);
+  btoep_ef_encoder_free(&encoder);
+
+  // [0, 1) and [2, 4): boundaries 0, 1, 2, 4 without low bits, so the high bit
+  // vector has ones at 0, 2, 4, and 7.
+  ranges[0] = btoep_mkrange(0, 1);
+  ranges[1] = btoep_mkrange(2, 2);
+  encode(2, &encoder);
+  assert(encoder.size == BTOEP_EF_MAGIC_SIZE + 3);
+  assert(memcmp(encoder.data + BTOEP_EF_MAGIC_SIZE, "\x02\x04\x95", 3) == 0);
+  btoep_ef_encoder_free(&encoder);
+
+  // Regularly spaced ranges take slightly more than one byte each, whereas the
+  // compact format requires two bytes per range.
+  for (size_t i = 0; i < MAX_RANGES; i++)
+    ranges[i] = btoep_mkrange(10 * i, 5);
+  encode(MAX_RANGES, &encoder);
+  assert(encoder.size < MAX_RANGES + MAX_RANGES / 10);
+  btoep_ef_encoder_free(&encoder);
+}
+
+static void check_invalid(const uint8_t* data, size_t size) {
+  btoep_ef_index index;
+  assert(!btoep_ef_index_open(&index, data, size));
+  assert(index.last_error.code == B_ERR_INVALID_INDEX_FORMAT);
+}
+
+static void test_invalid(void) {
+  btoep_ef_encoder encoder;
+  uint8_t buffer[64];
+
+  // Ranges must be in ascending order, and must fit the declared end.
+  assert(btoep_ef_encoder_init(&encoder, 2, 100));
+  assert(!btoep_ef_encoder_add(&encoder, btoep_mkrange(10, 0)));
+  assert(btoep_ef_encoder_add(&encoder, btoep_mkrange(10, 5)));
+  assert(!btoep_ef_encoder_add(&encoder, btoep_mkrange(15, 5)));
+  assert(!btoep_ef_encoder_add(&encoder, btoep_mkrange(20, 100)));
+  assert(!btoep_ef_encoder_add(&encoder, btoep_mkrange(20, 5)));
+  assert(encoder.last_error.code == B_ERR_INVALID_ARGUMENT);
+  assert(btoep_ef_encoder_add(&encoder, btoep_mkrange(20, 80)));
+  btoep_ef_encoder_free(&encoder);
+  // Ranges cannot end before all boundaries fit.
+  assert(!btoep_ef_encoder_init(&encoder, 3, 4));
+
+  ranges[0] = btoep_mkrange(3, 4);
+  ranges[1] = btoep_mkrange(100, 20);
+  ranges[2] = btoep_mkrange(200, 1);
+  encode(3, &encoder);
+  assert(encoder.size < sizeof(buffer));
+  memcpy(buffer, encoder.data, encoder.size);
+
+  // Truncated data, trailing data, and a wrong magic value.
+  for (size_t size = 0; size < encoder.size; size++)
+    check_invalid(buffer, size);
+  buffer[encoder.size] = 0;
+  check_invalid(buffer, encoder.size + 1);
+  buffer[0] ^= 1;
+  check_invalid(buffer, encoder.size);
+  buffer[0] ^= 1;
+
+  // Flipping any bit of the encoded ranges either produces an invalid index, or
+  // one that still consists of well-formed ranges.
+  btoep_ef_index index;
+  for (size_t bit = 8 * BTOEP_EF_MAGIC_SIZE; bit < 8 * encoder.size; bit++) {
+    buffer[bit / 8] ^= 1 << (bit % 8);
+    if (btoep_ef_index_open(&index, buffer, encoder.size)) {
+      btoep_range prev = btoep_mkrange(0, 0);
+      for (uint64_t i = 0; i < index.n_ranges; i++) {
+        btoep_range range = btoep_ef_index_get(&index, i);
+        assert(range.length != 0 && (i == 0 || range.offset > prev.offset + prev.length));
+        prev = range;
+      }
+      btoep_ef_index_close(&index);
+    } else {
+      assert(index.last_error.code == B_ERR_INVALID_INDEX_FORMAT);
+    }
+    buffer[bit / 8] ^= 1 << (bit % 8);
+  }
+
+  assert(btoep_ef_index_open(&index, buffer, encoder.size));
+  btoep_ef_index_close(&index);
+  btoep_ef_encoder_free(&encoder);
+}
+
+static void test_eliasfano(void) {
+  test_round_trip();
+  test_size();
+  test_invalid();
+}
+
+TEST_MAIN(test_eliasfano)
@@ -1,6 +1,9 @@
 #include "test.h"
 
-#include <btoep/dataset.h>
+#include <btoep/stream.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static void assert_iterator_is_dead(btoep_index_iterator* iterator) {
   btoep_last_error_info error;
@@ -201,4 +204,1036 @@ static void test_index(void) {
   assert(btoep_close(&dataset));
 }
 
-TEST_MAIN(test_index)
+static void test_index_queries(void) {
+  btoep_dataset dataset;
+  btoep_range range;
+  uint64_t offset;
+  bool b;
+
+  assert(btoep_open(&dataset, "test_index_queries", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+
+  // Create a fragmented index: 1000 ranges of 50 bytes each, 100 bytes apart.
+  for (uint64_t i = 0; i < 1000; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(100 * i + 50, 50)));
+
+  // Query the index. This loads the decoded index table.
+  assert(btoep_index_find_offset(&dataset, 0, BTOEP_FIND_DATA, &b, &offset));
+  assert(b && offset == 50);
+  assert(btoep_index_find_offset(&dataset, 49999, BTOEP_FIND_DATA, &b, &offset));
+  assert(b && offset == 49999);
+  assert(btoep_index_find_offset(&dataset, 100000, BTOEP_FIND_DATA, &b, &offset));
+  assert(!b);
+  assert(btoep_index_find_offset(&dataset, 12345, BTOEP_FIND_DATA, &b, &offset));
+  assert(b && offset == 12350);
+  assert(btoep_index_find_offset(&dataset, 12355, BTOEP_FIND_NO_DATA, &b, &offset));
+  assert(b && offset == 12400);
+  assert(btoep_index_find_offset(&dataset, 90000, BTOEP_FIND_NO_DATA, &b, &offset));
+  assert(b && offset == 90000);
+
+  assert(btoep_index_contains(&dataset, btoep_mkrange(25050, 50), &b) && b);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(25050, 51), &b) && !b);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(25049, 2), &b) && !b);
+  assert(btoep_index_contains_any(&dataset, btoep_mkrange(25000, 50), &b) && !b);
+  assert(btoep_index_contains_any(&dataset, btoep_mkrange(25000, 51), &b) && b);
+  assert(btoep_index_contains_any(&dataset, btoep_mkrange(49999, 100), &b) && b);
+  assert(btoep_index_contains_any(&dataset, btoep_mkrange(50000, 50), &b) && !b);
+
+  // Merge ranges 10 to 20, and make sure queries reflect that.
+  assert(btoep_index_add(&dataset, btoep_mkrange(1090, 1000)));
+  assert(btoep_index_contains(&dataset, btoep_mkrange(1050, 1050), &b) && b);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(1050, 1051), &b) && !b);
+  assert(btoep_index_find_offset(&dataset, 1050, BTOEP_FIND_NO_DATA, &b, &offset));
+  assert(b && offset == 2100);
+
+  // Split the merged range again, and remove a few ranges entirely.
+  assert(btoep_index_remove(&dataset, btoep_mkrange(1500, 10)));
+  assert(btoep_index_remove(&dataset, btoep_mkrange(2140, 320)));
+  assert(btoep_index_find_offset(&dataset, 1050, BTOEP_FIND_NO_DATA, &b, &offset));
+  assert(b && offset == 1500);
+  assert(btoep_index_find_offset(&dataset, 1500, BTOEP_FIND_DATA, &b, &offset));
+  assert(b && offset == 1510);
+  assert(btoep_index_find_offset(&dataset, 2100, BTOEP_FIND_DATA, &b, &offset));
+  assert(b && offset == 2460);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(2150, 50), &b) && !b);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(2460, 40), &b) && b);
+  assert(btoep_index_contains_any(&dataset, btoep_mkrange(2100, 360), &b) && !b);
+
+  // The decoded table must match the index itself.
+  btoep_index_iterator iterator;
+  uint64_t n_ranges = 0;
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  while (!btoep_index_iterator_is_eof(&iterator)) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(btoep_index_contains(&dataset, range, &b) && b);
+    assert(btoep_index_find_offset(&dataset, range.offset, BTOEP_FIND_NO_DATA,
+                                   &b, &offset));
+    assert(b && offset == range.offset + range.length);
+    n_ranges++;
+  }
+  assert(n_ranges == 1000 - 10 + 1 - 3);
+
+  assert(btoep_close(&dataset));
+}
+
+static void assert_seek(btoep_dataset* dataset, uint64_t data_offset,
+                        bool is_eof, uint64_t expected_offset) {
+  btoep_index_iterator iterator;
+  btoep_range range;
+  assert(btoep_index_iterator_start(dataset, &iterator));
+  assert(btoep_index_iterator_seek(&iterator, data_offset));
+  assert(btoep_index_iterator_is_eof(&iterator) == is_eof);
+  if (!is_eof) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == expected_offset);
+  }
+}
+
+static void test_index_checkpoints(void) {
+  btoep_dataset dataset;
+  btoep_index_iterator iterator;
+  btoep_range range;
+  FILE* file;
+
+  assert(btoep_open(&dataset, "test_index_checkpoints", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+
+  // Add 10000 ranges in a pseudo-random order. Each range is 8 bytes long, and
+  // there are 8 missing bytes between two ranges, which results in an index
+  // size of 20000 bytes.
+  for (uint64_t i = 0; i < 10000; i++) {
+    uint64_t j = (i * 7919) % 10000;
+    assert(btoep_index_add(&dataset, btoep_mkrange(16 * j + 8, 8)));
+  }
+
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  for (uint64_t i = 0; i < 10000; i++) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == 16 * i + 8 && range.length == 8);
+  }
+  assert(btoep_index_iterator_is_eof(&iterator));
+
+  assert_seek(&dataset, 0, false, 8);
+  assert_seek(&dataset, 8, false, 8);
+  assert_seek(&dataset, 15, false, 8);
+  assert_seek(&dataset, 16, false, 24);
+  assert_seek(&dataset, 80000, false, 80008);
+  assert_seek(&dataset, 159999, false, 159992);
+  assert_seek(&dataset, 160000, true, 0);
+
+  // Iterators can seek backwards, and seeking revives dead iterators.
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  assert(btoep_index_iterator_seek(&iterator, 100000));
+  assert(btoep_index_iterator_seek(&iterator, 50000));
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 50008);
+  assert(btoep_index_remove(&dataset, btoep_mkrange(50008, 8)));
+  assert(btoep_index_iterator_seek(&iterator, 50000));
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 50024);
+  assert(btoep_index_add(&dataset, btoep_mkrange(50008, 8)));
+
+  assert(btoep_close(&dataset));
+
+  // The index is large enough to warrant a checkpoint file.
+  assert((file = fopen("test_index_checkpoints.idx.ckp", "rb")) != NULL);
+  fclose(file);
+
+  // Use the checkpoint file in a read-only process.
+  assert(btoep_open(&dataset, "test_index_checkpoints", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_seek(&dataset, 123456, false, 123464);
+  assert_seek(&dataset, 1000, false, 1000);
+  assert(btoep_close(&dataset));
+
+  // Merge many ranges, and split others, using the checkpoint file.
+  assert(btoep_open(&dataset, "test_index_checkpoints", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  assert(btoep_index_add(&dataset, btoep_mkrange(20000, 40000)));
+  for (uint64_t i = 0; i < 1000; i++)
+    assert(btoep_index_remove(&dataset, btoep_mkrange(100000 + 16 * i + 10, 4)));
+  assert(btoep_close(&dataset));
+
+  assert(btoep_open(&dataset, "test_index_checkpoints", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_seek(&dataset, 19000, false, 19000);
+  assert_seek(&dataset, 20000, false, 19992);
+  assert_seek(&dataset, 50000, false, 19992);
+  assert_seek(&dataset, 60000, false, 60008);
+  assert_seek(&dataset, 100010, false, 100014);
+  assert_seek(&dataset, 100014, false, 100014);
+  assert_seek(&dataset, 115999, false, 115998);
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  uint64_t n_ranges = 0, prev_end = 0;
+  while (!btoep_index_iterator_is_eof(&iterator)) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset > prev_end);
+    assert_seek(&dataset, range.offset, false, range.offset);
+    prev_end = range.offset + range.length;
+    n_ranges++;
+  }
+  assert(n_ranges == 10000 - 2500 + 1000);
+  assert(btoep_close(&dataset));
+
+  // Replacing the index must invalidate the checkpoint file.
+  assert((file = fopen("test_index_checkpoints.idx", "wb")) != NULL);
+  assert(fwrite("\x80\x01\x7f", 1, 3, file) == 3);
+  fclose(file);
+  assert(btoep_open(&dataset, "test_index_checkpoints", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_seek(&dataset, 0, false, 128);
+  assert_seek(&dataset, 200, false, 128);
+  assert_seek(&dataset, 256, true, 0);
+  assert(btoep_close(&dataset));
+}
+
+static void assert_large_index(btoep_dataset* dataset, uint64_t n_ranges) {
+  btoep_index_iterator iterator;
+  btoep_range range;
+
+  // All ranges except for the ones that were modified have the same layout.
+  assert(btoep_index_iterator_start(dataset, &iterator));
+  for (uint64_t i = 0; i < n_ranges; i++) {
+    if (i >= 40000 && i < 40010)
+      continue;
+    assert(btoep_index_iterator_next(&iterator, &range));
+    if (i == 20000) {
+      assert(range.offset == 1280008 && range.length == 600);
+      i += 9;
+    } else {
+      assert(range.offset == 64 * i + 8 && range.length == 8);
+    }
+    if (i == 100) {
+      assert(btoep_index_iterator_next(&iterator, &range));
+      assert(range.offset == 6420 && range.length == 4);
+    }
+  }
+  assert(btoep_index_iterator_is_eof(&iterator));
+}
+
+static void test_index_large(const char* name, int create_mode) {
+  btoep_dataset dataset;
+  bool b;
+
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+
+  // Each of these ranges requires two bytes in the index, so the index is much
+  // larger than the index cache.
+  for (uint64_t i = 0; i < 50000; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(64 * i + 8, 8)));
+
+  // Insert, merge, and remove ranges close to the beginning of the index, which
+  // requires moving the rest of the index.
+  assert(btoep_index_add(&dataset, btoep_mkrange(6420, 4)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(1280008, 600)));
+  assert(btoep_index_remove(&dataset, btoep_mkrange(2560000, 640)));
+  assert_large_index(&dataset, 50000);
+  assert(btoep_close(&dataset));
+
+  assert(btoep_open(&dataset, name, NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_large_index(&dataset, 50000);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(64 * 49999 + 8, 8), &b));
+  assert(b);
+  assert(btoep_close(&dataset));
+
+  // Removing most ranges shrinks the index.
+  assert(btoep_open(&dataset, name, NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  assert(btoep_index_remove(&dataset, btoep_max_range_from(64 * 45000)));
+  assert_large_index(&dataset, 45000);
+  assert(btoep_close(&dataset));
+
+  assert(btoep_open(&dataset, name, NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_large_index(&dataset, 45000);
+  assert(btoep_close(&dataset));
+}
+
+static size_t read_file(const char* path, uint8_t* buffer, size_t size) {
+  FILE* file;
+  assert((file = fopen(path, "rb")) != NULL);
+  size_t n_read = fread(buffer, 1, size, file);
+  assert(feof(file));
+  fclose(file);
+  return n_read;
+}
+
+static void write_file(const char* path, const uint8_t* data, size_t size) {
+  FILE* file;
+  assert((file = fopen(path, "wb")) != NULL);
+  assert(fwrite(data, 1, size, file) == size);
+  fclose(file);
+}
+
+static void test_index_paged(void) {
+  static uint8_t before[1024 * 1024], after[1024 * 1024];
+  btoep_dataset dataset;
+  btoep_last_error_info error;
+  btoep_index_iterator iterator;
+  btoep_range range;
+
+  test_index_large("test_index_paged", B_CREATE_NEW_READ_WRITE |
+                                       B_CREATE_PAGED_INDEX);
+
+  // The index file should start with the magic value of the paged format.
+  size_t size_before = read_file("test_index_paged.idx", before, sizeof(before));
+  assert(memcmp(before, "\xc2\xd4\xcf\xc5\xd0\xc9\xc4\xd8", 8) == 0);
+
+  // Inserting many ranges close to the beginning of the index only modifies a
+  // few pages of the index file.
+  assert(btoep_open(&dataset, "test_index_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  for (uint64_t i = 0; i < 200; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(64 * i + 20, 4)));
+  assert(btoep_close(&dataset));
+
+  size_t size_after = read_file("test_index_paged.idx", after, sizeof(after));
+  assert(size_after >= size_before);
+  size_t n_modified_pages = 0;
+  for (size_t offset = 0; offset < size_after; offset += 4096) {
+    size_t n = (size_after - offset < 4096) ? size_after - offset : 4096;
+    if (offset + n > size_before || memcmp(before + offset, after + offset, n) != 0)
+      n_modified_pages++;
+  }
+  assert(n_modified_pages <= 3);
+
+  assert(btoep_open(&dataset, "test_index_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  for (uint64_t i = 0; i < 200; i++) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == 64 * i + 8 && range.length == 8);
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == 64 * i + 20 && range.length == 4);
+  }
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 64 * 200 + 8 && range.length == 8);
+  assert(btoep_close(&dataset));
+
+  // An existing compact index keeps its format.
+  assert(btoep_open(&dataset, "test_index_large", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE | B_CREATE_PAGED_INDEX));
+  assert(btoep_index_add(&dataset, btoep_mkrange(20, 4)));
+  assert(btoep_close(&dataset));
+  assert(read_file("test_index_large.idx", before, sizeof(before)) > 8);
+  assert(before[0] == 8 && before[1] == 7);
+
+  // Reading a truncated index file fails, even if it is mapped into memory.
+  write_file("test_index_paged_truncated", NULL, 0);
+  write_file("test_index_paged_truncated.idx", after, size_after / 2 + 100);
+  assert(btoep_open(&dataset, "test_index_paged_truncated", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  bool ok = true;
+  while (ok && !btoep_index_iterator_is_eof(&iterator))
+    ok = btoep_index_iterator_next(&iterator, &range);
+  assert(!ok);
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_INVALID_INDEX_FORMAT);
+  assert(btoep_close(&dataset));
+}
+
+#define MANY_MODEL_SIZE 4096
+
+// Compares the index to a bitmap that contains one entry per offset.
+static void assert_index_matches(btoep_dataset* dataset, const bool* model) {
+  btoep_index_iterator iterator;
+  btoep_index_stats stats;
+  btoep_range range;
+  bool b;
+
+  assert(btoep_index_get_stats(dataset, &stats));
+  uint64_t n_entries = 0, n_bytes = 0, end = 0;
+  for (uint64_t offset = 0; offset < MANY_MODEL_SIZE; offset++) {
+    if (model[offset]) {
+      n_entries += offset == 0 || !model[offset - 1];
+      n_bytes++;
+      end = offset + 1;
+    }
+  }
+  assert(stats.n_entries == n_entries);
+  assert(stats.n_bytes == n_bytes);
+  assert(stats.end == end);
+
+  assert(btoep_index_iterator_start(dataset, &iterator));
+  uint64_t offset = 0;
+  while (offset < MANY_MODEL_SIZE) {
+    if (!model[offset]) {
+      offset++;
+      continue;
+    }
+    uint64_t end = offset;
+    while (end < MANY_MODEL_SIZE && model[end])
+      end++;
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == offset && range.length == end - offset);
+    assert(btoep_index_contains(dataset, range, &b));
+    assert(b);
+    offset = end;
+  }
+  assert(btoep_index_iterator_is_eof(&iterator));
+}
+
+static void test_index_many(const char* name, int create_mode) {
+  btoep_dataset dataset;
+  btoep_range ranges[100];
+  static bool model[MANY_MODEL_SIZE];
+
+  memset(model, 0, sizeof(model));
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+
+  // Empty batches do not modify the index.
+  assert(btoep_index_add_many(&dataset, NULL, 0));
+  assert(btoep_index_remove_many(&dataset, NULL, 0));
+  assert_index_matches(&dataset, model);
+
+  // Ranges are sorted and merged, even if they overlap.
+  ranges[0] = btoep_mkrange(30, 10);
+  ranges[1] = btoep_mkrange(0, 10);
+  ranges[2] = btoep_mkrange(10, 0);
+  ranges[3] = btoep_mkrange(35, 10);
+  ranges[4] = btoep_mkrange(10, 5);
+  assert(btoep_index_add_many(&dataset, ranges, 5));
+  for (size_t i = 0; i < 45; i++)
+    model[i] = i < 15 || i >= 30;
+  assert_index_matches(&dataset, model);
+
+  // Ranges may span and split multiple entries.
+  ranges[0] = btoep_mkrange(12, 20);
+  ranges[1] = btoep_mkrange(40, 1);
+  ranges[2] = btoep_mkrange(5, 2);
+  assert(btoep_index_remove_many(&dataset, ranges, 3));
+  for (size_t i = 5; i < 32; i++)
+    model[i] = i < 7 || (i >= 7 && i < 12);
+  model[5] = model[6] = model[40] = false;
+  assert_index_matches(&dataset, model);
+
+  // Compare random batches to the model.
+  srand(1234);
+  for (unsigned round = 0; round < 200; round++) {
+    bool add = rand() % 2;
+    size_t n_ranges = 1 + rand() % 100;
+    for (size_t i = 0; i < n_ranges; i++) {
+      uint64_t offset = rand() % (MANY_MODEL_SIZE - 64);
+      ranges[i] = btoep_mkrange(offset, rand() % 64);
+      for (uint64_t j = offset; j < offset + ranges[i].length; j++)
+        model[j] = add;
+    }
+    if (add)
+      assert(btoep_index_add_many(&dataset, ranges, n_ranges));
+    else
+      assert(btoep_index_remove_many(&dataset, ranges, n_ranges));
+    assert_index_matches(&dataset, model);
+  }
+
+  assert(btoep_close(&dataset));
+  assert(btoep_open(&dataset, name, NULL, NULL, B_OPEN_EXISTING_READ_ONLY));
+  assert_index_matches(&dataset, model);
+  assert(!btoep_index_add_many(&dataset, ranges, 1));
+  assert(btoep_close(&dataset));
+}
+
+static void test_index_stats(void) {
+  static uint8_t index[16384];
+  btoep_dataset compact, paged;
+  btoep_index_stats stats, paged_stats;
+  btoep_range ranges[3] = { { 10, 5 }, { 100, 50 }, { 300, 1 } };
+
+  assert(btoep_open(&compact, "test_index_stats", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+  assert(btoep_open(&paged, "test_index_stats_paged", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX));
+
+  assert(btoep_index_get_stats(&compact, &stats));
+  assert(stats.format_version == 0 && stats.n_entries == 0 &&
+         stats.n_bytes == 0 && stats.end == 0);
+  uint64_t empty_fingerprint = stats.fingerprint;
+
+  // The fingerprint depends on the entries only, not on how they were added.
+  assert(btoep_index_add_many(&compact, ranges, 3));
+  for (size_t i = 3; i-- > 0;) {
+    assert(btoep_index_add(&paged, btoep_mkrange(ranges[i].offset, 1)));
+    assert(btoep_index_add(&paged, ranges[i]));
+  }
+  assert(btoep_index_get_stats(&compact, &stats));
+  assert(btoep_index_get_stats(&paged, &paged_stats));
+  assert(stats.n_entries == 3 && stats.n_bytes == 56 && stats.end == 301);
+  assert(paged_stats.format_version == 2);
+  assert(paged_stats.n_entries == 3 && paged_stats.n_bytes == 56 &&
+         paged_stats.end == 301);
+  assert(stats.fingerprint == paged_stats.fingerprint);
+  assert(stats.fingerprint != empty_fingerprint);
+
+  // Moving data changes the fingerprint, even if the size does not change.
+  assert(btoep_index_remove(&paged, btoep_mkrange(149, 1)));
+  assert(btoep_index_add(&paged, btoep_mkrange(99, 1)));
+  assert(btoep_index_get_stats(&paged, &paged_stats));
+  assert(paged_stats.n_entries == 3 && paged_stats.n_bytes == 56);
+  assert(paged_stats.fingerprint != stats.fingerprint);
+  assert(btoep_index_remove(&paged, btoep_mkrange(99, 1)));
+  assert(btoep_index_add(&paged, btoep_mkrange(149, 1)));
+
+  assert(btoep_close(&compact));
+  assert(btoep_close(&paged));
+
+  // Paged indexes store the statistics, compact indexes do not.
+  assert(btoep_open(&compact, "test_index_stats", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(btoep_open(&paged, "test_index_stats_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(!compact.index_stats_are_known);
+  assert(paged.index_stats_are_known);
+  assert(btoep_index_get_stats(&compact, &stats));
+  assert(btoep_index_get_stats(&paged, &paged_stats));
+  assert(stats.n_entries == paged_stats.n_entries &&
+         stats.n_bytes == paged_stats.n_bytes &&
+         stats.end == paged_stats.end &&
+         stats.fingerprint == paged_stats.fingerprint);
+  assert(btoep_close(&compact));
+  assert(btoep_close(&paged));
+
+  // Headers of version 1 do not contain statistics, but are upgraded.
+  size_t size = read_file("test_index_stats_paged.idx", index, sizeof(index));
+  assert(size > 4096 && index[8] == 2 && index[56] == 1);
+  index[8] = 1;
+  memset(index + 56, 0, 40);
+  write_file("test_index_stats_paged.idx", index, size);
+  assert(btoep_open(&paged, "test_index_stats_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  assert(!paged.index_stats_are_known);
+  assert(btoep_index_get_stats(&paged, &paged_stats));
+  assert(paged_stats.format_version == 1);
+  assert(paged_stats.fingerprint == stats.fingerprint);
+  assert(btoep_close(&paged));
+  assert(btoep_open(&paged, "test_index_stats_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(paged.index_stats_are_known);
+  assert(btoep_index_get_stats(&paged, &paged_stats));
+  assert(paged_stats.format_version == 2);
+  assert(paged_stats.fingerprint == stats.fingerprint);
+  assert(btoep_close(&paged));
+}
+
+#define BITMAP_PIECE_SIZE 1024
+#define BITMAP_N_PIECES   8192
+// The last piece is shorter than the others.
+#define BITMAP_DATA_SIZE  ((BITMAP_N_PIECES - 1) * BITMAP_PIECE_SIZE + 300)
+
+// Compares queries to a model that contains one entry per piece.
+static void assert_pieces_match(btoep_dataset* dataset, const bool* model) {
+  for (int i = 0; i < 500; i++) {
+    uint64_t offset = rand() % (BITMAP_DATA_SIZE + 100), result;
+    uint64_t piece = offset / BITMAP_PIECE_SIZE, next = piece + 1;
+    bool has_data = offset < BITMAP_DATA_SIZE && model[piece], exists;
+
+    while (next < BITMAP_N_PIECES && !model[next])
+      next++;
+    assert(btoep_index_find_offset(dataset, offset, BTOEP_FIND_DATA, &exists,
+                                   &result));
+    if (has_data)
+      assert(exists && result == offset);
+    else if (offset < BITMAP_DATA_SIZE)
+      assert(exists && result == next * BITMAP_PIECE_SIZE);
+    else
+      assert(!exists);
+
+    next = piece + 1;
+    while (next < BITMAP_N_PIECES && model[next])
+      next++;
+    assert(btoep_index_find_offset(dataset, offset, BTOEP_FIND_NO_DATA,
+                                   &exists, &result));
+    assert(exists);
+    if (!has_data)
+      assert(result == offset);
+    else if (next == BITMAP_N_PIECES)
+      assert(result == BITMAP_DATA_SIZE);
+    else
+      assert(result == next * BITMAP_PIECE_SIZE);
+  }
+}
+
+static btoep_range piece_range(uint64_t first, uint64_t n) {
+  uint64_t end = (first + n) * BITMAP_PIECE_SIZE;
+  if (end > BITMAP_DATA_SIZE)
+    end = BITMAP_DATA_SIZE;
+  return btoep_mkrange(first * BITMAP_PIECE_SIZE,
+                       end - first * BITMAP_PIECE_SIZE);
+}
+
+static void test_index_bitmap(void) {
+  btoep_dataset dataset;
+  btoep_range ranges[BITMAP_N_PIECES / 2];
+  static bool model[BITMAP_N_PIECES];
+
+  srand(4321);
+  memset(model, 0, sizeof(model));
+  assert(btoep_open(&dataset, "test_index_bitmap", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+
+  // Every other piece, and the last piece, which is not aligned.
+  size_t n_ranges = 0;
+  for (uint64_t p = 0; p < BITMAP_N_PIECES; p += 2) {
+    ranges[n_ranges++] = piece_range(p, 1);
+    model[p] = true;
+  }
+  assert(btoep_index_add_many(&dataset, ranges, n_ranges));
+  assert(btoep_index_add(&dataset, piece_range(BITMAP_N_PIECES - 1, 1)));
+  model[BITMAP_N_PIECES - 1] = true;
+
+  // Such an index is represented as a bitmap instead of a table.
+  assert_pieces_match(&dataset, model);
+  assert(dataset.index_bitmap != NULL && !dataset.index_table_is_loaded);
+
+  // The bitmap follows aligned changes.
+  for (int round = 0; round < 100; round++) {
+    bool add = rand() % 2;
+    uint64_t first = rand() % (BITMAP_N_PIECES - 100), n = 1 + rand() % 64;
+    for (uint64_t p = first; p < first + n; p++)
+      model[p] = add;
+    if (add)
+      assert(btoep_index_add(&dataset, piece_range(first, n)));
+    else
+      assert(btoep_index_remove(&dataset, piece_range(first, n)));
+    if (round % 10 == 0)
+      assert_pieces_match(&dataset, model);
+  }
+  assert_pieces_match(&dataset, model);
+  assert(dataset.index_bitmap != NULL);
+
+  // Unaligned changes discard the bitmap, but queries remain correct.
+  uint64_t piece = 1;
+  while (model[piece - 1] || model[piece] || model[piece + 1])
+    piece++;
+  uint64_t offset = piece * BITMAP_PIECE_SIZE;
+  assert(btoep_index_add(&dataset, btoep_mkrange(offset + 100, 200)));
+  assert(dataset.index_bitmap == NULL);
+  uint64_t result;
+  bool exists;
+  assert(btoep_index_find_offset(&dataset, offset, BTOEP_FIND_DATA, &exists,
+                                 &result));
+  assert(exists && result == offset + 100);
+  assert(btoep_index_find_offset(&dataset, offset + 150, BTOEP_FIND_NO_DATA,
+                                 &exists, &result));
+  assert(exists && result == offset + 300);
+  assert(btoep_index_remove(&dataset, btoep_mkrange(offset + 100, 200)));
+  assert_pieces_match(&dataset, model);
+
+  // Removing the end of the last entry is not aligned either.
+  assert(btoep_index_remove(&dataset, piece_range(BITMAP_N_PIECES - 1, 1)));
+  model[BITMAP_N_PIECES - 1] = false;
+  assert(btoep_index_add(&dataset, piece_range(BITMAP_N_PIECES - 1, 1)));
+  model[BITMAP_N_PIECES - 1] = true;
+  assert_pieces_match(&dataset, model);
+
+  assert(btoep_close(&dataset));
+  assert(btoep_open(&dataset, "test_index_bitmap", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_pieces_match(&dataset, model);
+  assert(btoep_close(&dataset));
+}
+
+static void test_index_journal(void) {
+  btoep_dataset dataset;
+  btoep_index_iterator iterator;
+  btoep_range range;
+  bool b;
+  static uint8_t index[65536], journal[4096];
+
+  assert(btoep_open(&dataset, "test_index_journal", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE | B_INDEX_JOURNAL));
+  assert(btoep_index_add(&dataset, btoep_mkrange(100, 10)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(0, 10)));
+  assert(btoep_index_remove(&dataset, btoep_mkrange(104, 2)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(10, 5)));
+
+  // Queries reflect the journal.
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 0 && range.length == 15);
+  assert(btoep_index_iterator_seek(&iterator, 105));
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 106 && range.length == 4);
+  assert(btoep_index_iterator_is_eof(&iterator));
+  assert(btoep_index_contains(&dataset, btoep_mkrange(100, 4), &b));
+  assert(b);
+  assert(btoep_index_contains_any(&dataset, btoep_mkrange(104, 2), &b));
+  assert(!b);
+
+  // Flushing only writes the journal.
+  assert(btoep_index_flush(&dataset));
+  assert(read_file("test_index_journal.idx", index, sizeof(index)) == 0);
+  size_t journal_size = read_file("test_index_journal.idx.log", journal,
+                                  sizeof(journal));
+  assert(journal_size == 16 + 4 * 24);
+  assert(memcmp(journal, "BTOEPLOG", 8) == 0);
+
+  // Simulate a crash by copying the files before closing the dataset. The last
+  // record was not written completely.
+  write_file("test_index_journal_copy", NULL, 0);
+  write_file("test_index_journal_copy.idx", index, 0);
+  write_file("test_index_journal_copy.idx.log", journal, journal_size - 1);
+
+  // Closing the dataset folds the journal into the index.
+  assert(btoep_close(&dataset));
+  assert(read_file("test_index_journal.idx", index, sizeof(index)) == 6);
+  assert(memcmp(index, "\x00\x0e\x54\x03\x01\x03", 6) == 0);
+  assert(fopen("test_index_journal.idx.log", "rb") == NULL);
+
+  // Readers see the complete records.
+  assert(btoep_open(&dataset, "test_index_journal_copy", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(btoep_index_iterator_start(&dataset, &iterator));
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 0 && range.length == 10);
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 100 && range.length == 4);
+  assert(btoep_index_iterator_next(&iterator, &range));
+  assert(range.offset == 106 && range.length == 4);
+  assert(btoep_index_iterator_is_eof(&iterator));
+  assert(btoep_close(&dataset));
+
+  // Opening the dataset without the journal recovers the index.
+  assert(btoep_open(&dataset, "test_index_journal_copy", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  assert(fopen("test_index_journal_copy.idx.log", "rb") == NULL);
+  assert(btoep_close(&dataset));
+  assert(read_file("test_index_journal_copy.idx", index, sizeof(index)) == 6);
+  assert(memcmp(index, "\x00\x09\x59\x03\x01\x03", 6) == 0);
+
+  // The journal is compacted when it becomes too long.
+  assert(btoep_open(&dataset, "test_index_journal", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE | B_INDEX_JOURNAL));
+  for (uint64_t i = 0; i < 5000; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(1000 + 16 * i, 8)));
+  assert(read_file("test_index_journal.idx", index, sizeof(index)) > 6);
+  assert(btoep_close(&dataset));
+  assert(btoep_open(&dataset, "test_index_journal", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(btoep_index_contains(&dataset, btoep_mkrange(1000 + 16 * 4999, 8), &b));
+  assert(b);
+  assert(btoep_close(&dataset));
+}
+
+static void test_index_cursor(const char* name, int create_mode) {
+  btoep_dataset dataset;
+  btoep_index_cursor cursor;
+  btoep_range range;
+  bool exists;
+  static bool model[MANY_MODEL_SIZE];
+
+  memset(model, 0, sizeof(model));
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+  for (uint64_t i = 0; i < MANY_MODEL_SIZE / 16; i++) {
+    assert(btoep_index_add(&dataset, btoep_mkrange(16 * i, 8)));
+    memset(model + 16 * i, 1, 8);
+  }
+
+  // Walk the index while changing it before, at, and after the cursor.
+  srand(4321);
+  assert(btoep_index_cursor_start(&dataset, &cursor));
+  uint64_t offset = 0;
+  while (true) {
+    uint64_t start = offset;
+    while (start < MANY_MODEL_SIZE && !model[start])
+      start++;
+    uint64_t end = start;
+    while (end < MANY_MODEL_SIZE && model[end])
+      end++;
+
+    assert(btoep_index_cursor_next(&cursor, &exists, &range));
+    if (start == MANY_MODEL_SIZE) {
+      assert(!exists);
+      break;
+    }
+    assert(exists && range.offset == start && range.length == end - start);
+    offset = end;
+
+    bool add = rand() % 2;
+    int64_t edit_offset = (int64_t) offset + rand() % 128 - 64;
+    if (edit_offset < 0)
+      edit_offset = 0;
+    btoep_range edit = btoep_mkrange(edit_offset, 1 + rand() % 16);
+    if (edit.offset + edit.length > MANY_MODEL_SIZE)
+      continue;
+    memset(model + edit.offset, add, edit.length);
+    if (add)
+      assert(btoep_index_add(&dataset, edit));
+    else
+      assert(btoep_index_remove(&dataset, edit));
+  }
+
+  // Seeking into an entry only returns the rest of the entry.
+  assert(btoep_index_add(&dataset, btoep_mkrange(10000, 50)));
+  assert(btoep_index_cursor_seek(&cursor, 10020));
+  assert(btoep_index_cursor_peek(&cursor, &exists, &range));
+  assert(exists && range.offset == 10020 && range.length == 30);
+  assert(btoep_index_cursor_next(&cursor, &exists, &range));
+  assert(exists && range.offset == 10020 && range.length == 30);
+
+  // Extending an entry that the cursor has passed only returns the new part.
+  assert(btoep_index_add(&dataset, btoep_mkrange(10040, 20)));
+  assert(btoep_index_cursor_next(&cursor, &exists, &range));
+  assert(exists && range.offset == 10050 && range.length == 10);
+  assert(btoep_index_cursor_next(&cursor, &exists, &range));
+  assert(!exists);
+
+  assert(btoep_close(&dataset));
+}
+
+static void test_index_get_ranges(const char* name, int create_mode) {
+  btoep_dataset dataset;
+  btoep_index_cursor cursor;
+  btoep_range ranges[40];
+  static bool model[MANY_MODEL_SIZE], result[MANY_MODEL_SIZE];
+  size_t n;
+
+  memset(model, 0, sizeof(model));
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+  srand(2468);
+  for (int i = 0; i < 400; i++) {
+    btoep_range range = btoep_mkrange(rand() % (MANY_MODEL_SIZE - 32),
+                                      1 + rand() % 32);
+    bool add = rand() % 3 != 0;
+    memset(model + range.offset, add, range.length);
+    if (add)
+      assert(btoep_index_add(&dataset, range));
+    else
+      assert(btoep_index_remove(&dataset, range));
+  }
+
+  // Without a cursor, ranges are returned from the start of the window.
+  assert(btoep_index_get_ranges(&dataset, btoep_max_range_from(0),
+                                BTOEP_FIND_DATA, ranges, 1, &n, NULL));
+  uint64_t first = 0;
+  while (!model[first])
+    first++;
+  assert(n == 1 && ranges[0].offset == first && model[first]);
+  assert(!model[first + ranges[0].length]);
+
+  // Page through random windows, with random capacities, while changing the
+  // index after the cursor. Data that was added or removed after the cursor is
+  // always reflected in the results.
+  for (int round = 0; round < 300; round++) {
+    int mode = (round % 2) ? BTOEP_FIND_DATA : BTOEP_FIND_NO_DATA;
+    uint64_t start = rand() % MANY_MODEL_SIZE;
+    uint64_t end = start + rand() % (MANY_MODEL_SIZE - start + 1);
+    btoep_range window = btoep_mkrange(start, end - start);
+    size_t capacity = 1 + rand() % 40;
+
+    memset(result, 0, sizeof(result));
+    uint64_t prev_end = 0;
+    assert(btoep_index_cursor_start(&dataset, &cursor));
+    do {
+      assert(btoep_index_get_ranges(&dataset, window, mode, ranges, capacity,
+                                    &n, &cursor));
+      assert(n <= capacity);
+      for (size_t i = 0; i < n; i++) {
+        // Ranges are never empty, adjacent, or outside of the window.
+        assert(ranges[i].length != 0 && ranges[i].offset >= start &&
+               ranges[i].offset + ranges[i].length <= end);
+        assert(i == 0 || ranges[i].offset > prev_end);
+        memset(result + ranges[i].offset, 1, ranges[i].length);
+        prev_end = ranges[i].offset + ranges[i].length;
+      }
+      assert(cursor.data_offset >= prev_end);
+
+      if (rand() % 4 == 0 && cursor.data_offset + 16 < MANY_MODEL_SIZE) {
+        btoep_range edit = btoep_mkrange(cursor.data_offset + rand() % 16,
+                                         1 + rand() % 16);
+        if (edit.offset + edit.length > MANY_MODEL_SIZE)
+          edit.length = MANY_MODEL_SIZE - edit.offset;
+        bool add = rand() % 2;
+        memset(model + edit.offset, add, edit.length);
+        if (add)
+          assert(btoep_index_add(&dataset, edit));
+        else
+          assert(btoep_index_remove(&dataset, edit));
+      }
+    } while (n == capacity);
+
+    for (uint64_t offset = start; offset < end; offset++)
+      assert(result[offset] == (model[offset] == (mode == BTOEP_FIND_DATA)));
+  }
+
+  assert(!btoep_index_get_ranges(&dataset, btoep_max_range_from(0), 0, ranges,
+                                 1, &n, NULL));
+  assert(btoep_close(&dataset));
+}
+
+static void assert_changes(btoep_dataset* dataset, uint64_t since,
+                          const btoep_range* expected, size_t n_expected) {
+  static btoep_range ranges[BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH];
+  size_t n_ranges;
+  bool is_complete;
+  assert(btoep_index_get_changes(dataset, since, ranges, &n_ranges, &is_complete));
+  assert(is_complete && n_ranges == n_expected);
+  for (size_t i = 0; i < n_ranges; i++) {
+    assert(ranges[i].offset == expected[i].offset &&
+           ranges[i].length == expected[i].length);
+  }
+}
+
+static void assert_changes_unknown(btoep_dataset* dataset, uint64_t since) {
+  btoep_range range;
+  size_t n_ranges;
+  bool is_complete;
+  assert(btoep_index_get_changes(dataset, since, &range, &n_ranges, &is_complete));
+  assert(!is_complete && n_ranges == 0);
+}
+
+static void test_index_changes(const char* name, int create_mode) {
+  btoep_dataset dataset;
+  btoep_index_source source;
+  uint64_t rev, rev2;
+  static uint8_t index[65536];
+  char index_path[64], changes_path[64];
+  snprintf(index_path, sizeof(index_path), "%s.idx", name);
+  snprintf(changes_path, sizeof(changes_path), "%s.idx.chg", name);
+
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+  assert(btoep_index_get_revision(&dataset, &rev));
+  assert_changes(&dataset, rev, NULL, 0);
+  assert_changes_unknown(&dataset, rev - 1);
+  assert_changes_unknown(&dataset, rev + 1);
+
+  // Each change produces a new revision, and changes since a revision are
+  // merged, regardless of whether they added or removed data.
+  btoep_range many[2] = { { 40, 5 }, { 0, 2 } };
+  assert(btoep_index_add(&dataset, btoep_mkrange(10, 5)));
+  assert(btoep_index_remove(&dataset, btoep_mkrange(12, 5)));
+  assert(btoep_index_add_many(&dataset, many, 2));
+  assert(btoep_index_get_revision(&dataset, &rev2));
+  assert(rev2 == rev + 3);
+  btoep_range since_rev[3] = { { 0, 2 }, { 10, 7 }, { 40, 5 } };
+  btoep_range since_add[3] = { { 0, 2 }, { 12, 5 }, { 40, 5 } };
+  assert_changes(&dataset, rev, since_rev, 3);
+  assert_changes(&dataset, rev + 1, since_add, 3);
+  btoep_range sorted_many[2] = { { 0, 2 }, { 40, 5 } };
+  assert_changes(&dataset, rev + 2, sorted_many, 2);
+  assert_changes(&dataset, rev + 3, NULL, 0);
+  assert(btoep_close(&dataset));
+
+  // The revision and the change log persist.
+  assert(btoep_open(&dataset, name, NULL, NULL, B_OPEN_EXISTING_READ_ONLY));
+  assert(btoep_index_get_revision(&dataset, &rev2));
+  assert(rev2 == rev + 3);
+  assert_changes(&dataset, rev, since_rev, 3);
+  assert(btoep_close(&dataset));
+
+  // If the index changes without the change file, e.g., because the process
+  // was interrupted, the revision increases, and the log is cleared.
+  size_t index_size = read_file(index_path, index, sizeof(index));
+  assert(btoep_open(&dataset, name, NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE | (create_mode & B_INDEX_JOURNAL)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(100, 1)));
+  assert(btoep_close(&dataset));
+  write_file(index_path, index, index_size);
+  assert(btoep_open(&dataset, name, NULL, NULL, B_OPEN_EXISTING_READ_WRITE));
+  assert(btoep_index_get_revision(&dataset, &rev2));
+  assert(rev2 == rev + 5);
+  assert_changes_unknown(&dataset, rev + 4);
+  assert_changes(&dataset, rev + 5, NULL, 0);
+
+  // Only recent changes are kept.
+  rev = rev2;
+  for (uint64_t i = 0; i < BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH + 10; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(1000 + 2 * i, 1)));
+  assert(btoep_index_get_revision(&dataset, &rev2));
+  assert(rev2 == rev + BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH + 10);
+  assert_changes_unknown(&dataset, rev);
+  btoep_range recent = btoep_mkrange(1000 + 2 * BTOEP_INDEX_CHANGE_LOG_MAX_LENGTH + 18, 1);
+  assert_changes(&dataset, rev2 - 1, &recent, 1);
+
+  // Replacing the index clears the log.
+  btoep_range range = btoep_mkrange(3, 4);
+  btoep_index_source_init_array(&source, &range, 1);
+  assert(btoep_index_replace(&dataset, &source));
+  assert_changes_unknown(&dataset, rev2);
+  assert_changes(&dataset, rev2 + 1, NULL, 0);
+  assert(btoep_close(&dataset));
+
+  // The change file of a previous dataset is not reused.
+  remove(name);
+  remove(index_path);
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+  assert(fopen(changes_path, "rb") == NULL);
+  assert_changes_unknown(&dataset, rev2 + 1);
+  assert(btoep_close(&dataset));
+}
+
+static void assert_front_inserts(btoep_dataset* dataset, uint64_t n_inserted) {
+  btoep_index_iterator iterator;
+  btoep_range range;
+
+  assert(btoep_index_iterator_start(dataset, &iterator));
+  for (uint64_t i = 16 - n_inserted; i < 16; i++) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == 64 * i && range.length == 8);
+  }
+  for (uint64_t i = 0; i < 50000; i++) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == 1048576 + 64 * i && range.length == 8);
+  }
+  assert(btoep_index_iterator_is_eof(&iterator));
+}
+
+static void test_index_front_inserts(void) {
+  btoep_dataset dataset;
+
+  assert(btoep_open(&dataset, "test_index_front_inserts", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE));
+
+  // The index is larger than the index cache.
+  for (uint64_t i = 0; i < 50000; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(1048576 + 64 * i, 8)));
+  assert(btoep_close(&dataset));
+
+  // Each of these ranges is inserted at the front of the index, which grows the
+  // index and moves all existing entries through the cache.
+  assert(btoep_open(&dataset, "test_index_front_inserts", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  for (uint64_t i = 16; i > 0; i--)
+    assert(btoep_index_add(&dataset, btoep_mkrange(64 * (i - 1), 8)));
+  assert_front_inserts(&dataset, 16);
+  assert(btoep_close(&dataset));
+
+  assert(btoep_open(&dataset, "test_index_front_inserts", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_front_inserts(&dataset, 16);
+  assert(btoep_close(&dataset));
+}
+
+static void test_index_all(void) {
+  test_index();
+  test_index_queries();
+  test_index_checkpoints();
+  test_index_large("test_index_large", B_CREATE_NEW_READ_WRITE);
+  test_index_paged();
+  test_index_many("test_index_many", B_CREATE_NEW_READ_WRITE);
+  test_index_many("test_index_many_paged",
+                  B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX);
+  test_index_many("test_index_many_journal",
+                  B_CREATE_NEW_READ_WRITE | B_INDEX_JOURNAL);
+  test_index_stats();
+  test_index_bitmap();
+  test_index_journal();
+  test_index_cursor("test_index_cursor", B_CREATE_NEW_READ_WRITE);
+  test_index_cursor("test_index_cursor_paged",
+                    B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX);
+  test_index_cursor("test_index_cursor_journal",
+                    B_CREATE_NEW_READ_WRITE | B_INDEX_JOURNAL);
+  test_index_get_ranges("test_index_get_ranges", B_CREATE_NEW_READ_WRITE);
+  test_index_get_ranges("test_index_get_ranges_paged",
+                        B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX);
+  test_index_get_ranges("test_index_get_ranges_journal",
+                        B_CREATE_NEW_READ_WRITE | B_INDEX_JOURNAL);
+  test_index_changes("test_index_changes", B_CREATE_NEW_READ_WRITE);
+  test_index_changes("test_index_changes_paged",
+                     B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX);
+  test_index_changes("test_index_changes_journal",
+                     B_CREATE_NEW_READ_WRITE | B_INDEX_JOURNAL);
+  test_index_front_inserts();
+}
+
+TEST_MAIN(test_index_all)
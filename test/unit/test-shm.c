@@ -0,0 +1,138 @@
+#include "test.h"
+
+#include <btoep/shm.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _MSC_VER
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
+
+static void assert_published(btoep_shm_reader* reader, uint64_t offset,
+                             uint64_t length) {
+  bool exists, result;
+  uint64_t found;
+  assert(btoep_shm_reader_contains(reader, btoep_mkrange(offset, length), &result));
+  assert(result);
+  assert(btoep_shm_reader_contains(reader, btoep_mkrange(offset, length + 1), &result));
+  assert(!result);
+  assert(btoep_shm_reader_find_offset(reader, offset, BTOEP_FIND_NO_DATA, &exists, &found));
+  assert(exists && found == offset + length);
+}
+
+static void test_shm(void) {
+  btoep_dataset dataset;
+  btoep_shm_publisher publisher;
+  btoep_shm_reader reader;
+  bool exists, result;
+  uint64_t offset, revision, published_revision;
+
+  // Without a publisher, readers must fall back to the dataset.
+  assert(!btoep_shm_reader_open(&reader, "test_shm", NULL));
+  assert(reader.last_error.code == B_ERR_NOT_PUBLISHED);
+  assert(btoep_open(&dataset, "test_shm", NULL, NULL, B_CREATE_NEW_READ_WRITE));
+  assert(btoep_data_set_size(&dataset, 1000, false));
+  assert(!btoep_shm_reader_open(&reader, "test_shm", NULL));
+  assert(reader.last_error.code == B_ERR_NOT_PUBLISHED);
+
+  assert(btoep_index_add(&dataset, btoep_mkrange(10, 5)));
+  assert(btoep_shm_publisher_open(&publisher, &dataset));
+  assert(btoep_shm_reader_open(&reader, "test_shm", "test_shm.idx"));
+  assert(btoep_index_get_revision(&dataset, &revision));
+  assert(btoep_shm_reader_get_revision(&reader, &published_revision));
+  assert(published_revision == revision);
+  assert_published(&reader, 10, 5);
+  assert(btoep_shm_reader_find_offset(&reader, 0, BTOEP_FIND_DATA, &exists, &offset));
+  assert(exists && offset == 10);
+  assert(btoep_shm_reader_find_offset(&reader, 15, BTOEP_FIND_DATA, &exists, &offset));
+  assert(!exists);
+  assert(btoep_shm_reader_contains(&reader, btoep_mkrange(1000, 0), &result));
+  assert(result);
+  assert(btoep_shm_reader_contains(&reader, btoep_mkrange(1001, 0), &result));
+  assert(!result);
+  assert(btoep_shm_reader_contains_any(&reader, btoep_mkrange(0, 11), &result));
+  assert(result);
+  assert(btoep_shm_reader_contains_any(&reader, btoep_mkrange(15, 100), &result));
+  assert(!result);
+
+  // Changes are only visible once they have been published.
+  assert(btoep_index_add(&dataset, btoep_mkrange(15, 5)));
+  assert_published(&reader, 10, 5);
+  assert(btoep_shm_publish(&publisher));
+  assert_published(&reader, 10, 10);
+
+  // The reader switches to a larger table when the index grows.
+  uint64_t generation = reader.generation;
+  for (uint64_t i = 0; i < 1000; i++)
+    assert(btoep_index_add(&dataset, btoep_mkrange(100 + 2 * i, 1)));
+  assert(btoep_shm_publish(&publisher));
+  assert_published(&reader, 10, 10);
+  assert(reader.generation != generation);
+  for (uint64_t i = 0; i < 1000; i++)
+    assert_published(&reader, 100 + 2 * i, 1);
+
+#ifndef _MSC_VER
+  // Other processes can use the published index.
+  pid_t pid = fork();
+  assert(pid != -1);
+  if (pid == 0) {
+    btoep_shm_reader child_reader;
+    bool ok = btoep_shm_reader_open(&child_reader, "test_shm", NULL) &&
+              btoep_shm_reader_contains(&child_reader, btoep_mkrange(12, 4), &result) &&
+              result &&
+              btoep_shm_reader_contains(&child_reader, btoep_mkrange(99, 2), &result) &&
+              !result;
+    btoep_shm_reader_close(&child_reader);
+    _exit(ok ? 0 : 1);
+  }
+  int status;
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+
+  // Once the publisher is gone, readers must fall back to the dataset.
+  btoep_shm_publisher_close(&publisher);
+  assert(!btoep_shm_reader_contains(&reader, btoep_mkrange(10, 1), &result));
+  assert(reader.last_error.code == B_ERR_NOT_PUBLISHED);
+  btoep_shm_reader_close(&reader);
+  assert(!btoep_shm_reader_open(&reader, "test_shm", NULL));
+  assert(reader.last_error.code == B_ERR_NOT_PUBLISHED);
+
+  // Another publisher can take over.
+  assert(btoep_shm_publisher_open(&publisher, &dataset));
+  assert(btoep_shm_reader_open(&reader, "test_shm", NULL));
+  assert_published(&reader, 10, 10);
+  btoep_shm_reader_close(&reader);
+  btoep_shm_publisher_close(&publisher);
+
+  // A publisher that dies while updating its table leaves the sequence odd.
+  // Readers must switch to the table of the next publisher instead of waiting
+  // for the update to complete.
+  btoep_shm_publisher dead_publisher;
+  assert(btoep_shm_publisher_open(&dead_publisher, &dataset));
+  assert(btoep_shm_reader_open(&reader, "test_shm", NULL));
+  volatile uint64_t* sequence =
+      (volatile uint64_t*) ((char*) dead_publisher.table.address + 8);
+  (*sequence)++;
+  free(dead_publisher.buffer);
+  assert(btoep_shm_publisher_open(&publisher, &dataset));
+  assert_published(&reader, 10, 10);
+  btoep_shm_reader_close(&reader);
+  btoep_shm_publisher_close(&publisher);
+
+  assert(btoep_close(&dataset));
+
+  // Only the process that modifies a dataset may publish it.
+  assert(btoep_open(&dataset, "test_shm", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(!btoep_shm_publisher_open(&publisher, &dataset));
+  assert(publisher.last_error.code == B_ERR_DATASET_READ_ONLY);
+  assert(btoep_close(&dataset));
+
+  remove("test_shm");
+  remove("test_shm.idx");
+  remove("test_shm.idx.chg");
+}
+
+TEST_MAIN(test_shm)
@@ -0,0 +1,160 @@
+#include "test.h"
+
+#include <btoep/dataset.h>
+#include <stdio.h>
+
+#ifndef _MSC_VER
+# include <pthread.h>
+#endif
+
+static void test_snapshot_queries(void) {
+  btoep_dataset dataset;
+  btoep_last_error_info error;
+  uint64_t offset, revision;
+
+  assert(btoep_open(&dataset, "test_snapshot", NULL, NULL, B_CREATE_NEW_READ_WRITE));
+  assert(btoep_data_set_size(&dataset, 100, false));
+
+  // Nothing has been published yet.
+  assert(btoep_index_snapshot_acquire(&dataset) == NULL);
+
+  assert(btoep_index_add(&dataset, btoep_mkrange(10, 5)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(20, 10)));
+  assert(btoep_index_snapshot_publish(&dataset));
+  const btoep_index_snapshot* snapshot = btoep_index_snapshot_acquire(&dataset);
+  assert(snapshot != NULL);
+  assert(btoep_index_get_revision(&dataset, &revision));
+  assert(snapshot->revision == revision);
+  assert(snapshot->data_size == 100);
+  assert(snapshot->n_ranges == 2);
+
+  // The snapshot does not change when the index does.
+  assert(btoep_index_remove(&dataset, btoep_mkrange(0, 100)));
+  assert(btoep_index_snapshot_find_offset(snapshot, 0, BTOEP_FIND_DATA, &offset));
+  assert(offset == 10);
+  assert(btoep_index_snapshot_find_offset(snapshot, 12, BTOEP_FIND_DATA, &offset));
+  assert(offset == 12);
+  assert(btoep_index_snapshot_find_offset(snapshot, 12, BTOEP_FIND_NO_DATA, &offset));
+  assert(offset == 15);
+  assert(btoep_index_snapshot_find_offset(snapshot, 15, BTOEP_FIND_NO_DATA, &offset));
+  assert(offset == 15);
+  assert(!btoep_index_snapshot_find_offset(snapshot, 30, BTOEP_FIND_DATA, &offset));
+  assert(btoep_index_snapshot_find_offset(snapshot, 30, BTOEP_FIND_NO_DATA, &offset));
+  assert(offset == 30);
+
+  assert(btoep_index_snapshot_contains(snapshot, btoep_mkrange(20, 10)));
+  assert(!btoep_index_snapshot_contains(snapshot, btoep_mkrange(14, 7)));
+  assert(btoep_index_snapshot_contains(snapshot, btoep_mkrange(100, 0)));
+  assert(!btoep_index_snapshot_contains(snapshot, btoep_mkrange(101, 0)));
+  assert(btoep_index_snapshot_contains_any(snapshot, btoep_mkrange(14, 7)));
+  assert(!btoep_index_snapshot_contains_any(snapshot, btoep_mkrange(15, 5)));
+  assert(!btoep_index_snapshot_contains_any(snapshot, btoep_mkrange(30, 70)));
+
+  // Publishing replaces the current snapshot, but not those in use.
+  assert(btoep_index_snapshot_publish(&dataset));
+  const btoep_index_snapshot* empty = btoep_index_snapshot_acquire(&dataset);
+  assert(empty != snapshot && empty->n_ranges == 0);
+  assert(snapshot->n_ranges == 2);
+  btoep_index_snapshot_release(snapshot);
+  btoep_index_snapshot_release(empty);
+
+  // Each snapshot that is in use occupies a slot.
+  const btoep_index_snapshot* in_use[BTOEP_INDEX_SNAPSHOT_SLOTS];
+  for (size_t i = 0; i < BTOEP_INDEX_SNAPSHOT_SLOTS; i++) {
+    assert(btoep_index_add(&dataset, btoep_mkrange(i, 1)));
+    assert(btoep_index_snapshot_publish(&dataset));
+    in_use[i] = btoep_index_snapshot_acquire(&dataset);
+    assert(in_use[i]->n_ranges == 1 && in_use[i]->ranges[0].length == i + 1);
+  }
+  assert(!btoep_index_snapshot_publish(&dataset));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_SNAPSHOTS_IN_USE);
+  btoep_index_snapshot_release(in_use[0]);
+  assert(btoep_index_snapshot_publish(&dataset));
+  for (size_t i = 1; i < BTOEP_INDEX_SNAPSHOT_SLOTS; i++)
+    btoep_index_snapshot_release(in_use[i]);
+
+  assert(btoep_close(&dataset));
+  remove("test_snapshot");
+  remove("test_snapshot.idx");
+  remove("test_snapshot.idx.chg");
+}
+
+#ifndef _MSC_VER
+
+#define N_READERS 4
+#define N_ROUNDS  2000
+
+static volatile int writer_is_done = 0;
+
+/*
+ * The writer only ever publishes indexes that consist of ranges [i, i + 1) for
+ * all even i below some limit, so any other index is inconsistent.
+ */
+static void* reader_main(void* arg) {
+  btoep_dataset* dataset = arg;
+  uint64_t prev_revision = 0;
+  while (!__atomic_load_n(&writer_is_done, __ATOMIC_SEQ_CST)) {
+    const btoep_index_snapshot* snapshot = btoep_index_snapshot_acquire(dataset);
+    assert(snapshot != NULL);
+    assert(snapshot->revision >= prev_revision);
+    prev_revision = snapshot->revision;
+    uint64_t n = snapshot->n_ranges, offset;
+    for (uint64_t i = 0; i < n; i++) {
+      btoep_range range = snapshot->ranges[i];
+      assert(range.offset == 2 * i && range.length == 1);
+    }
+    uint64_t i = (n == 0) ? 0 : 2 * (snapshot->revision % n);
+    assert(btoep_index_snapshot_contains(snapshot, btoep_mkrange(i, n == 0 ? 0 : 1)));
+    assert(btoep_index_snapshot_find_offset(snapshot, 0, BTOEP_FIND_NO_DATA, &offset));
+    assert(offset == (n == 0 ? 0 : 1));
+    btoep_index_snapshot_release(snapshot);
+  }
+  return NULL;
+}
+
+static void test_snapshot_threads(void) {
+  btoep_dataset dataset;
+  pthread_t readers[N_READERS];
+
+  assert(btoep_open(&dataset, "test_snapshot_threads", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX));
+  assert(btoep_index_snapshot_publish(&dataset));
+  for (int i = 0; i < N_READERS; i++)
+    assert(pthread_create(&readers[i], NULL, reader_main, &dataset) == 0);
+
+  // The writer keeps modifying the index while the readers query snapshots.
+  for (uint64_t round = 0; round < N_ROUNDS; round++) {
+    uint64_t n = round % 500;
+    if (n == 0)
+      assert(btoep_index_remove(&dataset, btoep_max_range_from(0)));
+    else
+      assert(btoep_index_add(&dataset, btoep_mkrange(2 * (n - 1), 1)));
+    // Readers might occupy all other slots for a short time.
+    while (!btoep_index_snapshot_publish(&dataset)) {
+      btoep_last_error_info error;
+      btoep_last_error(&dataset, &error);
+      assert(error.code == B_ERR_SNAPSHOTS_IN_USE);
+    }
+  }
+
+  __atomic_store_n(&writer_is_done, 1, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < N_READERS; i++)
+    assert(pthread_join(readers[i], NULL) == 0);
+
+  assert(btoep_close(&dataset));
+  remove("test_snapshot_threads");
+  remove("test_snapshot_threads.idx");
+  remove("test_snapshot_threads.idx.chg");
+}
+
+#endif
+
+static void test_snapshot(void) {
+  test_snapshot_queries();
+#ifndef _MSC_VER
+  test_snapshot_threads();
+#endif
+}
+
+TEST_MAIN(test_snapshot)
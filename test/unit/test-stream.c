@@ -0,0 +1,331 @@
+#include "test.h"
+
+#include <btoep/stream.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#define MODEL_SIZE 2048
+#define N_SOURCES  12
+
+static bool models[N_SOURCES][MODEL_SIZE];
+
+static void write_model(const char* path, const bool* model) {
+  FILE* file = fopen(path, "wb");
+  assert(file != NULL);
+  btoep_index_writer writer;
+  btoep_index_writer_init(&writer, file);
+  for (uint64_t offset = 0; offset < MODEL_SIZE;) {
+    if (!model[offset]) {
+      offset++;
+      continue;
+    }
+    uint64_t end = offset;
+    while (end < MODEL_SIZE && model[end])
+      end++;
+    assert(btoep_index_writer_write(&writer, btoep_mkrange(offset, end - offset)));
+    offset = end;
+  }
+  assert(fclose(file) == 0);
+}
+
+static void read_model(const char* path, bool* model) {
+  FILE* file = fopen(path, "rb");
+  assert(file != NULL);
+  btoep_index_source source;
+  btoep_index_source_init_file(&source, file);
+  memset(model, 0, MODEL_SIZE);
+  uint64_t prev_end = 0;
+  bool exists;
+  btoep_range range;
+  while (btoep_index_source_next(&source, &exists, &range) && exists) {
+    // Entries are never adjacent.
+    assert(range.length != 0 && (prev_end == 0 || range.offset > prev_end));
+    assert(range.offset + range.length <= MODEL_SIZE);
+    memset(model + range.offset, 1, range.length);
+    prev_end = range.offset + range.length;
+  }
+  assert(!exists);
+  fclose(file);
+}
+
+static void combine_files(size_t n_sources, int op, const char* out_path) {
+  static btoep_index_source sources[N_SOURCES];
+  btoep_index_source* source_ptrs[N_SOURCES];
+  FILE* files[N_SOURCES];
+  for (size_t i = 0; i < n_sources; i++) {
+    char path[64];
+    snprintf(path, sizeof(path), "test_stream_%zu", i);
+    assert((files[i] = fopen(path, "rb")) != NULL);
+    btoep_index_source_init_file(&sources[i], files[i]);
+    source_ptrs[i] = &sources[i];
+  }
+
+  FILE* out = fopen(out_path, "wb");
+  assert(out != NULL);
+  btoep_index_writer writer;
+  btoep_index_writer_init(&writer, out);
+  btoep_last_error_info error;
+  assert(btoep_index_combine(source_ptrs, n_sources, op, &writer, &error));
+  assert(fclose(out) == 0);
+
+  for (size_t i = 0; i < n_sources; i++)
+    fclose(files[i]);
+}
+
+static void test_combine(void) {
+  static bool result[MODEL_SIZE];
+
+  srand(42);
+  for (int round = 0; round < 50; round++) {
+    size_t n_sources = 1 + rand() % N_SOURCES;
+    for (size_t i = 0; i < n_sources; i++) {
+      // Mostly dense models, so that intersections are not always empty.
+      memset(models[i], 0, MODEL_SIZE);
+      for (int j = 0; j < 40; j++) {
+        size_t offset = rand() % MODEL_SIZE, length = rand() % 200;
+        if (offset + length > MODEL_SIZE)
+          length = MODEL_SIZE - offset;
+        memset(models[i] + offset, j % 8 != 0, length);
+      }
+      char path[64];
+      snprintf(path, sizeof(path), "test_stream_%zu", i);
+      write_model(path, models[i]);
+      read_model(path, result);
+      assert(memcmp(result, models[i], MODEL_SIZE) == 0);
+    }
+
+    for (int op = BTOEP_INDEX_UNION; op <= BTOEP_INDEX_DIFFERENCE; op++) {
+      combine_files(n_sources, op, "test_stream_result");
+      read_model("test_stream_result", result);
+      for (size_t offset = 0; offset < MODEL_SIZE; offset++) {
+        size_t n = 0;
+        for (size_t i = 0; i < n_sources; i++)
+          n += models[i][offset];
+        bool expected = (op == BTOEP_INDEX_UNION) ? n != 0 :
+                        (op == BTOEP_INDEX_INTERSECTION) ? n == n_sources :
+                        models[0][offset] && n == 1;
+        assert(result[offset] == expected);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < N_SOURCES; i++) {
+    char path[64];
+    snprintf(path, sizeof(path), "test_stream_%zu", i);
+    remove(path);
+  }
+  remove("test_stream_result");
+}
+
+static void test_dataset_source(void) {
+  btoep_dataset dataset;
+  btoep_index_source source;
+  btoep_index_source* source_ptr = &source;
+  btoep_index_writer writer;
+  btoep_last_error_info error;
+
+  assert(btoep_open(&dataset, "test_stream_dataset", NULL, NULL,
+                    B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX));
+  assert(btoep_index_add(&dataset, btoep_mkrange(0, 10)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(300, 5)));
+
+  // The result is the same as what btoep-get-index produces.
+  FILE* out = fopen("test_stream_result", "w+b");
+  assert(out != NULL);
+  assert(btoep_index_source_init_dataset(&source, &dataset));
+  btoep_index_writer_init(&writer, out);
+  assert(btoep_index_combine(&source_ptr, 1, BTOEP_INDEX_UNION, &writer, &error));
+  uint8_t buffer[16];
+  rewind(out);
+  assert(fread(buffer, 1, sizeof(buffer), out) == 5);
+  assert(memcmp(buffer, "\x00\x09\xa1\x02\x04", 5) == 0);
+  fclose(out);
+
+  // The difference requires at least one source.
+  assert(!btoep_index_combine(NULL, 0, BTOEP_INDEX_DIFFERENCE, &writer, &error));
+  assert(error.code == B_ERR_INVALID_ARGUMENT);
+
+  assert(btoep_close(&dataset));
+  remove("test_stream_dataset.idx");
+  remove("test_stream_dataset");
+  remove("test_stream_result");
+}
+
+#define REPLACE_N_RANGES 100000
+
+static void assert_replaced(btoep_dataset* dataset, const btoep_range* ranges,
+                            size_t n_ranges) {
+  btoep_index_iterator iterator;
+  btoep_index_stats stats;
+  btoep_range range;
+  assert(btoep_index_iterator_start(dataset, &iterator));
+  for (size_t i = 0; i < n_ranges; i++) {
+    assert(btoep_index_iterator_next(&iterator, &range));
+    assert(range.offset == ranges[i].offset && range.length == ranges[i].length);
+  }
+  assert(btoep_index_iterator_is_eof(&iterator));
+  assert(btoep_index_get_stats(dataset, &stats));
+  assert(stats.n_entries == n_ranges);
+  assert(stats.end == (n_ranges == 0 ? 0 : ranges[n_ranges - 1].offset +
+                                           ranges[n_ranges - 1].length));
+}
+
+static void test_replace_mode(const char* name, int create_mode) {
+  static btoep_range ranges[REPLACE_N_RANGES];
+  btoep_dataset dataset;
+  btoep_index_source source;
+  btoep_last_error_info error;
+  btoep_range old_ranges[2] = { { 5, 10 }, { 1000, 1 } };
+  bool b;
+
+  for (size_t i = 0; i < REPLACE_N_RANGES; i++)
+    ranges[i] = btoep_mkrange(10 * i + 3, 1 + i % 7);
+
+  assert(btoep_open(&dataset, name, NULL, NULL, create_mode));
+  assert(btoep_index_add_many(&dataset, old_ranges, 2));
+
+  // Invalid sources do not modify the index.
+  btoep_range invalid[3] = { { 0, 5 }, { 7, 3 }, { 10, 1 } };
+  btoep_index_source_init_array(&source, invalid, 3);
+  assert(!btoep_index_replace(&dataset, &source));
+  btoep_last_error(&dataset, &error);
+  assert(error.code == B_ERR_INVALID_ARGUMENT);
+  assert_replaced(&dataset, old_ranges, 2);
+
+  btoep_index_source_init_array(&source, ranges, REPLACE_N_RANGES);
+  assert(btoep_index_replace(&dataset, &source));
+  assert_replaced(&dataset, ranges, REPLACE_N_RANGES);
+  assert(btoep_index_contains(&dataset, btoep_mkrange(10 * 500 + 3, 500 % 7 + 1), &b));
+  assert(b);
+
+  // The index remains usable afterwards.
+  assert(btoep_index_remove(&dataset, btoep_mkrange(0, 10 * 500)));
+  assert(btoep_index_add(&dataset, btoep_mkrange(0, 1)));
+  assert(btoep_close(&dataset));
+
+  assert(btoep_open(&dataset, name, NULL, NULL, B_OPEN_EXISTING_READ_WRITE));
+  ranges[499] = btoep_mkrange(0, 1);
+  assert_replaced(&dataset, ranges + 499, REPLACE_N_RANGES - 499);
+
+  // An empty source clears the index.
+  btoep_index_source_init_array(&source, NULL, 0);
+  assert(btoep_index_replace(&dataset, &source));
+  assert_replaced(&dataset, NULL, 0);
+  assert(btoep_close(&dataset));
+
+  assert(btoep_open(&dataset, name, NULL, NULL, B_OPEN_EXISTING_READ_ONLY));
+  assert_replaced(&dataset, NULL, 0);
+  assert(btoep_close(&dataset));
+}
+
+static void test_replace(void) {
+  btoep_dataset dataset;
+  btoep_index_source source;
+
+  test_replace_mode("test_stream_replace", B_CREATE_NEW_READ_WRITE);
+  test_replace_mode("test_stream_replace_paged",
+                    B_CREATE_NEW_READ_WRITE | B_CREATE_PAGED_INDEX);
+  test_replace_mode("test_stream_replace_journal",
+                    B_CREATE_NEW_READ_WRITE | B_INDEX_JOURNAL);
+
+  // Journal records are discarded along with the previous index.
+  btoep_range range = btoep_mkrange(1, 2);
+  assert(btoep_open(&dataset, "test_stream_replace_journal", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE | B_INDEX_JOURNAL));
+  assert(btoep_index_add(&dataset, btoep_mkrange(100, 1)));
+  assert(btoep_index_flush(&dataset));
+  btoep_index_source_init_array(&source, &range, 1);
+  assert(btoep_index_replace(&dataset, &source));
+  assert(fopen("test_stream_replace_journal.idx.log", "rb") == NULL);
+  assert(fopen("test_stream_replace_journal.idx.tmp", "rb") == NULL);
+  assert(btoep_close(&dataset));
+  assert(btoep_open(&dataset, "test_stream_replace_journal", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_replaced(&dataset, &range, 1);
+  assert(btoep_close(&dataset));
+
+  // A temporary file left over from an interrupted replacement is overwritten.
+  FILE* file = fopen("test_stream_replace_paged.idx.tmp", "wb");
+  assert(file != NULL);
+  assert(fputs("garbage", file) >= 0);
+  assert(fclose(file) == 0);
+  assert(btoep_open(&dataset, "test_stream_replace_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE));
+  btoep_index_source_init_array(&source, &range, 1);
+  assert(btoep_index_replace(&dataset, &source));
+  assert(fopen("test_stream_replace_paged.idx.tmp", "rb") == NULL);
+  assert(btoep_close(&dataset));
+  assert(btoep_open(&dataset, "test_stream_replace_paged", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_replaced(&dataset, &range, 1);
+  assert(btoep_close(&dataset));
+
+#ifndef _MSC_VER
+  // If the new index cannot be written, the previous index, including pending
+  // journal records, remains intact.
+  btoep_range journal_ranges[2] = { range, { 100, 1 } };
+  assert(mkdir("test_stream_replace_journal.idx.tmp", S_IRWXU) == 0);
+  assert(btoep_open(&dataset, "test_stream_replace_journal", NULL, NULL,
+                    B_OPEN_EXISTING_READ_WRITE | B_INDEX_JOURNAL));
+  assert(btoep_index_add(&dataset, journal_ranges[1]));
+  btoep_index_source_init_array(&source, NULL, 0);
+  assert(!btoep_index_replace(&dataset, &source));
+  assert_replaced(&dataset, journal_ranges, 2);
+  assert(btoep_close(&dataset));
+  assert(rmdir("test_stream_replace_journal.idx.tmp") == 0);
+  assert(btoep_open(&dataset, "test_stream_replace_journal", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert_replaced(&dataset, journal_ranges, 2);
+  assert(btoep_close(&dataset));
+#endif
+
+  // Replacing a read-only index fails.
+  assert(btoep_open(&dataset, "test_stream_replace", NULL, NULL,
+                    B_OPEN_EXISTING_READ_ONLY));
+  assert(!btoep_index_replace(&dataset, &source));
+  assert(btoep_close(&dataset));
+}
+
+static void assert_invalid(const void* data, size_t size) {
+  FILE* file = fopen("test_stream_invalid", "w+b");
+  assert(file != NULL);
+  assert(fwrite(data, 1, size, file) == size);
+  rewind(file);
+
+  btoep_index_source source;
+  btoep_index_source_init_file(&source, file);
+  bool exists = true;
+  btoep_range range;
+  while (btoep_index_source_next(&source, &exists, &range)) {
+    // Invalid data must not go unnoticed.
+    assert(exists);
+  }
+  assert(source.last_error.code == B_ERR_INVALID_INDEX_FORMAT);
+
+  fclose(file);
+  remove("test_stream_invalid");
+}
+
+static void test_invalid(void) {
+  // An incomplete entry.
+  assert_invalid("\x00\x05\x03", 3);
+  assert_invalid("\x00\x05\x03\x80", 4);
+  // A value that is too long.
+  assert_invalid("\x00\x05\x80\x80\x80\x80\x80\x80\x80\x80\x01\x00", 12);
+  // A paged index file.
+  assert_invalid("\xc2\xd4\xcf\xc5\xd0\xc9\xc4\xd8\x01\x00\x00\x00", 12);
+}
+
+static void test_stream(void) {
+  test_combine();
+  test_dataset_source();
+  test_replace();
+  test_invalid();
+}
+
+TEST_MAIN(test_stream)
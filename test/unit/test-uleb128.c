@@ -0,0 +1,82 @@
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../lib/src/uleb128.h"
+
+#define N_PAIRS 1000
+
+static size_t encode(uint8_t* out, uint64_t value) {
+  size_t length = 0;
+  do {
+    out[length++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+  } while (value > 0);
+  return length;
+}
+
+static uint64_t random_value(void) {
+  // Produce values of all lengths, with a bias towards short values.
+  unsigned bits = rand() % 57;
+  if (rand() % 2)
+    bits = bits % 15;
+  uint64_t value = ((uint64_t) rand() << 32) ^ ((uint64_t) rand() << 16) ^ rand();
+  return (bits == 0) ? 0 : value & (((uint64_t) -1) >> (64 - bits));
+}
+
+static void test_uleb128(void) {
+  static uint8_t buffer[N_PAIRS * 2 * BTOEP_ULEB128_MAX_LENGTH];
+  static uint64_t values[N_PAIRS * 2];
+  static size_t ends[N_PAIRS];
+  static btoep_uleb128_pair pairs[N_PAIRS];
+
+  size_t length = 0;
+  for (size_t i = 0; i < N_PAIRS; i++) {
+    values[2 * i] = random_value();
+    values[2 * i + 1] = random_value();
+    length += encode(buffer + length, values[2 * i]);
+    length += encode(buffer + length, values[2 * i + 1]);
+    ends[i] = length;
+  }
+
+  for (size_t d = 0; d < btoep_uleb128_n_decoders; d++) {
+    const btoep_uleb128_decoder* decoder = &btoep_uleb128_decoders[d];
+    if (!decoder->is_supported())
+      continue;
+
+    // Decode everything.
+    assert(decoder->decode_pairs(buffer, length, pairs, N_PAIRS) == N_PAIRS);
+    for (size_t i = 0; i < N_PAIRS; i++) {
+      assert(pairs[i].first == values[2 * i]);
+      assert(pairs[i].second == values[2 * i + 1]);
+      assert(pairs[i].end == ends[i]);
+    }
+
+    // Decoding stops after the given number of pairs.
+    assert(decoder->decode_pairs(buffer, length, pairs, 10) == 10);
+    assert(pairs[9].end == ends[9]);
+
+    // Decoding stops at the first incomplete pair.
+    for (size_t l = 0; l < 200; l++) {
+      size_t n = 0;
+      while (n < N_PAIRS && ends[n] <= l)
+        n++;
+      assert(decoder->decode_pairs(buffer, l, pairs, N_PAIRS) == n);
+      assert(n == 0 || pairs[n - 1].end == ends[n - 1]);
+    }
+
+    // Decoding stops at the first value that is too long.
+    uint8_t saved[BTOEP_ULEB128_MAX_LENGTH + 1];
+    size_t pos = ends[99];
+    memcpy(saved, buffer + pos, sizeof(saved));
+    memset(buffer + pos, 0x80, BTOEP_ULEB128_MAX_LENGTH);
+    buffer[pos + BTOEP_ULEB128_MAX_LENGTH] = 0x00;
+    assert(decoder->decode_pairs(buffer, length, pairs, N_PAIRS) == 100);
+    memcpy(buffer + pos, saved, sizeof(saved));
+  }
+
+  assert(btoep_uleb128_decode_pairs(buffer, length, pairs, N_PAIRS) == N_PAIRS);
+}
+
+TEST_MAIN(test_uleb128)